@@ -2,6 +2,7 @@
 #include <iostream>
 #include <csignal>
 #include <climits>
+#include <thread>
 
 #if defined(_MSC_VER) || defined(__MINGW32__)
 #include <direct.h>
@@ -22,7 +23,11 @@
 #define DAEMONIZE_CLOSE_FILE_DESCRIPTORS_AFTER_FORK false
 #else
 
+#ifdef ENABLE_IO_URING
+#include "lorawan/storage/listener/io-uring-listener.h"
+#else
 #include "lorawan/storage/listener/udp-listener.h"
+#endif
 #define DAEMONIZE_CLOSE_FILE_DESCRIPTORS_AFTER_FORK true
 #endif
 
@@ -69,6 +74,7 @@
 #include "lorawan/storage/serialization/gateway-binary-serialization.h"
 #include "lorawan/helper/file-helper.h"
 #include "lorawan/storage/service/identity-service-udp.h"
+#include "lorawan/storage/service/identity-service-mem.h"
 
 // i18n
 // #include <libintl.h>
@@ -131,9 +137,14 @@ public:
     bool runAsDaemon;
     std::string pidfile;
     int verbose;
+    int threadCount;
     STORAGE_TYPE storageType;
     std::string db;
     std::string dbGatewayJson;
+    // binary identity snapshot to map at start
+    std::string snapshotImport;
+    // binary identity snapshot to write and exit
+    std::string snapshotExport;
     int32_t retCode;
 #ifdef ENABLE_GEN
     std::string passPhrase;
@@ -147,7 +158,7 @@ public:
 #ifdef ENABLE_QRCODE
           httpQRCodeURNServer(nullptr), httpQRCodeURNPort(4248),
 #endif
-        code(0), accessCode(0), verbose(0), retCode(0),
+        code(0), accessCode(0), verbose(0), threadCount(1), retCode(0),
         runAsDaemon(false)
 #ifdef ENABLE_GEN
         , netid(0, 0)
@@ -158,7 +169,8 @@ public:
 
     std::string toString() const {
         std::stringstream ss;
-        ss << _("Service: ") << intf << ":" << port << " " << IP_PROTO2string(proto) << "\n";
+        ss << _("Service: ") << intf << ":" << port << " " << IP_PROTO2string(proto) << "\n"
+            << _("Threads: ") << threadCount << "\n";
 #ifdef ENABLE_HTTP
         ss << _("HTTP: ") << httpIntf << ":" << httpPort << "\n"
             << _("HTML page root directory: ") << (httpHtmlRootDir.empty() ? _("none") : httpHtmlRootDir) << "\n";
@@ -169,6 +181,8 @@ public:
         ss << _("Code: ") << std::hex << code << _(", access code: ")  << accessCode << " " << "\n";
         if (!db.empty())
             ss << _("database file name: ") << db << "\n";
+        if (!snapshotImport.empty())
+            ss << _("identity snapshot: ") << snapshotImport << "\n";
 #ifdef ENABLE_JSON
         if (!dbGatewayJson.empty())
             ss << _("gateway database file name: ") << dbGatewayJson << "\n";
@@ -225,6 +239,61 @@ void setSignalHandler()
 #endif
 }
 
+/**
+ * Map snapshot by in-memory storages, put records to other ones
+ * @return CODE_OK- success
+ */
+static int importSnapshot(
+    IdentityService *identityService,
+    const std::string &fileName
+)
+{
+    auto memoryService = dynamic_cast<MemoryIdentityService *>(identityService);
+    if (memoryService)
+        return memoryService->openSnapshot(fileName);
+    IdentitySnapshot snapshot;
+    int r = snapshot.open(fileName);
+    if (r)
+        return r;
+    DEVICEID id;
+    for (size_t i = 0; i < snapshot.size() && r == CODE_OK; i++) {
+        id.id = snapshot.id(i);
+        r = identityService->put(DEVADDR(snapshot.addr(i)), id);
+    }
+    identityService->flush();
+    return r;
+}
+
+/**
+ * Write identities to the snapshot file
+ * @return CODE_OK- success
+ */
+static int exportSnapshot(
+    IdentityService *identityService,
+    const std::string &fileName
+)
+{
+    auto memoryService = dynamic_cast<MemoryIdentityService *>(identityService);
+    if (memoryService)
+        return memoryService->saveSnapshot(fileName);
+    // other storages may list records in other order
+    MemoryIdentityService copy;
+    std::vector<NETWORKIDENTITY> page;
+    const DEVADDR *after = nullptr;
+    do {
+        page.clear();
+        int r = identityService->listAfter(page, after, 4096);
+        if (r)
+            return r;
+        for (auto &ni : page) {
+            copy.put(ni.value.devaddr, ni.value.devid);
+        }
+        if (!page.empty())
+            after = &page.back().value.devaddr;
+    } while (!page.empty());
+    return copy.saveSnapshot(fileName);
+}
+
 void run() {
     IdentityService *identityService = nullptr;
 #ifdef ENABLE_SQLITE
@@ -245,10 +314,30 @@ void run() {
         identityService->init(svc.db, nullptr);
     }
 #endif
+    if (!svc.snapshotImport.empty()) {
+        if (!identityService)
+            identityService = new MemoryIdentityService;
+        int r = importSnapshot(identityService, svc.snapshotImport);
+        if (r) {
+            std::cerr << ERR_MESSAGE << r << ": " << svc.snapshotImport << std::endl;
+            svc.retCode = r;
+            return;
+        }
+    }
     if (!identityService) {
         identityService = new ClientUDPIdentityService;
         identityService->init("", nullptr);
     }
+    if (!svc.snapshotExport.empty()) {
+        svc.retCode = exportSnapshot(identityService, svc.snapshotExport);
+        if (svc.retCode)
+            std::cerr << ERR_MESSAGE << svc.retCode << ": " << svc.snapshotExport << std::endl;
+        else
+            if (svc.verbose)
+                std::cout << _("Identities: ") << identityService->size() << std::endl;
+        delete identityService;
+        return;
+    }
 
     auto gatewayService =
 #ifdef ENABLE_SQLITE
@@ -267,12 +356,16 @@ void run() {
     auto identitySerialization = new IdentityBinarySerialization(identityService, svc.code, svc.accessCode);
     auto gatewaySerialization = new GatewayBinarySerialization(gatewayService, svc.code, svc.accessCode);
 #ifdef ENABLE_LIBUV
+    // libuv listener serves TCP too
     svc.server = new UVListener(identitySerialization, gatewaySerialization);
+#elif defined(ENABLE_IO_URING)
+    svc.server = new IoUringListener(identitySerialization, gatewaySerialization);
 #else
     svc.server = new UDPListener(identitySerialization, gatewaySerialization);
 #endif
     svc.server->setAddress(svc.intf, svc.port);
     svc.server->setLog(svc.verbose, &svc);
+    svc.server->setThreadCount(svc.threadCount);
 
 #ifdef ENABLE_HTTP
     auto identitySerializationJSON = new IdentityTextJSONSerialization(identityService, svc.code, svc.accessCode);
@@ -318,6 +411,8 @@ int main(int argc, char **argv) {
 #ifdef ENABLE_JSON
     struct arg_str *a_gateway_json_db = arg_str0("g", "gateway-db", _("<database file>"), _("database file name. Default " DEF_DB_GATEWAY_JSON));
 #endif
+    struct arg_str *a_snapshot_import = arg_str0(nullptr, "snapshot", _("<file>"), _("map binary identity snapshot at start"));
+    struct arg_str *a_snapshot_export = arg_str0(nullptr, "export-snapshot", _("<file>"), _("write identities to the binary snapshot and exit"));
     struct arg_int *a_code = arg_int0("c", "code", _("<number>"), _("Default 42. 0x - hex number prefix"));
 #ifdef ENABLE_GEN
     struct arg_str *a_pass_phrase = arg_str0("m", _("master-key"), _("<pass-phrase>"), _("Default " DEF_PASSPHRASE));
@@ -327,6 +422,7 @@ int main(int argc, char **argv) {
     struct arg_str *a_access_code = arg_str0("a", "access", _("<hex>"), _("Default 2a (42 decimal)"));
 	struct arg_lit *a_daemonize = arg_lit0("d", "daemonize", _("run daemon"));
     struct arg_str *a_pidfile = arg_str0("p", "pidfile", _("<file>"), _("Check whether a process has created the file pidfile"));
+    struct arg_int *a_threads = arg_int0("t", "threads", _("<number>"), _("worker threads or libuv loops, 0- one per core. Default 1"));
     struct arg_lit *a_verbose = arg_litn("v", "verbose", 0, 2, _("-v - verbose, -vv - debug"));
 	struct arg_lit *a_help = arg_lit0("h", "help", _("Show this help"));
 	struct arg_end *a_end = arg_end(20);
@@ -353,7 +449,8 @@ int main(int argc, char **argv) {
 #ifdef ENABLE_JSON
             a_gateway_json_db,
 #endif
-            a_code, a_access_code, a_verbose, a_daemonize, a_pidfile,
+            a_snapshot_import, a_snapshot_export,
+            a_code, a_access_code, a_threads, a_verbose, a_daemonize, a_pidfile,
             a_help, a_end
     };
     // verify the argtable[] entries were allocated successfully
@@ -371,6 +468,13 @@ int main(int argc, char **argv) {
         svc.pidfile = "";
 
     svc.verbose = a_verbose->count;
+    if (a_threads->count && *a_threads->ival > 0)
+        svc.threadCount = *a_threads->ival;
+    else if (a_threads->count && *a_threads->ival == 0 && std::thread::hardware_concurrency() > 0)
+        // one per core
+        svc.threadCount = (int) std::thread::hardware_concurrency();
+    else
+        svc.threadCount = 1;
 
 	if (a_interface_n_port->count) {
         splitAddress(svc.intf, svc.port, std::string(*a_interface_n_port->sval));
@@ -434,6 +538,10 @@ int main(int argc, char **argv) {
     else
         svc.dbGatewayJson = DEF_DB_GATEWAY_JSON;
 #endif
+    if (a_snapshot_import->count)
+        svc.snapshotImport = *a_snapshot_import->sval;
+    if (a_snapshot_export->count)
+        svc.snapshotExport = *a_snapshot_export->sval;
     if (a_code->count)
         svc.code = *a_code->ival;
     else
@@ -482,4 +590,5 @@ int main(int argc, char **argv) {
 		run();
 		done();
 	}
+    return svc.retCode;
 }
@@ -44,12 +44,17 @@ public:
     uint64_t accessCode;
     uint32_t offset;
     uint8_t size;
+    // list after: entries left to export and the last received entry
+    uint32_t limit;
+    bool hasCursor;
+    DEVADDR afterAddr;
+    uint64_t afterGatewayId;
 
     int32_t retCode;
 
     CliQueryParams()
         : tag(QUERY_GATEWAY_NONE), queryPos(0), useTcp(false), verbose(0), port(DEF_PORT), code(42), accessCode(42), offset(0), size(0),
-          retCode(0)
+          limit(0), hasCursor(false), afterGatewayId(0), retCode(0)
     {
 
     }
@@ -157,6 +162,9 @@ public:
                     std::cout << response->identities[i].toString() << std::endl;
                 }
             }
+            if (response->tag == QUERY_IDENTITY_LIST_AFTER
+                && nextIdentityPage(client, (const IdentityListAfterResponse *) response))
+                return;
             if (!next(client)) {
                 client->stop();
             }
@@ -226,6 +234,9 @@ public:
                         << std::endl;
                 }
             }
+            if (response->tag == QUERY_GATEWAY_LIST_AFTER
+                && nextGatewayPage(client, (const GatewayListAfterResponse *) response))
+                return;
             if (!next(client)) {
                 client->stop();
             }
@@ -242,6 +253,54 @@ public:
         }
     }
 
+    /**
+     * Request the frame following the received one, keep query position
+     * @return false if the list is over
+     */
+    bool nextIdentityPage(
+        QueryClient *client,
+        const IdentityListAfterResponse *response
+    ) {
+        if (response->status != CODE_OK) {
+            std::cerr << ERR_MESSAGE << response->status << std::endl;
+            params.retCode = response->status;
+            return false;
+        }
+        if ((response->flags & LIST_AFTER_FLAG_END) || response->identities.empty()
+            || response->identities.size() >= params.limit)
+            return false;
+        params.limit -= (uint32_t) response->identities.size();
+        params.hasCursor = true;
+        params.afterAddr = response->identities.back().value.devaddr;
+        ServiceMessage *previousMessage = client->request(
+            new IdentityListAfterRequest(&params.afterAddr, params.limit, params.code, params.accessCode));
+        if (previousMessage)
+            delete previousMessage;
+        return true;
+    }
+
+    bool nextGatewayPage(
+        QueryClient *client,
+        const GatewayListAfterResponse *response
+    ) {
+        if (response->status != CODE_OK) {
+            std::cerr << ERR_MESSAGE << response->status << std::endl;
+            params.retCode = response->status;
+            return false;
+        }
+        if ((response->flags & GATEWAY_LIST_AFTER_FLAG_END) || response->identities.empty()
+            || response->identities.size() >= params.limit)
+            return false;
+        params.limit -= (uint32_t) response->identities.size();
+        params.hasCursor = true;
+        params.afterGatewayId = response->identities.back().gatewayId;
+        ServiceMessage *previousMessage = client->request(
+            new GatewayListAfterRequest(&params.afterGatewayId, params.limit, params.code, params.accessCode));
+        if (previousMessage)
+            delete previousMessage;
+        return true;
+    }
+
     bool next(
         QueryClient *client
     ) {
@@ -253,6 +312,10 @@ public:
                 case QUERY_IDENTITY_LIST:
                     req = new IdentityOperationRequest(params.tag, params.offset, params.size, params.code, params.accessCode);
                     break;
+                case QUERY_IDENTITY_LIST_AFTER:
+                    req = new IdentityListAfterRequest(params.hasCursor ? &params.afterAddr : nullptr, params.limit,
+                        params.code, params.accessCode);
+                    break;
                 case QUERY_IDENTITY_COUNT:
                     req = new IdentityOperationRequest(params.tag, params.offset, params.size, params.code, params.accessCode);
                     break;
@@ -279,6 +342,10 @@ public:
                 case QUERY_GATEWAY_LIST:
                     req = new GatewayOperationRequest(params.tag, params.offset, params.size, params.code, params.accessCode);
                     break;
+                case QUERY_GATEWAY_LIST_AFTER:
+                    req = new GatewayListAfterRequest(params.hasCursor ? &params.afterGatewayId : nullptr, params.limit,
+                        params.code, params.accessCode);
+                    break;
                 case QUERY_GATEWAY_COUNT:
                     req = new GatewayOperationRequest(params.tag, params.offset, params.size, params.code, params.accessCode);
                     break;
@@ -340,7 +407,7 @@ int main(int argc, char **argv) {
     struct arg_str *a_access_code = arg_str0("a", "access", _("<hex>"), _("Default 2a (42 decimal)"));
 	struct arg_lit *a_tcp = arg_lit0("t", "tcp", _("use TCP protocol. Default UDP"));
     struct arg_int *a_offset = arg_int0("o", "offset", _("<0..>"), _("list offset. Default 0. Max 4294967295"));
-    struct arg_int *a_size = arg_int0("z", "size", _("<number>"), _("list size limit. Default 10. Max 255"));
+    struct arg_int *a_size = arg_int0("z", "size", _("<number>"), _("list size limit. Default 10. Max 255. List after: default all"));
     struct arg_lit *a_verbose = arg_litn("v", "verbose", 0, 2, _("-v verbose -vv debug"));
     struct arg_lit *a_help = arg_lit0("h", "help", _("Show this help"));
 	struct arg_end *a_end = arg_end(20);
@@ -398,6 +465,7 @@ int main(int argc, char **argv) {
                     string2DEVEUI(id.nid.value.devid.id.devEUI, a_query->sval[i]);
                     break;
                 case QUERY_IDENTITY_EUI:
+                case QUERY_IDENTITY_LIST_AFTER:
                     string2DEVADDR(id.nid.value.devaddr, a_query->sval[i]);
                     break;
                 default:
@@ -445,6 +513,20 @@ int main(int argc, char **argv) {
             params.size = 10;
     }
 
+    if (params.tag == QUERY_IDENTITY_LIST_AFTER || params.tag == QUERY_GATEWAY_LIST_AFTER) {
+        // export continues after the address or gateway identifier if given, one request per frame
+        params.hasCursor = !params.query.empty();
+        if (params.hasCursor) {
+            params.afterAddr = params.query[0].nid.value.devaddr;
+            params.afterGatewayId = params.query[0].gid.gatewayId;
+        }
+        params.query.resize(1);
+        if (a_size->count && *a_size->ival > 0)
+            params.limit = (uint32_t) *a_size->ival;
+        else
+            params.limit = UINT32_MAX;
+    }
+
     if (params.tag == QUERY_GATEWAY_ASSIGN) {
         // reorder query
         mergeIdAddress(params.query);
@@ -142,6 +142,30 @@ static void run()
             std::cout << std::endl;
         }
             break;
+        case QUERY_IDENTITY_LIST_AFTER: {
+            // export page by page, each page continues after the last entry of the previous one
+            std::vector<NETWORKIDENTITY> nids;
+            bool hasCursor = !params.query.empty();
+            DEVADDR after;
+            if (hasCursor)
+                after = params.query[0].nid.value.devaddr;
+            while (c->svcIdentity->listAfter(nids, hasCursor ? &after : nullptr, 255) == CODE_OK && !nids.empty()) {
+                for (auto &it: nids) {
+                    if (params.verbose > 0)
+                        std::cout << it.toJsonString() << "\n";
+                    else
+                        std::cout
+                            << DEVADDR2string(it.value.devaddr) << "\t"
+                            << it.value.devid.toString()
+                            << "\n";
+                }
+                hasCursor = true;
+                after = nids.back().value.devaddr;
+                nids.clear();
+            }
+            std::cout << std::flush;
+        }
+            break;
         case QUERY_IDENTITY_COUNT:
             std::cout << c->svcIdentity->size() << std::endl;
             break;
@@ -178,6 +202,24 @@ static void run()
             }
         }
             break;
+        case QUERY_GATEWAY_LIST_AFTER: {
+            std::vector <GatewayIdentity> gids;
+            bool hasCursor = !params.query.empty();
+            uint64_t after = hasCursor ? params.query[0].gid.gatewayId : 0;
+            while (c->svcGateway->listAfter(gids, hasCursor ? &after : nullptr, 255) == CODE_OK && !gids.empty()) {
+                for (auto &it: gids) {
+                    std::cout
+                        << sockaddr2string(&it.sockaddr) << "\t"
+                        << gatewayId2str(it.gatewayId)
+                        << "\n";
+                }
+                hasCursor = true;
+                after = gids.back().gatewayId;
+                gids.clear();
+            }
+            std::cout << std::flush;
+        }
+            break;
         case QUERY_GATEWAY_COUNT:
             std::cout << c->svcGateway->size() << std::endl;
             break;
@@ -305,6 +347,7 @@ int main(int argc, char **argv) {
                     string2DEVEUI(id.nid.value.devid.id.devEUI, a_query->sval[i]);
                     break;
                 case QUERY_IDENTITY_EUI:
+                case QUERY_IDENTITY_LIST_AFTER:
                     string2DEVADDR(id.nid.value.devaddr, a_query->sval[i]);
                     break;
                 default:
@@ -0,0 +1,153 @@
+#ifndef BUFFER_POOL_H_
+#define BUFFER_POOL_H_ 1
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#define BUFFER_POOL_SLAB_BLOCKS 16
+
+/**
+ * Free list of fixed size blocks carved from slabs of BUFFER_POOL_SLAB_BLOCKS blocks.
+ * Released block is linked into the free list by its first bytes, slabs are freed by the destructor only,
+ * so after the warm-up alloc() and release() do not call the heap.
+ * Not thread safe, pool belongs to one event loop.
+ */
+class BlockPool {
+private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+    size_t size;
+    FreeBlock *freeList;
+    std::vector<char *> slabs;
+    size_t used;
+
+    void grow()
+    {
+        char *slab = new char[size * BUFFER_POOL_SLAB_BLOCKS];
+        slabs.push_back(slab);
+        for (size_t i = BUFFER_POOL_SLAB_BLOCKS; i > 0; i--) {
+            auto b = (FreeBlock *) (slab + (i - 1) * size);
+            b->next = freeList;
+            freeList = b;
+        }
+    }
+public:
+    /**
+     * @param blockSize block size, rounded up to the pointer alignment
+     */
+    explicit BlockPool(size_t blockSize)
+        : size((std::max)(sizeof(FreeBlock), (blockSize + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *))),
+        freeList(nullptr), used(0)
+    {
+    }
+
+    virtual ~BlockPool()
+    {
+        for (auto s : slabs) {
+            delete[] s;
+        }
+    }
+
+    BlockPool(const BlockPool &) = delete;
+    BlockPool &operator=(const BlockPool &) = delete;
+
+    void *alloc()
+    {
+        if (!freeList)
+            grow();
+        FreeBlock *r = freeList;
+        freeList = r->next;
+        used++;
+        return r;
+    }
+
+    /**
+     * Return block to the pool
+     * @param block block returned by alloc(), nullptr is ignored
+     */
+    void release(void *block)
+    {
+        if (!block)
+            return;
+        auto b = (FreeBlock *) block;
+        b->next = freeList;
+        freeList = b;
+        used--;
+    }
+
+    size_t blockSize() const
+    {
+        return size;
+    }
+
+    // blocks in use
+    size_t inUse() const
+    {
+        return used;
+    }
+
+    // blocks allocated from the heap
+    size_t capacity() const
+    {
+        return slabs.size() * BUFFER_POOL_SLAB_BLOCKS;
+    }
+};
+
+/**
+ * Free list of objects which keep their own buffers between uses, e.g. std::vector keeps its capacity.
+ * Object is not destroyed on release(), caller resets it.
+ * Not thread safe, pool belongs to one event loop.
+ */
+template <typename T>
+class ObjectPool {
+private:
+    std::vector<T *> freeList;
+    size_t count;
+public:
+    ObjectPool()
+        : count(0)
+    {
+        freeList.reserve(BUFFER_POOL_SLAB_BLOCKS);
+    }
+
+    virtual ~ObjectPool()
+    {
+        for (auto o : freeList) {
+            delete o;
+        }
+    }
+
+    ObjectPool(const ObjectPool &) = delete;
+    ObjectPool &operator=(const ObjectPool &) = delete;
+
+    T *alloc()
+    {
+        if (freeList.empty()) {
+            count++;
+            return new T;
+        }
+        T *r = freeList.back();
+        freeList.pop_back();
+        return r;
+    }
+
+    /**
+     * Return object to the pool
+     * @param value object returned by alloc(), nullptr is ignored
+     */
+    void release(T *value)
+    {
+        if (value)
+            freeList.push_back(value);
+    }
+
+    // objects allocated from the heap
+    size_t capacity() const
+    {
+        return count;
+    }
+};
+
+#endif
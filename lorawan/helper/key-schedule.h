@@ -0,0 +1,17 @@
+#ifndef KEY_SCHEDULE_H_
+#define KEY_SCHEDULE_H_ 1
+
+#include <cinttypes>
+
+#include "system/crypto/aes.h"
+
+/**
+ * Expanded AES key and CMAC subkey prepared once by keyScheduleInit() for many derivations with the same key.
+ * Kept out of key128gen.h, so public headers do not depend on third-party/system/crypto.
+ */
+struct KEY_SCHEDULE {
+    aes_context aes;    ///< AES key schedule
+    uint8_t k1[16];     ///< CMAC subkey of the complete last block
+};
+
+#endif
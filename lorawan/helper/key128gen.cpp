@@ -1,4 +1,5 @@
 #include "lorawan/helper/key128gen.h"
+#include "lorawan/helper/key-schedule.h"
 
 #include <cstring>
 #if __cplusplus < 199711L
@@ -73,6 +74,75 @@ uint8_t* keyGen(
 	return retVal;
 }
 
+// "ANDY" | key number | address | "ENZI"
+static void keyGenBlock(
+    uint8_t *retVal,
+    uint32_t keyNumber,
+    uint32_t devAddr
+)
+{
+    memmove(retVal, "ANDY", 4);
+    memmove(retVal + 4, &keyNumber, 4);
+    memmove(retVal + 8, &devAddr, 4);
+    memmove(retVal + 12, "ENZI", 4);
+}
+
+void keyScheduleInit(
+    KEY_SCHEDULE &retVal,
+    const uint8_t *key
+)
+{
+    memset(retVal.aes.ksch, '\0', KSCH_SIZE);
+    aes_set_key(key, 16, &retVal.aes);
+    // subkey K1 as AES_CMAC_Final() does
+    uint8_t l[16];
+    memset(l, '\0', 16);
+    aes_encrypt(l, l, &retVal.aes);
+    for (int i = 0; i < 15; i++)
+        retVal.k1[i] = (uint8_t) (l[i] << 1 | l[i + 1] >> 7);
+    retVal.k1[15] = (uint8_t) (l[15] << 1);
+    if (l[0] & 0x80)
+        retVal.k1[15] ^= 0x87;
+}
+
+void keyScheduleCMAC(
+    uint8_t *retVal,
+    const KEY_SCHEDULE &schedule,
+    const uint8_t *block
+)
+{
+    // one complete block: AES(key, block ^ K1)
+    uint8_t x[16];
+    for (int i = 0; i < 16; i++)
+        x[i] = block[i] ^ schedule.k1[i];
+    aes_encrypt(x, retVal, &schedule.aes);
+}
+
+void euiGen(
+    uint8_t *retVal,
+    uint32_t keyNumber,
+    const KEY_SCHEDULE &schedule,
+    uint32_t devAddr
+)
+{
+    uint8_t k[16];
+    keyGen(k, keyNumber, schedule, devAddr);
+    memmove(retVal, k, 8);
+}
+
+uint8_t* keyGen(
+    uint8_t *retVal,
+    uint32_t keyNumber,
+    const KEY_SCHEDULE &schedule,
+    uint32_t devAddr
+)
+{
+    uint8_t blockB[16];
+    keyGenBlock(blockB, keyNumber, devAddr);
+    keyScheduleCMAC(retVal, schedule, blockB);
+    return retVal;
+}
+
 #if __cplusplus < 199711L
 uint8_t* rnd2key(
     uint8_t* retVal
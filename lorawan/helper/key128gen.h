@@ -1,3 +1,6 @@
+#ifndef KEY128GEN_H_
+#define KEY128GEN_H_ 1
+
 #include <cstddef>
 #include <cinttypes>
 
@@ -46,6 +49,51 @@ uint8_t* keyGen(
     uint32_t devAddr
 );
 
+// expanded key, defined in lorawan/helper/key-schedule.h
+struct KEY_SCHEDULE;
+
+/**
+ * Expand key
+ * @param retVal return key schedule
+ * @param key 128bit key
+ */
+void keyScheduleInit(
+    KEY_SCHEDULE &retVal,
+    const uint8_t *key
+);
+
+/**
+ * AES-CMAC of the one 16 bytes long block, same as AES_CMAC_Init(), AES_CMAC_SetKey(), AES_CMAC_Update(), AES_CMAC_Final()
+ * @param retVal return 16 bytes
+ * @param schedule key schedule
+ * @param block 16 bytes
+ */
+void keyScheduleCMAC(
+    uint8_t *retVal,
+    const KEY_SCHEDULE &schedule,
+    const uint8_t *block
+);
+
+/**
+ * Generate EUI by the expanded "master key", same as euiGen()
+ */
+void euiGen(
+    uint8_t *retVal,
+    uint32_t keyNumber,
+    const KEY_SCHEDULE &schedule,
+    uint32_t devAddr
+);
+
+/**
+ * Generate 128bit key by the expanded "master key", same as keyGen()
+ */
+uint8_t* keyGen(
+    uint8_t* retVal,
+    uint32_t keyNumber,
+    const KEY_SCHEDULE &schedule,
+    uint32_t devAddr
+);
+
 /**
  * Generate pseudo-random 128 bit long key
  * @param retVal return 128 bits (16 bytes) "master key"
@@ -89,3 +137,5 @@ uint8_t* sessionKeyGen(
     NETID netId,		// 3 bytes
     DEVNONCE& devNonce	// 2 bytes
 );
+
+#endif
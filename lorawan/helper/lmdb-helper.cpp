@@ -1,3 +1,4 @@
+#include <cerrno>
 #include <string>
 
 #include "log.h"
@@ -10,7 +11,7 @@
 #include <iostream>
 
 dbenv::dbenv()
-    : flags(0), mode(0664), log(nullptr)
+    : flags(0), mode(0664), maxDbs(0), log(nullptr)
 {
 
 }
@@ -20,7 +21,7 @@ dbenv::dbenv(
     int aflags,
     int amode
 )
-    : path(aPath), flags(aflags), mode(amode), log(nullptr)
+    : path(aPath), flags(aflags), mode(amode), maxDbs(0), log(nullptr)
 {
 
 }
@@ -106,19 +107,20 @@ bool openDb(
         env->env = nullptr;
         return false;
     }
+    if (env->maxDbs)
+        mdb_env_set_maxdbs(env->env, env->maxDbs);
 
     rc = mdb_env_open(env->env, env->path.c_str(), env->flags, env->mode);
-    if (rc) {
-        if (rc == 3) {
-            // try to create a new directory
-            bool dirCreated = file::mkDir(env->path);
-            if (dirCreated) {
-                // try again
-                rc = mdb_env_open(env->env, env->path.c_str(), env->flags, env->mode);
-                if (rc == 0)
-                    return true;
-            }
+    // ENOENT, ERROR_PATH_NOT_FOUND on Windows
+    if (rc == ENOENT || rc == 3) {
+        // try to create a new directory
+        bool dirCreated = file::mkDir(env->path);
+        if (dirCreated) {
+            // try again
+            rc = mdb_env_open(env->env, env->path.c_str(), env->flags, env->mode);
         }
+    }
+    if (rc) {
         env->LOG(LOG_ERR, ERR_CODE_LMDB_OPEN, ERR_LMDB_ENV_OPEN);
         env->env = nullptr;
         return false;
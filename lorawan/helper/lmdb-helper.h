@@ -16,6 +16,8 @@ public:
     std::string path;
     int flags;
     int mode;
+    // named databases, 0- unnamed database only
+    int maxDbs;
     void (*log)(dbenv* env, int level, int code, const char *msg);
     dbenv();
     dbenv(const std::string &aPath, int flags, int mode);
@@ -0,0 +1,357 @@
+#ifndef SEQLOCK_HASH_MAP_H_
+#define SEQLOCK_HASH_MAP_H_ 1
+
+#include <atomic>
+#include <cstring>
+#include <cinttypes>
+#include <thread>
+#include <vector>
+
+#define SEQLOCK_MIN_CAPACITY    16
+#define SEQLOCK_READER_SHARDS   16
+
+/**
+ * Open addressing hash map with per-slot sequence lock.
+ * Readers do not take locks and write nothing but own reader counter. Readers are not wait-free:
+ * while writer is inside a slot, reader yields and spins on it, and lookup is repeated if the table is replaced.
+ * Writers must be serialized by the caller.
+ * Key K is unsigned integer, value V must be a plain (memcpy-able) structure, constructors are not called.
+ * Slots never move: removed entry becomes a tombstone, table is rebuilt when entries and
+ * tombstones take 3/4 of slots.
+ * Replaced tables are released by epoch: reader registers in the counter of the current epoch parity,
+ * writer moves retired tables to the draining list, switches the epoch and releases them by a later write
+ * when the counters of the previous parity drop to zero. New readers use the other parity,
+ * so constant reads do not hold tables back.
+ */
+template <typename K, typename V>
+class SeqlockHashMap {
+private:
+    enum { WORDS = (sizeof(V) + sizeof(uint64_t) - 1) / sizeof(uint64_t) };
+    enum { SLOT_EMPTY = 0, SLOT_USED = 1, SLOT_REMOVED = 2 };
+
+    struct Slot {
+        std::atomic<uint32_t> seq;      ///< odd- writer is in the slot
+        std::atomic<uint32_t> state;
+        std::atomic<K> key;
+        std::atomic<uint64_t> words[WORDS];
+    };
+
+    struct Table {
+        size_t mask;
+        Slot *slots;
+        explicit Table(size_t capacity)
+            : mask(capacity - 1), slots(new Slot[capacity])
+        {
+            for (size_t i = 0; i < capacity; i++) {
+                slots[i].seq.store(0, std::memory_order_relaxed);
+                slots[i].state.store(SLOT_EMPTY, std::memory_order_relaxed);
+                slots[i].key.store(0, std::memory_order_relaxed);
+                for (int w = 0; w < WORDS; w++)
+                    slots[i].words[w].store(0, std::memory_order_relaxed);
+            }
+        }
+        ~Table() {
+            delete[] slots;
+        }
+    };
+
+    // keep reader counters in separate cache lines, one counter per epoch parity
+    struct ReaderShard {
+        std::atomic<uint32_t> count[2];
+        char padding[64 - 2 * sizeof(std::atomic<uint32_t>)];
+    };
+
+    std::atomic<Table *> table;
+    std::vector<Table *> retired;   ///< replaced in the current epoch
+    std::vector<Table *> draining;  ///< replaced before the last epoch switch
+    unsigned int drainParity;
+    mutable std::atomic<uint32_t> epoch;
+    mutable ReaderShard readers[SEQLOCK_READER_SHARDS];
+    std::atomic<size_t> count;  ///< entries
+    size_t used;                ///< entries and tombstones, writer only
+
+    static size_t hash(K key) {
+        return (size_t) (((uint64_t) key * 0x9E3779B97F4A7C15ull) >> 32);
+    }
+
+    static size_t readerShard() {
+        static std::atomic<size_t> next(0);
+        static thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % SEQLOCK_READER_SHARDS;
+        return shard;
+    }
+
+    static bool lookup(
+        const Table *t,
+        V &retVal,
+        K key
+    ) {
+        uint64_t w[WORDS];
+        size_t i = hash(key) & t->mask;
+        for (size_t n = 0; n <= t->mask; n++) {
+            const Slot &s = t->slots[i];
+            uint32_t st;
+            K k;
+            while (true) {
+                uint32_t s1 = s.seq.load(std::memory_order_acquire);
+                if (s1 & 1) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                st = s.state.load(std::memory_order_relaxed);
+                k = s.key.load(std::memory_order_relaxed);
+                if (st == SLOT_USED && k == key) {
+                    for (int j = 0; j < WORDS; j++)
+                        w[j] = s.words[j].load(std::memory_order_relaxed);
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (s.seq.load(std::memory_order_relaxed) == s1)
+                    break;
+            }
+            if (st == SLOT_EMPTY)
+                return false;
+            if (st == SLOT_USED && k == key) {
+                memcpy((void *) &retVal, w, sizeof(V));
+                return true;
+            }
+            i = (i + 1) & t->mask;
+        }
+        return false;
+    }
+
+    static void writeSlot(
+        Slot &s,
+        uint32_t state,
+        K key,
+        const V *value
+    ) {
+        uint32_t q = s.seq.load(std::memory_order_relaxed);
+        s.seq.store(q + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.state.store(state, std::memory_order_relaxed);
+        s.key.store(key, std::memory_order_relaxed);
+        if (value) {
+            uint64_t w[WORDS];
+            w[WORDS - 1] = 0;
+            memcpy(w, (const void *) value, sizeof(V));
+            for (int j = 0; j < WORDS; j++)
+                s.words[j].store(w[j], std::memory_order_relaxed);
+        }
+        s.seq.store(q + 2, std::memory_order_release);
+    }
+
+    // Build a new table of live entries and publish it
+    void rebuild(
+        size_t entries
+    ) {
+        size_t capacity = SEQLOCK_MIN_CAPACITY;
+        while (capacity < entries * 2)
+            capacity <<= 1;
+        Table *t = table.load(std::memory_order_relaxed);
+        Table *nt = new Table(capacity);
+        for (size_t i = 0; i <= t->mask; i++) {
+            const Slot &s = t->slots[i];
+            if (s.state.load(std::memory_order_relaxed) != SLOT_USED)
+                continue;
+            K k = s.key.load(std::memory_order_relaxed);
+            size_t p = hash(k) & nt->mask;
+            while (nt->slots[p].state.load(std::memory_order_relaxed) != SLOT_EMPTY)
+                p = (p + 1) & nt->mask;
+            Slot &d = nt->slots[p];
+            d.state.store(SLOT_USED, std::memory_order_relaxed);
+            d.key.store(k, std::memory_order_relaxed);
+            for (int j = 0; j < WORDS; j++)
+                d.words[j].store(s.words[j].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        publish(nt);
+    }
+
+    void publish(
+        Table *nt
+    ) {
+        Table *t = table.load(std::memory_order_relaxed);
+        table.store(nt, std::memory_order_seq_cst);
+        retired.push_back(t);
+        used = count.load(std::memory_order_relaxed);
+        reclaim();
+    }
+
+    // Release tables replaced before the last epoch switch if their readers are gone, then switch epoch
+    void reclaim() {
+        if (!draining.empty()) {
+            for (int i = 0; i < SEQLOCK_READER_SHARDS; i++) {
+                if (readers[i].count[drainParity].load(std::memory_order_seq_cst))
+                    return;
+            }
+            for (auto t : draining)
+                delete t;
+            draining.clear();
+        }
+        if (retired.empty())
+            return;
+        draining.swap(retired);
+        drainParity = epoch.fetch_add(1, std::memory_order_seq_cst) & 1;
+    }
+
+    // Register reader in the current epoch, return parity to leave
+    unsigned int enter(
+        std::atomic<uint32_t> *counters
+    ) const {
+        while (true) {
+            uint32_t e = epoch.load(std::memory_order_seq_cst);
+            counters[e & 1].fetch_add(1, std::memory_order_seq_cst);
+            // epoch switched before registration, writer could miss it
+            if (epoch.load(std::memory_order_seq_cst) == e)
+                return e & 1;
+            counters[e & 1].fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+public:
+    SeqlockHashMap()
+        : table(new Table(SEQLOCK_MIN_CAPACITY)), drainParity(0), epoch(0), count(0), used(0)
+    {
+        for (int i = 0; i < SEQLOCK_READER_SHARDS; i++) {
+            readers[i].count[0].store(0, std::memory_order_relaxed);
+            readers[i].count[1].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    virtual ~SeqlockHashMap() {
+        for (auto t : retired)
+            delete t;
+        for (auto t : draining)
+            delete t;
+        delete table.load();
+    }
+
+    /**
+     * Find value by key. Can be called from any thread, spins while writer is in the slot.
+     * @param retVal return value
+     * @param key key
+     * @return true if found
+     */
+    bool find(
+        V &retVal,
+        K key
+    ) const {
+        std::atomic<uint32_t> *counters = readers[readerShard()].count;
+        unsigned int parity = enter(counters);
+        Table *t = table.load(std::memory_order_seq_cst);
+        bool found;
+        while (true) {
+            found = lookup(t, retVal, key);
+            // table replaced during lookup, value can be outdated
+            Table *t2 = table.load(std::memory_order_seq_cst);
+            if (t2 == t)
+                break;
+            t = t2;
+        }
+        counters[parity].fetch_sub(1, std::memory_order_release);
+        return found;
+    }
+
+    /**
+     * Insert or replace value. Writer only.
+     * @param key key
+     * @param value value
+     * @return true if inserted, false if replaced
+     */
+    bool put(
+        K key,
+        const V &value
+    ) {
+        reclaim();
+        Table *t = table.load(std::memory_order_relaxed);
+        size_t freeSlot = t->mask + 1;
+        size_t i = hash(key) & t->mask;
+        for (size_t n = 0; n <= t->mask; n++) {
+            Slot &s = t->slots[i];
+            uint32_t st = s.state.load(std::memory_order_relaxed);
+            if (st == SLOT_EMPTY) {
+                if (freeSlot > t->mask)
+                    freeSlot = i;
+                break;
+            }
+            if (st == SLOT_REMOVED) {
+                if (freeSlot > t->mask)
+                    freeSlot = i;
+            } else {
+                if (s.key.load(std::memory_order_relaxed) == key) {
+                    writeSlot(s, SLOT_USED, key, &value);
+                    return false;
+                }
+            }
+            i = (i + 1) & t->mask;
+        }
+        Slot &s = t->slots[freeSlot];
+        if (s.state.load(std::memory_order_relaxed) == SLOT_EMPTY) {
+            if ((used + 1) * 4 > (t->mask + 1) * 3) {
+                rebuild(count.load(std::memory_order_relaxed) + 1);
+                return put(key, value);
+            }
+            used++;
+        }
+        writeSlot(s, SLOT_USED, key, &value);
+        count.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * Remove value. Writer only.
+     * @param key key
+     * @return true if removed
+     */
+    bool rm(
+        K key
+    ) {
+        reclaim();
+        Table *t = table.load(std::memory_order_relaxed);
+        size_t i = hash(key) & t->mask;
+        for (size_t n = 0; n <= t->mask; n++) {
+            Slot &s = t->slots[i];
+            uint32_t st = s.state.load(std::memory_order_relaxed);
+            if (st == SLOT_EMPTY)
+                return false;
+            if (st == SLOT_USED && s.key.load(std::memory_order_relaxed) == key) {
+                writeSlot(s, SLOT_REMOVED, key, nullptr);
+                count.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+            i = (i + 1) & t->mask;
+        }
+        return false;
+    }
+
+    /**
+     * Remove all. Writer only.
+     */
+    void clear() {
+        count.store(0, std::memory_order_relaxed);
+        publish(new Table(SEQLOCK_MIN_CAPACITY));
+    }
+
+    /**
+     * Reserve slots to avoid rebuilds on bulk load. Writer only.
+     * @param entries expected entries count
+     */
+    void reserve(
+        size_t entries
+    ) {
+        Table *t = table.load(std::memory_order_relaxed);
+        if (entries * 4 > (t->mask + 1) * 3)
+            rebuild(entries);
+    }
+
+    size_t size() const {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Replaced tables not released yet. Writer only.
+     */
+    size_t retiredSize() const {
+        return retired.size() + draining.size();
+    }
+};
+
+#endif
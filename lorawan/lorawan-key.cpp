@@ -26,7 +26,7 @@ static void deriveKeyBlock(
     AES_CMAC_CTX aesCmacCtx;
     AES_CMAC_Init(&aesCmacCtx);
     AES_CMAC_SetKey(&aesCmacCtx, nwkKey.c);
-    AES_CMAC_Update(&aesCmacCtx, (const uint8_t *) &value, (std::uint32_t) size);
+    AES_CMAC_Update(&aesCmacCtx, (const uint8_t *) value, (std::uint32_t) size);
     AES_CMAC_Final(retval.c, &aesCmacCtx);
 }
 
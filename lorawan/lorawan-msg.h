@@ -246,6 +246,9 @@
 #define ERR_LORA_GATEWAY_SPECTRAL_SCAN_RESULT           "Spectral scan request results failed"
 #define ERR_STOPPED                                     "Stopped"
 #define ERR_ACCESS_DENIED                               "Access denied"
+#define ERR_NOT_IMPLEMENTED                             "Not implemented"
+#define ERR_JOURNAL_WRITE                               "Journal write failed"
+#define ERR_INVALID_SNAPSHOT                            "Invalid identity snapshot"
 
 // Message en-us locale strings
 #define MSG_COLON_N_SPACE               ": "
@@ -275,6 +278,8 @@
 #define MSG_RECEIVED					"Message received "
 #define MSG_MAC_COMMAND_RECEIVED		"MAC command(s) received from "
 #define MSG_SENT    					"Sent successfully "
+#define MSG_BATCH_SIZES 				"Batch sizes "
+#define MSG_IO_URING_FALLBACK			"io_uring is not available, use sockets: "
 #define MSG_SENT_ACK_TO					"Sent ACK to "
 #define MSG_SENT_REPLY_TO				"Sent reply to "
 #define MSG_GATEWAY_STAT				"Gateway statistics "
@@ -5,6 +5,8 @@
 
 #include "lorawan/storage/service/identity-service-json.h"
 #include "lorawan/storage/service/identity-service-gen.h"
+#include "lorawan/storage/service/identity-service-flat.h"
+#include "lorawan/storage/service/identity-service-concurrent.h"
 #include "lorawan/storage/service/gateway-service-json.h"
 #ifdef ENABLE_SQLITE
 #include "lorawan/storage/service/identity-service-sqlite.h"
@@ -34,6 +36,14 @@ ServiceClient::ServiceClient(
                 svcIdentity = new MemoryIdentityService;
                 svcGateway = new MemoryGatewayService;
             } else {
+                if (name == "flat") {
+                    svcIdentity = new FlatMemoryIdentityService;
+                    svcGateway = new MemoryGatewayService;
+                }
+                if (name == "concurrent") {
+                    svcIdentity = new ConcurrentMemoryIdentityService;
+                    svcGateway = new MemoryGatewayService;
+                }
 #ifdef ENABLE_SQLITE
                 if (name == "sqlite") {
                     svcIdentity = new SqliteIdentityService;
@@ -49,7 +59,7 @@ bool ServiceClient::hasStaticPlugin(
     const std::string &name
 )
 {
-    if (name == "json" || name == "gen" || name == "mem")
+    if (name == "json" || name == "gen" || name == "mem" || name == "flat" || name == "concurrent")
         return true;
     else {
 #ifdef ENABLE_SQLITE
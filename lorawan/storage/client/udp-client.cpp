@@ -33,6 +33,114 @@
 #define DEF_KEEPALIVE_SECS 60
 #define DEF_READ_TIMEOUT_SECONDS    2
 
+/**
+ * Parse response and call back
+ * @param client client
+ * @param buf response
+ * @param len response size
+ * @param status batch item status is returned in the code, nullptr- not a batch item
+ */
+static void parseResponse(
+    QueryClient *client,
+    const unsigned char *buf,
+    size_t len,
+    const int32_t *status = nullptr
+) {
+    ResponseClient *onResponse = client->onResponse;
+    if (status && len == 0) {
+        // batch item without response
+        IdentityOperationResponse gr;
+        gr.code = *status;
+        gr.response = *status;
+        onResponse->onIdentityOperation(client, &gr);
+        return;
+    }
+    if (isIdentityTag(buf, len)) {
+        enum IdentityQueryTag tag = validateIdentityQuery(buf, len);
+        switch (tag) {
+            case QUERY_IDENTITY_EUI:   // request gateway identifier(with address) by network address.
+            case QUERY_IDENTITY_ADDR:   // request gateway address (with identifier) by identifier.
+            {
+                IdentityGetResponse gr(buf, len);
+                gr.ntoh();
+                if (status)
+                    gr.code = *status;
+                onResponse->onIdentityGet(client, &gr);
+            }
+                break;
+            case QUERY_IDENTITY_LIST:   // List entries
+            {
+                IdentityListResponse gr(buf, len);
+                gr.response = NTOH4(gr.response);
+                gr.ntoh();
+                if (status)
+                    gr.code = *status;
+                onResponse->onIdentityList(client, &gr);
+            }
+                break;
+            case QUERY_IDENTITY_LIST_AFTER:   // page of entries
+            {
+                IdentityListAfterResponse gr(buf, len);
+                gr.ntoh();
+                if (status)
+                    gr.code = *status;
+                onResponse->onIdentityList(client, &gr);
+            }
+                break;
+            case QUERY_IDENTITY_BATCH:  // responses in order of requests
+            {
+                IdentityBatchResponse br(buf, len);
+                br.ntoh();
+                for (auto &item : br.items) {
+                    parseResponse(client, item.response, item.size, &item.status);
+                }
+            }
+                break;
+            default: {
+                IdentityOperationResponse gr(buf, len);
+                gr.ntoh();
+                if (status)
+                    gr.code = *status;
+                onResponse->onIdentityOperation(client, &gr);
+            }
+                break;
+        }
+    } else {
+        enum GatewayQueryTag tag = validateGatewayQuery(buf, len);
+        switch (tag) {
+            case QUERY_GATEWAY_ADDR:   // request gateway identifier(with address) by network address.
+            case QUERY_GATEWAY_ID:   // request gateway address (with identifier) by identifier.
+            {
+                GatewayGetResponse gr(buf, len);
+                gr.ntoh();
+                onResponse->onGatewayGet(client, &gr);
+            }
+                break;
+            case QUERY_GATEWAY_LIST:   // List entries
+            {
+                GatewayListResponse gr(buf, len);
+                gr.response = NTOH4(gr.response);
+                gr.ntoh();
+                onResponse->onGatewayList(client, &gr);
+            }
+                break;
+            case QUERY_GATEWAY_LIST_AFTER:   // page of entries
+            {
+                GatewayListAfterResponse gr(buf, len);
+                gr.ntoh();
+                onResponse->onGatewayList(client, &gr);
+            }
+                break;
+            default: {
+                GatewayOperationResponse gr(buf, len);
+                gr.ntoh();
+                onResponse->onGatewayOperation(client, &gr);
+            }
+                break;
+        }
+    }
+}
+
 void UDPClient::stop()
 {
     status = ERR_CODE_STOPPED;
@@ -119,7 +227,7 @@ void UDPClient::start() {
 #endif
         setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *) &timeout, sizeof timeout);
 
-        unsigned char sendBuffer[110];
+        unsigned char sendBuffer[SIZE_BATCH_REQUEST_MAX];
         while (status != ERR_CODE_STOPPED) {
             if (!query) {
                 status = ERR_CODE_STOPPED;
@@ -160,60 +268,7 @@ void UDPClient::start() {
                 << MSG_COLON_N_SPACE << hexString(rxBuf, len)
                 << std::endl;
 #endif
-                if (isIdentityTag(rxBuf, len)) {
-                    enum IdentityQueryTag tag = validateIdentityQuery(rxBuf, len);
-                    switch (tag) {
-                        case QUERY_IDENTITY_EUI:   // request gateway identifier(with address) by network address.
-                        case QUERY_IDENTITY_ADDR:   // request gateway address (with identifier) by identifier.
-                        {
-                            IdentityGetResponse gr(rxBuf, len);
-                            gr.ntoh();
-                            onResponse->onIdentityGet(this, &gr);
-                        }
-                            break;
-                        case QUERY_IDENTITY_LIST:   // List entries
-                        {
-                            IdentityListResponse gr(rxBuf, len);
-                            gr.response = NTOH4(gr.response);
-                            gr.ntoh();
-                            onResponse->onIdentityList(this, &gr);
-                        }
-                            break;
-                        default: {
-                            IdentityOperationResponse gr(rxBuf, len);
-                            gr.ntoh();
-                            onResponse->onIdentityOperation(this, &gr);
-                        }
-                            break;
-                    }
-
-                } else {
-                    enum GatewayQueryTag tag = validateGatewayQuery(rxBuf, len);
-                    switch (tag) {
-                        case QUERY_GATEWAY_ADDR:   // request gateway identifier(with address) by network address.
-                        case QUERY_GATEWAY_ID:   // request gateway address (with identifier) by identifier.
-                        {
-                            GatewayGetResponse gr(rxBuf, len);
-                            gr.ntoh();
-                            onResponse->onGatewayGet(this, &gr);
-                        }
-                            break;
-                        case QUERY_GATEWAY_LIST:   // List entries
-                        {
-                            GatewayListResponse gr(rxBuf, len);
-                            gr.response = NTOH4(gr.response);
-                            gr.ntoh();
-                            onResponse->onGatewayList(this, &gr);
-                        }
-                            break;
-                        default: {
-                            GatewayOperationResponse gr(rxBuf, len);
-                            gr.ntoh();
-                            onResponse->onGatewayOperation(this, &gr);
-                        }
-                            break;
-                    }
-                }
+                parseResponse(this, rxBuf, len);
                 free(rxBuf);
             }
         }
@@ -3,6 +3,7 @@
 #include <uv.h>
 
 #include "lorawan/helper/ip-helper.h"
+#include "lorawan/helper/ip-address.h"
 #include "lorawan/storage/serialization/gateway-binary-serialization.h"
 
 #if defined(_MSC_VER) || defined(__MINGW32__)
@@ -32,13 +33,29 @@
 
 #define DEF_KEEPALIVE_SECS 60
 
+/**
+ * Parse response and call back
+ * @param client client
+ * @param buf response
+ * @param nRead response size
+ * @param status batch item status is returned in the code, nullptr- not a batch item
+ */
 static void parseResponse(
     UvClient *client,
     const unsigned char *buf,
-    ssize_t nRead
+    ssize_t nRead,
+    const int32_t *status = nullptr
 ) {
     if (!client)
         return;
+    if (status && nRead == 0) {
+        // batch item without response
+        IdentityOperationResponse gr;
+        gr.code = *status;
+        gr.response = *status;
+        client->onResponse->onIdentityOperation(client, &gr);
+        return;
+    }
     if (isIdentityTag(buf, nRead)) {
         enum IdentityQueryTag tag = validateIdentityQuery(buf, nRead);
         switch (tag) {
@@ -47,6 +64,8 @@ static void parseResponse(
             {
                 IdentityGetResponse gr(buf, nRead);
                 gr.ntoh();
+                if (status)
+                    gr.code = *status;
                 client->onResponse->onIdentityGet(client, &gr);
             }
                 break;
@@ -55,12 +74,34 @@ static void parseResponse(
                 IdentityListResponse gr(buf, nRead);
                 gr.response = NTOH4(gr.response);
                 gr.ntoh();
+                if (status)
+                    gr.code = *status;
+                client->onResponse->onIdentityList(client, &gr);
+            }
+                break;
+            case QUERY_IDENTITY_LIST_AFTER:   // page of entries
+            {
+                IdentityListAfterResponse gr(buf, nRead);
+                gr.ntoh();
+                if (status)
+                    gr.code = *status;
                 client->onResponse->onIdentityList(client, &gr);
             }
                 break;
+            case QUERY_IDENTITY_BATCH:  // responses in order of requests
+            {
+                IdentityBatchResponse br(buf, nRead);
+                br.ntoh();
+                for (auto &item : br.items) {
+                    parseResponse(client, item.response, (ssize_t) item.size, &item.status);
+                }
+            }
+                break;
             default: {
                 IdentityOperationResponse gr(buf, nRead);
                 gr.ntoh();
+                if (status)
+                    gr.code = *status;
                 client->onResponse->onIdentityOperation(client, &gr);
             }
                 break;
@@ -85,6 +126,13 @@ static void parseResponse(
                 client->onResponse->onGatewayList(client, &gr);
             }
                 break;
+            case QUERY_GATEWAY_LIST_AFTER:   // page of entries
+            {
+                GatewayListAfterResponse gr(buf, nRead);
+                gr.ntoh();
+                client->onResponse->onGatewayList(client, &gr);
+            }
+                break;
             default: {
                 GatewayOperationResponse gr(buf, nRead);
                 gr.ntoh();
@@ -63,7 +63,7 @@ HTTPListener::HTTPListener(
 )
     : StorageListener(aIdentitySerialization, aSerializationWrapper),
       port(DEF_HTTP_PORT), log(nullptr), verbose(0), flags(MHD_START_FLAGS),
-      threadCount(1), connectionLimit(32768), descriptor(nullptr),
+      threadPoolSize(1), connectionLimit(32768), descriptor(nullptr),
       mimeType(aIdentitySerialization ? aIdentitySerialization->mimeType() : serializationKnownType2MimeType(SKT_BINARY)),
       htmlRootDir(aHTMLRootDir)
 {
@@ -409,7 +409,7 @@ int HTTPListener::run()
         flags, port, nullptr, nullptr,
         &cbRequest, this,
         MHD_OPTION_CONNECTION_TIMEOUT, (unsigned int) 30,  // 30s timeout
-        MHD_OPTION_THREAD_POOL_SIZE, threadCount,
+        MHD_OPTION_THREAD_POOL_SIZE, threadPoolSize,
         // MHD_OPTION_URI_LOG_CALLBACK, &cbUriLogger, this,
         MHD_OPTION_CONNECTION_LIMIT, connectionLimit,
         MHD_OPTION_END
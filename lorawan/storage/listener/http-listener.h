@@ -21,7 +21,8 @@ private:
 public:
     int verbose;
     unsigned int flags;
-    unsigned int threadCount;
+    // daemon thread pool size, requests are not serialized, so setThreadCount() does not change it
+    unsigned int threadPoolSize;
     unsigned int connectionLimit;
     void *descriptor;   // HTTP daemon
     const char* mimeType;
@@ -0,0 +1,537 @@
+#include "io-uring-listener.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "lorawan/lorawan-string.h"
+#include "lorawan/lorawan-error.h"
+#include "lorawan/lorawan-msg.h"
+#include "lorawan/storage/serialization/identity-binary-serialization.h"
+
+// submission queue entries, completion queue is twice as long
+#define RING_ENTRIES        256
+#define RECV_BUFFER_GROUP   0
+// recvmsg header, source address and batch request
+#define RECV_BUFFER_SIZE    (sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_storage) + SIZE_BATCH_REQUEST_MAX + 1)
+#define SEND_BUFFER_SIZE    SIZE_BATCH_RESPONSE_MAX
+// send completions carry the slot number
+#define RECV_USER_DATA      UINT64_MAX
+#define CANCEL_USER_DATA    (UINT64_MAX - 1)
+#define STOP_USER_DATA      (UINT64_MAX - 2)
+// check stop request once a second if there is no stop descriptor
+#define WAIT_TIMEOUT_NS     1000000000LL
+// completions waited for on exit
+#define EXIT_WAIT_ROUNDS    10
+
+/**
+ * io_uring without liburing: mapped submission and completion queues and the provided buffer ring.
+ * Used by one thread.
+ */
+class IoUring {
+private:
+    void *ringMem;
+    size_t ringMemSize;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned sqLocalTail;
+    unsigned toSubmit;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe *cqes;
+    // io_uring_buf_ring::bufs is shifted by the empty struct in C++, use entries directly
+    struct io_uring_buf *bufRing;
+    size_t bufRingSize;
+    unsigned bufCount;
+    uint16_t bufTail;
+    std::vector<unsigned char> buffers;
+public:
+    int fd;
+
+    IoUring()
+        : ringMem(MAP_FAILED), ringMemSize(0), sqes((struct io_uring_sqe *) MAP_FAILED), sqesSize(0),
+        sqHead(nullptr), sqTail(nullptr), sqMask(0), sqEntries(0), sqLocalTail(0), toSubmit(0),
+        cqHead(nullptr), cqTail(nullptr), cqMask(0), cqes(nullptr),
+        bufRing((struct io_uring_buf *) MAP_FAILED), bufRingSize(0), bufCount(0), bufTail(0), fd(-1)
+    {
+    }
+
+    ~IoUring()
+    {
+        // closing the ring cancels requests in flight
+        if (fd >= 0)
+            ::close(fd);
+        if (bufRing != MAP_FAILED)
+            munmap(bufRing, bufRingSize);
+        if (sqes != MAP_FAILED)
+            munmap(sqes, sqesSize);
+        if (ringMem != MAP_FAILED)
+            munmap(ringMem, ringMemSize);
+    }
+
+    /**
+     * Create ring and register provided buffers
+     * @param entries submission queue size
+     * @param bufferCount receive buffers, power of 2
+     * @return 0- success, -errno
+     */
+    int open(
+        unsigned entries,
+        unsigned bufferCount
+    )
+    {
+        struct io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        // only the worker submits, run completion work at io_uring_enter()
+        p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+        fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+        if (fd < 0 && errno == EINVAL) {
+            memset(&p, 0, sizeof(p));
+            fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+        }
+        if (fd < 0)
+            return -errno;
+        if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG))
+            return -EOPNOTSUPP;
+        size_t sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        size_t cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        ringMemSize = sqSize > cqSize ? sqSize : cqSize;
+        ringMem = mmap(nullptr, ringMemSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (ringMem == MAP_FAILED)
+            return -errno;
+        sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = (struct io_uring_sqe *) mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            return -errno;
+        auto m = (char *) ringMem;
+        sqHead = (unsigned *) (m + p.sq_off.head);
+        sqTail = (unsigned *) (m + p.sq_off.tail);
+        sqMask = *(unsigned *) (m + p.sq_off.ring_mask);
+        sqEntries = p.sq_entries;
+        sqLocalTail = *sqTail;
+        // submission queue index array is identity
+        auto array = (unsigned *) (m + p.sq_off.array);
+        for (unsigned i = 0; i < p.sq_entries; i++)
+            array[i] = i;
+        cqHead = (unsigned *) (m + p.cq_off.head);
+        cqTail = (unsigned *) (m + p.cq_off.tail);
+        cqMask = *(unsigned *) (m + p.cq_off.ring_mask);
+        cqes = (struct io_uring_cqe *) (m + p.cq_off.cqes);
+
+        bufCount = bufferCount;
+        bufRingSize = bufCount * sizeof(struct io_uring_buf);
+        bufRing = (struct io_uring_buf *) mmap(nullptr, bufRingSize, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (bufRing == MAP_FAILED)
+            return -errno;
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = (uint64_t) (uintptr_t) bufRing;
+        reg.ring_entries = bufCount;
+        reg.bgid = RECV_BUFFER_GROUP;
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+            return -errno;
+        buffers.resize(bufCount * RECV_BUFFER_SIZE);
+        for (unsigned i = 0; i < bufCount; i++)
+            recycle((uint16_t) i);
+        publishBuffers();
+        return 0;
+    }
+
+    /**
+     * Next submission queue entry, zeroed
+     * @return nullptr if queue is full, call submit() first
+     */
+    struct io_uring_sqe *sqe()
+    {
+        if (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+            return nullptr;
+        struct io_uring_sqe *r = &sqes[sqLocalTail & sqMask];
+        memset(r, 0, sizeof(*r));
+        sqLocalTail++;
+        toSubmit++;
+        return r;
+    }
+
+    /**
+     * Submit queued entries and wait for completions
+     * @param waitCount completions to wait for, 0- submit only
+     * @param timeoutNs longest wait, 0- no timeout
+     * @return 0- success, -errno, -ETIME- timed out
+     */
+    int submit(
+        unsigned waitCount,
+        long long timeoutNs
+    )
+    {
+        __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeoutNs / 1000000000LL;
+        ts.tv_nsec = timeoutNs % 1000000000LL;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        if (timeoutNs > 0)
+            arg.ts = (uint64_t) (uintptr_t) &ts;
+        unsigned flags = IORING_ENTER_EXT_ARG;
+        if (waitCount)
+            flags |= IORING_ENTER_GETEVENTS;
+        int r = (int) syscall(__NR_io_uring_enter, fd, toSubmit, waitCount, flags, &arg, sizeof(arg));
+        if (r < 0)
+            return -errno;
+        toSubmit -= (unsigned) r < toSubmit ? (unsigned) r : toSubmit;
+        return 0;
+    }
+
+    bool hasCompletions() const
+    {
+        return *cqHead != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    }
+
+    /**
+     * Call f for each completion and release them
+     */
+    template <typename F>
+    void forEachCompletion(
+        F f
+    )
+    {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+            f(cqes[head & cqMask]);
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    unsigned char *buffer(
+        uint16_t bid
+    )
+    {
+        return &buffers[bid * RECV_BUFFER_SIZE];
+    }
+
+    /**
+     * Return receive buffer to the kernel, call publishBuffers() after
+     */
+    void recycle(
+        uint16_t bid
+    )
+    {
+        struct io_uring_buf *b = &bufRing[bufTail & (bufCount - 1)];
+        b->addr = (uint64_t) (uintptr_t) buffer(bid);
+        b->len = (uint32_t) RECV_BUFFER_SIZE;
+        b->bid = bid;
+        bufTail++;
+    }
+
+    void publishBuffers()
+    {
+        // ring tail overlays resv of the first entry
+        __atomic_store_n(&bufRing[0].resv, bufTail, __ATOMIC_RELEASE);
+    }
+};
+
+/**
+ * Reply in flight
+ */
+typedef struct {
+    struct msghdr msg;
+    struct iovec iov;
+    struct sockaddr_storage addr;
+    unsigned char buffer[SEND_BUFFER_SIZE];
+} SEND_SLOT;
+
+static void prepRecv(
+    struct io_uring_sqe *sqe,
+    int sock,
+    struct msghdr *hdr
+)
+{
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = sock;
+    sqe->addr = (uint64_t) (uintptr_t) hdr;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_BUFFER_GROUP;
+    sqe->user_data = RECV_USER_DATA;
+}
+
+/**
+ * Find payload and source address in the multishot receive buffer
+ * @return payload size, 0- truncated or empty datagram
+ */
+static size_t parseRecv(
+    const unsigned char *&retPayload,
+    const struct sockaddr *&retAddr,
+    socklen_t &retAddrLen,
+    const unsigned char *buf,
+    size_t sz,
+    const struct msghdr &hdr
+)
+{
+    auto out = (const struct io_uring_recvmsg_out *) buf;
+    size_t ofs = sizeof(struct io_uring_recvmsg_out) + hdr.msg_namelen + hdr.msg_controllen;
+    if (sz < ofs || (out->flags & MSG_TRUNC))
+        return 0;
+    retAddr = (const struct sockaddr *) (buf + sizeof(struct io_uring_recvmsg_out));
+    retAddrLen = out->namelen > hdr.msg_namelen ? hdr.msg_namelen : out->namelen;
+    retPayload = buf + ofs;
+    return out->payloadlen < sz - ofs ? out->payloadlen : sz - ofs;
+}
+
+IoUringListener::IoUringListener(
+    IdentitySerialization *aIdentitySerialization,
+    GatewaySerialization *aSerializationWrapper
+)
+    : UDPListener(aIdentitySerialization, aSerializationWrapper), requestCount(0), enterCount(0)
+{
+}
+
+bool IoUringListener::isSupported()
+{
+    IoUring ring;
+    if (ring.open(8, 8))
+        return false;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+        return false;
+    struct sockaddr_in a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(a);
+    bool r = false;
+    // datagram to itself must come through the multishot receive
+    if (!bind(sock, (struct sockaddr *) &a, sizeof(a)) && !getsockname(sock, (struct sockaddr *) &a, &len)) {
+        struct msghdr hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        prepRecv(ring.sqe(), sock, &hdr);
+        if (!ring.submit(0, 0) && sendto(sock, "", 1, 0, (struct sockaddr *) &a, sizeof(a)) == 1) {
+            ring.submit(1, WAIT_TIMEOUT_NS);
+            ring.forEachCompletion([&r](const struct io_uring_cqe &cqe) {
+                if (cqe.user_data == RECV_USER_DATA && cqe.res > 0 && (cqe.flags & IORING_CQE_F_MORE))
+                    r = true;
+            });
+        }
+    }
+    ::close(sock);
+    return r;
+}
+
+void IoUringListener::ringStats(
+    uint64_t &retRequests,
+    uint64_t &retEnters
+) const
+{
+    retRequests = requestCount.load(std::memory_order_relaxed);
+    retEnters = enterCount.load(std::memory_order_relaxed);
+}
+
+void IoUringListener::serveSocket(
+    SOCKET sock
+)
+{
+    bool served;
+    int r;
+    {
+        IoUring ring;
+        r = ring.open(RING_ENTRIES, IO_URING_RECV_BUFFERS);
+        served = !r && serveRing(ring, sock);
+    }
+    if (served)
+        return;
+    if (log) {
+        std::lock_guard<std::mutex> lock(logMutex);
+        log->strm(LOG_ERR) << MSG_IO_URING_FALLBACK << ERR_MESSAGE << (r ? -r : EINVAL);
+        log->flush();
+    }
+    UDPListener::serveSocket(sock);
+}
+
+/**
+ * Answer requests until stop() called
+ * @return false- multishot receive is not supported, nothing is received
+ */
+bool IoUringListener::serveRing(
+    IoUring &ring,
+    SOCKET sock
+)
+{
+    std::vector<SEND_SLOT> slots(IO_URING_SEND_SLOTS);
+    std::vector<uint16_t> freeSlots;
+    for (int i = IO_URING_SEND_SLOTS - 1; i >= 0; i--)
+        freeSlots.push_back((uint16_t) i);
+    struct msghdr recvHdr;
+    memset(&recvHdr, 0, sizeof(recvHdr));
+    recvHdr.msg_namelen = sizeof(struct sockaddr_storage);
+
+    bool armed = false;
+    bool received = false;
+    bool unsupported = false;
+    uint64_t requests = 0;
+    uint64_t enters = 0;
+    long long waitTimeout = WAIT_TIMEOUT_NS;
+    auto onCompletion = [&](const struct io_uring_cqe &cqe) {
+        if (cqe.user_data == CANCEL_USER_DATA)
+            return;
+        if (cqe.user_data == STOP_USER_DATA) {
+            // stop() called, status is checked by the loop; poll failed- check it by timeout
+            if (cqe.res < 0)
+                waitTimeout = WAIT_TIMEOUT_NS;
+            return;
+        }
+        if (cqe.user_data != RECV_USER_DATA) {
+            // reply sent
+            if (cqe.res < 0 && log) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                log->strm(LOG_ERR) << ERR_SOCKET_WRITE << MSG_SPACE << ERR_MESSAGE << -cqe.res;
+                log->flush();
+            }
+            freeSlots.push_back((uint16_t) cqe.user_data);
+            return;
+        }
+        if (!(cqe.flags & IORING_CQE_F_MORE))
+            armed = false;
+        if (cqe.res < 0) {
+            // buffers are recycled at once, no buffers for the first datagram means the ring does not work
+            if ((cqe.res == -EINVAL || cqe.res == -ENOBUFS) && !received)
+                unsupported = true;
+            // -ENOBUFS: all buffers are taken, receive is posted again after they are recycled
+            else if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED && log) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                log->strm(LOG_ERR) << ERR_SOCKET_READ << MSG_SPACE << ERR_MESSAGE << -cqe.res;
+                log->flush();
+            }
+            return;
+        }
+        if (!(cqe.flags & IORING_CQE_F_BUFFER))
+            return;
+        received = true;
+        requests++;
+        auto bid = (uint16_t) (cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        const unsigned char *payload = nullptr;
+        const struct sockaddr *addr = nullptr;
+        socklen_t addrLen = 0;
+        size_t len = parseRecv(payload, addr, addrLen, ring.buffer(bid), (size_t) cqe.res, recvHdr);
+        if (log && verbose > 1 && len) {
+            std::lock_guard<std::mutex> lock(logMutex);
+            log->strm(LOG_INFO) << MSG_RECEIVED << len << MSG_SPACE << MSG_BYTES << MSG_COLON_N_SPACE << hexString(payload, len);
+            log->flush();
+        }
+        unsigned char overflow[SEND_BUFFER_SIZE];
+        SEND_SLOT *slot = freeSlots.empty() ? nullptr : &slots[freeSlots.back()];
+        unsigned char *tx = slot ? slot->buffer : overflow;
+        size_t sz = len ? query(tx, SEND_BUFFER_SIZE, payload, len) : 0;
+        if (sz == 0) {
+            if (log && verbose) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                log->strm(LOG_ERR) << ERR_INVALID_PACKET << ": " << hexString(payload, len)
+                    << " (" << len << MSG_SPACE << MSG_BYTES << ")";
+                log->flush();
+            }
+        } else if (slot) {
+            freeSlots.pop_back();
+            memmove(&slot->addr, addr, addrLen);
+            slot->iov.iov_base = slot->buffer;
+            slot->iov.iov_len = sz;
+            memset(&slot->msg, 0, sizeof(slot->msg));
+            slot->msg.msg_name = &slot->addr;
+            slot->msg.msg_namelen = addrLen;
+            slot->msg.msg_iov = &slot->iov;
+            slot->msg.msg_iovlen = 1;
+            struct io_uring_sqe *sqe = ring.sqe();
+            if (!sqe) {
+                ring.submit(0, 0);
+                enters++;
+                sqe = ring.sqe();
+            }
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = sock;
+            sqe->addr = (uint64_t) (uintptr_t) &slot->msg;
+            sqe->len = 1;
+            sqe->user_data = (uint64_t) (slot - slots.data());
+        } else {
+            // all slots are in flight
+            if (sendto(sock, tx, sz, 0, addr, addrLen) < 0 && log) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                log->strm(LOG_ERR) << ERR_SOCKET_WRITE << MSG_SPACE << ERR_MESSAGE << errno;
+                log->flush();
+            }
+        }
+        ring.recycle(bid);
+    };
+
+    // stop() wakes up the wait for completions
+    if (stopEvent() >= 0) {
+        struct io_uring_sqe *sqe = ring.sqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = stopEvent();
+        sqe->poll32_events = POLLIN;
+        sqe->user_data = STOP_USER_DATA;
+        waitTimeout = 0;
+    }
+
+    while (status != ERR_CODE_STOPPED) {
+        if (!armed) {
+            struct io_uring_sqe *sqe = ring.sqe();
+            if (!sqe) {
+                ring.submit(0, 0);
+                enters++;
+                sqe = ring.sqe();
+            }
+            prepRecv(sqe, sock, &recvHdr);
+            armed = true;
+        }
+        // replies of the previous completions are submitted with waiting for the next ones
+        int r = ring.submit(ring.hasCompletions() ? 0 : 1, waitTimeout);
+        enters++;
+        if (r < 0 && r != -ETIME && r != -EINTR && r != -EBUSY && r != -EAGAIN) {
+            if (log) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                log->strm(LOG_ERR) << ERR_SOCKET_READ << MSG_SPACE << ERR_MESSAGE << -r;
+                log->flush();
+            }
+            break;
+        }
+        ring.forEachCompletion(onCompletion);
+        ring.publishBuffers();
+        requestCount.fetch_add(requests, std::memory_order_relaxed);
+        enterCount.fetch_add(enters, std::memory_order_relaxed);
+        requests = 0;
+        enters = 0;
+        if (unsupported)
+            return false;
+    }
+
+    // cancel receive and wait for replies in flight before buffers are released
+    if (armed) {
+        struct io_uring_sqe *sqe = ring.sqe();
+        if (!sqe) {
+            ring.submit(0, 0);
+            sqe = ring.sqe();
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = RECV_USER_DATA;
+        sqe->user_data = CANCEL_USER_DATA;
+    }
+    for (int i = 0; i < EXIT_WAIT_ROUNDS && (armed || freeSlots.size() < IO_URING_SEND_SLOTS); i++) {
+        ring.submit(1, WAIT_TIMEOUT_NS / EXIT_WAIT_ROUNDS);
+        ring.forEachCompletion(onCompletion);
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef IO_URING_LISTENER_H_
+#define IO_URING_LISTENER_H_	1
+
+#include <atomic>
+#include <cstdint>
+
+#include "lorawan/storage/listener/udp-listener.h"
+
+// provided receive buffers per worker, power of 2
+#define IO_URING_RECV_BUFFERS   256
+// replies in flight per worker, next replies are sent by sendto()
+#define IO_URING_SEND_SLOTS     64
+
+class IoUring;
+
+/**
+ * UDP listener on io_uring (Linux 6.0 or newer).
+ * Each worker posts one multishot recvmsg which takes datagrams into the provided buffer ring,
+ * replies are queued as sendmsg and submitted by the same io_uring_enter() call which waits for next datagrams.
+ * If the kernel has no io_uring, multishot receive or buffer rings, worker falls back to UDPListener sockets.
+ * Threads (SO_REUSEPORT workers), stop() and log are the same as UDPListener's.
+ */
+class IoUringListener : public UDPListener {
+private:
+    std::atomic<uint64_t> requestCount;
+    std::atomic<uint64_t> enterCount;
+    bool serveRing(IoUring &ring, SOCKET sock);
+protected:
+    void serveSocket(SOCKET sock) override;
+public:
+    explicit IoUringListener(
+        IdentitySerialization *aIdentitySerialization,
+        GatewaySerialization *aSerializationWrapper
+    );
+    /**
+     * Check io_uring, buffer ring and multishot receive are available
+     * @return true- requests are served by io_uring
+     */
+    static bool isSupported();
+    /**
+     * Return datagrams received and io_uring_enter() calls made by all workers
+     * @param retRequests datagrams received
+     * @param retEnters system calls
+     */
+    void ringStats(uint64_t &retRequests, uint64_t &retEnters) const;
+};
+
+#endif
@@ -1,3 +1,163 @@
+#include <cstring>
+
 #include "storage-listener.h"
+#include "lorawan/storage/serialization/identity-binary-serialization.h"
+#include "lorawan/storage/serialization/gateway-binary-serialization.h"
+#include "lorawan/lorawan-error.h"
+
+// batch response is the longest one
+#define SIZE_RESPONSE_MAX SIZE_BATCH_RESPONSE_MAX
 
 StorageListener::~StorageListener() = default;
+
+STORAGE_ROUTE StorageListener::route(
+    const unsigned char *request,
+    size_t sz
+) const
+{
+    if (sz == 0)
+        return STORAGE_ROUTE_NONE;
+    if ((identitySerialization && identitySerialization->serializationType != SKT_BINARY)
+        || (gatewaySerialization && gatewaySerialization->serializationType != SKT_BINARY))
+        return STORAGE_ROUTE_ANY;
+    if (identitySerialization && isIdentityTag(request, sz))
+        return STORAGE_ROUTE_IDENTITY;
+    if (gatewaySerialization && isGatewayTag(request, sz))
+        return STORAGE_ROUTE_GATEWAY;
+    return STORAGE_ROUTE_NONE;
+}
+
+size_t StorageListener::query(
+    unsigned char *retBuf,
+    size_t retSize,
+    const unsigned char *request,
+    size_t sz
+)
+{
+    size_t r = 0;
+    switch (route(request, sz)) {
+        case STORAGE_ROUTE_IDENTITY:
+            return identitySerialization->query(retBuf, retSize, request, sz);
+        case STORAGE_ROUTE_GATEWAY:
+            return gatewaySerialization->query(retBuf, retSize, request, sz);
+        case STORAGE_ROUTE_ANY:
+            if (identitySerialization)
+                r = identitySerialization->query(retBuf, retSize, request, sz);
+            if (r == 0 && gatewaySerialization)
+                r = gatewaySerialization->query(retBuf, retSize, request, sz);
+            return r;
+        default:
+            return 0;
+    }
+}
+
+static void appendResponse(
+    std::vector<unsigned char> &retVal,
+    const unsigned char *response,
+    size_t sz,
+    bool framed
+)
+{
+    if (framed) {
+        unsigned char header[SIZE_FRAME_HEADER] = {
+            (unsigned char) (sz >> 24), (unsigned char) (sz >> 16), (unsigned char) (sz >> 8), (unsigned char) sz
+        };
+        retVal.insert(retVal.end(), header, header + SIZE_FRAME_HEADER);
+    }
+    retVal.insert(retVal.end(), response, response + sz);
+}
+
+size_t StorageListener::queryResponses(
+    std::vector<unsigned char> &retVal,
+    const unsigned char *request,
+    size_t sz,
+    bool framed,
+    ListAfterCursor *cursor
+)
+{
+    unsigned char response[SIZE_RESPONSE_MAX];
+    // list after request is answered by frames until requested count is reached
+    unsigned char next[SIZE_LIST_AFTER_REQUEST];
+    bool streaming = route(request, sz) == STORAGE_ROUTE_IDENTITY
+        && validateIdentityQuery(request, sz) == QUERY_IDENTITY_LIST_AFTER;
+    if (streaming)
+        memmove(next, request, sizeof(next));
+    size_t count = 0;
+    size_t r = query(response, sizeof(response), request, sz);
+    while (true) {
+        if (r > 0 || framed) {
+            appendResponse(retVal, response, r, framed);
+            count++;
+        }
+        if (r == 0 || !streaming || !nextListAfterRequest(next, sizeof(next), response, r))
+            break;
+        if (cursor) {
+            // next frames are answered after this one is written
+            memmove(cursor->next, next, sizeof(next));
+            cursor->active = true;
+            break;
+        }
+        r = query(response, sizeof(response), next, sizeof(next));
+    }
+    return count;
+}
+
+size_t StorageListener::queryNext(
+    std::vector<unsigned char> &retVal,
+    ListAfterCursor &cursor,
+    bool framed
+)
+{
+    if (!cursor.active)
+        return 0;
+    unsigned char response[SIZE_RESPONSE_MAX];
+    size_t r = query(response, sizeof(response), cursor.next, sizeof(cursor.next));
+    cursor.active = r > 0 && nextListAfterRequest(cursor.next, sizeof(cursor.next), response, r);
+    if (r == 0 && !framed)
+        return 0;
+    appendResponse(retVal, response, r, framed);
+    return 1;
+}
+
+int StorageListener::queryFrames(
+    std::vector<unsigned char> &retVal,
+    std::vector<unsigned char> &pending,
+    const unsigned char *data,
+    size_t sz,
+    ListAfterCursor *cursor
+)
+{
+    // frames read at once are answered from the read buffer
+    bool buffered = !pending.empty();
+    if (buffered) {
+        pending.insert(pending.end(), data, data + sz);
+        data = pending.data();
+        sz = pending.size();
+    }
+    size_t ofs = 0;
+    // requests following the list after request wait for its last frame
+    while (sz - ofs >= SIZE_FRAME_HEADER && !(cursor && cursor->active)) {
+        const unsigned char *h = data + ofs;
+        size_t len = ((size_t) h[0] << 24) | ((size_t) h[1] << 16) | ((size_t) h[2] << 8) | h[3];
+        if (len > SIZE_FRAME_MAX) {
+            pending.clear();
+            return ERR_CODE_INVALID_PACKET;
+        }
+        if (sz - ofs - SIZE_FRAME_HEADER < len)
+            break;
+        queryResponses(retVal, h + SIZE_FRAME_HEADER, len, true, cursor);
+        ofs += SIZE_FRAME_HEADER + len;
+    }
+    if (buffered)
+        pending.erase(pending.begin(), pending.begin() + ofs);
+    else
+        pending.assign(data + ofs, data + sz);
+    return CODE_OK;
+}
+
+void StorageListener::setThreadCount(
+    int count
+)
+{
+    threadCount = count < 1 ? 1 : count;
+}
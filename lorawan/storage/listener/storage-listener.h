@@ -1,8 +1,20 @@
 #ifndef GATEWAY_LISTENER_H
 #define GATEWAY_LISTENER_H
 
+#include <vector>
+
 #include "lorawan/storage/serialization/identity-serialization.h"
 #include "lorawan/storage/serialization/gateway-serialization.h"
+#include "lorawan/storage/serialization/identity-binary-serialization.h"
+
+/**
+ * TCP connection which first byte is zero is framed: each request and response is prefixed by 4 bytes
+ * length in network byte order. Tags are never zero, so connections without prefix are answered as before,
+ * one request per read.
+ */
+#define SIZE_FRAME_HEADER   4
+// longest accepted request frame
+#define SIZE_FRAME_MAX      (1024 * 1024)
 
 class Log {
 public:
@@ -10,6 +22,32 @@ public:
     virtual void flush() = 0;
 };
 
+/**
+ * Which serialization serves the request
+ */
+typedef enum {
+    STORAGE_ROUTE_NONE = 0,     ///< unknown tag
+    STORAGE_ROUTE_IDENTITY = 1,
+    STORAGE_ROUTE_GATEWAY = 2,
+    STORAGE_ROUTE_ANY = 3       ///< serialization is not binary, try identity then gateway
+} STORAGE_ROUTE;
+
+/**
+ * List after request of the connection which answer is not complete yet.
+ * Connection asks for the next frame after the previous one is written, so it holds one frame at a time.
+ */
+class ListAfterCursor {
+public:
+    // request of the next frame
+    unsigned char next[SIZE_LIST_AFTER_REQUEST];
+    // true- next frame is expected
+    bool active;
+    ListAfterCursor()
+        : active(false)
+    {
+    }
+};
+
 class StorageListener {
 public:
     IdentitySerialization *identitySerialization;
@@ -18,11 +56,83 @@ public:
     explicit StorageListener(
         IdentitySerialization *aIdentitySerialization,
         GatewaySerialization *aSerializationWrapper
-    ) : identitySerialization(aIdentitySerialization), gatewaySerialization(aSerializationWrapper)
+    ) : identitySerialization(aIdentitySerialization), gatewaySerialization(aSerializationWrapper), threadCount(1)
     {
 
     }
 
+    /**
+     * Pick serialization by the request tag (first byte): identity tags are lower case, gateway tags are upper case
+     * @param request serialized request
+     * @param sz request size
+     * @return serialization to call
+     */
+    STORAGE_ROUTE route(
+        const unsigned char *request,
+        size_t sz
+    ) const;
+
+    /**
+     * Call identity or gateway serialization chosen by route()
+     * @return response size, 0- invalid request
+     */
+    virtual size_t query(
+        unsigned char *retBuf,
+        size_t retSize,
+        const unsigned char *request,
+        size_t sz
+    );
+
+    /**
+     * Answer request. List after request is answered by frames until requested count is reached.
+     * @param retVal responses are appended
+     * @param request serialized request
+     * @param sz request size
+     * @param framed prefix each response by length, invalid request is answered by the empty frame
+     * @param cursor nullptr- all list after frames at once, otherwise the first frame, next ones by queryNext()
+     * @return responses count
+     */
+    size_t queryResponses(
+        std::vector<unsigned char> &retVal,
+        const unsigned char *request,
+        size_t sz,
+        bool framed,
+        ListAfterCursor *cursor = nullptr
+    );
+
+    /**
+     * Answer the next frame of the list after request started by queryResponses() or queryFrames()
+     * @param retVal response is appended
+     * @param cursor connection cursor, inactive after the last frame
+     * @param framed prefix response by length
+     * @return responses count, 0- cursor is not active
+     */
+    size_t queryNext(
+        std::vector<unsigned char> &retVal,
+        ListAfterCursor &cursor,
+        bool framed
+    );
+
+    /**
+     * Answer each complete request frame read from the framed connection.
+     * Incomplete frame stays in the pending buffer until the next read.
+     * With cursor frames following the list after request stay in the pending buffer until its answer is complete,
+     * call again without data to answer them.
+     * @param retVal framed responses are appended
+     * @param pending connection reassembly buffer
+     * @param data bytes read
+     * @param sz bytes count
+     * @param cursor nullptr- list after request is answered at once, otherwise by queryNext()
+     * @return CODE_OK- success, ERR_CODE_INVALID_PACKET- frame is longer than SIZE_FRAME_MAX, close connection
+     */
+    int queryFrames(
+        std::vector<unsigned char> &retVal,
+        std::vector<unsigned char> &pending,
+        const unsigned char *data,
+        size_t sz,
+        ListAfterCursor *cursor = nullptr
+    );
+
     virtual void setAddress(
         const std::string &host,
         uint16_t port
@@ -39,7 +149,16 @@ public:
 
     virtual void setLog(int verbose, Log *log) = 0;
 
+    /**
+     * Set worker threads count. Listener may ignore it.
+     * @param count 1- run in the caller thread, less than 1 is treated as 1
+     */
+    virtual void setThreadCount(int count);
+
     virtual ~StorageListener();
+protected:
+    // worker threads count set by setThreadCount()
+    int threadCount;
 };
 
 
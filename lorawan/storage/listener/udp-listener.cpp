@@ -1,6 +1,8 @@
 #include "udp-listener.h"
 
 #include <iostream>
+#include <thread>
+#include <vector>
 
 #ifdef ESP_PLATFORM
 #include "platform-defs.h"
@@ -30,11 +32,28 @@
         #include <netinet/in.h>
         #include <cstring>
         #include <unistd.h>
+        #include <cerrno>
+        #include <fcntl.h>
+        #include <poll.h>
+        #ifdef __linux__
+            #include <sys/eventfd.h>
+        #endif
     #endif
 #endif
 
 #include "lorawan/lorawan-string.h"
 #include "lorawan/lorawan-error.h"
+#include "lorawan/storage/serialization/identity-binary-serialization.h"
+
+#ifdef ESP_PLATFORM
+// 307 bytes for IPv4 up to 18, IPv6 up to 10; keep task stack small, long batches are truncated
+#define RX_BUFFER_SIZE  307
+#define TX_BUFFER_SIZE  2048
+#else
+// batch request and response
+#define RX_BUFFER_SIZE  (SIZE_BATCH_REQUEST_MAX + 1)
+#define TX_BUFFER_SIZE  SIZE_BATCH_RESPONSE_MAX
+#endif
 #include "lorawan/lorawan-msg.h"
 #include "lorawan/helper/ip-address.h"
 
@@ -48,6 +67,9 @@
 #define SOCKET_ERROR_TIMEOUT EAGAIN
 #endif
 
+// check stop request once a second if the stop descriptor can not be created
+#define STOP_POLL_TIMEOUT_MS 1000
+
 /**
  * @see https://habr.com/ru/post/340758/
  * @see https://github.com/Mityuha/grpc_async/blob/master/grpc_async_server.cc
@@ -56,8 +78,29 @@ UDPListener::UDPListener(
     IdentitySerialization *aIdentitySerialization,
     GatewaySerialization *aSerializationWrapper
 )
-    : StorageListener(aIdentitySerialization, aSerializationWrapper), destAddr({}), log(nullptr), verbose(0), status(CODE_OK)
+    : StorageListener(aIdentitySerialization, aSerializationWrapper), destAddr({}), log(nullptr), verbose(0),
+      status(CODE_OK)
 {
+    for (int i = 0; i < UDP_BATCH_HISTOGRAM; i++)
+        batchCount[i] = 0;
+    stopFds[0] = -1;
+    stopFds[1] = -1;
+#ifdef UDP_LISTENER_POLL
+#ifdef __linux__
+    stopFds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    stopFds[1] = stopFds[0];
+#else
+    if (pipe(stopFds) == 0) {
+        for (int i = 0; i < 2; i++) {
+            fcntl(stopFds[i], F_SETFL, fcntl(stopFds[i], F_GETFL) | O_NONBLOCK);
+            fcntl(stopFds[i], F_SETFD, FD_CLOEXEC);
+        }
+    } else {
+        stopFds[0] = -1;
+        stopFds[1] = -1;
+    }
+#endif
+#endif
 }
 
 void UDPListener::setLog(
@@ -73,6 +116,19 @@ void UDPListener::setLog(
 void UDPListener::stop()
 {
     status = ERR_CODE_STOPPED;
+#ifdef UDP_LISTENER_POLL
+    // wake up all workers; write() is safe in the signal handler
+    if (stopFds[1] >= 0) {
+        uint64_t one = 1;
+        ssize_t r = ::write(stopFds[1], &one, sizeof(one));
+        (void) r;
+    }
+#endif
+}
+
+int UDPListener::stopEvent() const
+{
+    return stopFds[0];
 }
 
 void UDPListener::setAddress(
@@ -105,134 +161,432 @@ void UDPListener::setAddress(
     a->sin_port = htons(port);
 }
 
+void UDPListener::setThreadCount(
+    int count
+)
+{
+#ifdef SO_REUSEPORT
+    StorageListener::setThreadCount(count);
+#else
+    // sockets can not share the same port
+    StorageListener::setThreadCount(1);
+#endif
+}
+
+/**
+ * Call identity or gateway serialization chosen by the request tag.
+ * Services which are not thread-safe are called by one worker at a time.
+ * @return response size, 0- invalid request
+ */
+size_t UDPListener::query(
+    unsigned char *retBuf,
+    size_t retSize,
+    const unsigned char *request,
+    size_t sz
+)
+{
+    STORAGE_ROUTE r = route(request, sz);
+    size_t rsz = 0;
+    if (r == STORAGE_ROUTE_IDENTITY || r == STORAGE_ROUTE_ANY) {
+        if (threadCount > 1 && !(identitySerialization->svc && identitySerialization->svc->isThreadSafe())) {
+            std::lock_guard<std::mutex> lock(identityMutex);
+            rsz = identitySerialization->query(retBuf, retSize, request, sz);
+        } else
+            rsz = identitySerialization->query(retBuf, retSize, request, sz);
+    }
+    if (rsz == 0 && (r == STORAGE_ROUTE_GATEWAY || r == STORAGE_ROUTE_ANY)) {
+        std::lock_guard<std::mutex> lock(gatewayMutex);
+        rsz = gatewaySerialization->query(retBuf, retSize, request, sz);
+    }
+    return rsz;
+}
+
 int UDPListener::run()
 {
-    unsigned char rxBuf[307];
+    if (threadCount <= 1)
+        return runWorker(false);
+    std::vector<int> results(threadCount, CODE_OK);
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threadCount; i++) {
+        workers.emplace_back([this, &results, i] {
+            results[i] = runWorker(true);
+        });
+    }
+    results[0] = runWorker(true);
+    for (auto &w : workers)
+        w.join();
+    for (auto r : results) {
+        if (r)
+            return r;
+    }
+    return CODE_OK;
+}
 
+/**
+ * Receive requests and send responses until stop() called
+ * @param reusePort true- set SO_REUSEPORT, other workers bind the same address
+ * @return 0- success
+ */
+int UDPListener::runWorker(
+    bool reusePort
+)
+{
     int proto = isIPv6(&destAddr) ? IPPROTO_IPV6 : IPPROTO_IP;
     int af = isIPv6(&destAddr) ? AF_INET6 : AF_INET;
 
-    int r = CODE_OK;
-    while (status != ERR_CODE_STOPPED) {
-        SOCKET sock = socket(af, SOCK_DGRAM, proto);
-        if (sock == INVALID_SOCKET) {
+    SOCKET sock = socket(af, SOCK_DGRAM, proto);
+    if (sock == INVALID_SOCKET) {
+        if (log) {
+            std::lock_guard<std::mutex> lock(logMutex);
+            log->strm(LOG_ERR) << ERR_SOCKET_CREATE
+                << MSG_SPACE << ERR_MESSAGE << SOCKET_ERRNO;
+            log->flush();
+        }
+        return ERR_CODE_SOCKET_CREATE;
+    }
+#ifdef _MSC_VER
+    if (log && verbose > 1) {
+        std::lock_guard<std::mutex> lock(logMutex);
+        log->strm(LOG_INFO) << "Socket created ";
+        log->flush();
+    }
+#endif
+    int enable = 1;
+    if (setsockopt(sock, IPPROTO_IP, IP_PKTINFO, (const char*) &enable, sizeof(enable))) {
+        if (log) {
+            std::lock_guard<std::mutex> lock(logMutex);
+            log->strm(LOG_ERR) << ERR_SOCKET_SET
+                << MSG_SPACE << ERR_MESSAGE << SOCKET_ERRNO;
+            log->flush();
+        }
+    }
+
+    if (af == AF_INET6) {
+        // Note that by default IPV6 binds to both protocols, it must be disabled
+        // if both protocols used at the same time (used in CI)
+        int opt = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*) &opt, sizeof(opt));
+        setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, (const char*) &opt, sizeof(opt));
+    }
+#ifdef SO_REUSEPORT
+    if (reusePort) {
+        // all workers bind the same address, kernel spreads datagrams between sockets
+        int opt = 1;
+        if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (const char*) &opt, sizeof(opt))) {
             if (log) {
-                log->strm(LOG_ERR) << ERR_SOCKET_CREATE
+                std::lock_guard<std::mutex> lock(logMutex);
+                log->strm(LOG_ERR) << ERR_SOCKET_SET
                     << MSG_SPACE << ERR_MESSAGE << SOCKET_ERRNO;
                 log->flush();
             }
-            r = ERR_CODE_SOCKET_CREATE;
-            break;
         }
+    }
+#endif
+
+#ifdef UDP_LISTENER_POLL
+    // queued datagrams are taken until EAGAIN, then worker waits by poll()
+    int optErr = fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+#else
+    // Set timeout
 #ifdef _MSC_VER
-        if (log && verbose > 1) {
-            log->strm(LOG_INFO) << "Socket created ";
+    DWORD timeout = 1000;   // ms
+#else
+    struct timeval timeout { 1, 0 };
+#endif
+    int optErr = setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*) &timeout, sizeof timeout);
+#endif
+    if (optErr) {
+        if (log) {
+            std::lock_guard<std::mutex> lock(logMutex);
+            log->strm(LOG_ERR) << ERR_SOCKET_SET
+                << MSG_SPACE << ERR_MESSAGE << SOCKET_ERRNO;
             log->flush();
         }
-#endif
-        int enable = 1;
-        if (setsockopt(sock, IPPROTO_IP, IP_PKTINFO, (const char*) &enable, sizeof(enable))) {
+    }
+
+    if (bind(sock, (struct sockaddr *) &destAddr, sizeof(destAddr)) < 0) {
+        if (log) {
+            std::lock_guard<std::mutex> lock(logMutex);
+            log->strm(LOG_ERR) << ERR_SOCKET_BIND
+                << MSG_SPACE << ERR_MESSAGE << SOCKET_ERRNO;
+            log->flush();
+        }
+        shutdown(sock, 0);
+        close(sock);
+        if (reusePort)
+            stop(); // other workers must not wait forever
+        return ERR_CODE_SOCKET_BIND;
+    }
+    // read and write errors are logged, socket is kept until stop() called
+    serveSocket(sock);
+    shutdown(sock, 0);
+    close(sock);
+    return CODE_OK;
+}
+
+#ifdef UDP_LISTENER_POLL
+/**
+ * Wait until a datagram is queued or stop() called
+ * @param sock non-blocking socket
+ * @return false- stop() called
+ */
+bool UDPListener::waitReadable(
+    SOCKET sock
+)
+{
+    struct pollfd fds[2];
+    fds[0].fd = sock;
+    fds[0].events = POLLIN;
+    // negative descriptor is ignored
+    fds[1].fd = stopFds[0];
+    fds[1].events = POLLIN;
+    while (status != ERR_CODE_STOPPED) {
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+        int r = poll(fds, 2, stopFds[0] < 0 ? STOP_POLL_TIMEOUT_MS : -1);
+        if (r < 0) {
+            if (SOCKET_ERRNO == EINTR)
+                continue;
             if (log) {
-                log->strm(LOG_ERR) << ERR_SOCKET_SET
+                std::lock_guard<std::mutex> lock(logMutex);
+                log->strm(LOG_ERR) << ERR_SOCKET_READ
                     << MSG_SPACE << ERR_MESSAGE << SOCKET_ERRNO;
                 log->flush();
             }
+            return false;
         }
+        if (fds[1].revents)
+            return false;
+        // error is reported by the next read
+        if (fds[0].revents)
+            return true;
+    }
+    return false;
+}
+#endif
 
-        if (af == AF_INET6) {
-            // Note that by default IPV6 binds to both protocols, it must be disabled
-            // if both protocols used at the same time (used in CI)
-            int opt = 1;
-            setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*) &opt, sizeof(opt));
-            setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, (const char*) &opt, sizeof(opt));
-        }
-
-        // Set timeout
-#ifdef _MSC_VER
-        DWORD timeout = 1000;   // ms
+/**
+ * Answer requests received by the bound socket until stop() called
+ * @param sock bound socket, non-blocking or with receive timeout
+ */
+void UDPListener::serveSocket(
+    SOCKET sock
+)
+{
+#ifdef UDP_LISTENER_MMSG
+    runBatch(sock);
 #else
-        struct timeval timeout { 1, 0 };
+    struct sockaddr_storage source_addr{}; // Large enough for both IPv4 or IPv6
+    socklen_t socklen = sizeof(source_addr);
+
+    unsigned char rxBuf[RX_BUFFER_SIZE];
+    unsigned char rBuf[TX_BUFFER_SIZE];
+    while (status != ERR_CODE_STOPPED) {
+        ssize_t len = recvfrom(sock, (char*) rxBuf, sizeof(rxBuf) - 1, 0, (struct sockaddr*)&source_addr, & socklen);
+        // Error occurred during receiving
+        if (len < 0) {
+            if (SOCKET_ERRNO == SOCKET_ERROR_TIMEOUT) {    // timeout occurs or queue is drained
+#ifdef UDP_LISTENER_POLL
+                if (!waitReadable(sock))
+                    break;
 #endif
-        if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*) &timeout, sizeof timeout)) {
+                continue;
+            }
             if (log) {
-                log->strm(LOG_ERR) << ERR_SOCKET_SET
+                std::lock_guard<std::mutex> lock(logMutex);
+                log->strm(LOG_ERR) << ERR_SOCKET_READ
                     << MSG_SPACE << ERR_MESSAGE << SOCKET_ERRNO;
                 log->flush();
             }
+            continue;
+        } else {
+            // Data received
+            if (log && verbose > 1) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                log->strm(LOG_INFO) << MSG_RECEIVED << len << MSG_SPACE << MSG_BYTES << MSG_COLON_N_SPACE << hexString(rxBuf, len);
+                log->flush();
+            }
+            size_t sz;
+            if (len > 0) {
+                sz = query(rBuf, sizeof(rBuf), rxBuf, len);
+            } else
+                sz = 0;
+            if (sz > 0) {
+                if (sendto(sock, (const char *) rBuf, (int) sz, 0, (struct sockaddr *) &source_addr, sizeof(source_addr)) < 0) {
+                    if (log) {
+                        std::lock_guard<std::mutex> lock(logMutex);
+                        log->strm(LOG_ERR) << ERR_SOCKET_WRITE
+                            << MSG_SPACE << ERR_MESSAGE << SOCKET_ERRNO;
+                        log->flush();
+                    }
+                } else {
+                    if (log && verbose > 1) {
+                        std::lock_guard<std::mutex> lock(logMutex);
+                        log->strm(LOG_INFO) << MSG_SENT
+                            << sz << MSG_SPACE << MSG_BYTES << ": " << hexString(rBuf, sz);
+                        log->flush();
+                    }
+                }
+            } else {
+                if (log && verbose) {
+                    std::lock_guard<std::mutex> lock(logMutex);
+                    log->strm(LOG_ERR) << ERR_INVALID_PACKET << ": " << hexString(rxBuf, len)
+                        << " (" << len << MSG_SPACE << MSG_BYTES << ")";
+                    log->flush();
+                }
+            }
         }
+    }
+#endif
+}
 
-        if (bind(sock, (struct sockaddr *) &destAddr, sizeof(destAddr)) < 0) {
-            if (log) {
-                log->strm(LOG_ERR) << ERR_SOCKET_BIND
+#ifdef UDP_LISTENER_MMSG
+/**
+ * Receive up to UDP_BATCH_SIZE datagrams by one recvmmsg() call, query each one and send all responses by sendmmsg().
+ * Wait by poll() when the socket queue is drained.
+ * @param sock bound non-blocking socket
+ */
+void UDPListener::runBatch(
+    int sock
+)
+{
+    const size_t rxSize = RX_BUFFER_SIZE;
+    const size_t txSize = TX_BUFFER_SIZE;
+    std::vector<unsigned char> rxBufs(UDP_BATCH_SIZE * rxSize);
+    std::vector<unsigned char> txBufs(UDP_BATCH_SIZE * txSize);
+    struct mmsghdr rxMsgs[UDP_BATCH_SIZE];
+    struct mmsghdr txMsgs[UDP_BATCH_SIZE];
+    struct iovec rxIov[UDP_BATCH_SIZE];
+    struct iovec txIov[UDP_BATCH_SIZE];
+    struct sockaddr_storage addrs[UDP_BATCH_SIZE];
+    memset(rxMsgs, 0, sizeof(rxMsgs));
+    memset(txMsgs, 0, sizeof(txMsgs));
+    for (int i = 0; i < UDP_BATCH_SIZE; i++) {
+        rxIov[i].iov_base = &rxBufs[i * rxSize];
+        rxIov[i].iov_len = rxSize - 1;
+        rxMsgs[i].msg_hdr.msg_iov = &rxIov[i];
+        rxMsgs[i].msg_hdr.msg_iovlen = 1;
+        rxMsgs[i].msg_hdr.msg_name = &addrs[i];
+        txMsgs[i].msg_hdr.msg_iov = &txIov[i];
+        txMsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    bool hasNewStats = false;
+    bool drained = false;
+    while (status != ERR_CODE_STOPPED) {
+        if (drained) {
+            // report batch sizes when burst is over
+            if (hasNewStats && log && verbose > 1)
+                logBatchStats();
+            hasNewStats = false;
+            if (!waitReadable(sock))
+                break;
+            drained = false;
+        }
+        for (int i = 0; i < UDP_BATCH_SIZE; i++)
+            rxMsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        // take what is already queued, socket is non-blocking
+        int n = recvmmsg(sock, rxMsgs, UDP_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+        if (n <= 0) {
+            drained = true;
+            if (n < 0 && SOCKET_ERRNO != SOCKET_ERROR_TIMEOUT && SOCKET_ERRNO != EINTR && log) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                log->strm(LOG_ERR) << ERR_SOCKET_READ
                     << MSG_SPACE << ERR_MESSAGE << SOCKET_ERRNO;
                 log->flush();
             }
-            shutdown(sock, 0);
-            close(sock);
-            return ERR_CODE_SOCKET_BIND;
+            continue;
         }
-        struct sockaddr_storage source_addr{}; // Large enough for both IPv4 or IPv6
-        socklen_t socklen = sizeof(source_addr);
-
-        // 307 bytes for IPv4 up to 18, IPv6 up to 10
-        unsigned char rBuf[2048];
-        while (status != ERR_CODE_STOPPED) {
-            ssize_t len = recvfrom(sock, (char*) rxBuf, sizeof(rxBuf) - 1, 0, (struct sockaddr*)&source_addr, & socklen);
-            // Error occurred during receiving
-            if (len < 0) {
-                if (SOCKET_ERRNO == SOCKET_ERROR_TIMEOUT) {    // timeout occurs
-                    continue;
+        batchCount[31 - __builtin_clz((unsigned) n)].fetch_add(1, std::memory_order_relaxed);
+        hasNewStats = true;
+        // short batch: queue is empty, wait by poll() instead of the recvmmsg() which returns EAGAIN
+        drained = n < UDP_BATCH_SIZE;
+
+        int replies = 0;
+        for (int i = 0; i < n; i++) {
+            unsigned char *rx = &rxBufs[i * rxSize];
+            size_t len = rxMsgs[i].msg_len;
+            if (log && verbose > 1) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                log->strm(LOG_INFO) << MSG_RECEIVED << len << MSG_SPACE << MSG_BYTES << MSG_COLON_N_SPACE << hexString(rx, len);
+                log->flush();
+            }
+            unsigned char *tx = &txBufs[replies * txSize];
+            size_t sz = len > 0 ? query(tx, txSize, rx, len) : 0;
+            if (sz == 0) {
+                if (log && verbose) {
+                    std::lock_guard<std::mutex> lock(logMutex);
+                    log->strm(LOG_ERR) << ERR_INVALID_PACKET << ": " << hexString(rx, len)
+                        << " (" << len << MSG_SPACE << MSG_BYTES << ")";
+                    log->flush();
                 }
+                continue;
+            }
+            txIov[replies].iov_base = tx;
+            txIov[replies].iov_len = sz;
+            txMsgs[replies].msg_hdr.msg_name = &addrs[i];
+            txMsgs[replies].msg_hdr.msg_namelen = rxMsgs[i].msg_hdr.msg_namelen;
+            replies++;
+        }
+
+        int sent = 0;
+        while (sent < replies) {
+            int c = sendmmsg(sock, txMsgs + sent, replies - sent, 0);
+            if (c < 0) {
+                if (SOCKET_ERRNO == EINTR)
+                    continue;
                 if (log) {
-                    log->strm(LOG_ERR) << ERR_SOCKET_READ
+                    std::lock_guard<std::mutex> lock(logMutex);
+                    log->strm(LOG_ERR) << ERR_SOCKET_WRITE
                         << MSG_SPACE << ERR_MESSAGE << SOCKET_ERRNO;
                     log->flush();
                 }
-                continue;
-            } else {
-                // Data received
-                if (log && verbose > 1) {
-                    log->strm(LOG_INFO) << MSG_RECEIVED << len << MSG_SPACE << MSG_BYTES << MSG_COLON_N_SPACE << hexString(rxBuf, len);
+                break;
+            }
+            if (log && verbose > 1) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                for (int i = sent; i < sent + c; i++) {
+                    log->strm(LOG_INFO) << MSG_SENT << txIov[i].iov_len << MSG_SPACE << MSG_BYTES << ": "
+                        << hexString(txIov[i].iov_base, txIov[i].iov_len);
                     log->flush();
                 }
-                size_t sz;
-                if (len > 0) {
-                    sz = identitySerialization->query(rBuf, sizeof(rBuf), rxBuf, len);
-                    if (sz == 0) {
-                        sz = gatewaySerialization->query(rBuf, sizeof(rBuf), rxBuf, len);
-                    }
-                } else
-                    sz = 0;
-                if (sz > 0) {
-                    if (sendto(sock, (const char *) rBuf, (int) sz, 0, (struct sockaddr *) &source_addr, sizeof(source_addr)) < 0) {
-                        if (log) {
-                            log->strm(LOG_ERR) << ERR_SOCKET_WRITE
-                                << MSG_SPACE << ERR_MESSAGE << SOCKET_ERRNO;
-                            log->flush();
-                        }
-                    } else {
-                        if (log && verbose > 1) {
-                            log->strm(LOG_INFO) << MSG_SENT
-                                << sz << MSG_SPACE << MSG_BYTES << ": " << hexString(rBuf, sz);
-                            log->flush();
-                        }
-                    }
-                } else {
-                    if (log && verbose) {
-                        log->strm(LOG_ERR) << ERR_INVALID_PACKET << ": " << hexString(rxBuf, len)
-                            << " (" << len << MSG_SPACE << MSG_BYTES << ")";
-                        log->flush();
-                    }
-                }
             }
+            sent += c;
         }
-        shutdown(sock, 0);
-        close(sock);
     }
-    return r;
+}
+#endif
+
+void UDPListener::logBatchStats()
+{
+    std::vector<uint64_t> h;
+    batchStats(h);
+    std::lock_guard<std::mutex> lock(logMutex);
+    std::ostream &strm = log->strm(LOG_INFO);
+    strm << MSG_BATCH_SIZES;
+    for (size_t i = 0; i < h.size(); i++) {
+        strm << (1 << i);
+        if (i > 0 && i + 1 < h.size())
+            strm << ".." << (2 << i) - 1;
+        strm << MSG_COLON_N_SPACE << h[i] << MSG_SPACE;
+    }
+    log->flush();
+}
+
+void UDPListener::batchStats(
+    std::vector<uint64_t> &retVal
+) const
+{
+    retVal.clear();
+    for (int i = 0; i < UDP_BATCH_HISTOGRAM; i++)
+        retVal.push_back(batchCount[i].load(std::memory_order_relaxed));
 }
 
 UDPListener::~UDPListener()
 {
 	stop();
+    if (stopFds[1] >= 0 && stopFds[1] != stopFds[0])
+        close(stopFds[1]);
+    if (stopFds[0] >= 0)
+        close(stopFds[0]);
 }
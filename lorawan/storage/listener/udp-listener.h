@@ -2,21 +2,66 @@
 #define UDP_LISTENER_H_	1
 
 #include <string>
+#include <atomic>
+#include <mutex>
+#include <vector>
 #if defined(_MSC_VER) || defined(__MINGW32__)
 #include <WinSock2.h>
 #else
 #include <sys/socket.h>
 #endif
 
+#include "lorawan/helper/ip-address.h"
 #include "lorawan/storage/listener/storage-listener.h"
 
+#if !defined(_MSC_VER) && !defined(__MINGW32__) && !defined(ESP_PLATFORM)
+// non-blocking sockets, wait for datagrams and stop() by poll(), otherwise check stop once a second by receive timeout
+#define UDP_LISTENER_POLL   1
+#endif
+#if defined(__linux__) && defined(UDP_LISTENER_POLL)
+// receive and send datagrams in batches by recvmmsg()/sendmmsg()
+#define UDP_LISTENER_MMSG   1
+#endif
+// max datagrams per recvmmsg() call
+#define UDP_BATCH_SIZE      32
+// batch size histogram buckets: 1, 2..3, 4..7, 8..15, 16..31, 32
+#define UDP_BATCH_HISTOGRAM 6
+
 class UDPListener : public StorageListener {
 private:
     struct sockaddr destAddr;
+    // serialize calls of not thread-safe services
+    std::mutex identityMutex;
+    std::mutex gatewayMutex;
+    std::atomic<uint64_t> batchCount[UDP_BATCH_HISTOGRAM];
+    // eventfd or self-pipe read and write ends, readable after stop() called
+    int stopFds[2];
+    int runWorker(bool reusePort);
+    void logBatchStats();
+#ifdef UDP_LISTENER_POLL
+    bool waitReadable(SOCKET sock);
+#endif
+#ifdef UDP_LISTENER_MMSG
+    void runBatch(int sock);
+#endif
+protected:
     Log *log;
     int verbose;
+    // serialize log output of workers
+    std::mutex logMutex;
+    size_t query(unsigned char *retBuf, size_t retSize, const unsigned char *request, size_t sz) override;
+    /**
+     * Descriptor which becomes readable when stop() called, workers wait on it with the socket
+     * @return -1 if not available
+     */
+    int stopEvent() const;
+    /**
+     * Answer requests received by the socket until stop() called. Called by each worker.
+     * @param sock bound socket, non-blocking if UDP_LISTENER_POLL defined
+     */
+    virtual void serveSocket(SOCKET sock);
 public:
-    int status; // ERR_CODE_STOPPED - stop request
+    std::atomic<int> status; // ERR_CODE_STOPPED - stop request
     explicit UDPListener(
         IdentitySerialization *aIdentitySerialization,
         GatewaySerialization *aSerializationWrapper
@@ -33,6 +78,17 @@ public:
     int run() override;
     void stop() override;
     void setLog(int verbose, Log *log) override;
+    /**
+     * Run count workers, each with own SO_REUSEPORT socket bound to the same address
+     * @param count workers count, 1- single socket in the caller thread
+     */
+    void setThreadCount(int count) override;
+    /**
+     * Return how many recvmmsg() calls returned 1, 2..3, 4..7, 8..15, 16..31, 32 datagrams.
+     * All zeroes if batched I/O is not available.
+     * @param retVal histogram
+     */
+    void batchStats(std::vector<uint64_t> &retVal) const;
 };
 
 #endif
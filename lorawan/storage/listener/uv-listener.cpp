@@ -1,8 +1,14 @@
 #include "uv-listener.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
 
 #include <uv.h>
+// before SOCKET definition below
+#include "lorawan/helper/ip-address.h"
 #ifdef ENABLE_DEBUG
 #include <iostream>
 #include "lorawan-msg.h"
@@ -16,18 +22,132 @@
 #else
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <unistd.h>
 #define SOCKET int
 #endif
 
+#include "lorawan/helper/buffer-pool.h"
 #include "lorawan/helper/uv-mem.h"
 #include "lorawan/helper/ip-helper.h"
 #include "lorawan/lorawan-string.h"
 #include "lorawan/lorawan-error.h"
+#include "lorawan/storage/serialization/identity-binary-serialization.h"
 
 #define DEF_KEEPALIVE_SECS 60
 
-// 307 bytes for IPv4 up to 18, IPv6 up to 10
-#define WRITE_BUFFER_SIZE 1432
+// batch response is the longest one
+#define WRITE_BUFFER_SIZE SIZE_BATCH_RESPONSE_MAX
+// libuv suggests 64K
+#define READ_BUFFER_SIZE (64 * 1024)
+// larger response buffer is freed instead of going back to the pool
+#define POOLED_RESPONSES_MAX (1024 * 1024)
+// list after frames sent by one write
+#define TCP_STREAM_WRITE_SIZE (64 * 1024)
+
+/**
+ * UDP response and its send request, lives until the send callback
+ */
+typedef struct {
+    uv_udp_send_t req;
+    unsigned char buffer[WRITE_BUFFER_SIZE];
+} UDP_SEND;
+
+/**
+ * TCP responses of one read and the write request, lives until the write callback.
+ * Response vector keeps its capacity in the pool.
+ */
+class TCPWrite {
+public:
+    uv_write_t req;
+    std::vector<unsigned char> responses;
+    // reading is stopped, write callback answers the rest of the list after request
+    bool resume;
+};
+
+/**
+ * Buffers and requests reused by the loop, nothing is allocated per request after the warm-up
+ */
+class UVListenerPools {
+public:
+    BlockPool readBuffers;
+    BlockPool udpSends;
+    ObjectPool<TCPWrite> tcpWrites;
+    UVListenerPools()
+        : readBuffers(READ_BUFFER_SIZE), udpSends(sizeof(UDP_SEND))
+    {
+    }
+};
+
+/**
+ * Event loop with own sockets and pools, each loop is run by one thread
+ */
+class UVLoop {
+public:
+    UVListener *listener;
+    uv_loop_t *loop;
+    uv_loop_t ownLoop;
+    uv_tcp_t tcpSocket;
+    uv_udp_t udpSocket;
+    // wakes up the loop to close handles
+    uv_async_t stopSignal;
+    // stopSignal is sent by stop(), loop passes it to the other loops
+    bool forwardStop;
+    std::atomic<bool> running;
+    UVListenerPools pools;
+    int status;
+
+    /**
+     * @param aListener listener
+     * @param defaultLoop true- use libuv default loop, false- own loop
+     */
+    UVLoop(
+        UVListener *aListener,
+        bool defaultLoop
+    )
+        : listener(aListener), forwardStop(defaultLoop), running(false), status(CODE_OK)
+    {
+        if (defaultLoop)
+            loop = uv_default_loop();
+        else {
+            uv_loop_init(&ownLoop);
+            loop = &ownLoop;
+        }
+        loop->data = this;
+    }
+};
+
+static UVListenerPools *loopPools(
+    uv_loop_t *loop
+)
+{
+    return &((UVLoop *) loop->data)->pools;
+}
+
+static UVListener *loopListener(
+    uv_loop_t *loop
+)
+{
+    return ((UVLoop *) loop->data)->listener;
+}
+
+static void allocReadBuffer(
+    uv_handle_t *handle,
+    size_t suggestedSize,
+    uv_buf_t *buf
+)
+{
+    auto pools = loopPools(handle->loop);
+    buf->base = (char *) pools->readBuffers.alloc();
+    buf->len = (unsigned long) (std::min)(suggestedSize, pools->readBuffers.blockSize());
+}
+
+static void freeReadBuffer(
+    uv_handle_t *handle,
+    const uv_buf_t *buf
+)
+{
+    loopPools(handle->loop)->readBuffers.release(buf->base);
+}
 
 static void getAddrNPort(
 	uv_tcp_t *stream,
@@ -105,29 +225,152 @@ static void onUDPRead(
                   << MSG_SPACE << MSG_OPAREN << host << ":" << port
                   << MSG_SPACE << bytesRead << MSG_SPACE << MSG_BYTES << MSG_CPAREN << std::endl;
 #endif
-            // 307 bytes for IPv4 up to 18, IPv6 up to 10
-            unsigned char writeBuffer[WRITE_BUFFER_SIZE];
-            size_t sz = ((UVListener*) handle->loop->data)->identitySerialization->query(writeBuffer,
-                sizeof(writeBuffer), (const unsigned char *) buf->base, bytesRead);
-            if (sz == 0) {
-                sz = ((UVListener*) handle->loop->data)->gatewaySerialization->query(writeBuffer,
-                    sizeof(writeBuffer), (const unsigned char *) buf->base, bytesRead);
-            }
+            auto pools = loopPools(handle->loop);
+            auto send = (UDP_SEND *) pools->udpSends.alloc();
+            size_t sz = loopListener(handle->loop)->query(send->buffer,
+                sizeof(send->buffer), (const unsigned char *) buf->base, bytesRead);
             if (sz > 0) {
-                uv_buf_t wrBuf = uv_buf_init((char *) writeBuffer, (unsigned int) sz);
-                auto req = (uv_udp_send_t *) malloc(sizeof(uv_udp_send_t));
-                if (req) {
-                    req->data = writeBuffer; // to free up if need it
-                    uv_udp_send(req, handle, &wrBuf, 1, addr,
-                        [](uv_udp_send_t* req, int status) {
-                            if (req)
-                                free(req);
-                        });
-                }
-            }
+                // buffer is returned to the pool when sent
+                uv_buf_t wrBuf = uv_buf_init((char *) send->buffer, (unsigned int) sz);
+                send->req.data = send;
+                if (uv_udp_send(&send->req, handle, &wrBuf, 1, addr,
+                    [](uv_udp_send_t* req, int status) {
+                        loopPools(req->handle->loop)->udpSends.release(req->data);
+                    }))
+                    pools->udpSends.release(send);
+            } else
+                pools->udpSends.release(send);
         }
     }
-	freeBuffer(buf);
+	freeReadBuffer((uv_handle_t *) handle, buf);
+}
+
+/**
+ * TCP connection state, client handle data
+ */
+class TCPConnection {
+public:
+    // mode is known after the first byte is read
+    bool started;
+    // requests are length prefixed
+    bool framed;
+    // incomplete request frame, requests waiting for the list after answer
+    std::vector<unsigned char> pending;
+    // list after request answered by the next writes
+    ListAfterCursor cursor;
+    bool reading;
+    TCPConnection()
+        : started(false), framed(false), reading(true)
+    {
+    }
+};
+
+static void onCloseConnection(
+    uv_handle_t *handle
+)
+{
+    delete (TCPConnection *) handle->data;
+    onCloseClient(handle);
+}
+
+static void onReadTCP(
+	uv_stream_t *client,
+	ssize_t readCount,
+	const uv_buf_t *buf
+);
+
+static void releaseTCPWrite(
+    UVListenerPools *pools,
+    TCPWrite *w
+)
+{
+    if (w->responses.capacity() > POOLED_RESPONSES_MAX)
+        std::vector<unsigned char>().swap(w->responses);
+    pools->tcpWrites.release(w);
+}
+
+static void continueTCP(
+    uv_stream_t *client
+);
+
+static void onWriteTCP(
+    uv_write_t *req,
+    int status
+)
+{
+    auto w = (TCPWrite *) req->data;
+    bool resume = w->resume;
+    uv_stream_t *client = req->handle;
+    releaseTCPWrite(loopPools(client->loop), w);
+    // canceled by closing connection
+    if (!resume || uv_is_closing((uv_handle_t *) client))
+        return;
+    if (status < 0) {
+        uv_close((uv_handle_t *) client, onCloseConnection);
+        return;
+    }
+    continueTCP(client);
+}
+
+/**
+ * Write responses. While list after frames are streamed, reading is stopped and one write is in flight,
+ * its callback answers the next frames.
+ */
+static void writeTCP(
+    uv_stream_t *client,
+    TCPWrite *w
+)
+{
+    auto connection = (TCPConnection *) client->data;
+    auto pools = loopPools(client->loop);
+    if (connection->cursor.active) {
+        if (connection->reading) {
+            uv_read_stop(client);
+            connection->reading = false;
+        }
+    } else {
+        if (!connection->reading) {
+            uv_read_start(client, allocReadBuffer, onReadTCP);
+            connection->reading = true;
+        }
+    }
+    if (w->responses.empty()) {
+        pools->tcpWrites.release(w);
+        return;
+    }
+    w->resume = !connection->reading;
+    w->req.data = w;
+    uv_buf_t writeBuf = uv_buf_init((char *) w->responses.data(), (unsigned int) w->responses.size());
+    if (uv_write(&w->req, client, &writeBuf, 1, onWriteTCP)) {
+        releaseTCPWrite(pools, w);
+        // stream can not continue
+        uv_close((uv_handle_t *) client, onCloseConnection);
+    }
+}
+
+/**
+ * Answer next list after frames, then requests read with the list after request
+ */
+static void continueTCP(
+    uv_stream_t *client
+)
+{
+    auto listener = loopListener(client->loop);
+    auto connection = (TCPConnection *) client->data;
+    auto pools = loopPools(client->loop);
+    auto w = pools->tcpWrites.alloc();
+    w->responses.clear();
+    while (connection->cursor.active && w->responses.size() < TCP_STREAM_WRITE_SIZE) {
+        listener->queryNext(w->responses, connection->cursor, connection->framed);
+    }
+    if (!connection->cursor.active && connection->framed && !connection->pending.empty()) {
+        if (listener->queryFrames(w->responses, connection->pending, nullptr, 0, &connection->cursor) != CODE_OK) {
+            pools->tcpWrites.release(w);
+            uv_close((uv_handle_t *) client, onCloseConnection);
+            return;
+        }
+    }
+    writeTCP(client, w);
 }
 
 static void onReadTCP(
@@ -144,7 +387,7 @@ static void onReadTCP(
 #endif			
 		}
 		// client disconnected, close socket
-		uv_close((uv_handle_t *)client, onCloseClient);
+		uv_close((uv_handle_t *)client, onCloseConnection);
 	} else {
 #ifdef ENABLE_DEBUG
         std::string addr;
@@ -155,29 +398,36 @@ static void onReadTCP(
             << MSG_SPACE << MSG_OPAREN << "TCP " << addr << ":" << port << MSG_SPACE << readCount
             << MSG_SPACE << MSG_BYTES << MSG_CPAREN << std::endl;
 #endif
-        unsigned char writeBuffer[WRITE_BUFFER_SIZE];
-        size_t sz = ((UVListener*) client->loop->data)->identitySerialization->query(writeBuffer,
-            sizeof(writeBuffer), (const unsigned char *) buf->base, readCount);
-        if (sz == 0) {
-            sz = ((UVListener*) client->loop->data)->gatewaySerialization->query(writeBuffer,
-                sizeof(writeBuffer), (const unsigned char *) buf->base, readCount);
-        }
-        if (sz > 0) {
-			uv_write_t *req = allocReq();
-			uv_buf_t writeBuf = uv_buf_init((char *) writeBuffer, (unsigned int) sz);
-			req->data = writeBuffer; // to free up if required
-			uv_write(req, client, &writeBuf, 1,
-                 [](uv_write_t *req, int status) {
-                     if (req)
-                         free(req);
-                }
-            );
+        auto listener = loopListener(client->loop);
+        auto connection = (TCPConnection *) client->data;
+        if (!connection->started) {
+            connection->started = true;
+            connection->framed = buf->base[0] == '\0';
         }
+        // responses to all requests of the read, returned to the pool when written
+        auto pools = loopPools(client->loop);
+        auto w = pools->tcpWrites.alloc();
+        w->responses.clear();
+        // list after request is answered by the first frame, next ones are answered by the write callbacks
+        if (connection->framed) {
+            // coalesced and split requests
+            if (listener->queryFrames(w->responses, connection->pending,
+                (const unsigned char *) buf->base, (size_t) readCount, &connection->cursor) != CODE_OK) {
+                pools->tcpWrites.release(w);
+                uv_close((uv_handle_t *)client, onCloseConnection);
+                freeReadBuffer((uv_handle_t *) client, buf);
+                return;
+            }
+        } else
+            listener->queryResponses(w->responses, (const unsigned char *) buf->base, (size_t) readCount, false,
+                &connection->cursor);
+        // one write for all responses
+        writeTCP(client, w);
         bool keepalive = true;
         if (!keepalive)
-            uv_close((uv_handle_t *)client, onCloseClient);
+            uv_close((uv_handle_t *)client, onCloseConnection);
 	}
-    freeBuffer(buf);
+    freeReadBuffer((uv_handle_t *) client, buf);
 }
 
 static void onConnect(
@@ -193,17 +443,66 @@ static void onConnect(
 	}
 	uv_tcp_t *client = allocClient();
 	uv_tcp_init(server->loop, client);
+    client->data = new TCPConnection;
     uv_tcp_keepalive(client, 1, DEF_KEEPALIVE_SECS);
 #ifdef ENABLE_DEBUG
     std::cerr << MSG_CONNECTED << std::endl;
 #endif
     if (uv_accept(server, (uv_stream_t *)client) == 0) {
-		uv_read_start((uv_stream_t *)client, allocBuffer, onReadTCP);
+		uv_read_start((uv_stream_t *)client, allocReadBuffer, onReadTCP);
 	} else {
-		uv_close((uv_handle_t *)client, onCloseClient);
+		uv_close((uv_handle_t *)client, onCloseConnection);
 	}
 }
 
+/**
+ * Close sockets and connections of the loop, uv_run() returns when all handles are closed
+ */
+static void closeHandles(
+    UVLoop *l
+)
+{
+    uv_walk(l->loop, [](uv_handle_t* handle, void* arg) {
+        auto l = (UVLoop *) arg;
+        if (uv_is_closing(handle))
+            return;
+        if (handle == (uv_handle_t *) &l->tcpSocket || handle == (uv_handle_t *) &l->udpSocket
+            || handle == (uv_handle_t *) &l->stopSignal)
+            uv_close(handle, nullptr);
+        else
+            // accepted connection
+            uv_close(handle, onCloseConnection);
+    }, l);
+}
+
+#ifdef SO_REUSEPORT
+/**
+ * Create socket with SO_REUSEPORT bound to the address, each loop binds own socket
+ * and kernel spreads datagrams and connections between them
+ * @param addr address
+ * @param type SOCK_STREAM or SOCK_DGRAM
+ * @return socket, -1 if failed
+ */
+static int reusePortSocket(
+    const struct sockaddr *addr,
+    int type
+)
+{
+    int sock = socket(addr->sa_family, type, 0);
+    if (sock < 0)
+        return -1;
+    int opt = 1;
+    socklen_t len = addr->sa_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))
+        || setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))
+        || bind(sock, addr, len)) {
+        ::close(sock);
+        return -1;
+    }
+    return sock;
+}
+#endif
+
 /**
  * @see https://habr.com/ru/post/340758/
  */
@@ -211,34 +510,78 @@ UVListener::UVListener(
     IdentitySerialization *aIdentitySerialization,
     GatewaySerialization *aSerializationWrapper
 )
-	: StorageListener(aIdentitySerialization, aSerializationWrapper), status(CODE_OK), log(nullptr), verbose(0)
+	: StorageListener(aIdentitySerialization, aSerializationWrapper), log(nullptr), verbose(0),
+    signalLoop(nullptr), status(CODE_OK)
+{
+}
+
+void UVListener::setThreadCount(
+    int count
+)
 {
-	uv_loop_t *loop = uv_default_loop();
-    loop->data = this;
-    uv = (void *) loop;
+#ifdef SO_REUSEPORT
+    StorageListener::setThreadCount(count);
+#else
+    // sockets can not share the same port
+    StorageListener::setThreadCount(1);
+#endif
 }
 
-// http://stackoverflow.com/questions/25615340/closing-libuv-handles-correctly
+/**
+ * Call identity or gateway serialization chosen by the request tag.
+ * Services which are not thread-safe are called by one loop at a time.
+ * @return response size, 0- invalid request
+ */
+size_t UVListener::query(
+    unsigned char *retBuf,
+    size_t retSize,
+    const unsigned char *request,
+    size_t sz
+)
+{
+    if (threadCount <= 1)
+        return StorageListener::query(retBuf, retSize, request, sz);
+    STORAGE_ROUTE r = route(request, sz);
+    size_t rsz = 0;
+    if (r == STORAGE_ROUTE_IDENTITY || r == STORAGE_ROUTE_ANY) {
+        if (!(identitySerialization->svc && identitySerialization->svc->isThreadSafe())) {
+            std::lock_guard<std::mutex> lock(identityMutex);
+            rsz = identitySerialization->query(retBuf, retSize, request, sz);
+        } else
+            rsz = identitySerialization->query(retBuf, retSize, request, sz);
+    }
+    if (rsz == 0 && (r == STORAGE_ROUTE_GATEWAY || r == STORAGE_ROUTE_ANY) && gatewaySerialization) {
+        std::lock_guard<std::mutex> lock(gatewayMutex);
+        rsz = gatewaySerialization->query(retBuf, retSize, request, sz);
+    }
+    return rsz;
+}
+
+/**
+ * Called by SIGINT handler, so it takes no locks: atomic store and uv_async_send() only.
+ * Loop which has not published its stop signal yet sees the flag before uv_run().
+ */
 void UVListener::stop()
 {
-	auto *uvLoop = (uv_loop_t *) uv;
-    if (!uvLoop || status == ERR_CODE_STOPPED)
+    if (status == ERR_CODE_STOPPED)
         return;
     status = ERR_CODE_STOPPED;
-    uv_stop(uvLoop);
-    int result = uv_loop_close(uvLoop);
-
-	if (result == UV_EBUSY && uv_loop_alive(uvLoop)) {
-		uv_walk(uvLoop, [](uv_handle_t* handle, void* arg) {
-			if (handle->loop && !uv_is_closing(handle))
-				uv_close(handle, nullptr);
-			}, nullptr);
-		int r;
-		do {
-			r = uv_run(uvLoop, UV_RUN_ONCE);
-		} while (r != 0);
-        uv_loop_close(uvLoop);
-	}
+    UVLoop *l = signalLoop.load();
+    if (l)
+        uv_async_send(&l->stopSignal);
+}
+
+/**
+ * Ask each running loop to close its handles, loops return from uv_run().
+ * uv_async_send() is the only libuv call which is safe from other threads.
+ */
+void UVListener::stopLoops()
+{
+    std::lock_guard<std::mutex> lock(loopsMutex);
+    for (auto l : loops) {
+        if (l->running)
+            uv_async_send(&l->stopSignal);
+    }
 }
 
 void UVListener::setAddress(
@@ -263,46 +606,124 @@ void UVListener::setAddress(
     a->sin_port = htons(port);
 }
 
-int UVListener::run()
+/**
+ * Bind TCP and UDP sockets of the loop and run it until stop()
+ * @param l loop
+ * @param reusePort true- each loop binds own sockets with SO_REUSEPORT
+ * @return CODE_OK- success
+ */
+int UVListener::runLoop(
+    UVLoop *l,
+    bool reusePort
+)
 {
-	auto *loop = (uv_loop_t *) uv;
 	// TCP
-	uv_tcp_t tcpSocket;
-	uv_tcp_init(loop, &tcpSocket);
-    uv_tcp_keepalive(&tcpSocket, 1, DEF_KEEPALIVE_SECS);
-	uv_tcp_bind(&tcpSocket, (const struct sockaddr *)&servaddr, 0);
-	int r = uv_listen((uv_stream_t *) &tcpSocket, 128, onConnect);
+	uv_tcp_init(l->loop, &l->tcpSocket);
+	uv_udp_init(l->loop, &l->udpSocket);
+    uv_async_init(l->loop, &l->stopSignal, [](uv_async_t *handle) {
+        auto l = (UVLoop *) handle->loop->data;
+        if (l->forwardStop)
+            l->listener->stopLoops();
+        closeHandles(l);
+    });
+    if (l->forwardStop)
+        signalLoop = l;
+    int r;
+#ifdef SO_REUSEPORT
+    if (reusePort) {
+        int sock = reusePortSocket(&servaddr, SOCK_STREAM);
+        r = sock < 0 ? UV_EADDRINUSE : uv_tcp_open(&l->tcpSocket, sock);
+    } else
+#endif
+	r = uv_tcp_bind(&l->tcpSocket, (const struct sockaddr *)&servaddr, 0);
+    uv_tcp_keepalive(&l->tcpSocket, 1, DEF_KEEPALIVE_SECS);
+    if (!r)
+	    r = uv_listen((uv_stream_t *) &l->tcpSocket, 128, onConnect);
 	if (r) {
 #ifdef ENABLE_DEBUG
 		std::cerr << ERR_SOCKET_LISTEN << uv_strerror(r) << std::endl;
 #endif		
-		status = ERR_CODE_SOCKET_LISTEN;
-		return ERR_CODE_SOCKET_LISTEN;
+		l->status = ERR_CODE_SOCKET_LISTEN;
 	}
 
 	// UDP
-	uv_udp_t udpSocket;
-	uv_udp_init(loop, &udpSocket);
-	r = uv_udp_bind(&udpSocket, (const struct sockaddr *)&servaddr, UV_UDP_REUSEADDR);
-    if (r) {
+    if (!l->status) {
+#ifdef SO_REUSEPORT
+        if (reusePort) {
+            int sock = reusePortSocket(&servaddr, SOCK_DGRAM);
+            r = sock < 0 ? UV_EADDRINUSE : uv_udp_open(&l->udpSocket, sock);
+        } else
+#endif
+	    r = uv_udp_bind(&l->udpSocket, (const struct sockaddr *)&servaddr, UV_UDP_REUSEADDR);
+        if (r) {
 #ifdef ENABLE_DEBUG
-        std::cerr << ERR_SOCKET_BIND << uv_strerror(r) << std::endl;
+            std::cerr << ERR_SOCKET_BIND << uv_strerror(r) << std::endl;
 #endif
-        status = ERR_CODE_SOCKET_BIND;
-        return ERR_CODE_SOCKET_BIND;
+            l->status = ERR_CODE_SOCKET_BIND;
+        }
     }
-	uv_udp_set_broadcast(&udpSocket, 1);
-	r = uv_udp_recv_start(&udpSocket, allocBuffer, onUDPRead);
-	if (r) {
+    if (!l->status) {
+	    uv_udp_set_broadcast(&l->udpSocket, 1);
+	    r = uv_udp_recv_start(&l->udpSocket, allocReadBuffer, onUDPRead);
+	    if (r) {
 #ifdef ENABLE_DEBUG
-		std::cerr << ERR_SOCKET_LISTEN << uv_strerror(r) << std::endl;
+		    std::cerr << ERR_SOCKET_LISTEN << uv_strerror(r) << std::endl;
 #endif
-		status = ERR_CODE_SOCKET_LISTEN;
-		return ERR_CODE_SOCKET_LISTEN;
-	}
-	status = CODE_OK;
-	uv_run(loop, UV_RUN_DEFAULT);
-    return status;
+		    l->status = ERR_CODE_SOCKET_LISTEN;
+	    }
+    }
+    if (l->status) {
+        // stop other loops too
+        status = ERR_CODE_STOPPED;
+        stopLoops();
+        closeHandles(l);
+    } else {
+        std::lock_guard<std::mutex> lock(loopsMutex);
+        l->running = true;
+        // stop() is called before the loop is running
+        if (status == ERR_CODE_STOPPED)
+            closeHandles(l);
+    }
+	uv_run(l->loop, UV_RUN_DEFAULT);
+    if (l->forwardStop)
+        signalLoop = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(loopsMutex);
+        l->running = false;
+    }
+    uv_loop_close(l->loop);
+    return l->status;
+}
+
+/**
+ * Run threadCount loops, first one in the caller thread with libuv default loop
+ */
+int UVListener::run()
+{
+    status = CODE_OK;
+    {
+        std::lock_guard<std::mutex> lock(loopsMutex);
+        for (int i = 0; i < threadCount; i++) {
+            loops.push_back(new UVLoop(this, i == 0));
+        }
+    }
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threadCount; i++) {
+        workers.emplace_back([this, i] {
+            runLoop(loops[i], true);
+        });
+    }
+    int r = runLoop(loops[0], threadCount > 1);
+    for (auto &w : workers)
+        w.join();
+    std::lock_guard<std::mutex> lock(loopsMutex);
+    for (auto l : loops) {
+        if (!r)
+            r = l->status;
+        delete l;
+    }
+    loops.clear();
+    return r;
 }
 
 /**
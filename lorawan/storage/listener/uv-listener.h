@@ -6,7 +6,10 @@
 typedef SSIZE_T ssize_t;
 #endif
 
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <vector>
 #if defined(_MSC_VER) || defined(__MINGW32__)
 #else
 #include <arpa/inet.h>
@@ -15,15 +18,24 @@ typedef SSIZE_T ssize_t;
 
 #include "storage-listener.h"
 
+class UVLoop;
+
 class UVListener : public StorageListener{
 private:
-    // libuv handler
-    void *uv;
     struct sockaddr servaddr;
     Log *log;
     int verbose;
+    // serialize calls of not thread-safe services when loops run in several threads
+    std::mutex identityMutex;
+    std::mutex gatewayMutex;
+    // loops created by run(), each has own sockets, buffers and send requests
+    std::mutex loopsMutex;
+    std::vector<UVLoop *> loops;
+    // loop which receives stop() from any thread or signal handler, nullptr if not running
+    std::atomic<UVLoop *> signalLoop;
+    int runLoop(UVLoop *loop, bool reusePort);
 public:
-    int status;
+    std::atomic<int> status; // ERR_CODE_STOPPED - stop request
     explicit UVListener(
             IdentitySerialization *aIdentitySerialization,
             GatewaySerialization *aSerializationWrapper
@@ -38,8 +50,21 @@ public:
         uint16_t port
     ) override;
     int run() override;
+    /**
+     * Set stop flag and wake up the first loop, it stops the others. Safe to call from a signal handler.
+     */
     void stop() override;
+    /**
+     * Ask all running loops to close handles. Takes the loops mutex, call it from a loop thread.
+     */
+    void stopLoops();
     void setLog(int verbose, Log *log) override;
+    /**
+     * Run count libuv loops in own threads, each with own SO_REUSEPORT TCP and UDP sockets bound to the same address
+     * @param count loops count, 1- single loop in the caller thread
+     */
+    void setThreadCount(int count) override;
+    size_t query(unsigned char *retBuf, size_t retSize, const unsigned char *request, size_t sz) override;
 };
 
 #endif
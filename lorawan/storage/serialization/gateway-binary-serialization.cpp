@@ -421,7 +421,6 @@ GatewayListResponse::GatewayListResponse(
 )
     : GatewayOperationResponse(buf, sz)       // 22
 {
-    deserializeGateway(buf, sz);
     size_t ofs = SIZE_OPERATION_RESPONSE;
     response = 0;
     while (true) {
@@ -523,6 +522,148 @@ size_t GatewayListResponse::shortenList2Fit(
     return r;
 }
 
+GatewayListAfterRequest::GatewayListAfterRequest()
+    : ServiceMessage(QUERY_GATEWAY_LIST_AFTER, 0, 0), flags(0), after(0), size(0)
+{
+}
+
+GatewayListAfterRequest::GatewayListAfterRequest(
+    const uint64_t *aAfter,
+    uint32_t aSize,
+    int32_t code,
+    uint64_t accessCode
+)
+    : ServiceMessage(QUERY_GATEWAY_LIST_AFTER, code, accessCode),
+      flags(aAfter ? GATEWAY_LIST_AFTER_FLAG_CURSOR : 0), after(aAfter ? *aAfter : 0), size(aSize)
+{
+}
+
+GatewayListAfterRequest::GatewayListAfterRequest(
+    const unsigned char *buf,
+    size_t sz
+)
+    : ServiceMessage(buf, sz), flags(0), after(0), size(0)  // 13
+{
+    if (sz >= SIZE_GATEWAY_LIST_AFTER_REQUEST) {
+        flags = buf[13];                                // 1
+        memmove(&after, &buf[14], sizeof(after));       // 8
+        memmove(&size, &buf[22], sizeof(size));         // 4
+    }   // 26
+}
+
+void GatewayListAfterRequest::ntoh() {
+    ServiceMessage::ntoh();
+    after = NTOH8(after);
+    size = NTOH4(size);
+}
+
+size_t GatewayListAfterRequest::serialize(
+    unsigned char *retBuf
+) const
+{
+    ServiceMessage::serialize(retBuf);                  // 13
+    if (retBuf) {
+        retBuf[13] = flags;                             // 1
+        memmove(&retBuf[14], &after, sizeof(after));    // 8
+        memmove(&retBuf[22], &size, sizeof(size));      // 4
+    }
+    return SIZE_GATEWAY_LIST_AFTER_REQUEST;             // 26
+}
+
+std::string GatewayListAfterRequest::toJsonString() const {
+    std::stringstream ss;
+    ss << "{";
+    if (flags & GATEWAY_LIST_AFTER_FLAG_CURSOR)
+        ss << R"("after": ")" << std::hex << after << std::dec << "\", ";
+    ss << R"("size": )" << size << "}";
+    return ss.str();
+}
+
+GatewayListAfterResponse::GatewayListAfterResponse()
+    : GatewayListResponse(), status(0), count(0), flags(0)
+{
+    tag = QUERY_GATEWAY_LIST_AFTER;
+}
+
+GatewayListAfterResponse::GatewayListAfterResponse(
+    const unsigned char *buf,
+    size_t sz
+)
+    : GatewayListResponse(), status(0), count(0), flags(0)
+{
+    ServiceMessage header(buf, sz);     // 13
+    tag = header.tag;
+    code = header.code;
+    accessCode = header.accessCode;
+    if (sz < SIZE_GATEWAY_LIST_AFTER_RESPONSE)
+        return;
+    memmove(&status, &buf[13], sizeof(status));     // 4
+    memmove(&count, &buf[17], sizeof(count));       // 4
+    flags = buf[21];                                // 1
+    size_t ofs = SIZE_GATEWAY_LIST_AFTER_RESPONSE;
+    response = 0;
+    while (ofs + sizeof(uint64_t) <= sz) {
+        GatewayIdentity gi;
+        memmove(&gi.gatewayId, &buf[ofs], sizeof(uint64_t));  // 8
+        ofs += 8;
+        ofs += deserializeSocketAddress(&gi.sockaddr, &buf[ofs], sz - ofs); // 0, 7, 19
+        identities.push_back(gi);
+        response++;
+    }
+}
+
+void GatewayListAfterResponse::ntoh()
+{
+    ServiceMessage::ntoh();
+    status = NTOH4(status);
+    count = NTOH4(count);
+    for (auto &it : identities) {
+        it.gatewayId = NTOH8(it.gatewayId);
+        sockaddrNtoh(&it.sockaddr);
+    }
+}
+
+size_t GatewayListAfterResponse::serialize(
+    unsigned char *retBuf
+) const
+{
+    ServiceMessage::serialize(retBuf);                  // 13
+    size_t ofs = SIZE_GATEWAY_LIST_AFTER_RESPONSE;
+    if (retBuf) {
+        memmove(&retBuf[13], &status, sizeof(status));  // 4
+        memmove(&retBuf[17], &count, sizeof(count));    // 4
+        retBuf[21] = flags;                             // 1
+        for (auto &it : identities) {
+            memmove(&retBuf[ofs], &it.gatewayId, sizeof(uint64_t));  // 8
+            ofs += 8;
+            ofs += serializeSocketAddress(&retBuf[ofs], &it.sockaddr);   // 0, 7, 19
+        }
+    } else {
+        for (auto &it : identities) {
+            ofs += 8;
+            ofs += serializeSocketAddress(nullptr, &it.sockaddr);   // 0, 7, 19
+        }
+    }
+    return ofs;
+}
+
+std::string GatewayListAfterResponse::toJsonString() const {
+    std::stringstream ss;
+    ss << R"({"status": )" << status
+       << ", \"end\": " << ((flags & GATEWAY_LIST_AFTER_FLAG_END) ? "true" : "false")
+       << ", \"gateways\": [";
+    bool isFirst = true;
+    for (auto &it : identities) {
+        if (isFirst)
+            isFirst = false;
+        else
+            ss << ", ";
+        ss << it.toJsonString();
+    }
+    ss <<  "]}";
+    return ss.str();
+}
+
 GatewayBinarySerialization::GatewayBinarySerialization(
     GatewayService *aSvc,
     int32_t aCode,
@@ -545,15 +686,37 @@ static size_t getMaxGatewayListResponseSize(
     return SIZE_OPERATION_RESPONSE + sz * (sizeof(uint64_t) + 19);
 }
 
-static size_t getListResponseSize(
-    const std::vector<GatewayIdentity> &list
+/**
+ * Check request size
+ * @param buf serialized request
+ * @param sz buffer size
+ * @return true if request is known and not truncated
+ */
+static bool isGatewayRequest(
+    const unsigned char *buf,
+    size_t sz
 )
 {
-    size_t r = SIZE_OPERATION_RESPONSE;
-    for (const auto & it : list) {
-        r += sizeof(uint64_t) + serializeSocketAddress(nullptr, &it.sockaddr);
+    if (sz < SIZE_SERVICE_MESSAGE)
+        return false;
+    switch (buf[0]) {
+        case QUERY_GATEWAY_ADDR:
+        case QUERY_GATEWAY_RM:   // it can contain id only(no address)
+            return sz >= SIZE_GATEWAY_ID_REQUEST;
+        case QUERY_GATEWAY_ID:
+            return sz >= SIZE_DEVICE_ADDR_REQUEST;
+        case QUERY_GATEWAY_ASSIGN:
+            return sz >= SIZE_DEVICE_EUI_ADDR_REQUEST;
+        case QUERY_GATEWAY_LIST_AFTER:
+            return sz >= SIZE_GATEWAY_LIST_AFTER_REQUEST;
+        case QUERY_GATEWAY_LIST:
+        case QUERY_GATEWAY_COUNT:
+        case QUERY_GATEWAY_FORCE_SAVE:
+        case QUERY_GATEWAY_CLOSE_RESOURCES:
+            return sz >= SIZE_OPERATION_REQUEST;
+        default:
+            return false;
     }
-    return r;
 }
 
 size_t GatewayBinarySerialization::query(
@@ -565,90 +728,131 @@ size_t GatewayBinarySerialization::query(
 {
     if (!svc)
         return 0;
-    if (sz < SIZE_SERVICE_MESSAGE)
-        return 0;
-    ServiceMessage *pMsg = deserializeGateway((const unsigned char *) request, sz);
-    if (!pMsg)
+    // requests are decoded into stack objects, responses are serialized to the retBuf
+    if (!isGatewayRequest(request, sz))
         return 0;   // unknown request
-    if ((pMsg->code != code) || (pMsg->accessCode != accessCode)) {
+    ServiceMessage header(request, sz);
+    header.ntoh();
+    if ((header.code != code) || (header.accessCode != accessCode)) {
 #ifdef ENABLE_DEBUG
         std::cerr << ERR_ACCESS_DENIED
-            << ": " << pMsg->code
-            << "," << pMsg->accessCode
+            << ": " << header.code
+            << "," << header.accessCode
             << std::endl;
 #endif
-        auto r = new GatewayOperationResponse;
-        r->code = ERR_CODE_ACCESS_DENIED;
-        r->ntoh();
-        r->serialize(retBuf);
-        delete pMsg;
-        return sizeof(GatewayOperationResponse);
+        GatewayOperationResponse r;
+        r.code = ERR_CODE_ACCESS_DENIED;
+        r.ntoh();
+        return r.serialize(retBuf);
     }
 
-    ServiceMessage *r = nullptr;
     switch (request[0]) {
         case QUERY_GATEWAY_ADDR:   // request gateway identifier(with address) by network address. Return 0 if success
             {
-                auto gr = (GatewayIdRequest *) pMsg;
-                r = new GatewayGetResponse(*gr);
-                memmove(&((GatewayGetResponse*) r)->response.sockaddr, &gr->id, sizeof(gr->id));
-                svc->get(((GatewayGetResponse*) r)->response, ((GatewayGetResponse*) r)->response);
-                break;
+                GatewayIdRequest gr(request, sz);
+                gr.ntoh();
+                GatewayGetResponse r(gr);
+                memmove(&r.response.sockaddr, &gr.id, sizeof(gr.id));
+                svc->get(r.response, r.response);
+                r.ntoh();
+                return r.serialize(retBuf);
             }
         case QUERY_GATEWAY_ID:   // request gateway address (with identifier) by identifier. Return 0 if success
             {
-                auto gr = (GatewayAddrRequest *) pMsg;
-                r = new GatewayGetResponse(*gr);
-                memmove(&((GatewayGetResponse*) r)->response.sockaddr, &gr->addr, sizeof(struct sockaddr));
-                r->code = svc->get(((GatewayGetResponse*) r)->response, ((GatewayGetResponse*) r)->response);
-                break;
+                GatewayAddrRequest gr(request, sz);
+                gr.ntoh();
+                GatewayGetResponse r(gr);
+                memmove(&r.response.sockaddr, &gr.addr, sizeof(struct sockaddr));
+                r.code = svc->get(r.response, r.response);
+                r.ntoh();
+                return r.serialize(retBuf);
             }
         case QUERY_GATEWAY_ASSIGN:   // assign (put) gateway address to the gateway by identifier
-            {
-                auto gr = (GatewayIdAddrRequest *) pMsg;
-                r = new GatewayOperationResponse(*gr);
-                int errCode = svc->put(gr->identity);
-                ((GatewayOperationResponse *) r)->response = errCode;
-                if (errCode == 0)
-                    ((GatewayOperationResponse *) r)->size = 1;    // count of placed entries
-                break;
-            }
         case QUERY_GATEWAY_RM:   // Remove entry
             {
-                auto gr = (GatewayIdAddrRequest *) pMsg;
-                r = new GatewayOperationResponse(*gr);
-                int errCode = svc->rm(gr->identity);
-                ((GatewayOperationResponse *) r)->response = errCode;
+                GatewayIdAddrRequest gr(request, sz);
+                gr.ntoh();
+                GatewayOperationResponse r(gr);
+                int errCode = request[0] == QUERY_GATEWAY_ASSIGN ? svc->put(gr.identity) : svc->rm(gr.identity);
+                r.response = errCode;
                 if (errCode == 0)
-                    ((GatewayOperationResponse *) r)->size = 1;    // count of deleted entries
-                break;
+                    r.size = 1;    // count of placed or deleted entries
+                r.ntoh();
+                return r.serialize(retBuf);
             }
         case QUERY_GATEWAY_LIST:   // List entries
-        {
-            auto gr = (GatewayOperationRequest *) pMsg;
-            r = new GatewayListResponse(*gr);
-            svc->list(((GatewayListResponse *) r)->identities, gr->offset, gr->size);
-            size_t serSize = getListResponseSize(((GatewayListResponse *) r)->identities);
-            if (serSize > retSize) {
-                serSize = ((GatewayListResponse *) r)->shortenList2Fit(serSize);
-                if (serSize > retSize) {
-                    delete r;
-                    r = nullptr;
+            {
+                if (retSize < SIZE_OPERATION_RESPONSE)
+                    return 0;
+                GatewayOperationRequest gr(request, sz);
+                gr.ntoh();
+                // keep capacity between requests
+                static thread_local std::vector<GatewayIdentity> identities;
+                identities.clear();
+                GatewayOperationResponse r(gr);
+                r.response = svc->list(identities, gr.offset, gr.size);
+                r.ntoh();
+                // same layout as GatewayListResponse, shortened to fit
+                size_t ofs = r.serialize(retBuf);   // 22
+                for (auto &it : identities) {
+                    size_t isz = sizeof(uint64_t) + serializeSocketAddress(nullptr, &it.sockaddr);
+                    if (ofs + isz > retSize)
+                        break;
+                    uint64_t id = NTOH8(it.gatewayId);
+                    memmove(&retBuf[ofs], &id, sizeof(uint64_t));  // 8
+                    sockaddrNtoh(&it.sockaddr);
+                    serializeSocketAddress(&retBuf[ofs + 8], &it.sockaddr);   // 0, 7, 19
+                    ofs += isz;
                 }
-                break;
+                return ofs;
+            }
+        case QUERY_GATEWAY_LIST_AFTER:   // list entries after the cursor
+            {
+                if (retSize < SIZE_GATEWAY_LIST_AFTER_RESPONSE)
+                    return 0;
+                GatewayListAfterRequest gr(request, sz);
+                gr.ntoh();
+                // entries are variable length, each one takes at least 8 + 7 bytes
+                size_t fit = (retSize - SIZE_GATEWAY_LIST_AFTER_RESPONSE) / (sizeof(uint64_t) + 7);
+                uint32_t cnt = gr.size < fit ? gr.size : (uint32_t) fit;
+                static thread_local std::vector<GatewayIdentity> identities;
+                identities.clear();
+                // one more entry tells is there something after the page
+                int status = svc->listAfter(identities, (gr.flags & GATEWAY_LIST_AFTER_FLAG_CURSOR) ? &gr.after : nullptr, cnt + 1);
+                GatewayListAfterResponse r;
+                r.code = gr.code;
+                r.accessCode = gr.accessCode;
+                r.status = status;
+                size_t ofs = SIZE_GATEWAY_LIST_AFTER_RESPONSE;
+                uint32_t c = 0;
+                for (auto &it : identities) {
+                    size_t isz = sizeof(uint64_t) + serializeSocketAddress(nullptr, &it.sockaddr);
+                    if (c == cnt || ofs + isz > retSize)
+                        break;
+                    uint64_t id = NTOH8(it.gatewayId);
+                    memmove(&retBuf[ofs], &id, sizeof(uint64_t));  // 8
+                    sockaddrNtoh(&it.sockaddr);
+                    serializeSocketAddress(&retBuf[ofs + 8], &it.sockaddr);   // 0, 7, 19
+                    ofs += isz;
+                    c++;
+                }
+                if (c == identities.size())
+                    r.flags = GATEWAY_LIST_AFTER_FLAG_END;
+                r.count = c;
+                r.ntoh();
+                r.serialize(retBuf);    // 22, header only
+                return ofs;
             }
-            break;
-        }
         case QUERY_GATEWAY_COUNT:   // count
-        {
-            auto gr = (GatewayOperationRequest *) pMsg;
-            r = new GatewayOperationResponse(*gr);
-            r->tag = gr->tag;
-            r->code = CODE_OK;
-            r->accessCode = gr->accessCode;
-            ((GatewayOperationResponse *) r)->response = (uint32_t) svc->size();
-            break;
-        }
+            {
+                GatewayOperationRequest gr(request, sz);
+                gr.ntoh();
+                GatewayOperationResponse r(gr);
+                r.code = CODE_OK;
+                r.response = (uint32_t) svc->size();
+                r.ntoh();
+                return r.serialize(retBuf);
+            }
         case QUERY_GATEWAY_FORCE_SAVE:   // force save
             break;
         case QUERY_GATEWAY_CLOSE_RESOURCES:   // close resources
@@ -656,14 +860,7 @@ size_t GatewayBinarySerialization::query(
         default:
             break;
     }
-    delete pMsg;
-    size_t rsize = 0;
-    if (r) {
-        r->ntoh();
-        rsize = r->serialize(retBuf);
-        delete r;
-    }
-    return rsize;
+    return 0;
 }
 
 /**
@@ -710,6 +907,10 @@ enum GatewayQueryTag validateGatewayQuery(
             if (size < SIZE_OPERATION_REQUEST)
                 return QUERY_GATEWAY_NONE;
             return QUERY_GATEWAY_CLOSE_RESOURCES;
+        case QUERY_GATEWAY_LIST_AFTER:   // list entries after the cursor
+            if (size < SIZE_GATEWAY_LIST_AFTER_REQUEST)
+                return QUERY_GATEWAY_NONE;
+            return QUERY_GATEWAY_LIST_AFTER;
     default:
             break;
     }
@@ -737,6 +938,16 @@ size_t responseSizeForGatewayRequest(
                 GatewayOperationRequest lr(buffer, size);
                 return getMaxGatewayListResponseSize(lr.size);
             }
+        case QUERY_GATEWAY_LIST_AFTER:
+            {
+                GatewayListAfterRequest lr(buffer, size);
+                lr.ntoh();
+                // IPv6 entries, but no more than one frame
+                size_t maxCount = (SIZE_GATEWAY_LIST_AFTER_RESPONSE_MAX - SIZE_GATEWAY_LIST_AFTER_RESPONSE) / (sizeof(uint64_t) + 19);
+                if (lr.size > maxCount)
+                    return SIZE_GATEWAY_LIST_AFTER_RESPONSE_MAX;
+                return getMaxGatewayListResponseSize(lr.size);
+            }
         default:
             break;
     }
@@ -798,6 +1009,11 @@ ServiceMessage* deserializeGateway(
                 return nullptr;
             r = new GatewayOperationRequest(buf, sz);
             break;
+        case QUERY_GATEWAY_LIST_AFTER:   // list entries after the cursor
+            if (sz < SIZE_GATEWAY_LIST_AFTER_REQUEST)
+                return nullptr;
+            r = new GatewayListAfterRequest(buf, sz);
+            break;
         default:
             r = nullptr;
     }
@@ -827,12 +1043,14 @@ const char* gatewayTag2string(
             return "gw-save";
         case QUERY_GATEWAY_CLOSE_RESOURCES:
             return "gw-close";
+        case QUERY_GATEWAY_LIST_AFTER:
+            return "gw-list-after";
         default:
             return "";
     }
 }
 
-static std::string GWCS("AILCPRSE");
+static std::string GWCS("AILCPRSEK");
 
 const std::string &gatewayCommandSet()
 {
@@ -861,12 +1079,53 @@ bool isGatewayTag(
         case QUERY_GATEWAY_RM:
         case QUERY_GATEWAY_FORCE_SAVE:
         case QUERY_GATEWAY_CLOSE_RESOURCES:
+        case QUERY_GATEWAY_LIST_AFTER:
             return true;
         default:
             return false;
     }
 }
 
+bool nextGatewayListAfterRequest(
+    unsigned char *request,
+    size_t sz,
+    const unsigned char *response,
+    size_t responseSize
+)
+{
+    if (validateGatewayQuery(request, sz) != QUERY_GATEWAY_LIST_AFTER
+        || responseSize < SIZE_GATEWAY_LIST_AFTER_RESPONSE || response[0] != QUERY_GATEWAY_LIST_AFTER)
+        return false;
+    uint32_t count;
+    memmove(&count, &response[17], sizeof(count));
+    count = NTOH4(count);
+    if ((response[21] & GATEWAY_LIST_AFTER_FLAG_END) || count == 0)
+        return false;
+    // entries are variable length, walk to the last one
+    size_t ofs = SIZE_GATEWAY_LIST_AFTER_RESPONSE;
+    size_t last = ofs;
+    for (uint32_t i = 0; i < count; i++) {
+        if (ofs + sizeof(uint64_t) > responseSize)
+            return false;
+        last = ofs;
+        struct sockaddr addr;
+        ofs += sizeof(uint64_t);
+        ofs += deserializeSocketAddress(&addr, &response[ofs], responseSize - ofs);
+    }
+    GatewayListAfterRequest req(request, sz);
+    req.ntoh();
+    if (req.size <= count)
+        return false;
+    req.size -= count;
+    req.flags |= GATEWAY_LIST_AFTER_FLAG_CURSOR;
+    // gateway identifier is the first field of the entry
+    memmove(&req.after, &response[last], sizeof(req.after));
+    req.after = NTOH8(req.after);
+    req.ntoh();
+    req.serialize(request);
+    return true;
+}
+
 GatewayQueryTag isGatewayTag(const char *tag) {
     if (!tag)
         return QUERY_GATEWAY_NONE;
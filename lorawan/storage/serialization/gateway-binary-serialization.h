@@ -21,9 +21,22 @@ enum GatewayQueryTag {
     QUERY_GATEWAY_ASSIGN = 'P',
     QUERY_GATEWAY_RM = 'R',
     QUERY_GATEWAY_FORCE_SAVE = 'S',
-    QUERY_GATEWAY_CLOSE_RESOURCES = 'E'
+    QUERY_GATEWAY_CLOSE_RESOURCES = 'E',
+    QUERY_GATEWAY_LIST_AFTER = 'K'
 };
 
+// 13 + 1 flags + 8 gateway identifier + 4 size
+#define SIZE_GATEWAY_LIST_AFTER_REQUEST 26
+// 13 + 4 response + 4 count + 1 flags, followed by gateways
+#define SIZE_GATEWAY_LIST_AFTER_RESPONSE 22
+// response frame fits the listener transmit buffer
+#define SIZE_GATEWAY_LIST_AFTER_RESPONSE_MAX 16384
+
+// list after request: gateway identifier is set, otherwise list from the first entry
+#define GATEWAY_LIST_AFTER_FLAG_CURSOR  1
+// list after response: no more entries after the last one
+#define GATEWAY_LIST_AFTER_FLAG_END     1
+
 class GatewayIdRequest : public ServiceMessage {
 public:
     uint64_t id;
@@ -120,6 +133,37 @@ public:
     size_t shortenList2Fit(size_t serializedSize);
 };
 
+class GatewayListAfterRequest : public ServiceMessage {
+public:
+    uint8_t flags;      ///< GATEWAY_LIST_AFTER_FLAG_CURSOR
+    uint64_t after;     ///< last gateway identifier of the previous page
+    uint32_t size;      ///< max entries count
+    GatewayListAfterRequest();
+    GatewayListAfterRequest(const uint64_t *after, uint32_t size, int32_t code, uint64_t accessCode);
+    GatewayListAfterRequest(const unsigned char *buf, size_t sz);
+    ~GatewayListAfterRequest() override = default;
+    void ntoh() override;
+    size_t serialize(unsigned char *retBuf) const override;
+    std::string toJsonString() const override;
+};
+
+/**
+ * Page of gateways. Client side response is a count of entries (as GatewayListResponse has), storage error code
+ * is in the status.
+ */
+class GatewayListAfterResponse : public GatewayListResponse {
+public:
+    int32_t status;     ///< CODE_OK or error code returned by the storage
+    uint32_t count;     ///< entries in the frame
+    uint8_t flags;      ///< GATEWAY_LIST_AFTER_FLAG_END
+    GatewayListAfterResponse();
+    GatewayListAfterResponse(const unsigned char *buf, size_t sz);
+    ~GatewayListAfterResponse() override = default;
+    void ntoh() override;
+    size_t serialize(unsigned char *retBuf) const override;
+    std::string toJsonString() const override;
+};
+
 class GatewayBinarySerialization : public GatewaySerialization {
 public:
     explicit GatewayBinarySerialization(
@@ -189,6 +233,22 @@ size_t responseSizeForGatewayRequest(
 
 const char* gatewayTag2string(enum GatewayQueryTag value);
 
+/**
+ * Make request for the next frame of the gateway list after response.
+ * Response frame has as many entries as the buffer can take, next request continues after the last entry.
+ * @param request serialized list after request, updated
+ * @param sz request size
+ * @param response serialized response frame
+ * @param responseSize response size
+ * @return false if there are no more entries or requested count is reached
+ */
+bool nextGatewayListAfterRequest(
+    unsigned char *request,
+    size_t sz,
+    const unsigned char *response,
+    size_t responseSize
+);
+
 const std::string &gatewayCommandSet();
 
 GatewayQueryTag isGatewayTag(const char *tag);
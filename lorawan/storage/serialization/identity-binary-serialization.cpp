@@ -53,6 +53,47 @@ static void serializeNETWORKIDENTITY(
     memmove(p, &response.value.devid.id.name, 8);	                // 8 total 141
 }
 
+/**
+ * Serialize address and device identifier in network byte order, same layout as serializeNETWORKIDENTITY() has
+ * @param retBuf return buffer
+ * @param addr address in host byte order
+ * @param id device identifier in host byte order
+ */
+static void serializeDEVICE_IDn(
+    unsigned char* retBuf,
+    uint32_t addr,
+    const DEVICE_ID &id
+)
+{
+    unsigned char *p = retBuf;
+    *(uint32_t *) p = NTOH4(addr);                  // 4
+    p += sizeof(uint32_t);
+    *(uint8_t *) p = (uint8_t) id.activation;	    // 1 activation type: ABP or OTAA
+    p++;
+    *(uint8_t *) p = (uint8_t) id.deviceclass;	    // 1 DEVICECLASS: A, B. C
+    p++;
+    *(uint64_t *) p = NTOH8(id.devEUI.u);	        // 8 device identifier
+    p += 8;
+    memmove(p, &id.nwkSKey, 16);	                // 16 shared session key
+    p += 16;
+    memmove(p, &id.appSKey, 16);	                // 16 private key
+    p += 16;
+    *(uint8_t *) p = id.version.c;	                // 1 LORAWAN_VERSION
+    p++;
+    // OTAA
+    *(uint64_t *) p = NTOH8(id.appEUI.u);	        // 8 OTAA application identifier
+    p += 8;
+    memmove(p, &id.appKey, 16);	                    // 16 OTAA application private key
+    p += 16;
+    memmove(p, &id.nwkKey, 16);	                    // 16 OTAA network key
+    p += 16;
+    *(uint16_t *) p = NTOH2(id.devNonce.u);	        // 2 last device nonce
+    p += 2;
+    memmove(p, &id.joinNonce.c, 3);	                // 3 Join nonce
+    p += 3;
+    memmove(p, &id.name, 8);	                    // 8 total 141
+}
+
 static void deserializeNETWORKIDENTITY(
     NETWORKIDENTITY &retVal,
     const unsigned char* buf
@@ -244,11 +285,11 @@ IdentityOperationRequest::IdentityOperationRequest()
 IdentityOperationRequest::IdentityOperationRequest(
     char tag,
     uint32_t aOffset,
-    uint8_t aSize,
+    uint32_t aSize,
     int32_t code,
     uint64_t accessCode
 )
-    : ServiceMessage(tag, code, accessCode), offset((uint32_t) aOffset), size((uint8_t) aSize)
+    : ServiceMessage(tag, code, accessCode), offset((uint32_t) aOffset), size(aSize)
 {
 }
 
@@ -260,7 +301,7 @@ IdentityOperationRequest::IdentityOperationRequest(
 {
     if (sz >= SIZE_OPERATION_REQUEST) {
         memmove(&offset, &buf[13], sizeof(offset));     // 4
-        memmove(&size, &buf[17], sizeof(size));         // 1
+        size = buf[17];                                 // 1
     }   // 18
 }
 
@@ -276,7 +317,7 @@ size_t IdentityOperationRequest::serialize(
     ServiceMessage::serialize(retBuf);                  // 13
     if (retBuf) {
         memmove(&retBuf[13], &offset, sizeof(offset));  // 4
-        memmove(&retBuf[17], &size, sizeof(size));      // 1
+        retBuf[17] = size > UINT8_MAX ? UINT8_MAX : (uint8_t) size;    // 1
     }
     return SIZE_OPERATION_REQUEST;                      // 18
 }
@@ -467,7 +508,6 @@ IdentityListResponse::IdentityListResponse(
 )
     : IdentityOperationResponse(buf, sz)       // 22
 {
-    deserializeIdentity(buf, sz);
     size_t ofs = SIZE_OPERATION_RESPONSE;
     response = 0;
     while (true) {
@@ -539,6 +579,315 @@ size_t IdentityListResponse::shortenList2Fit(
     return r;
 }
 
+IdentityListAfterRequest::IdentityListAfterRequest()
+    : ServiceMessage(QUERY_IDENTITY_LIST_AFTER, 0, 0), flags(0), after(0), size(0)
+{
+}
+
+IdentityListAfterRequest::IdentityListAfterRequest(
+    const DEVADDR *aAfter,
+    uint32_t aSize,
+    int32_t code,
+    uint64_t accessCode
+)
+    : ServiceMessage(QUERY_IDENTITY_LIST_AFTER, code, accessCode),
+      flags(aAfter ? LIST_AFTER_FLAG_CURSOR : 0), after(aAfter ? aAfter->u : 0), size(aSize)
+{
+}
+
+IdentityListAfterRequest::IdentityListAfterRequest(
+    const unsigned char *buf,
+    size_t sz
+)
+    : ServiceMessage(buf, sz), flags(0), after(0), size(0)  // 13
+{
+    if (sz >= SIZE_LIST_AFTER_REQUEST) {
+        flags = buf[13];                                // 1
+        memmove(&after.u, &buf[14], sizeof(after.u));   // 4
+        memmove(&size, &buf[18], sizeof(size));         // 4
+    }   // 22
+}
+
+void IdentityListAfterRequest::ntoh() {
+    ServiceMessage::ntoh();
+    after.u = NTOH4(after.u);
+    size = NTOH4(size);
+}
+
+size_t IdentityListAfterRequest::serialize(
+    unsigned char *retBuf
+) const
+{
+    ServiceMessage::serialize(retBuf);                  // 13
+    if (retBuf) {
+        retBuf[13] = flags;                             // 1
+        memmove(&retBuf[14], &after.u, sizeof(after.u));    // 4
+        memmove(&retBuf[18], &size, sizeof(size));      // 4
+    }
+    return SIZE_LIST_AFTER_REQUEST;                     // 22
+}
+
+std::string IdentityListAfterRequest::toJsonString() const {
+    std::stringstream ss;
+    ss << "{";
+    if (flags & LIST_AFTER_FLAG_CURSOR)
+        ss << R"("after": ")" << DEVADDR2string(after) << "\", ";
+    ss << R"("size": )" << size << "}";
+    return ss.str();
+}
+
+IdentityListAfterResponse::IdentityListAfterResponse()
+    : IdentityListResponse(), status(0), count(0), flags(0)
+{
+    tag = QUERY_IDENTITY_LIST_AFTER;
+}
+
+IdentityListAfterResponse::IdentityListAfterResponse(
+    const unsigned char *buf,
+    size_t sz
+)
+    : IdentityListResponse(), status(0), count(0), flags(0)
+{
+    ServiceMessage header(buf, sz);     // 13
+    tag = header.tag;
+    code = header.code;
+    accessCode = header.accessCode;
+    if (sz < SIZE_LIST_AFTER_RESPONSE)
+        return;
+    memmove(&status, &buf[13], sizeof(status));     // 4
+    memmove(&count, &buf[17], sizeof(count));       // 4
+    flags = buf[21];                                // 1
+    size_t ofs = SIZE_LIST_AFTER_RESPONSE;
+    response = 0;
+    while (ofs + SIZE_NETWORK_IDENTITY <= sz) {
+        NETWORKIDENTITY ni;
+        deserializeNETWORKIDENTITY(ni, buf + ofs);
+        ofs += SIZE_NETWORK_IDENTITY;
+        identities.push_back(ni);
+        response++;
+    }
+}
+
+void IdentityListAfterResponse::ntoh()
+{
+    ServiceMessage::ntoh();
+    status = NTOH4(status);
+    count = NTOH4(count);
+    for (auto &it : identities) {
+        ntohNETWORKIDENTITY(it);
+    }
+}
+
+size_t IdentityListAfterResponse::serialize(
+    unsigned char *retBuf
+) const
+{
+    ServiceMessage::serialize(retBuf);                  // 13
+    memmove(&retBuf[13], &status, sizeof(status));      // 4
+    memmove(&retBuf[17], &count, sizeof(count));        // 4
+    retBuf[21] = flags;                                 // 1
+    size_t ofs = SIZE_LIST_AFTER_RESPONSE;
+    for (auto &it : identities) {
+        serializeNETWORKIDENTITY(retBuf + ofs, it);
+        ofs += SIZE_NETWORK_IDENTITY;
+    }
+    return ofs;
+}
+
+std::string IdentityListAfterResponse::toJsonString() const {
+    std::stringstream ss;
+    ss << R"({"status": )" << status
+       << ", \"end\": " << ((flags & LIST_AFTER_FLAG_END) ? "true" : "false")
+       << ", \"identities\": [";
+    bool isFirst = true;
+    for (auto &it : identities) {
+        if (isFirst)
+            isFirst = false;
+        else
+            ss << ", ";
+        ss << it.toJsonString();
+    }
+    ss <<  "]}";
+    return ss.str();
+}
+
+/**
+ * Return size of the serialized request
+ * @param buf serialized request
+ * @param sz buffer size
+ * @return 0- unknown or truncated request
+ */
+static size_t identityRequestSize(
+    const unsigned char *buf,
+    size_t sz
+)
+{
+    if (sz == 0)
+        return 0;
+    size_t r;
+    switch (buf[0]) {
+        case QUERY_IDENTITY_ADDR:
+            r = SIZE_DEVICE_EUI_REQUEST;
+            break;
+        case QUERY_IDENTITY_EUI:
+        case QUERY_IDENTITY_RM:
+            r = SIZE_DEVICE_ADDR_REQUEST;
+            break;
+        case QUERY_IDENTITY_ASSIGN:
+            r = SIZE_ASSIGN_REQUEST;
+            break;
+        case QUERY_IDENTITY_LIST_AFTER:
+            r = SIZE_LIST_AFTER_REQUEST;
+            break;
+        case QUERY_IDENTITY_LIST:
+        case QUERY_IDENTITY_COUNT:
+        case QUERY_IDENTITY_NEXT:
+        case QUERY_IDENTITY_FORCE_SAVE:
+        case QUERY_IDENTITY_CLOSE_RESOURCES:
+            r = SIZE_OPERATION_REQUEST;
+            break;
+        default:
+            return 0;
+    }
+    return r <= sz ? r : 0;
+}
+
+IdentityBatchRequest::IdentityBatchRequest()
+    : ServiceMessage(QUERY_IDENTITY_BATCH, 0, 0), count(0)
+{
+}
+
+IdentityBatchRequest::IdentityBatchRequest(
+    int32_t code,
+    uint64_t accessCode
+)
+    : ServiceMessage(QUERY_IDENTITY_BATCH, code, accessCode), count(0)
+{
+}
+
+IdentityBatchRequest::IdentityBatchRequest(
+    const unsigned char *buf,
+    size_t sz
+)
+    : ServiceMessage(buf, sz), count(0)    // 13
+{
+    if (sz < SIZE_BATCH_HEADER)
+        return;
+    size_t ofs = SIZE_BATCH_HEADER;
+    for (uint8_t i = 0; i < buf[SIZE_SERVICE_MESSAGE]; i++) {
+        size_t isz = identityRequestSize(buf + ofs, sz - ofs);
+        if (isz == 0)
+            break;
+        items.insert(items.end(), buf + ofs, buf + ofs + isz);
+        ofs += isz;
+        count++;
+    }
+}
+
+bool IdentityBatchRequest::add(
+    ServiceMessage &request
+)
+{
+    unsigned char b[SIZE_ASSIGN_REQUEST];   // largest request
+    b[0] = (unsigned char) request.tag;
+    size_t sz = identityRequestSize(b, sizeof(b));
+    if (sz == 0 || count == 255 || SIZE_BATCH_HEADER + items.size() + sz > SIZE_BATCH_REQUEST_MAX)
+        return false;
+    request.ntoh();
+    request.serialize(b);
+    request.ntoh();
+    items.insert(items.end(), b, b + sz);
+    count++;
+    return true;
+}
+
+void IdentityBatchRequest::clear()
+{
+    items.clear();
+    count = 0;
+}
+
+void IdentityBatchRequest::ntoh()
+{
+    // requests are already serialized in network byte order
+    ServiceMessage::ntoh();
+}
+
+size_t IdentityBatchRequest::serialize(
+    unsigned char *retBuf
+) const
+{
+    ServiceMessage::serialize(retBuf);                  // 13
+    retBuf[SIZE_SERVICE_MESSAGE] = count;               // 1
+    if (!items.empty())
+        memmove(retBuf + SIZE_BATCH_HEADER, items.data(), items.size());
+    return SIZE_BATCH_HEADER + items.size();
+}
+
+std::string IdentityBatchRequest::toJsonString() const
+{
+    std::stringstream ss;
+    ss << R"({"count": )" << (int) count
+       << ", \"size\": " << items.size() << "}";
+    return ss.str();
+}
+
+IdentityBatchResponse::IdentityBatchResponse()
+    : ServiceMessage(QUERY_IDENTITY_BATCH, 0, 0), count(0)
+{
+}
+
+IdentityBatchResponse::IdentityBatchResponse(
+    const unsigned char *buf,
+    size_t sz
+)
+    : ServiceMessage(buf, sz), count(0)    // 13
+{
+    if (sz < SIZE_BATCH_HEADER)
+        return;
+    size_t ofs = SIZE_BATCH_HEADER;
+    for (uint8_t i = 0; i < buf[SIZE_SERVICE_MESSAGE]; i++) {
+        if (ofs + SIZE_BATCH_ITEM_HEADER > sz)
+            break;
+        IDENTITY_BATCH_ITEM item;
+        memmove(&item.status, buf + ofs, sizeof(item.status));  // 4
+        uint16_t isz;
+        memmove(&isz, buf + ofs + 4, sizeof(isz));              // 2
+        item.size = NTOH2(isz);
+        ofs += SIZE_BATCH_ITEM_HEADER;
+        if (ofs + item.size > sz)
+            break;
+        item.response = buf + ofs;
+        ofs += item.size;
+        items.push_back(item);
+        count++;
+    }
+}
+
+void IdentityBatchResponse::ntoh()
+{
+    ServiceMessage::ntoh();
+    for (auto &item : items) {
+        item.status = NTOH4(item.status);
+    }
+}
+
+std::string IdentityBatchResponse::toJsonString() const
+{
+    std::stringstream ss;
+    ss << R"({"count": )" << (int) count << ", \"status\": [";
+    bool isFirst = true;
+    for (auto &item : items) {
+        if (isFirst)
+            isFirst = false;
+        else
+            ss << ", ";
+        ss << item.status;
+    }
+    ss << "]}";
+    return ss.str();
+}
+
 /**
  * Get size for serialized list
  * @param sz count ofg items
@@ -551,6 +900,45 @@ static size_t getMaxIdentityListResponseSize(
     return SIZE_OPERATION_RESPONSE + sz * SIZE_NETWORK_IDENTITY;
 }
 
+/**
+ * Serialize get response from the device identifier kept by the storage without intermediate copies
+ * @param retBuf return buffer
+ * @param retSize return buffer size
+ * @param svc storage
+ * @param request request header in host byte order
+ * @param addr address to get, nullptr- get by EUI
+ * @param eui device EUI if address is not provided
+ * @return response size, 0- storage does not provide views or identity not found
+ */
+static size_t serializeGetView(
+    unsigned char *retBuf,
+    size_t retSize,
+    IdentityService *svc,
+    const ServiceMessage &request,
+    const DEVADDR *addr,
+    const DEVEUI &eui
+)
+{
+    if (retSize < SIZE_GET_RESPONSE)
+        return 0;
+    const DEVICE_ID *id;
+    DEVADDR a;
+    int r;
+    if (addr) {
+        a = *addr;
+        r = svc->getView(id, a);
+    } else
+        r = svc->getNetworkIdentityView(id, a, eui);
+    if (r != CODE_OK)
+        return 0;
+    ServiceMessage header(request.tag, request.code, request.accessCode);
+    header.ntoh();
+    header.serialize(retBuf);                                   // 13
+    serializeDEVICE_IDn(retBuf + SIZE_SERVICE_MESSAGE, a.u, *id);  // 141
+    svc->releaseView();
+    return SIZE_GET_RESPONSE;
+}
+
 size_t IdentitySerialization::query(
     unsigned char *retBuf,
     size_t retSize,
@@ -585,6 +973,11 @@ size_t IdentitySerialization::query(
         case QUERY_IDENTITY_ADDR:   // request device identifier(with address) by network address. Return 0 if success
             {
                 auto gr = (IdentityEUIRequest *) pMsg;
+                size_t vsz = serializeGetView(retBuf, retSize, svc, *gr, nullptr, gr->eui);
+                if (vsz) {
+                    delete pMsg;
+                    return vsz;
+                }
                 r = new IdentityGetResponse(*gr);
                 ((IdentityGetResponse*) r)->response.value.devid.id.devEUI.u = gr->eui.u;
                 int errCode;
@@ -603,6 +996,11 @@ size_t IdentitySerialization::query(
         case QUERY_IDENTITY_EUI:   // request device address (with identifier) by identifier. Return 0 if success
             {
                 auto gr = (IdentityAddrRequest *) pMsg;
+                size_t vsz = serializeGetView(retBuf, retSize, svc, *gr, &gr->addr, DEVEUI(0));
+                if (vsz) {
+                    delete pMsg;
+                    return vsz;
+                }
                 r = new IdentityGetResponse(*gr);
                 ((IdentityGetResponse*) r)->response.value.devaddr.u = gr->addr.u;
                 svc->get(((IdentityGetResponse*) r)->response.value.devid, ((IdentityGetResponse*) r)->response.value.devaddr);
@@ -731,6 +1129,14 @@ enum IdentityQueryTag validateIdentityQuery(
             if (size < SIZE_OPERATION_REQUEST)
                 return QUERY_IDENTITY_NONE;
             return QUERY_IDENTITY_CLOSE_RESOURCES;
+        case QUERY_IDENTITY_BATCH:   // requests in one datagram
+            if (size < SIZE_BATCH_HEADER)
+                return QUERY_IDENTITY_NONE;
+            return QUERY_IDENTITY_BATCH;
+        case QUERY_IDENTITY_LIST_AFTER:   // list entries after the cursor
+            if (size < SIZE_LIST_AFTER_REQUEST)
+                return QUERY_IDENTITY_NONE;
+            return QUERY_IDENTITY_LIST_AFTER;
     default:
             break;
     }
@@ -787,6 +1193,14 @@ enum IdentityQueryTag validateIdentityResponse(
             if (size < SIZE_OPERATION_RESPONSE)
                 return QUERY_IDENTITY_NONE;
             return QUERY_IDENTITY_CLOSE_RESOURCES;
+        case QUERY_IDENTITY_BATCH:   // responses in one datagram
+            if (size < SIZE_BATCH_HEADER)
+                return QUERY_IDENTITY_NONE;
+            return QUERY_IDENTITY_BATCH;
+        case QUERY_IDENTITY_LIST_AFTER:   // page of entries
+            if (size < SIZE_LIST_AFTER_RESPONSE)
+                return QUERY_IDENTITY_NONE;
+            return QUERY_IDENTITY_LIST_AFTER;
         default:
             break;
     }
@@ -814,6 +1228,28 @@ size_t responseSizeForIdentityRequest(
                 IdentityOperationRequest lr(buffer, size);
                 return getMaxIdentityListResponseSize(lr.size);
             }
+        case QUERY_IDENTITY_BATCH:      // sum of responses
+            {
+                size_t r = SIZE_BATCH_HEADER;
+                size_t ofs = SIZE_BATCH_HEADER;
+                for (uint8_t i = 0; i < buffer[SIZE_SERVICE_MESSAGE]; i++) {
+                    size_t isz = identityRequestSize(buffer + ofs, size - ofs);
+                    if (isz == 0)
+                        break;
+                    r += SIZE_BATCH_ITEM_HEADER + responseSizeForIdentityRequest(buffer + ofs, isz);
+                    ofs += isz;
+                }
+                return r < SIZE_BATCH_RESPONSE_MAX ? r : SIZE_BATCH_RESPONSE_MAX;
+            }
+        case QUERY_IDENTITY_LIST_AFTER: // one frame
+            {
+                IdentityListAfterRequest lr(buffer, size);
+                lr.ntoh();
+                size_t r = SIZE_LIST_AFTER_RESPONSE + (size_t) lr.size * SIZE_NETWORK_IDENTITY;
+                size_t frame = SIZE_BATCH_RESPONSE_MAX
+                    - (SIZE_BATCH_RESPONSE_MAX - SIZE_LIST_AFTER_RESPONSE) % SIZE_NETWORK_IDENTITY;
+                return r < frame ? r : frame;
+            }
         default:
             break;
     }
@@ -911,12 +1347,16 @@ const char* identityTag2string(
             return "save";
         case QUERY_IDENTITY_CLOSE_RESOURCES:
             return "close";
+        case QUERY_IDENTITY_BATCH:
+            return "batch";
+        case QUERY_IDENTITY_LIST_AFTER:
+            return "list-after";
         default:
             return "";
     }
 }
 
-static std::string IDCS("ailcprse");
+static std::string IDCS("ailcprsek");
 
 const std::string &identityCommandSet() {
     return IDCS;
@@ -940,16 +1380,50 @@ bool isIdentityTag(
         case QUERY_IDENTITY_EUI:
         case QUERY_IDENTITY_LIST:
         case QUERY_IDENTITY_COUNT:
+        case QUERY_IDENTITY_NEXT:
         case QUERY_IDENTITY_ASSIGN:
         case QUERY_IDENTITY_RM:
         case QUERY_IDENTITY_FORCE_SAVE:
         case QUERY_IDENTITY_CLOSE_RESOURCES:
+        case QUERY_IDENTITY_BATCH:
+        case QUERY_IDENTITY_LIST_AFTER:
             return true;
         default:
             return false;
     }
 }
 
+bool nextListAfterRequest(
+    unsigned char *request,
+    size_t sz,
+    const unsigned char *response,
+    size_t responseSize
+)
+{
+    if (validateIdentityQuery(request, sz) != QUERY_IDENTITY_LIST_AFTER
+        || validateIdentityResponse(response, responseSize) != QUERY_IDENTITY_LIST_AFTER)
+        return false;
+    uint32_t count;
+    memmove(&count, &response[17], sizeof(count));
+    count = NTOH4(count);
+    if ((response[21] & LIST_AFTER_FLAG_END) || count == 0)
+        return false;
+    size_t last = SIZE_LIST_AFTER_RESPONSE + (count - 1) * SIZE_NETWORK_IDENTITY;
+    if (last + SIZE_NETWORK_IDENTITY > responseSize)
+        return false;
+    IdentityListAfterRequest req(request, sz);
+    req.ntoh();
+    if (req.size <= count)
+        return false;
+    req.size -= count;
+    req.flags |= LIST_AFTER_FLAG_CURSOR;
+    // address is the first field of the identity
+    memmove(&req.after.u, &response[last], sizeof(req.after.u));
+    req.after.u = NTOH4(req.after.u);
+    req.ntoh();
+    req.serialize(request);
+    return true;
+}
 
 IdentityBinarySerialization::IdentityBinarySerialization(
     IdentityService* aSvc,
@@ -968,112 +1442,187 @@ size_t IdentityBinarySerialization::query(
     size_t sz
 )
 {
+    if (sz > 0 && request[0] == QUERY_IDENTITY_BATCH)
+        return queryBatch(retBuf, retSize, request, sz);
+    int32_t status;
+    return queryItem(retBuf, retSize, request, sz, status);
+}
+
+/**
+ * Request IdentityService and return serialized response.
+ * @param retBuf buffer to return serialized response
+ * @param retSize buffer size
+ * @param request serialized request
+ * @param sz serialized request size
+ * @param status return CODE_OK or error code returned by the storage
+ * @return IdentityService response size
+ */
+size_t IdentityBinarySerialization::queryItem(
+    unsigned char* retBuf,
+    size_t retSize,
+    const unsigned char* request,
+    size_t sz,
+    int32_t &status
+)
+{
+    status = ERR_CODE_INVALID_PACKET;
     if (!svc)
         return 0;
-    if (sz < SIZE_SERVICE_MESSAGE)
-        return 0;
-    ServiceMessage* pMsg = deserializeIdentity((const unsigned char*)request, sz);
-    if (!pMsg)
-        return 0;   // unknown request
-    if ((pMsg->code != code) || (pMsg->accessCode != accessCode)) {
+    // requests are decoded into stack objects, responses are serialized to the retBuf
+    size_t rsz = identityRequestSize(request, sz);
+    if (!rsz)
+        return 0;   // unknown or truncated request
+    ServiceMessage header(request, rsz);
+    header.ntoh();
+    if ((header.code != code) || (header.accessCode != accessCode)) {
 #ifdef ENABLE_DEBUG
         std::cerr << ERR_ACCESS_DENIED
-            << ": " << pMsg->code
-            << "," << pMsg->accessCode
+            << ": " << header.code
+            << "," << header.accessCode
             << std::endl;
 #endif
-        auto r = new IdentityOperationResponse;
-        r->code = ERR_CODE_ACCESS_DENIED;
-        r->ntoh();
-        size_t sz = r->serialize(retBuf);
-        delete pMsg;
-        return sz;
+        IdentityOperationResponse r;
+        r.code = ERR_CODE_ACCESS_DENIED;
+        r.ntoh();
+        status = ERR_CODE_ACCESS_DENIED;
+        return r.serialize(retBuf);
     }
 
-    ServiceMessage* r = nullptr;
+    status = CODE_OK;
     switch (request[0]) {
     case QUERY_IDENTITY_ADDR:   // request gateway identifier(with address) by network address. Return 0 if success
     {
-        auto gr = (IdentityEUIRequest*)pMsg;
-        r = new IdentityGetResponse(*gr);
-        ((IdentityGetResponse*)r)->response.value.devid.id.devEUI.u = gr->eui.u;
-        int errCode;
-        if (((IdentityGetResponse*)r)->response.value.devaddr.empty())
-            errCode = svc->getNetworkIdentity(((IdentityGetResponse*)r)->response,
-                ((IdentityGetResponse*)r)->response.value.devid.id.devEUI);
+        IdentityEUIRequest gr(request, rsz);
+        gr.ntoh();
+        size_t vsz = serializeGetView(retBuf, retSize, svc, gr, nullptr, gr.eui);
+        if (vsz)
+            return vsz;
+        IdentityGetResponse r(gr);
+        r.response.value.devid.id.devEUI.u = gr.eui.u;
+        if (r.response.value.devaddr.empty())
+            status = svc->getNetworkIdentity(r.response, r.response.value.devid.id.devEUI);
         else
-            errCode = svc->get(((IdentityGetResponse*)r)->response.value.devid, ((IdentityGetResponse*)r)->response.value.devaddr);
-
-        if (errCode) {
+            status = svc->get(r.response.value.devid, r.response.value.devaddr);
+        if (status) {
             // indicate nothing there
-            ((IdentityGetResponse*)r)->response.value.devid.id.devEUI.u = 0;
+            r.response.value.devid.id.devEUI.u = 0;
         }
-        break;
+        r.ntoh();
+        return r.serialize(retBuf);
     }
     case QUERY_IDENTITY_EUI:   // request gateway address (with identifier) by identifier. Return 0 if success
     {
-        auto gr = (IdentityAddrRequest*)pMsg;
-        r = new IdentityGetResponse(*gr);
-        ((IdentityGetResponse*)r)->response.value.devaddr.u = gr->addr.u;
-        svc->get(((IdentityGetResponse*)r)->response.value.devid, ((IdentityGetResponse*)r)->response.value.devaddr);
-        break;
+        IdentityAddrRequest gr(request, rsz);
+        gr.ntoh();
+        size_t vsz = serializeGetView(retBuf, retSize, svc, gr, &gr.addr, DEVEUI(0));
+        if (vsz)
+            return vsz;
+        IdentityGetResponse r(gr);
+        r.response.value.devaddr.u = gr.addr.u;
+        status = svc->get(r.response.value.devid, r.response.value.devaddr);
+        r.ntoh();
+        return r.serialize(retBuf);
     }
     case QUERY_IDENTITY_ASSIGN:   // assign (put) gateway address to the gateway by identifier
     {
-        auto gr = (IdentityAssignRequest*)pMsg;
-        r = new IdentityOperationResponse(*gr);
-        ((IdentityOperationResponse*)r)->response = svc->put(gr->identity.value.devaddr, gr->identity.value.devid);
-        if (((IdentityOperationResponse*)r)->response == 0)
-            ((IdentityOperationResponse*)r)->size = 1;    // count of placed entries
-        break;
+        IdentityAssignRequest gr(request, rsz);
+        gr.ntoh();
+        IdentityOperationResponse r(gr);
+        r.response = svc->put(gr.identity.value.devaddr, gr.identity.value.devid);
+        if (r.response == 0)
+            r.size = 1;    // count of placed entries
+        status = r.response;
+        r.ntoh();
+        return r.serialize(retBuf);
     }
     case QUERY_IDENTITY_RM:   // Remove entry
     {
-        auto gr = (IdentityAddrRequest*)pMsg;
-        r = new IdentityOperationResponse(*gr);
-        ((IdentityOperationResponse*)r)->response = svc->rm(gr->addr);
-        if (((IdentityOperationResponse*)r)->response == 0)
-            ((IdentityOperationResponse*)r)->size = 1;    // count of deleted entries
-        break;
+        IdentityAddrRequest gr(request, rsz);
+        gr.ntoh();
+        IdentityOperationResponse r(gr);
+        r.response = svc->rm(gr.addr);
+        if (r.response == 0)
+            r.size = 1;    // count of deleted entries
+        status = r.response;
+        r.ntoh();
+        return r.serialize(retBuf);
     }
     case QUERY_IDENTITY_LIST:   // List entries
     {
-        auto gr = (IdentityOperationRequest*)pMsg;
-        r = new IdentityListResponse(*gr);
-        ((IdentityOperationResponse*)r)->response = svc->list(((IdentityListResponse*)r)->identities, gr->offset, gr->size);
-        size_t idSize = ((IdentityListResponse*)r)->identities.size();
-        size_t serSize = SIZE_OPERATION_RESPONSE + (idSize * SIZE_NETWORK_IDENTITY);
-        if (serSize > retSize) {
-            serSize = ((IdentityListResponse*)r)->shortenList2Fit(retSize);
-            if (serSize > retSize) {
-                delete r;
-                r = nullptr;
-            }
-            break;
+        if (retSize < SIZE_OPERATION_RESPONSE)
+            return 0;
+        IdentityOperationRequest gr(request, rsz);
+        gr.ntoh();
+        // keep capacity between requests
+        static thread_local std::vector<NETWORKIDENTITY> identities;
+        identities.clear();
+        IdentityOperationResponse r(gr);
+        r.response = svc->list(identities, gr.offset, gr.size);
+        status = r.response;
+        // same layout as IdentityListResponse, shortened to fit
+        size_t cnt = (retSize - SIZE_OPERATION_RESPONSE) / SIZE_NETWORK_IDENTITY;
+        if (cnt > identities.size())
+            cnt = identities.size();
+        r.ntoh();
+        size_t ofs = r.serialize(retBuf);   // 22
+        for (size_t i = 0; i < cnt; i++) {
+            ntohNETWORKIDENTITY(identities[i]);
+            serializeNETWORKIDENTITY(retBuf + ofs, identities[i]);
+            ofs += SIZE_NETWORK_IDENTITY;
         }
-        break;
+        return ofs;
+    }
+    case QUERY_IDENTITY_LIST_AFTER:   // list entries after the cursor
+    {
+        if (retSize < SIZE_LIST_AFTER_RESPONSE)
+            return 0;
+        IdentityListAfterRequest gr(request, rsz);
+        gr.ntoh();
+        size_t fit = (retSize - SIZE_LIST_AFTER_RESPONSE) / SIZE_NETWORK_IDENTITY;
+        uint32_t cnt = gr.size < fit ? gr.size : (uint32_t) fit;
+        static thread_local std::vector<NETWORKIDENTITY> identities;
+        identities.clear();
+        // one more entry tells is there something after the page
+        status = svc->listAfter(identities, (gr.flags & LIST_AFTER_FLAG_CURSOR) ? &gr.after : nullptr, cnt + 1);
+        IdentityListAfterResponse r;
+        r.code = gr.code;
+        r.accessCode = gr.accessCode;
+        r.status = status;
+        if (identities.size() > cnt)
+            identities.resize(cnt);
+        else
+            r.flags = LIST_AFTER_FLAG_END;
+        r.count = (uint32_t) identities.size();
+        r.ntoh();
+        size_t ofs = r.serialize(retBuf);   // 22
+        for (auto &it : identities) {
+            ntohNETWORKIDENTITY(it);
+            serializeNETWORKIDENTITY(retBuf + ofs, it);
+            ofs += SIZE_NETWORK_IDENTITY;
+        }
+        return ofs;
     }
     case QUERY_IDENTITY_COUNT:   // count
     {
-        auto gr = (IdentityOperationRequest*)pMsg;
-        r = new IdentityOperationResponse(*gr);
-        r->tag = gr->tag;
-        r->code = CODE_OK;
-        r->accessCode = gr->accessCode;
-        ((IdentityOperationResponse*)r)->response = (uint8_t)svc->size();
-        break;
+        IdentityOperationRequest gr(request, rsz);
+        gr.ntoh();
+        IdentityOperationResponse r(gr);
+        r.code = CODE_OK;
+        // response is 32 bit, do not truncate to the page size
+        size_t c = svc->size();
+        r.response = c < INT32_MAX ? (int32_t) c : INT32_MAX;
+        r.ntoh();
+        return r.serialize(retBuf);
     }
     case QUERY_IDENTITY_NEXT:   // next
     {
-        auto gr = (IdentityOperationRequest*)pMsg;
-        r = new IdentityNextResponse;
-        r->tag = gr->tag;
-        r->code = CODE_OK;
-        r->accessCode = gr->accessCode;
-        NETWORKIDENTITY ni;
-        svc->next(ni);
-        ((IdentityNextResponse*)r)->response = ni;
-        break;
+        IdentityNextResponse r;
+        r.tag = header.tag;
+        r.code = CODE_OK;
+        r.accessCode = header.accessCode;
+        status = svc->next(r.response);
+        r.ntoh();
+        return r.serialize(retBuf);
     }
     case QUERY_IDENTITY_FORCE_SAVE:   // force save
         break;
@@ -1082,14 +1631,60 @@ size_t IdentityBinarySerialization::query(
     default:
         break;
     }
-    delete pMsg;
-    size_t rsize = 0;
-    if (r) {
-        r->ntoh();
-        rsize = r->serialize(retBuf);
-        delete r;
+    return 0;
+}
+
+/**
+ * Execute batch requests in order and return responses in one buffer.
+ * Requests which responses do not fit the buffer are not executed, response count tells how many are done.
+ * @param retBuf buffer to return serialized response
+ * @param retSize buffer size
+ * @param request serialized batch request
+ * @param sz serialized request size
+ * @return response size
+ */
+size_t IdentityBinarySerialization::queryBatch(
+    unsigned char* retBuf,
+    size_t retSize,
+    const unsigned char* request,
+    size_t sz
+)
+{
+    if (!svc || sz < SIZE_BATCH_HEADER || retSize < SIZE_BATCH_HEADER)
+        return 0;
+    ServiceMessage header(request, sz);
+    header.ntoh();
+    if ((header.code != code) || (header.accessCode != accessCode)) {
+        IdentityOperationResponse r;
+        r.code = ERR_CODE_ACCESS_DENIED;
+        r.ntoh();
+        return r.serialize(retBuf);
     }
-    return rsize;
+    uint8_t count = request[SIZE_SERVICE_MESSAGE];
+    uint8_t done = 0;
+    size_t ofs = SIZE_BATCH_HEADER;
+    size_t rofs = SIZE_BATCH_HEADER;
+    for (; done < count; done++) {
+        size_t isz = identityRequestSize(request + ofs, sz - ofs);
+        if (isz == 0)
+            break;  // truncated or unknown request
+        if (rofs + SIZE_BATCH_ITEM_HEADER + responseSizeForIdentityRequest(request + ofs, isz) > retSize)
+            break;  // client sends the rest again
+        int32_t status;
+        size_t rsz = queryItem(retBuf + rofs + SIZE_BATCH_ITEM_HEADER, retSize - rofs - SIZE_BATCH_ITEM_HEADER,
+            request + ofs, isz, status);
+        // item offset depends on previous response sizes, it is not aligned
+        int32_t nstatus = NTOH4(status);
+        uint16_t nsize = NTOH2((uint16_t) rsz);
+        memmove(retBuf + rofs, &nstatus, sizeof(int32_t));          // 4
+        memmove(retBuf + rofs + 4, &nsize, sizeof(uint16_t));       // 2
+        rofs += SIZE_BATCH_ITEM_HEADER + rsz;
+        ofs += isz;
+    }
+    header.ntoh();
+    header.serialize(retBuf);               // 13
+    retBuf[SIZE_SERVICE_MESSAGE] = done;    // 1
+    return rofs;
 }
 
 IdentityQueryTag isIdentityTag(const char *tag) {
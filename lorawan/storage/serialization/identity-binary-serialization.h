@@ -22,7 +22,9 @@ enum IdentityQueryTag {
     QUERY_IDENTITY_RM = 'r',
     QUERY_IDENTITY_FORCE_SAVE = 's',
     QUERY_IDENTITY_CLOSE_RESOURCES = 'e',
-    QUERY_IDENTITY_FILTER = 'f'
+    QUERY_IDENTITY_FILTER = 'f',
+    QUERY_IDENTITY_BATCH = 'b',
+    QUERY_IDENTITY_LIST_AFTER = 'k'
 };
 
 // 13 + 4 + 1
@@ -34,6 +36,22 @@ enum IdentityQueryTag {
 #define SIZE_NETWORK_IDENTITY 141
 #define SIZE_ASSIGN_REQUEST 154
 #define SIZE_GET_RESPONSE 154
+// 13 + 1 items count, followed by serialized requests or responses
+#define SIZE_BATCH_HEADER 14
+// 4 status + 2 response size, followed by response
+#define SIZE_BATCH_ITEM_HEADER 6
+// batch request fits Ethernet frame, response can be fragmented
+#define SIZE_BATCH_REQUEST_MAX 1432
+#define SIZE_BATCH_RESPONSE_MAX 16384
+// 13 + 1 flags + 4 address + 4 size
+#define SIZE_LIST_AFTER_REQUEST 22
+// 13 + 4 response + 4 count + 1 flags, followed by identities
+#define SIZE_LIST_AFTER_RESPONSE 22
+
+// list after request: address is set, otherwise list from the first entry
+#define LIST_AFTER_FLAG_CURSOR  1
+// list after response: no more entries after the last one
+#define LIST_AFTER_FLAG_END     1
 
 class IdentityEUIRequest : public ServiceMessage {
 public:
@@ -75,9 +93,9 @@ public:
 class IdentityOperationRequest : public ServiceMessage {
 public:
     uint32_t offset;
-    uint8_t size;
+    uint32_t size;      ///< page size or entries count, 1 byte in the frame, saturated to 255
     IdentityOperationRequest();
-    IdentityOperationRequest(char tag, uint32_t aOffset, uint8_t aSize, int32_t code, uint64_t accessCode);
+    IdentityOperationRequest(char tag, uint32_t aOffset, uint32_t aSize, int32_t code, uint64_t accessCode);
     IdentityOperationRequest(const unsigned char *buf, size_t sz);
     ~IdentityOperationRequest() override = default;
     void ntoh() override;
@@ -140,6 +158,87 @@ public:
     size_t shortenList2Fit(size_t serializedSize);
 };
 
+/**
+ * Request entries in the storage order following the address of the last received entry (key continuation).
+ * Size is 32 bit, response is split to frames if it does not fit.
+ */
+class IdentityListAfterRequest : public ServiceMessage {
+public:
+    uint8_t flags;      ///< LIST_AFTER_FLAG_CURSOR
+    DEVADDR after;      ///< last address of the previous page
+    uint32_t size;      ///< max entries count
+    IdentityListAfterRequest();
+    IdentityListAfterRequest(const DEVADDR *after, uint32_t size, int32_t code, uint64_t accessCode);
+    IdentityListAfterRequest(const unsigned char *buf, size_t sz);
+    ~IdentityListAfterRequest() override = default;
+    void ntoh() override;
+    size_t serialize(unsigned char *retBuf) const override;
+    std::string toJsonString() const override;
+};
+
+/**
+ * Page of entries. Client side response is a count of entries (as IdentityListResponse has), storage error code
+ * is in the status.
+ */
+class IdentityListAfterResponse : public IdentityListResponse {
+public:
+    int32_t status;     ///< CODE_OK or error code returned by the storage
+    uint32_t count;     ///< entries in the frame
+    uint8_t flags;      ///< LIST_AFTER_FLAG_END
+    IdentityListAfterResponse();
+    IdentityListAfterResponse(const unsigned char *buf, size_t sz);
+    ~IdentityListAfterResponse() override = default;
+    void ntoh() override;
+    size_t serialize(unsigned char *retBuf) const override;
+    std::string toJsonString() const override;
+};
+
+/**
+ * Requests sent in one datagram and answered by one datagram.
+ * Requests are kept serialized, so the request objects can be released after add().
+ */
+class IdentityBatchRequest : public ServiceMessage {
+public:
+    uint8_t count;
+    std::vector<unsigned char> items;   ///< serialized requests in network byte order
+    IdentityBatchRequest();
+    IdentityBatchRequest(int32_t code, uint64_t accessCode);
+    IdentityBatchRequest(const unsigned char *buf, size_t sz);
+    ~IdentityBatchRequest() override = default;
+    /**
+     * Append request to the batch. Request is restored after serialization.
+     * @param request request in host byte order, batch requests can not be nested
+     * @return false if batch is full or request can not be batched
+     */
+    bool add(ServiceMessage &request);
+    void clear();
+    void ntoh() override;
+    size_t serialize(unsigned char *retBuf) const override;
+    std::string toJsonString() const override;
+};
+
+typedef struct {
+    int32_t status;                 ///< CODE_OK or error code returned by the storage
+    const unsigned char *response;  ///< serialized response in network byte order
+    size_t size;                    ///< response size
+} IDENTITY_BATCH_ITEM;
+
+/**
+ * Responses in order of requests. Items point to the buffer passed to the constructor.
+ * count can be less than requests count if the rest of the responses does not fit the datagram,
+ * such requests are not executed and must be sent again.
+ */
+class IdentityBatchResponse : public ServiceMessage {
+public:
+    uint8_t count;
+    std::vector<IDENTITY_BATCH_ITEM> items;
+    IdentityBatchResponse();
+    IdentityBatchResponse(const unsigned char *buf, size_t sz);
+    ~IdentityBatchResponse() override = default;
+    void ntoh() override;
+    std::string toJsonString() const override;
+};
+
 /**
  * Return request object or NULL if packet is invalid
  * @param buf buffer
@@ -199,6 +298,22 @@ const char* identityTag2string(
     enum IdentityQueryTag value
 );
 
+/**
+ * Make request for the next frame of the list after response.
+ * Response frame has as many entries as the buffer can take, next request continues after the last entry.
+ * @param request serialized list after request, updated
+ * @param sz request size
+ * @param response serialized response frame
+ * @param responseSize response size
+ * @return false if there are no more entries or requested count is reached
+ */
+bool nextListAfterRequest(
+    unsigned char *request,
+    size_t sz,
+    const unsigned char *response,
+    size_t responseSize
+);
+
 const std::string &identityCommandSet();
 
 class IdentityBinarySerialization : public IdentitySerialization {
@@ -222,6 +337,20 @@ public:
         const unsigned char* request,
         size_t sz
     ) override;
+protected:
+    size_t queryItem(
+        unsigned char* retBuf,
+        size_t retSize,
+        const unsigned char* request,
+        size_t sz,
+        int32_t &status
+    );
+    size_t queryBatch(
+        unsigned char* retBuf,
+        size_t retSize,
+        const unsigned char* request,
+        size_t sz
+    );
 };
 
 IdentityQueryTag isIdentityTag(const char *tag);
@@ -0,0 +1,262 @@
+#include <cstring>
+
+#include "lorawan/storage/serialization/json-stream.h"
+#include "third-party/nlohmann/json.hpp"
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+// depth of the values of the record fields: array, object
+#define RECORD_DEPTH    2
+
+class JsonRecordReader::Handler : public nlohmann::json_sax<nlohmann::json> {
+private:
+    JsonRecordReader &reader;
+    int depth;
+    int field;
+    uint32_t present;
+
+    bool value() {
+        if (depth == 0) {
+            reader.errorMessage = "array expected";
+            return false;
+        }
+        return true;
+    }
+
+    bool nested() {
+        if (depth == 0 && !isArray) {
+            reader.errorMessage = "array expected";
+            return false;
+        }
+        depth++;
+        return true;
+    }
+public:
+    bool isArray;
+
+    explicit Handler(JsonRecordReader &aReader)
+        : reader(aReader), depth(0), field(-1), present(0), isArray(false)
+    {
+    }
+
+    bool null() override { return value(); }
+    bool boolean(bool) override { return value(); }
+    bool number_integer(number_integer_t) override { return value(); }
+    bool number_unsigned(number_unsigned_t) override { return value(); }
+    bool number_float(number_float_t, const string_t &) override { return value(); }
+    bool binary(binary_t &) override { return value(); }
+
+    bool string(string_t &val) override {
+        if (depth == RECORD_DEPTH && field >= 0) {
+            reader.values[field].swap(val);
+            present |= 1u << field;
+        }
+        return value();
+    }
+
+    bool start_object(std::size_t) override {
+        if (!nested())
+            return false;
+        if (depth == RECORD_DEPTH) {
+            present = 0;
+            field = -1;
+        }
+        return true;
+    }
+
+    bool key(string_t &val) override {
+        if (depth != RECORD_DEPTH)
+            return true;
+        field = -1;
+        for (size_t i = 0; i < reader.fields.size(); i++) {
+            if (reader.fields[i] == val) {
+                field = (int) i;
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool end_object() override {
+        depth--;
+        if (depth == RECORD_DEPTH - 1) {
+            reader.records++;
+            reader.onRecord(reader.values, present);
+        }
+        if (depth == RECORD_DEPTH)
+            field = -1;
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        if (depth == 0)
+            isArray = true;
+        return nested();
+    }
+
+    bool end_array() override {
+        depth--;
+        if (depth == RECORD_DEPTH)
+            field = -1;
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string &, const nlohmann::detail::exception &ex) override {
+        reader.errorMessage = ex.what();
+        return false;
+    }
+};
+
+JsonRecordReader::JsonRecordReader(
+    const std::vector<std::string> &aFields,
+    const OnRecord &aOnRecord
+)
+    : fields(aFields), onRecord(aOnRecord), values(aFields.size()), records(0)
+{
+}
+
+bool JsonRecordReader::parse(
+    std::istream &strm
+)
+{
+    errorMessage.clear();
+    records = 0;
+    Handler handler(*this);
+    bool r = nlohmann::json::sax_parse(strm, &handler);
+    return r && handler.isArray;
+}
+
+const std::string &JsonRecordReader::error() const
+{
+    return errorMessage;
+}
+
+size_t JsonRecordReader::count() const
+{
+    return records;
+}
+
+JsonStreamWriter::JsonStreamWriter(
+    size_t bufferSize
+)
+    : file(nullptr), buffer(bufferSize < 64 ? 64 : bufferSize), used(0), good(false)
+{
+}
+
+JsonStreamWriter::~JsonStreamWriter()
+{
+    close();
+}
+
+bool JsonStreamWriter::open(
+    const std::string &fileName
+)
+{
+    close();
+    file = fopen(fileName.c_str(), "wb");
+    used = 0;
+    good = file != nullptr;
+    return good;
+}
+
+bool JsonStreamWriter::close()
+{
+    if (!file)
+        return false;
+    flushBuffer();
+    if (fclose(file))
+        good = false;
+    file = nullptr;
+    return good;
+}
+
+void JsonStreamWriter::flushBuffer()
+{
+    if (used && fwrite(buffer.data(), used, 1, file) != 1)
+        good = false;
+    used = 0;
+}
+
+JsonStreamWriter &JsonStreamWriter::put(
+    char c
+)
+{
+    if (used == buffer.size())
+        flushBuffer();
+    buffer[used++] = c;
+    return *this;
+}
+
+JsonStreamWriter &JsonStreamWriter::put(
+    const char *s
+)
+{
+    return put(s, strlen(s));
+}
+
+JsonStreamWriter &JsonStreamWriter::put(
+    const char *s,
+    size_t size
+)
+{
+    while (size) {
+        if (used == buffer.size())
+            flushBuffer();
+        size_t sz = buffer.size() - used;
+        if (sz > size)
+            sz = size;
+        memmove(buffer.data() + used, s, sz);
+        used += sz;
+        s += sz;
+        size -= sz;
+    }
+    return *this;
+}
+
+JsonStreamWriter &JsonStreamWriter::put(
+    const std::string &s
+)
+{
+    return put(s.c_str(), s.size());
+}
+
+JsonStreamWriter &JsonStreamWriter::hex(
+    const void *value,
+    size_t size
+)
+{
+    auto p = (const unsigned char *) value;
+    for (size_t i = 0; i < size; i++) {
+        if (used + 2 > buffer.size())
+            flushBuffer();
+        buffer[used++] = HEX_DIGITS[p[i] >> 4];
+        buffer[used++] = HEX_DIGITS[p[i] & 0xf];
+    }
+    return *this;
+}
+
+JsonStreamWriter &JsonStreamWriter::hex(
+    uint64_t value
+)
+{
+    char s[16];
+    size_t i = sizeof(s);
+    do {
+        s[--i] = HEX_DIGITS[value & 0xf];
+        value >>= 4;
+    } while (value);
+    return put(s + i, sizeof(s) - i);
+}
+
+JsonStreamWriter &JsonStreamWriter::dec(
+    uint32_t value
+)
+{
+    char s[10];
+    size_t i = sizeof(s);
+    do {
+        s[--i] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value);
+    return put(s + i, sizeof(s) - i);
+}
@@ -0,0 +1,89 @@
+#ifndef LORAWAN_STORAGE_JSON_STREAM_H
+#define LORAWAN_STORAGE_JSON_STREAM_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+
+/**
+ * Read top level array of flat objects without building the document.
+ * String values of the requested fields are collected into reused strings, onRecord is called at the end of each object.
+ * Values of other types and nested objects are skipped.
+ */
+class JsonRecordReader {
+public:
+    /**
+     * @param values values indexed as fields passed to the constructor
+     * @param present bit i is set if the field i is present in the object
+     */
+    typedef std::function<void(const std::vector<std::string> &values, uint32_t present)> OnRecord;
+    /**
+     * @param fields field names, up to 32
+     * @param onRecord called for each object of the top level array
+     */
+    JsonRecordReader(const std::vector<std::string> &fields, const OnRecord &onRecord);
+    /**
+     * Parse stream
+     * @param strm input stream
+     * @return true- success, false- JSON syntax error or top level value is not an array
+     */
+    bool parse(std::istream &strm);
+    // parse error message
+    const std::string &error() const;
+    // objects read by parse()
+    size_t count() const;
+private:
+    class Handler;
+    std::vector<std::string> fields;
+    OnRecord onRecord;
+    std::vector<std::string> values;
+    std::string errorMessage;
+    size_t records;
+};
+
+/**
+ * Write JSON file through the fixed size buffer.
+ * Values are appended as is, caller adds quotes and separators.
+ */
+class JsonStreamWriter {
+public:
+    explicit JsonStreamWriter(size_t bufferSize = 64 * 1024);
+    virtual ~JsonStreamWriter();
+    /**
+     * Create or truncate file
+     * @return true- success
+     */
+    bool open(const std::string &fileName);
+    /**
+     * Write buffer and close file
+     * @return true- all writes succeeded
+     */
+    bool close();
+    JsonStreamWriter &put(char c);
+    JsonStreamWriter &put(const char *s);
+    JsonStreamWriter &put(const char *s, size_t size);
+    JsonStreamWriter &put(const std::string &s);
+    /**
+     * Append lower case hex of each byte, 2 characters per byte
+     */
+    JsonStreamWriter &hex(const void *buffer, size_t size);
+    /**
+     * Append lower case hex without leading zeros
+     */
+    JsonStreamWriter &hex(uint64_t value);
+    /**
+     * Append decimal
+     */
+    JsonStreamWriter &dec(uint32_t value);
+private:
+    FILE *file;
+    std::vector<char> buffer;
+    size_t used;
+    bool good;
+    void flushBuffer();
+};
+
+#endif
@@ -58,7 +58,7 @@ void AsyncWrapperIdentityService::rm(
 
 void AsyncWrapperIdentityService::list(
     uint32_t offset,
-    uint8_t size,
+    uint32_t size,
     const std::function<void(
         int retCode,
         std::vector<NETWORKIDENTITY> &retval
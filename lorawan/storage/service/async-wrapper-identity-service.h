@@ -48,7 +48,7 @@ public:
 
     void list(
         uint32_t offset,
-        uint8_t size,
+        uint32_t size,
         const std::function<void(
             int retCode,
             std::vector<NETWORKIDENTITY> &retval
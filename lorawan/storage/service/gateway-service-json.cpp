@@ -6,7 +6,7 @@
 #include "lorawan/helper/ip-address.h"
 #include "lorawan/lorawan-error.h"
 #include "lorawan/lorawan-string.h"
-#include "nlohmann/json.hpp"
+#include "lorawan/storage/serialization/json-stream.h"
 
 #ifdef ESP_PLATFORM
 #include <iostream>
@@ -110,50 +110,52 @@ int JsonGatewayService::rm(
     return ERR_CODE_GATEWAY_NOT_FOUND;
 }
 
+#define GATEWAY_JSON_FIELD_ID      0
+#define GATEWAY_JSON_FIELD_ADDR    1
+
+/**
+ * Read gateways one by one, document is not built
+ * @return true- success
+ */
 bool JsonGatewayService::load()
 {
     std::ifstream f(fileName);
-    nlohmann::json js;
-    try {
-        js = nlohmann::json::parse(f);
-    } catch (nlohmann::json::exception &exception) {
-        std::cerr << exception.what() << std::endl;
-        return false;
-    }
-    if (!js.is_array())
-        return false;
-    for (auto& e : js) {
-        if (!e.contains("gwid") || !e.contains("addr"))
-            continue;
-        auto jgwid = e["gwid"];
-        if (!jgwid.is_string())
-            continue;
-        auto jaddr = e["addr"];
-        if (!jaddr.is_string())
-            continue;
-        uint64_t gatewayId = string2gatewayId(jgwid);
-        GatewayIdentity gi(gatewayId, jaddr);
+    JsonRecordReader reader({ "gwid", "addr" }, [this] (const std::vector<std::string> &v, uint32_t present) {
+        if (present != ((1u << GATEWAY_JSON_FIELD_ID) | (1u << GATEWAY_JSON_FIELD_ADDR)))
+            return;
+        uint64_t gatewayId = string2gatewayId(v[GATEWAY_JSON_FIELD_ID]);
+        GatewayIdentity gi(gatewayId, v[GATEWAY_JSON_FIELD_ADDR]);
         storage[gatewayId] = gi;
+    });
+    if (!reader.parse(f)) {
+        std::cerr << reader.error() << std::endl;
+        return false;
     }
-    f.close();
     return true;
 }
 
+/**
+ * Write gateways in the GatewayIdentity::toJsonString() format
+ * @return true- success
+ */
 bool JsonGatewayService::store()
 {
-    std::ofstream f(fileName);
+    JsonStreamWriter w;
+    if (!w.open(fileName))
+        return false;
     bool isFirst = true;
-    f << "[\n";
+    w.put("[\n");
     for (auto& e : this->storage) {
         if (isFirst)
             isFirst = false;
         else
-            f << ",\n";
-        f << e.second.toJsonString();
+            w.put(",\n");
+        w.put(R"({"gwid": ")").hex(e.second.gatewayId)
+            .put(R"(", "addr": ")").put(sockaddr2string(&e.second.sockaddr))
+            .put("\"}");
     }
-    f << "]\n";
-    f.close();
-    return true;
+    w.put("]\n");
+    return w.close();
 }
 
 int JsonGatewayService::init(
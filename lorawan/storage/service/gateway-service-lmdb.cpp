@@ -86,6 +86,54 @@ int  LMDBGatewayService::list(
     return r;
 }
 
+/**
+ * List entries in the key order. Cursor is positioned by MDB_SET_RANGE to the key or the next one.
+ */
+int LMDBGatewayService::listAfter(
+    std::vector<GatewayIdentity> &retVal,
+    const uint64_t *after,
+    uint32_t size
+)
+{
+    if (size == 0)
+        return CODE_OK;
+    int r = mdb_txn_begin(env.env, nullptr, MDB_RDONLY, &env.txn);
+    if (r)
+        return ERR_CODE_LMDB_TXN_BEGIN;
+
+    MDB_cursor *cursor;
+    r = mdb_cursor_open(env.txn, env.dbi, &cursor);
+    if (r != MDB_SUCCESS) {
+        mdb_txn_abort(env.txn);
+        return r;
+    }
+
+    uint64_t key = after ? *after : 0;
+    MDB_val dbKey { sizeof(uint64_t), &key };
+    MDB_val dbVal {};
+    if (after) {
+        r = mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_SET_RANGE);
+        // skip the cursor entry itself
+        if (r == MDB_SUCCESS && dbKey.mv_size == sizeof(uint64_t) && memcmp(dbKey.mv_data, &key, sizeof(uint64_t)) == 0)
+            r = mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_NEXT);
+    } else
+        r = mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_FIRST);
+
+    for (; r == MDB_SUCCESS; r = mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_NEXT)) {
+        if (dbKey.mv_size != sizeof(uint64_t) || dbVal.mv_size != sizeof(struct sockaddr))
+            break;  // error, database corrupted
+        retVal.emplace_back();
+        GatewayIdentity &gi = retVal.back();
+        memmove(&gi.gatewayId, dbKey.mv_data, sizeof(uint64_t));
+        memmove(&gi.sockaddr, dbVal.mv_data, sizeof(struct sockaddr));
+        if (--size == 0)
+            break;
+    }
+    mdb_cursor_close(cursor);
+    mdb_txn_abort(env.txn);
+    return CODE_OK;
+}
+
 // Entries count
 size_t LMDBGatewayService::size()
 {
@@ -77,6 +77,20 @@ int  MemoryGatewayService::list(
     return CODE_OK;
 }
 
+// List entries following the gateway identifier
+int MemoryGatewayService::listAfter(
+    std::vector<GatewayIdentity> &retVal,
+    const uint64_t *after,
+    uint32_t size
+)
+{
+    auto it = after ? storage.upper_bound(*after) : storage.begin();
+    for (; it != storage.end() && size > 0; it++, size--) {
+        retVal.push_back(it->second);
+    }
+    return CODE_OK;
+}
+
 // Entries count
 size_t MemoryGatewayService::size()
 {
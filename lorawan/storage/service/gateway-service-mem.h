@@ -20,6 +20,10 @@ public:
         uint32_t offset,
         uint8_t size
     ) override;
+    int listAfter(std::vector<GatewayIdentity> &retVal,
+        const uint64_t *after,
+        uint32_t size
+    ) override;
     // Entries count
     size_t size() override;
     int put(const GatewayIdentity &request) override;
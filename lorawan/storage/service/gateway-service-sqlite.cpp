@@ -87,6 +87,43 @@ int SqliteGatewayService::list(
     return CODE_OK;
 }
 
+/**
+ * List entries in the primary key order following the gateway identifier.
+ * Identifiers are stored as text, so the order is the text order of the hexadecimal identifiers.
+ */
+int SqliteGatewayService::listAfter(
+    std::vector<GatewayIdentity> &retVal,
+    const uint64_t *after,
+    uint32_t size
+)
+{
+    if (!db)
+        return ERR_CODE_DB_DATABASE_NOT_FOUND;
+    char *zErrMsg = nullptr;
+    std::stringstream statement;
+    statement << "SELECT id, addr FROM gateway ";
+    if (after)
+        statement << "WHERE id > '" << gatewayId2str(*after) << "' ";
+    statement << "ORDER BY id LIMIT " << size;
+    std::vector<std::vector<std::string>> table;
+    int r = sqlite3_exec(db, statement.str().c_str(), tableCallback, &table, &zErrMsg);
+    if (r != SQLITE_OK) {
+        if (zErrMsg) {
+            sqlite3_free(zErrMsg);
+        }
+        return ERR_CODE_DB_SELECT;
+    }
+    for (auto &row : table) {
+        if (row.size() < 2)
+            continue;
+        GatewayIdentity gi;
+        gi.gatewayId = string2gatewayId(row[0]);
+        string2sockaddr(&gi.sockaddr, row[1]);
+        retVal.push_back(gi);
+    }
+    return CODE_OK;
+}
+
 // Entries count
 size_t SqliteGatewayService::size()
 {
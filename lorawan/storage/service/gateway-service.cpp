@@ -1,6 +1,8 @@
 #include "lorawan/lorawan-conv.h"
+#include "lorawan/lorawan-error.h"
 #include "gateway-service.h"
 
 GatewayService::GatewayService() = default;
 
 GatewayService::~GatewayService() = default;
+
@@ -44,6 +44,19 @@ public:
         uint8_t size
     ) = 0;
 
+    /**
+     * List entries in the storage order following the entry with the gateway identifier (key continuation)
+     * @param retVal return values
+     * @param after gateway identifier of the last entry of the previous page, nullptr- from the first entry
+     * @param size max entries count
+     * @return CODE_OK- success
+     */
+    virtual int listAfter(
+        std::vector<GatewayIdentity> &retVal,
+        const uint64_t *after,
+        uint32_t size
+    ) = 0;
+
     // Entries count
     virtual size_t size() = 0;
 
@@ -0,0 +1,171 @@
+#include "lorawan/storage/service/identity-address-allocator.h"
+#include "lorawan/lorawan-error.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define ALL_USED    (~(uint64_t) 0)
+
+// index of the lowest set bit, value must not be 0
+static inline int ctz64(
+    uint64_t value
+)
+{
+#ifdef _MSC_VER
+    unsigned long r;
+    _BitScanForward64(&r, value);
+    return (int) r;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+IdentityAddressAllocator::IdentityAddressAllocator()
+    : base(0), capacity(0), used(0)
+{
+}
+
+IdentityAddressAllocator::~IdentityAddressAllocator() = default;
+
+void IdentityAddressAllocator::reset(
+    const NETID &aNetid
+)
+{
+    netid.set(aNetid);
+    base = DEVADDR(netid, false).u;
+    capacity = DEVADDR(netid, true).u - base + 1;
+    used = 0;
+    levels.clear();
+    size_t bits = capacity;
+    do {
+        size_t words = (bits + 63) / 64;
+        levels.emplace_back(words, 0);
+        // bits out of range are always used
+        if (bits % 64)
+            levels.back()[words - 1] = ALL_USED << (bits % 64);
+        bits = words;
+    } while (bits > 1);
+    // padding can make the last word full
+    for (size_t l = 0; l + 1 < levels.size(); l++) {
+        size_t w = levels[l].size() - 1;
+        if (levels[l][w] == ALL_USED)
+            levels[l + 1][w / 64] |= (uint64_t) 1 << (w % 64);
+    }
+    // zero address is reserved as "no address"
+    if (base == 0)
+        setBit(0);
+}
+
+void IdentityAddressAllocator::clear()
+{
+    levels.clear();
+    capacity = 0;
+    used = 0;
+}
+
+bool IdentityAddressAllocator::ready(
+    const NETID &aNetid
+) const
+{
+    return !levels.empty() && netid.get() == aNetid.get();
+}
+
+/**
+ * Get bit index of the address if address belongs to the network
+ * @param retVal bit index
+ * @param addr address
+ * @return true if address is in the network address space
+ */
+bool IdentityAddressAllocator::index(
+    uint32_t &retVal,
+    const DEVADDR &addr
+) const
+{
+    if (levels.empty())
+        return false;
+    // NwkAddr is the lowest bits of the address, so network addresses are contiguous
+    retVal = addr.u - base;
+    return retVal < capacity;
+}
+
+void IdentityAddressAllocator::setBit(
+    uint32_t n
+)
+{
+    size_t i = n;
+    for (auto &level : levels) {
+        uint64_t &w = level[i / 64];
+        uint64_t b = (uint64_t) 1 << (i % 64);
+        if (w & b)
+            return;
+        if (&level == &levels.front())
+            used++;
+        w |= b;
+        if (w != ALL_USED)
+            return;
+        // word is full, mark it in the upper level
+        i /= 64;
+    }
+}
+
+void IdentityAddressAllocator::clearBit(
+    uint32_t n
+)
+{
+    size_t i = n;
+    for (auto &level : levels) {
+        uint64_t &w = level[i / 64];
+        uint64_t b = (uint64_t) 1 << (i % 64);
+        if (!(w & b))
+            return;
+        if (&level == &levels.front())
+            used--;
+        bool wasFull = w == ALL_USED;
+        w &= ~b;
+        if (!wasFull)
+            return;
+        // word was full, upper level must know it has a free bit now
+        i /= 64;
+    }
+}
+
+void IdentityAddressAllocator::put(
+    const DEVADDR &addr
+)
+{
+    uint32_t n;
+    if (index(n, addr))
+        setBit(n);
+}
+
+void IdentityAddressAllocator::rm(
+    const DEVADDR &addr
+)
+{
+    uint32_t n;
+    if (index(n, addr))
+        clearBit(n);
+}
+
+int IdentityAddressAllocator::next(
+    DEVADDR &retVal
+)
+{
+    if (levels.empty() || levels.back()[0] == ALL_USED)
+        return ERR_CODE_ADDR_SPACE_FULL;
+    // descend from the single top word to the free bit
+    size_t i = 0;
+    for (size_t l = levels.size(); l > 0; l--) {
+        uint64_t w = levels[l - 1][i];
+        i = i * 64 + ctz64(~w);
+    }
+    setBit((uint32_t) i);
+    retVal.u = base + (uint32_t) i;
+    return CODE_OK;
+}
+
+size_t IdentityAddressAllocator::size() const
+{
+    return used;
+}
@@ -0,0 +1,66 @@
+#ifndef IDENTITY_ADDRESS_ALLOCATOR_H_
+#define IDENTITY_ADDRESS_ALLOCATOR_H_ 1
+
+#include <vector>
+
+#include "lorawan/lorawan-types.h"
+
+/**
+ * Free address allocator over address space of the network, addresses DEVADDR(netid, false)..DEVADDR(netid, true).
+ * Hierarchical bitmap: level 0 has a bit per address (1- used), each upper level has a bit
+ * per word of the level below (1- word is full). Top level is a single word, so next() looks
+ * at one word per level whatever full the space is.
+ * Bitmap is allocated by reset(). Before it put() and rm() do nothing, so storage does not pay
+ * for it until next() is called first time.
+ */
+class IdentityAddressAllocator {
+protected:
+    NETID netid;
+    uint32_t base;      ///< lowest address
+    uint32_t capacity;  ///< addresses count
+    size_t used;
+    std::vector<std::vector<uint64_t> > levels;
+
+    bool index(uint32_t &retVal, const DEVADDR &addr) const;
+    void setBit(uint32_t idx);
+    void clearBit(uint32_t idx);
+public:
+    IdentityAddressAllocator();
+    virtual ~IdentityAddressAllocator();
+    /**
+     * Allocate empty bitmap for the network address space
+     * @param netid network identifier
+     */
+    void reset(const NETID &netid);
+    /**
+     * Release bitmap
+     */
+    void clear();
+    /**
+     * Return true if bitmap is allocated for the network
+     * @param netid network identifier
+     */
+    bool ready(const NETID &netid) const;
+    /**
+     * Mark address as used. Addresses of other networks are ignored
+     * @param addr address
+     */
+    void put(const DEVADDR &addr);
+    /**
+     * Mark address as free
+     * @param addr address
+     */
+    void rm(const DEVADDR &addr);
+    /**
+     * Find out the lowest free address and mark it as used
+     * @param retVal free address
+     * @return CODE_OK- success, ERR_CODE_ADDR_SPACE_FULL- no free address
+     */
+    int next(DEVADDR &retVal);
+    /**
+     * @return used addresses count
+     */
+    size_t size() const;
+};
+
+#endif
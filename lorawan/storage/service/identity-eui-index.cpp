@@ -0,0 +1,74 @@
+#include "lorawan/storage/service/identity-eui-index.h"
+
+IdentityEUIIndex::IdentityEUIIndex() = default;
+
+IdentityEUIIndex::~IdentityEUIIndex() = default;
+
+void IdentityEUIIndex::put(
+    const DEVEUI &eui,
+    const DEVADDR &addr,
+    const DEVEUI &previous,
+    bool hasPrevious
+)
+{
+    if (hasPrevious) {
+        if (previous.u == eui.u)
+            return; // already indexed
+        rm(previous, addr);
+    }
+    index.emplace(eui.u, addr.u);
+}
+
+void IdentityEUIIndex::rm(
+    const DEVEUI &eui,
+    const DEVADDR &addr
+)
+{
+    auto range = index.equal_range(eui.u);
+    for (auto it = range.first; it != range.second; it++) {
+        if (it->second == addr.u) {
+            index.erase(it);
+            return;
+        }
+    }
+}
+
+bool IdentityEUIIndex::find(
+    DEVADDR &retVal,
+    const DEVEUI &eui
+) const
+{
+    auto range = index.equal_range(eui.u);
+    if (range.first == range.second)
+        return false;
+    uint32_t a = range.first->second;
+    for (auto it = range.first; it != range.second; it++) {
+        if (it->second < a)
+            a = it->second;
+    }
+    retVal.u = a;
+    return true;
+}
+
+void IdentityEUIIndex::clear()
+{
+    index.clear();
+}
+
+void IdentityEUIIndex::reserve(
+    size_t count
+)
+{
+    index.reserve(count);
+}
+
+void IdentityEUIIndex::stats(
+    IDENTITY_INDEX_STATS &retVal
+) const
+{
+    retVal.entries = index.size();
+    retVal.buckets = index.bucket_count();
+    // bucket is a pointer, node keeps next pointer and the pair
+    retVal.bytes = retVal.buckets * sizeof(void *)
+        + retVal.entries * (sizeof(void *) + sizeof(std::pair<const uint64_t, uint32_t>));
+}
@@ -0,0 +1,58 @@
+#ifndef IDENTITY_EUI_INDEX_H_
+#define IDENTITY_EUI_INDEX_H_ 1
+
+#include <unordered_map>
+
+#include "lorawan/lorawan-types.h"
+
+/**
+ * Index memory usage
+ */
+typedef struct {
+    size_t entries;     ///< indexed device identifiers count
+    size_t buckets;     ///< hash table buckets count
+    size_t bytes;       ///< estimated memory used by the index, bytes
+} IDENTITY_INDEX_STATS;
+
+/**
+ * Secondary DevEUI -> DEVADDR hash index.
+ * ABP devices may not store EUI, so one EUI can be shared by several addresses.
+ * find() returns the lowest address, same as a linear scan over ordered storage.
+ */
+class IdentityEUIIndex {
+protected:
+    std::unordered_multimap<uint64_t, uint32_t> index;
+public:
+    IdentityEUIIndex();
+    virtual ~IdentityEUIIndex();
+    /**
+     * Add address to the index. If address was indexed with other EUI, remove it first
+     * @param eui new device EUI
+     * @param addr device address
+     * @param previous previous device EUI if address was already stored
+     * @param hasPrevious true if address was already stored
+     */
+    void put(const DEVEUI &eui, const DEVADDR &addr, const DEVEUI &previous, bool hasPrevious);
+    /**
+     * Remove address from the index
+     * @param eui device EUI
+     * @param addr device address
+     */
+    void rm(const DEVEUI &eui, const DEVADDR &addr);
+    /**
+     * Find out address by EUI
+     * @param retVal return lowest address
+     * @param eui device EUI
+     * @return true if found
+     */
+    bool find(DEVADDR &retVal, const DEVEUI &eui) const;
+    void clear();
+    /**
+     * Reserve buckets to avoid rehashing on bulk load
+     * @param count expected entries count
+     */
+    void reserve(size_t count);
+    void stats(IDENTITY_INDEX_STATS &retVal) const;
+};
+
+#endif
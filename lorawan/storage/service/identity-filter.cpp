@@ -0,0 +1,317 @@
+#include "lorawan/storage/service/identity-filter.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define FIELD_OFFSET(id, field) ((size_t) ((const char *) &(id).field - (const char *) &(id)))
+
+/**
+ * Get property location in the DEVICE_ID, sizes are the same as isIdentityFilteredV2() compares
+ * @param retOffset return offset in DEVICE_ID
+ * @param p property
+ * @return property size, 0- unknown property
+ */
+static size_t getDeviceIdPropertyLocation(
+    size_t &retOffset,
+    enum NETWORK_IDENTITY_PROPERTY p
+)
+{
+    static const DEVICE_ID id {};
+    switch (p) {
+        case NIP_ACTIVATION:
+            retOffset = FIELD_OFFSET(id, activation);
+            return sizeof(id.activation);
+        case NIP_DEVICE_CLASS:
+            retOffset = FIELD_OFFSET(id, deviceclass);
+            return sizeof(id.deviceclass);
+        case NIP_DEVEUI:
+            retOffset = FIELD_OFFSET(id, devEUI.u);
+            return sizeof(id.devEUI.u);
+        case NIP_NWKSKEY:
+            retOffset = FIELD_OFFSET(id, nwkSKey.u);
+            return sizeof(id.nwkSKey.u);
+        case NIP_APPSKEY:
+            retOffset = FIELD_OFFSET(id, appSKey.u);
+            return sizeof(id.appSKey.u);
+        case NIP_LORAWAN_VERSION:
+            retOffset = FIELD_OFFSET(id, version.c);
+            return sizeof(id.version.c);
+        // OTAA
+        case NIP_APPEUI:
+            retOffset = FIELD_OFFSET(id, appEUI.u);
+            return sizeof(id.appEUI.u);
+        case NIP_APPKEY:
+            retOffset = FIELD_OFFSET(id, appKey.u);
+            return sizeof(id.appKey.u);
+        case NIP_NWKKEY:
+            retOffset = FIELD_OFFSET(id, nwkKey.u);
+            return sizeof(id.nwkKey.u);
+        case NIP_DEVNONCE:
+            retOffset = FIELD_OFFSET(id, devNonce.c);
+            return sizeof(id.devNonce.u);
+        case NIP_JOINNONCE:
+            retOffset = FIELD_OFFSET(id, joinNonce.c);
+            return sizeof(id.joinNonce.c);
+        // added for searching
+        case NIP_DEVICENAME:
+            retOffset = FIELD_OFFSET(id, name.c);
+            return sizeof(id.name.c);
+        default:
+            retOffset = 0;
+            return 0;
+    }
+}
+
+static size_t getPropertyLocation(
+    size_t &retOffset,
+    const NETWORK_IDENTITY_FILTER &filter
+)
+{
+    size_t sz;
+    if (filter.property == NIP_ADDRESS) {
+        retOffset = 0;
+        sz = sizeof(DEVADDR::u);
+    } else
+        sz = getDeviceIdPropertyLocation(retOffset, filter.property);
+    if (filter.length < sz)
+        sz = filter.length;
+    return sz;
+}
+
+size_t IdentityFilter::comparedSize(
+    const NETWORK_IDENTITY_FILTER &filter
+)
+{
+    size_t offset;
+    return getPropertyLocation(offset, filter);
+}
+
+IdentityFilter::IdentityFilter(
+    const std::vector<NETWORK_IDENTITY_FILTER> &filters
+)
+    : never(false)
+{
+    for (auto &f : filters) {
+        if (f.pre == NILPO_OR)
+            continue;   // previous result is true, see isIdentityFilteredV2()
+        IDENTITY_FILTER_TERM t {};
+        t.op = f.comparisonOperator;
+        size_t offset = 0;
+        size_t sz = getPropertyLocation(offset, f);
+        t.offset = (uint8_t) offset;
+        t.size = (uint8_t) sz;
+        if (sz == 0) {
+            // memcmp() of nothing is 0
+            t.source = IFS_CONST;
+            t.constant = compare(0, 0, t.op);
+            if (!t.constant)
+                never = true;
+            continue;
+        }
+        if (sz > sizeof(uint64_t) || offset + sizeof(uint64_t) > sizeof(DEVICE_ID)) {
+            t.source = IFS_BYTES;
+            memmove(t.data, f.filterData, sz);
+            rowTerms.push_back(t);
+            continue;
+        }
+        uint64_t k = 0;
+        memmove(&k, f.filterData, sz);
+        t.key = NTOH8(k);
+        t.mask = ~0ull << (8 * (sizeof(uint64_t) - sz));
+        if (f.property == NIP_ADDRESS) {
+            t.source = IFS_ADDRESS;
+            columnTerms.push_back(t);
+        } else {
+            t.source = IFS_DEVICE;
+            if (f.property == NIP_DEVEUI)
+                columnTerms.push_back(t);
+            else
+                rowTerms.push_back(t);
+        }
+    }
+}
+
+/**
+ * Clear rejected rows, loop body has no branches
+ */
+template <enum NETWORK_IDENTITY_COMPARISON_OPERATOR OP>
+static void scanColumn64(
+    uint8_t *selected,
+    const uint64_t *column,
+    size_t count,
+    uint64_t mask,
+    uint64_t key
+)
+{
+    for (size_t i = 0; i < count; i++) {
+        uint64_t v = NTOH8(column[i]) & mask;
+        bool r;
+        switch (OP) {
+            case NICO_EQ:
+                r = v == key;
+                break;
+            case NICO_NE:
+                r = v != key;
+                break;
+            case NICO_GT:
+                r = v > key;
+                break;
+            case NICO_LT:
+                r = v < key;
+                break;
+            case NICO_GE:
+                r = v >= key;
+                break;
+            default:
+                r = v <= key;
+                break;
+        }
+        selected[i] &= (uint8_t) r;
+    }
+}
+
+template <enum NETWORK_IDENTITY_COMPARISON_OPERATOR OP>
+static void scanColumn32(
+    uint8_t *selected,
+    const uint32_t *column,
+    size_t count,
+    uint32_t mask,
+    uint32_t key
+)
+{
+    size_t i = 0;
+#if defined(__SSE2__) && (BYTE_ORDER == LITTLE_ENDIAN)
+    // 4 addresses at once. Bytes are swapped by shifts, unsigned order is signed order with flipped sign bits
+    const __m128i m = _mm_set1_epi32((int) mask);
+    const __m128i sign = _mm_set1_epi32((int) 0x80000000);
+    const __m128i k = _mm_xor_si128(_mm_set1_epi32((int) key), sign);
+    const __m128i b1 = _mm_set1_epi32(0x00ff0000);
+    const __m128i b2 = _mm_set1_epi32(0x0000ff00);
+    for (; i + 4 <= count; i += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (column + i));
+        __m128i v = _mm_or_si128(
+            _mm_or_si128(_mm_slli_epi32(a, 24), _mm_srli_epi32(a, 24)),
+            _mm_or_si128(_mm_and_si128(_mm_slli_epi32(a, 8), b1), _mm_and_si128(_mm_srli_epi32(a, 8), b2))
+        );
+        v = _mm_xor_si128(_mm_and_si128(v, m), sign);
+        __m128i r;
+        switch (OP) {
+            case NICO_EQ:
+                r = _mm_cmpeq_epi32(v, k);
+                break;
+            case NICO_NE:
+                r = _mm_andnot_si128(_mm_cmpeq_epi32(v, k), _mm_set1_epi32(-1));
+                break;
+            case NICO_GT:
+                r = _mm_cmpgt_epi32(v, k);
+                break;
+            case NICO_LT:
+                r = _mm_cmplt_epi32(v, k);
+                break;
+            case NICO_GE:
+                r = _mm_andnot_si128(_mm_cmplt_epi32(v, k), _mm_set1_epi32(-1));
+                break;
+            default:
+                r = _mm_andnot_si128(_mm_cmpgt_epi32(v, k), _mm_set1_epi32(-1));
+                break;
+        }
+        int bits = _mm_movemask_ps(_mm_castsi128_ps(r));
+        selected[i] &= (uint8_t) (bits & 1);
+        selected[i + 1] &= (uint8_t) ((bits >> 1) & 1);
+        selected[i + 2] &= (uint8_t) ((bits >> 2) & 1);
+        selected[i + 3] &= (uint8_t) ((bits >> 3) & 1);
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t v = NTOH4(column[i]) & mask;
+        bool r;
+        switch (OP) {
+            case NICO_EQ:
+                r = v == key;
+                break;
+            case NICO_NE:
+                r = v != key;
+                break;
+            case NICO_GT:
+                r = v > key;
+                break;
+            case NICO_LT:
+                r = v < key;
+                break;
+            case NICO_GE:
+                r = v >= key;
+                break;
+            default:
+                r = v <= key;
+                break;
+        }
+        selected[i] &= (uint8_t) r;
+    }
+}
+
+void IdentityFilter::scan(
+    uint8_t *selected,
+    const uint32_t *addrs,
+    const uint64_t *euis,
+    size_t count
+) const
+{
+    if (never) {
+        memset(selected, 0, count);
+        return;
+    }
+    for (auto &t : columnTerms) {
+        if (t.source == IFS_ADDRESS) {
+            auto m = (uint32_t) (t.mask >> 32);
+            auto k = (uint32_t) (t.key >> 32);
+            switch (t.op) {
+                case NICO_EQ:
+                    scanColumn32<NICO_EQ>(selected, addrs, count, m, k);
+                    break;
+                case NICO_NE:
+                    scanColumn32<NICO_NE>(selected, addrs, count, m, k);
+                    break;
+                case NICO_GT:
+                    scanColumn32<NICO_GT>(selected, addrs, count, m, k);
+                    break;
+                case NICO_LT:
+                    scanColumn32<NICO_LT>(selected, addrs, count, m, k);
+                    break;
+                case NICO_GE:
+                    scanColumn32<NICO_GE>(selected, addrs, count, m, k);
+                    break;
+                case NICO_LE:
+                    scanColumn32<NICO_LE>(selected, addrs, count, m, k);
+                    break;
+                default:
+                    memset(selected, 0, count);
+                    break;
+            }
+        } else {
+            switch (t.op) {
+                case NICO_EQ:
+                    scanColumn64<NICO_EQ>(selected, euis, count, t.mask, t.key);
+                    break;
+                case NICO_NE:
+                    scanColumn64<NICO_NE>(selected, euis, count, t.mask, t.key);
+                    break;
+                case NICO_GT:
+                    scanColumn64<NICO_GT>(selected, euis, count, t.mask, t.key);
+                    break;
+                case NICO_LT:
+                    scanColumn64<NICO_LT>(selected, euis, count, t.mask, t.key);
+                    break;
+                case NICO_GE:
+                    scanColumn64<NICO_GE>(selected, euis, count, t.mask, t.key);
+                    break;
+                case NICO_LE:
+                    scanColumn64<NICO_LE>(selected, euis, count, t.mask, t.key);
+                    break;
+                default:
+                    memset(selected, 0, count);
+                    break;
+            }
+        }
+    }
+}
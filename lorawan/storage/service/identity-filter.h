@@ -0,0 +1,134 @@
+#ifndef IDENTITY_FILTER_H_
+#define IDENTITY_FILTER_H_ 1
+
+#include <cstring>
+#include <vector>
+
+#include "lorawan/lorawan-types.h"
+#include "lorawan/lorawan-conv.h"
+
+enum IDENTITY_FILTER_SOURCE {
+    IFS_CONST = 0,      ///< result does not depend on the identity
+    IFS_ADDRESS,        ///< 4 bytes address
+    IFS_DEVICE,         ///< up to 8 bytes at the offset in DEVICE_ID
+    IFS_BYTES           ///< longer than 8 bytes at the offset in DEVICE_ID, compared by memcmp()
+};
+
+/**
+ * One compiled comparison. Property bytes are loaded as a big endian number, so integer comparison
+ * gives the same result as memcmp() of property bytes and filter data does.
+ */
+typedef struct {
+    enum IDENTITY_FILTER_SOURCE source;
+    enum NETWORK_IDENTITY_COMPARISON_OPERATOR op;
+    bool constant;      ///< IFS_CONST result
+    uint8_t offset;     ///< offset in DEVICE_ID
+    uint8_t size;       ///< compared bytes count
+    uint64_t mask;      ///< compared bytes in the most significant bytes
+    uint64_t key;       ///< filter data, big endian
+    char data[16];      ///< filter data for IFS_BYTES
+} IDENTITY_FILTER_TERM;
+
+/**
+ * Filter list compiled once per filter() call.
+ * isIdentityFilteredV2() stops at the first false result, so an "or" term is evaluated only when the previous
+ * result is true and can not change it. Compiled filter keeps "and" terms only and gives the same result.
+ * Address and DevEUI terms can be evaluated over packed columns by scan(), other terms are checked by matchRow().
+ */
+class IdentityFilter {
+protected:
+    std::vector<IDENTITY_FILTER_TERM> columnTerms;  ///< address and DevEUI
+    std::vector<IDENTITY_FILTER_TERM> rowTerms;     ///< other properties
+    bool never;                                     ///< some term is always false
+
+    static bool compare(uint64_t value, uint64_t key, enum NETWORK_IDENTITY_COMPARISON_OPERATOR op) {
+        switch (op) {
+            case NICO_EQ:
+                return value == key;
+            case NICO_NE:
+                return value != key;
+            case NICO_GT:
+                return value > key;
+            case NICO_LT:
+                return value < key;
+            case NICO_GE:
+                return value >= key;
+            case NICO_LE:
+                return value <= key;
+            default:
+                return false;
+        }
+    }
+
+    static bool test(const IDENTITY_FILTER_TERM &t, const DEVADDR &addr, const DEVICE_ID &id) {
+        uint64_t v;
+        switch (t.source) {
+            case IFS_ADDRESS:
+                v = (uint64_t) NTOH4(addr.u) << 32;
+                break;
+            case IFS_DEVICE:
+                memcpy(&v, (const char *) &id + t.offset, sizeof(v));
+                v = NTOH8(v);
+                break;
+            case IFS_BYTES:
+                {
+                    // memcmp() result as 0, 1 or 2 compared with 1
+                    int c = memcmp((const char *) &id + t.offset, t.data, t.size);
+                    return compare(c < 0 ? 0 : (c > 0 ? 2 : 1), 1, t.op);
+                }
+            default:
+                return t.constant;
+        }
+        return compare(v & t.mask, t.key, t.op);
+    }
+public:
+    explicit IdentityFilter(const std::vector<NETWORK_IDENTITY_FILTER> &filters);
+
+    /**
+     * Compared bytes count, min(property size, filter length)
+     * @param filter filter
+     * @return 0 if result does not depend on the identity
+     */
+    static size_t comparedSize(const NETWORK_IDENTITY_FILTER &filter);
+
+    /**
+     * Check identity, same result as isIdentityFilteredV2() returns
+     * @param addr address
+     * @param id device identifier
+     * @return true if identity matches filters
+     */
+    bool match(const DEVADDR &addr, const DEVICE_ID &id) const {
+        for (auto &t : columnTerms) {
+            if (!test(t, addr, id))
+                return false;
+        }
+        return matchRow(addr, id);
+    }
+
+    /**
+     * Check terms not evaluated by scan()
+     * @param addr address
+     * @param id device identifier
+     * @return true if identity matches filters
+     */
+    bool matchRow(const DEVADDR &addr, const DEVICE_ID &id) const {
+        if (never)
+            return false;
+        for (auto &t : rowTerms) {
+            if (!test(t, addr, id))
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * Evaluate address and DevEUI terms over packed columns, clear selected[i] of rejected rows.
+     * @param selected 0- row is rejected, 1- row must be checked by matchRow()
+     * @param addrs addresses (DEVADDR::u)
+     * @param euis DevEUI (DEVEUI::u)
+     * @param count rows count
+     */
+    void scan(uint8_t *selected, const uint32_t *addrs, const uint64_t *euis, size_t count) const;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include <cstring>
+
+#if defined(_MSC_VER) || defined(__MINGW32__)
+#include <io.h>
+#define FSYNC(f) _commit(_fileno(f))
+#else
+#include <unistd.h>
+#define FSYNC(f) fsync(fileno(f))
+#endif
+
+#include "lorawan/storage/service/identity-journal.h"
+#include "lorawan/lorawan-error.h"
+#include "lorawan/helper/crc-helper.h"
+
+#define OFFSET_JOURNAL_ID   4
+#define OFFSET_JOURNAL_OP   (OFFSET_JOURNAL_ID + sizeof(DEVICE_ID))
+#define OFFSET_JOURNAL_CRC  (SIZE_JOURNAL_RECORD - sizeof(uint16_t))
+
+IdentityJournal::IdentityJournal()
+    : file(nullptr), sync(false), count(0)
+{
+}
+
+IdentityJournal::~IdentityJournal()
+{
+    close();
+}
+
+int IdentityJournal::open(
+    const std::string &fileName,
+    bool syncEachRecord
+)
+{
+    close();
+    file = fopen(fileName.c_str(), "ab");
+    if (!file)
+        return ERR_CODE_JOURNAL_WRITE;
+    sync = syncEachRecord;
+    count = 0;
+    return CODE_OK;
+}
+
+void IdentityJournal::close()
+{
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+bool IdentityJournal::isOpen() const
+{
+    return file != nullptr;
+}
+
+int IdentityJournal::append(
+    enum IDENTITY_JOURNAL_OPERATION op,
+    const DEVADDR &addr,
+    const DEVICE_ID *id
+)
+{
+    if (!file)
+        return ERR_CODE_JOURNAL_WRITE;
+    uint8_t record[SIZE_JOURNAL_RECORD];
+    memmove(record, &addr.u, sizeof(addr.u));
+    if (id)
+        memmove(record + OFFSET_JOURNAL_ID, id, sizeof(DEVICE_ID));
+    else
+        memset(record + OFFSET_JOURNAL_ID, 0, sizeof(DEVICE_ID));
+    record[OFFSET_JOURNAL_OP] = (uint8_t) op;
+    record[OFFSET_JOURNAL_OP + 1] = 0;
+    uint16_t crc = crc16xmodem(record, OFFSET_JOURNAL_CRC);
+    memmove(record + OFFSET_JOURNAL_CRC, &crc, sizeof(crc));
+    if (fwrite(record, SIZE_JOURNAL_RECORD, 1, file) != 1 || fflush(file))
+        return ERR_CODE_JOURNAL_WRITE;
+    if (sync && FSYNC(file))
+        return ERR_CODE_JOURNAL_WRITE;
+    count++;
+    return CODE_OK;
+}
+
+size_t IdentityJournal::size() const
+{
+    return count;
+}
+
+size_t IdentityJournal::replay(
+    const std::string &fileName,
+    const std::function<void(enum IDENTITY_JOURNAL_OPERATION op, const DEVADDR &addr, const DEVICE_ID *id)> &onRecord
+)
+{
+    FILE *f = fopen(fileName.c_str(), "rb");
+    if (!f)
+        return 0;
+    size_t r = 0;
+    uint8_t record[SIZE_JOURNAL_RECORD];
+    while (fread(record, SIZE_JOURNAL_RECORD, 1, f) == 1) {
+        uint16_t crc;
+        memmove(&crc, record + OFFSET_JOURNAL_CRC, sizeof(crc));
+        if (crc != crc16xmodem(record, OFFSET_JOURNAL_CRC))
+            break;
+        DEVADDR addr;
+        memmove(&addr.u, record, sizeof(addr.u));
+        DEVICE_ID id;
+        memmove((void *) &id, record + OFFSET_JOURNAL_ID, sizeof(DEVICE_ID));
+        auto op = (enum IDENTITY_JOURNAL_OPERATION) record[OFFSET_JOURNAL_OP];
+        if (op == IJO_PUT)
+            onRecord(op, addr, &id);
+        else
+            if (op == IJO_RM)
+                onRecord(op, addr, nullptr);
+            else
+                break;
+        r++;
+    }
+    fclose(f);
+    return r;
+}
@@ -0,0 +1,62 @@
+#ifndef IDENTITY_JOURNAL_H_
+#define IDENTITY_JOURNAL_H_ 1
+
+#include <cstdio>
+#include <functional>
+#include <string>
+
+#include "lorawan/lorawan-types.h"
+
+// address, device identifier, operation, reserved, CRC
+#define SIZE_JOURNAL_RECORD (4 + sizeof(DEVICE_ID) + 1 + 1 + 2)
+
+enum IDENTITY_JOURNAL_OPERATION {
+    IJO_PUT = 'p',
+    IJO_RM = 'r'
+};
+
+/**
+ * Append-only log of put() and rm() calls.
+ * Record is 110 bytes long: address (4 bytes), device identifier (102 bytes), operation (1 byte), reserved (1 byte),
+ * CRC-16/XMODEM of the preceding 108 bytes (2 bytes). Address and CRC are in the host byte order.
+ * Record interrupted by the crash does not pass CRC check, replay stops at it.
+ */
+class IdentityJournal {
+protected:
+    FILE *file;
+    bool sync;
+    size_t count;
+public:
+    IdentityJournal();
+    virtual ~IdentityJournal();
+
+    /**
+     * Open journal for appending
+     * @param fileName journal file name
+     * @param syncEachRecord true- write record to the disk before append() returns
+     * @return CODE_OK- success
+     */
+    int open(const std::string &fileName, bool syncEachRecord);
+    void close();
+    bool isOpen() const;
+    /**
+     * Append record
+     * @return CODE_OK- success, ERR_CODE_JOURNAL_WRITE- write error
+     */
+    int append(enum IDENTITY_JOURNAL_OPERATION op, const DEVADDR &addr, const DEVICE_ID *id);
+    // records appended since open()
+    size_t size() const;
+
+    /**
+     * Read records in order
+     * @param fileName journal file name
+     * @param onRecord called for each valid record, id is nullptr for IJO_RM
+     * @return valid records count
+     */
+    static size_t replay(
+        const std::string &fileName,
+        const std::function<void(enum IDENTITY_JOURNAL_OPERATION op, const DEVADDR &addr, const DEVICE_ID *id)> &onRecord
+    );
+};
+
+#endif
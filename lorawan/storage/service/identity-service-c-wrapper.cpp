@@ -7,6 +7,8 @@
 #include <lorawan/lorawan-string.h>
 #include "lorawan/storage/service/identity-service.h"
 #include "lorawan/storage/service/identity-service-mem.h"
+#include "lorawan/storage/service/identity-service-flat.h"
+#include "lorawan/storage/service/identity-service-concurrent.h"
 #include "lorawan/storage/service/identity-service-udp.h"
 
 #ifdef ENABLE_GEN
@@ -57,6 +59,10 @@ EXPORT_SHARED_C_FUNC void *makeIdentityServiceC(
         case CISI_LMDB:
             return makeIdentityService5();
 #endif
+        case CISI_FLAT:
+            return makeIdentityService6();
+        case CISI_CONCURRENT:
+            return makeIdentityService7();
         default:
             return nullptr;
     }
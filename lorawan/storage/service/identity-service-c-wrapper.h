@@ -138,7 +138,9 @@ typedef enum C_IDENTITY_SERVICE_IMPL {
     CISI_MEM = 2,
     CISI_SQLITE = 3,
     CISI_UDP = 4,
-    CISI_LMDB = 5
+    CISI_LMDB = 5,
+    CISI_FLAT = 6,
+    CISI_CONCURRENT = 7
 } C_IDENTITY_SERVICE_IMPL;
 
 EXPORT_SHARED_C_FUNC void* makeIdentityServiceC(
@@ -0,0 +1,331 @@
+#include "lorawan/storage/service/identity-service-concurrent.h"
+#include "lorawan/storage/service/identity-filter.h"
+#include "lorawan/lorawan-error.h"
+#include "lorawan/storage/serialization/identity-binary-serialization.h"
+
+ConcurrentMemoryIdentityService::ConcurrentMemoryIdentityService() = default;
+
+ConcurrentMemoryIdentityService::~ConcurrentMemoryIdentityService() = default;
+
+/**
+ * Set EUI -> address mapping to the lowest address with this EUI or remove it. Writer only.
+ * @param eui device EUI
+ */
+void ConcurrentMemoryIdentityService::updateEUI(
+    const DEVEUI &eui
+)
+{
+    DEVADDR a;
+    if (euiIndex.find(a, eui))
+        euis.put(eui.u, a.u);
+    else
+        euis.rm(eui.u);
+}
+
+/**
+ * request device identifier by network address. Return 0 if success, retval = EUI and keys
+ * @param retval device identifier
+ * @param devaddr network address
+ * @return CODE_OK- success
+ */
+int ConcurrentMemoryIdentityService::get(
+    DEVICEID &retVal,
+    const DEVADDR &request
+)
+{
+    if (!storage.find(retVal.id, request.u))
+        return ERR_CODE_DEVICE_ADDRESS_NOTFOUND;
+    return CODE_OK;
+}
+
+// List entries
+int ConcurrentMemoryIdentityService::list(
+    std::vector<NETWORKIDENTITY> &retVal,
+    uint32_t offset,
+    uint32_t size
+) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    size_t o = 0;
+    size_t sz = 0;
+    for (auto a : ordered) {
+        if (o < offset) {
+            // skip first
+            o++;
+            continue;
+        }
+        sz++;
+        if (sz > size)
+            break;
+        NETWORKIDENTITY ni;
+        ni.value.devaddr.u = a;
+        storage.find(ni.value.devid.id, a);
+        retVal.push_back(ni);
+    }
+    return CODE_OK;
+}
+
+// List entries following the address
+int ConcurrentMemoryIdentityService::listAfter(
+    std::vector<NETWORKIDENTITY> &retVal,
+    const DEVADDR *after,
+    uint32_t size
+) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    auto it = after ? ordered.upper_bound(after->u) : ordered.begin();
+    for (; it != ordered.end() && size > 0; it++, size--) {
+        NETWORKIDENTITY ni;
+        ni.value.devaddr.u = *it;
+        storage.find(ni.value.devid.id, *it);
+        retVal.push_back(ni);
+    }
+    return CODE_OK;
+}
+
+// Entries count
+size_t ConcurrentMemoryIdentityService::size()
+{
+    return storage.size();
+}
+
+/**
+* request network identity(with address) by network address. Return 0 if success, retval = EUI and keys
+* Writer can be between address and EUI tables update, then lookup is repeated. If writes keep
+* changing the EUI, tables are read under the writer mutex.
+* @param retval network identity(with address)
+* @param eui device EUI
+* @return CODE_OK- success
+*/
+int ConcurrentMemoryIdentityService::getNetworkIdentity(
+    NETWORKIDENTITY &retVal,
+    const DEVEUI &eui
+)
+{
+    uint32_t a;
+    for (int i = 0; i < CONCURRENT_EUI_RETRIES; i++) {
+        if (!euis.find(a, eui.u))
+            return ERR_CODE_DEVICE_EUI_NOT_FOUND;
+        if (storage.find(retVal.value.devid.id, a) && retVal.value.devid.id.devEUI.u == eui.u) {
+            retVal.value.devaddr.u = a;
+            return CODE_OK;
+        }
+        std::this_thread::yield();
+    }
+    std::lock_guard<std::mutex> lock(writeMutex);
+    if (!euis.find(a, eui.u) || !storage.find(retVal.value.devid.id, a))
+        return ERR_CODE_DEVICE_EUI_NOT_FOUND;
+    retVal.value.devaddr.u = a;
+    return CODE_OK;
+}
+
+/**
+ * Insert or replace device identifier
+ * @param devAddr address
+ * @param id device identifier
+ * @return 0- success
+ */
+int ConcurrentMemoryIdentityService::put(
+    const DEVADDR &devAddr,
+    const DEVICEID &id
+)
+{
+    std::lock_guard<std::mutex> lock(writeMutex);
+    DEVICE_ID previous;
+    bool hasPrevious = storage.find(previous, devAddr.u);
+    storage.put(devAddr.u, id.id);
+    ordered.insert(devAddr.u);
+    addresses.put(devAddr);
+    euiIndex.put(id.id.devEUI, devAddr, previous.devEUI, hasPrevious);
+    if (hasPrevious && previous.devEUI.u != id.id.devEUI.u)
+        updateEUI(previous.devEUI);
+    updateEUI(id.id.devEUI);
+    return CODE_OK;
+}
+
+int ConcurrentMemoryIdentityService::rm(
+    const DEVADDR &addr
+)
+{
+    std::lock_guard<std::mutex> lock(writeMutex);
+    DEVICE_ID previous;
+    if (!storage.find(previous, addr.u))
+        return ERR_CODE_DEVICE_ADDRESS_NOTFOUND;
+    storage.rm(addr.u);
+    ordered.erase(addr.u);
+    addresses.rm(addr);
+    euiIndex.rm(previous.devEUI, addr);
+    updateEUI(previous.devEUI);
+    return CODE_OK;
+}
+
+int ConcurrentMemoryIdentityService::init(
+    const std::string &,
+    void *
+)
+{
+    return CODE_OK;
+}
+
+void ConcurrentMemoryIdentityService::flush()
+{
+}
+
+void ConcurrentMemoryIdentityService::done()
+{
+    std::lock_guard<std::mutex> lock(writeMutex);
+    storage.clear();
+    euis.clear();
+    euiIndex.clear();
+    ordered.clear();
+    addresses.clear();
+}
+
+/**
+ * Return next network address if available.
+ * Address is reserved until rm() even if it is not stored by put().
+ * @return 0- success, ERR_CODE_ADDR_SPACE_FULL- no address available
+ */
+int ConcurrentMemoryIdentityService::next(
+    NETWORKIDENTITY &retVal
+)
+{
+    std::lock_guard<std::mutex> lock(writeMutex);
+    if (!addresses.ready(netid)) {
+        // first call or network identifier changed, mark stored addresses in one pass
+        addresses.reset(netid);
+        for (auto a : ordered) {
+            addresses.put(DEVADDR(a));
+        }
+    }
+    return addresses.next(retVal.value.devaddr);
+}
+
+void ConcurrentMemoryIdentityService::setOption(
+    int,
+    void *
+)
+{
+    // nothing to do
+}
+
+bool ConcurrentMemoryIdentityService::isThreadSafe()
+{
+    return true;
+}
+
+// ------------------- asynchronous imitation -------------------
+int ConcurrentMemoryIdentityService::cGet(const DEVADDR &request)
+{
+    IdentityGetResponse r;
+    r.response.value.devaddr = request;
+    get(r.response.value.devid, request);
+    if (responseClient)
+        responseClient->onIdentityGet(nullptr, &r);
+    return CODE_OK;
+}
+
+int ConcurrentMemoryIdentityService::cGetNetworkIdentity(const DEVEUI &eui)
+{
+    IdentityGetResponse r;
+    getNetworkIdentity(r.response, eui);
+    if (responseClient)
+        responseClient->onIdentityGet(nullptr, &r);
+    return CODE_OK;
+}
+
+int ConcurrentMemoryIdentityService::cPut(const DEVADDR &devAddr, const DEVICEID &id)
+{
+    IdentityOperationResponse r;
+    r.response = put(devAddr, id);
+    if (responseClient)
+        responseClient->onIdentityOperation(nullptr, &r);
+    return CODE_OK;
+}
+
+int ConcurrentMemoryIdentityService::cRm(const DEVADDR &devAddr)
+{
+    IdentityOperationResponse r;
+    r.response = rm(devAddr);
+    if (responseClient)
+        responseClient->onIdentityOperation(nullptr, &r);
+    return CODE_OK;
+}
+
+int ConcurrentMemoryIdentityService::cList(
+    uint32_t offset,
+    uint32_t size
+)
+{
+    IdentityListResponse r;
+    r.response = list(r.identities, offset, size);
+    r.size = (uint32_t) r.identities.size();
+    if (responseClient)
+        responseClient->onIdentityList(nullptr, &r);
+    return CODE_OK;
+}
+
+int ConcurrentMemoryIdentityService::filter(
+    std::vector<NETWORKIDENTITY> &retVal,
+    const std::vector<NETWORK_IDENTITY_FILTER> &filters,
+    uint32_t offset,
+    uint32_t size
+)
+{
+    IdentityFilter f(filters);
+    std::lock_guard<std::mutex> lock(writeMutex);
+    size_t o = 0;
+    size_t sz = 0;
+    for (auto a : ordered) {
+        NETWORKIDENTITY ni;
+        ni.value.devaddr.u = a;
+        storage.find(ni.value.devid.id, a);
+        if (!f.match(ni.value.devaddr, ni.value.devid.id))
+            continue;
+        if (o < offset) {
+            // skip first
+            o++;
+            continue;
+        }
+        sz++;
+        if (sz > size)
+            break;
+        retVal.push_back(ni);
+    }
+    return CODE_OK;
+}
+
+int ConcurrentMemoryIdentityService::cFilter(
+    const std::vector<NETWORK_IDENTITY_FILTER> &filters,
+    uint32_t offset,
+    uint32_t size
+)
+{
+    IdentityListResponse r;
+    r.response = filter(r.identities, filters, offset, size);
+    r.size = (uint32_t) r.identities.size();
+    if (responseClient)
+        responseClient->onIdentityList(nullptr, &r);
+    return CODE_OK;
+}
+
+int ConcurrentMemoryIdentityService::cSize()
+{
+    IdentityOperationResponse r;
+    r.size = (uint32_t) size();
+    if (responseClient)
+        responseClient->onIdentityOperation(nullptr, &r);
+    return CODE_OK;
+}
+
+int ConcurrentMemoryIdentityService::cNext()
+{
+    IdentityGetResponse r;
+    next(r.response);
+    if (responseClient)
+        responseClient->onIdentityGet(nullptr, &r);
+    return CODE_OK;
+}
+
+EXPORT_SHARED_C_FUNC IdentityService* makeIdentityService7()
+{
+    return new ConcurrentMemoryIdentityService;
+}
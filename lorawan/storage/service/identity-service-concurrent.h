@@ -0,0 +1,75 @@
+#ifndef IDENTITY_SERVICE_CONCURRENT_H_
+#define IDENTITY_SERVICE_CONCURRENT_H_ 1
+
+#include <mutex>
+#include <set>
+
+#include "lorawan/storage/service/identity-service.h"
+#include "lorawan/storage/service/identity-eui-index.h"
+#include "lorawan/storage/service/identity-address-allocator.h"
+#include "lorawan/helper/seqlock-hash-map.h"
+#include "lorawan/helper/plugin-helper.h"
+
+// lock-free EUI lookups before getNetworkIdentity() takes the mutex
+#define CONCURRENT_EUI_RETRIES  16
+
+/**
+ * Thread-safe in-memory storage.
+ * get() and getNetworkIdentity() do not lock, put(), rm(), list(), filter() and next() are serialized by mutex.
+ */
+class ConcurrentMemoryIdentityService: public IdentityService {
+protected:
+    std::mutex writeMutex;
+    SeqlockHashMap<uint32_t, DEVICE_ID> storage;
+    // DevEUI -> lowest address with this EUI, read without lock
+    SeqlockHashMap<uint64_t, uint32_t> euis;
+    // writer side: all addresses by EUI and ordered addresses for list()
+    IdentityEUIIndex euiIndex;
+    std::set<uint32_t> ordered;
+    IdentityAddressAllocator addresses;
+
+    void updateEUI(const DEVEUI &eui);
+public:
+    ConcurrentMemoryIdentityService();
+    ~ConcurrentMemoryIdentityService() override;
+
+    // synchronous
+    int get(DEVICEID &retVal, const DEVADDR &request) override;
+    int getNetworkIdentity(NETWORKIDENTITY &retVal, const DEVEUI &eui) override;
+    int put(const DEVADDR &devAddr, const DEVICEID &id) override;
+    int rm(const DEVADDR &devAddr) override;
+    int list(std::vector<NETWORKIDENTITY> &retVal, uint32_t offset, uint32_t size) override;
+    int listAfter(std::vector<NETWORKIDENTITY> &retVal, const DEVADDR *after, uint32_t size) override;
+    size_t size() override;
+    int next(NETWORKIDENTITY &retVal) override;
+    // asynchronous imitation
+    int cGet(const DEVADDR &request) override;
+    int cGetNetworkIdentity(const DEVEUI &eui) override;
+    int cPut(const DEVADDR &devAddr, const DEVICEID &id) override;
+    int cRm(const DEVADDR &devAddr) override;
+    int cList(uint32_t offset, uint32_t size) override;
+    int cSize() override;
+    int cNext() override;
+
+    int filter(
+        std::vector<NETWORKIDENTITY> &retVal,
+        const std::vector<NETWORK_IDENTITY_FILTER> &filters,
+        uint32_t offset,
+        uint32_t size
+    ) override;
+    int cFilter(
+        const std::vector<NETWORK_IDENTITY_FILTER> &filters,
+        uint32_t offset,
+        uint32_t size
+    ) override;
+
+    int init(const std::string &dbName, void *db) override;
+    void flush() override;
+    void done() override;
+    void setOption(int option, void *value) override;
+    bool isThreadSafe() override;
+};
+
+EXPORT_SHARED_C_FUNC IdentityService* makeIdentityService7();
+
+#endif
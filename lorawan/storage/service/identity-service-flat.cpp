@@ -0,0 +1,431 @@
+#include <algorithm>
+#include "lorawan/storage/service/identity-service-flat.h"
+#include "lorawan/storage/service/identity-filter.h"
+#include "lorawan/lorawan-error.h"
+#include "lorawan/storage/serialization/identity-binary-serialization.h"
+
+#define FLAT_MIN_CAPACITY   16
+#define FLAT_MIN_SHIFT      28  // 32 - log2(FLAT_MIN_CAPACITY)
+
+// Fibonacci hashing: take high bits of the product
+#define FLAT_HASH(addr, shift) ((uint32_t) ((addr) * 0x9E3779B1u) >> (shift))
+
+FlatMemoryIdentityService::FlatMemoryIdentityService()
+    : slots(FLAT_MIN_CAPACITY, FLAT_IDENTITY_SLOT { 0, 0 }), mask(FLAT_MIN_CAPACITY - 1), shift(FLAT_MIN_SHIFT),
+      orderedDirty(false)
+{
+}
+
+FlatMemoryIdentityService::~FlatMemoryIdentityService() = default;
+
+/**
+ * Return slot index of the address or first empty slot in the probe sequence
+ * @param addr address
+ * @return slot index
+ */
+size_t FlatMemoryIdentityService::findSlot(
+    uint32_t addr
+) const
+{
+    size_t i = FLAT_HASH(addr, shift);
+    while (slots[i].idx && slots[i].addr != addr)
+        i = (i + 1) & mask;
+    return i;
+}
+
+void FlatMemoryIdentityService::rehash(
+    size_t capacity
+)
+{
+    size_t c = FLAT_MIN_CAPACITY;
+    uint32_t s = FLAT_MIN_SHIFT;
+    while (c < capacity) {
+        c <<= 1;
+        s--;
+    }
+    slots.assign(c, FLAT_IDENTITY_SLOT { 0, 0 });
+    mask = (uint32_t) (c - 1);
+    shift = s;
+    for (uint32_t i = 0; i < addrs.size(); i++) {
+        size_t n = findSlot(addrs[i]);
+        slots[n].addr = addrs[i];
+        slots[n].idx = i + 1;
+    }
+}
+
+/**
+ * Backward shift deletion, no tombstones left
+ * @param slot slot index to be freed
+ */
+void FlatMemoryIdentityService::removeSlot(
+    size_t slot
+)
+{
+    size_t i = slot;
+    size_t j = slot;
+    while (true) {
+        j = (j + 1) & mask;
+        if (!slots[j].idx)
+            break;
+        size_t k = FLAT_HASH(slots[j].addr, shift);
+        // move entry back if its home slot is not in the (i, j] cyclic range
+        bool inRange = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (!inRange) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i].idx = 0;
+}
+
+void FlatMemoryIdentityService::buildOrder()
+{
+    if (!orderedDirty)
+        return;
+    ordered.resize(addrs.size());
+    for (uint32_t i = 0; i < ordered.size(); i++)
+        ordered[i] = i;
+    const std::vector<uint32_t> &a = addrs;
+    std::sort(ordered.begin(), ordered.end(), [&a](uint32_t l, uint32_t r) {
+        return a[l] < a[r];
+    });
+    orderedDirty = false;
+}
+
+/**
+ * request device identifier by network address. Return 0 if success, retval = EUI and keys
+ * @param retval device identifier
+ * @param devaddr network address
+ * @return CODE_OK- success
+ */
+int FlatMemoryIdentityService::get(
+    DEVICEID &retVal,
+    const DEVADDR &request
+)
+{
+    const FLAT_IDENTITY_SLOT &s = slots[findSlot(request.u)];
+    if (!s.idx)
+        return ERR_CODE_DEVICE_ADDRESS_NOTFOUND;
+    retVal = values[s.idx - 1];
+    return CODE_OK;
+}
+
+// List entries in address order
+int FlatMemoryIdentityService::list(
+    std::vector<NETWORKIDENTITY> &retVal,
+    uint32_t offset,
+    uint32_t size
+) {
+    buildOrder();
+    for (size_t i = offset; i < ordered.size() && i < (size_t) offset + size; i++) {
+        DEVADDR a;
+        a.u = addrs[ordered[i]];
+        retVal.emplace_back(a, values[ordered[i]]);
+    }
+    return CODE_OK;
+}
+
+// List entries following the address, binary search in the sorted slab index
+int FlatMemoryIdentityService::listAfter(
+    std::vector<NETWORKIDENTITY> &retVal,
+    const DEVADDR *after,
+    uint32_t size
+) {
+    buildOrder();
+    auto it = ordered.begin();
+    if (after) {
+        const std::vector<uint32_t> &a = addrs;
+        it = std::upper_bound(ordered.begin(), ordered.end(), after->u, [&a](uint32_t v, uint32_t i) {
+            return v < a[i];
+        });
+    }
+    for (; it != ordered.end() && size > 0; it++, size--) {
+        DEVADDR a;
+        a.u = addrs[*it];
+        retVal.emplace_back(a, values[*it]);
+    }
+    return CODE_OK;
+}
+
+// Entries count
+size_t FlatMemoryIdentityService::size()
+{
+    return values.size();
+}
+
+/**
+* request network identity(with address) by network address. Return 0 if success, retval = EUI and keys
+* @param retval network identity(with address)
+* @param eui device EUI
+* @return CODE_OK- success
+*/
+int FlatMemoryIdentityService::getNetworkIdentity(
+    NETWORKIDENTITY &retVal,
+    const DEVEUI &eui
+)
+{
+    DEVADDR a;
+    if (!euiIndex.find(a, eui))
+        return ERR_CODE_DEVICE_EUI_NOT_FOUND;
+    const FLAT_IDENTITY_SLOT &s = slots[findSlot(a.u)];
+    if (!s.idx)
+        return ERR_CODE_DEVICE_EUI_NOT_FOUND;
+    retVal.value.devaddr = a;
+    retVal.value.devid = values[s.idx - 1];
+    return CODE_OK;
+}
+
+/**
+ * Insert or replace device identifier
+ * @param devAddr address
+ * @param id device identifier
+ * @return 0- success
+ */
+int FlatMemoryIdentityService::put(
+    const DEVADDR &devAddr,
+    const DEVICEID &id
+)
+{
+    size_t n = findSlot(devAddr.u);
+    if (slots[n].idx) {
+        DEVICEID &v = values[slots[n].idx - 1];
+        euiIndex.put(id.id.devEUI, devAddr, v.id.devEUI, true);
+        v = id;
+        euis[slots[n].idx - 1] = id.id.devEUI.u;
+        return CODE_OK;
+    }
+    // keep load factor below 3/4
+    if ((values.size() + 1) * 4 > slots.size() * 3) {
+        rehash(slots.size() * 2);
+        n = findSlot(devAddr.u);
+    }
+    values.push_back(id);
+    addrs.push_back(devAddr.u);
+    euis.push_back(id.id.devEUI.u);
+    slots[n].addr = devAddr.u;
+    slots[n].idx = (uint32_t) values.size();
+    euiIndex.put(id.id.devEUI, devAddr, id.id.devEUI, false);
+    addresses.put(devAddr);
+    orderedDirty = true;
+    return CODE_OK;
+}
+
+int FlatMemoryIdentityService::rm(
+    const DEVADDR &addr
+)
+{
+    size_t n = findSlot(addr.u);
+    if (!slots[n].idx)
+        return ERR_CODE_DEVICE_ADDRESS_NOTFOUND;
+    uint32_t idx = slots[n].idx - 1;
+    euiIndex.rm(values[idx].id.devEUI, addr);
+    addresses.rm(addr);
+    removeSlot(n);
+    // move last slab entry into the hole
+    uint32_t last = (uint32_t) values.size() - 1;
+    if (idx != last) {
+        values[idx] = values[last];
+        addrs[idx] = addrs[last];
+        euis[idx] = euis[last];
+        slots[findSlot(addrs[idx])].idx = idx + 1;
+    }
+    values.pop_back();
+    addrs.pop_back();
+    euis.pop_back();
+    orderedDirty = true;
+    return CODE_OK;
+}
+
+int FlatMemoryIdentityService::init(
+    const std::string &,
+    void *
+)
+{
+    return CODE_OK;
+}
+
+void FlatMemoryIdentityService::flush()
+{
+}
+
+void FlatMemoryIdentityService::done()
+{
+    values.clear();
+    addrs.clear();
+    euis.clear();
+    ordered.clear();
+    selected.clear();
+    orderedDirty = false;
+    euiIndex.clear();
+    addresses.clear();
+    rehash(FLAT_MIN_CAPACITY);
+}
+
+/**
+ * Return next network address if available.
+ * Address is reserved until rm() even if it is not stored by put().
+ * @return 0- success, ERR_CODE_ADDR_SPACE_FULL- no address available
+ */
+int FlatMemoryIdentityService::next(
+    NETWORKIDENTITY &retVal
+)
+{
+    if (!addresses.ready(netid)) {
+        // first call or network identifier changed, mark stored addresses in one pass over the slab
+        addresses.reset(netid);
+        for (auto a : addrs) {
+            addresses.put(DEVADDR(a));
+        }
+    }
+    return addresses.next(retVal.value.devaddr);
+}
+
+void FlatMemoryIdentityService::setOption(
+    int,
+    void *
+)
+{
+    // nothing to do
+}
+
+void FlatMemoryIdentityService::reserve(
+    size_t count
+)
+{
+    values.reserve(count);
+    addrs.reserve(count);
+    euis.reserve(count);
+    euiIndex.reserve(count);
+    if (count * 4 > slots.size() * 3)
+        rehash(count * 4 / 3 + 1);
+}
+
+void FlatMemoryIdentityService::indexStats(
+    IDENTITY_INDEX_STATS &retVal
+) const
+{
+    euiIndex.stats(retVal);
+}
+
+// ------------------- asynchronous imitation -------------------
+int FlatMemoryIdentityService::cGet(const DEVADDR &request)
+{
+    IdentityGetResponse r;
+    r.response.value.devaddr = request;
+    get(r.response.value.devid, request);
+    if (responseClient)
+        responseClient->onIdentityGet(nullptr, &r);
+    return CODE_OK;
+}
+
+int FlatMemoryIdentityService::cGetNetworkIdentity(const DEVEUI &eui)
+{
+    IdentityGetResponse r;
+    getNetworkIdentity(r.response, eui);
+    if (responseClient)
+        responseClient->onIdentityGet(nullptr, &r);
+    return CODE_OK;
+}
+
+int FlatMemoryIdentityService::cPut(const DEVADDR &devAddr, const DEVICEID &id)
+{
+    IdentityOperationResponse r;
+    r.response = put(devAddr, id);
+    if (responseClient)
+        responseClient->onIdentityOperation(nullptr, &r);
+    return CODE_OK;
+}
+
+int FlatMemoryIdentityService::cRm(const DEVADDR &devAddr)
+{
+    IdentityOperationResponse r;
+    r.response = rm(devAddr);
+    if (responseClient)
+        responseClient->onIdentityOperation(nullptr, &r);
+    return CODE_OK;
+}
+
+int FlatMemoryIdentityService::cList(
+    uint32_t offset,
+    uint32_t size
+)
+{
+    IdentityListResponse r;
+    r.response = list(r.identities, offset, size);
+    r.size = (uint32_t) r.identities.size();
+    if (responseClient)
+        responseClient->onIdentityList(nullptr, &r);
+    return CODE_OK;
+}
+
+int FlatMemoryIdentityService::filter(
+    std::vector<NETWORKIDENTITY> &retVal,
+    const std::vector<NETWORK_IDENTITY_FILTER> &filters,
+    uint32_t offset,
+    uint32_t size
+)
+{
+    buildOrder();
+    IdentityFilter f(filters);
+    // address and DevEUI terms are checked over packed columns first, buffer grows only
+    selected.assign(values.size(), 1);
+    f.scan(selected.data(), addrs.data(), euis.data(), values.size());
+    size_t o = 0;
+    size_t sz = 0;
+    for (auto i : ordered) {
+        if (!selected[i])
+            continue;
+        DEVADDR addr;
+        addr.u = addrs[i];
+        const DEVICEID &id = values[i];
+        if (!f.matchRow(addr, id.id))
+            continue;
+        if (o < offset) {
+            // skip first
+            o++;
+            continue;
+        }
+        sz++;
+        if (sz > size)
+            break;
+        retVal.emplace_back(addr, id);
+    }
+    return CODE_OK;
+}
+
+int FlatMemoryIdentityService::cFilter(
+    const std::vector<NETWORK_IDENTITY_FILTER> &filters,
+    uint32_t offset,
+    uint32_t size
+)
+{
+    IdentityListResponse r;
+    r.response = filter(r.identities, filters, offset, size);
+    r.size = (uint32_t) r.identities.size();
+    if (responseClient)
+        responseClient->onIdentityList(nullptr, &r);
+    return CODE_OK;
+}
+
+int FlatMemoryIdentityService::cSize()
+{
+    IdentityOperationResponse r;
+    r.size = (uint32_t) size();
+    if (responseClient)
+        responseClient->onIdentityOperation(nullptr, &r);
+    return CODE_OK;
+}
+
+int FlatMemoryIdentityService::cNext()
+{
+    IdentityGetResponse r;
+    next(r.response);
+    if (responseClient)
+        responseClient->onIdentityGet(nullptr, &r);
+    return CODE_OK;
+}
+
+EXPORT_SHARED_C_FUNC IdentityService* makeIdentityService6()
+{
+    return new FlatMemoryIdentityService;
+}
@@ -0,0 +1,105 @@
+#ifndef IDENTITY_SERVICE_FLAT_H_
+#define IDENTITY_SERVICE_FLAT_H_ 1
+
+#include <vector>
+
+#include "lorawan/storage/service/identity-service.h"
+#include "lorawan/storage/service/identity-eui-index.h"
+#include "lorawan/storage/service/identity-address-allocator.h"
+#include "lorawan/helper/plugin-helper.h"
+
+/**
+ * Open addressing hash table slot.
+ * Slot is empty if idx is 0, otherwise idx - 1 is an index in the slab.
+ */
+typedef struct {
+    uint32_t addr;  ///< DEVADDR.u
+    uint32_t idx;   ///< slab index + 1, 0- empty slot
+} FLAT_IDENTITY_SLOT;
+
+/**
+ * In-memory storage on open addressing (linear probing) hash table keyed by 32 bit address.
+ * Device identifiers are kept in the contiguous slab, table slot is 8 bytes long,
+ * so get() touches the slot and the slab entry only.
+ * list() and filter() iterate over lazily sorted slab indexes in the same order as std::map does.
+ * filter() checks address and DevEUI terms over packed columns before touching the slab.
+ */
+class FlatMemoryIdentityService: public IdentityService {
+protected:
+    // hash table, size is power of 2
+    std::vector<FLAT_IDENTITY_SLOT> slots;
+    uint32_t mask;
+    uint32_t shift;
+    // contiguous device identifiers and its addresses
+    std::vector<DEVICEID> values;
+    std::vector<uint32_t> addrs;
+    // packed DevEUI column for filter() scan
+    std::vector<uint64_t> euis;
+    // slab indexes sorted by address for ordered iteration, rebuilt on demand
+    std::vector<uint32_t> ordered;
+    // rows selected by filter() column scan, kept between calls to avoid allocation per call
+    std::vector<uint8_t> selected;
+    bool orderedDirty;
+    // DevEUI -> address secondary index
+    IdentityEUIIndex euiIndex;
+    // free addresses for next()
+    IdentityAddressAllocator addresses;
+
+    size_t findSlot(uint32_t addr) const;
+    void rehash(size_t capacity);
+    void removeSlot(size_t slot);
+    void buildOrder();
+public:
+    FlatMemoryIdentityService();
+    ~FlatMemoryIdentityService() override;
+
+    // synchronous
+    int get(DEVICEID &retVal, const DEVADDR &request) override;
+    int getNetworkIdentity(NETWORKIDENTITY &retVal, const DEVEUI &eui) override;
+    int put(const DEVADDR &devAddr, const DEVICEID &id) override;
+    int rm(const DEVADDR &devAddr) override;
+    int list(std::vector<NETWORKIDENTITY> &retVal, uint32_t offset, uint32_t size) override;
+    int listAfter(std::vector<NETWORKIDENTITY> &retVal, const DEVADDR *after, uint32_t size) override;
+    size_t size() override;
+    int next(NETWORKIDENTITY &retVal) override;
+    // asynchronous imitation
+    int cGet(const DEVADDR &request) override;
+    int cGetNetworkIdentity(const DEVEUI &eui) override;
+    int cPut(const DEVADDR &devAddr, const DEVICEID &id) override;
+    int cRm(const DEVADDR &devAddr) override;
+    int cList(uint32_t offset, uint32_t size) override;
+    int cSize() override;
+    int cNext() override;
+
+    int filter(
+        std::vector<NETWORKIDENTITY> &retVal,
+        const std::vector<NETWORK_IDENTITY_FILTER> &filters,
+        uint32_t offset,
+        uint32_t size
+    ) override;
+    int cFilter(
+        const std::vector<NETWORK_IDENTITY_FILTER> &filters,
+        uint32_t offset,
+        uint32_t size
+    ) override;
+
+    int init(const std::string &dbName, void *db) override;
+    void flush() override;
+    void done() override;
+    void setOption(int option, void *value) override;
+
+    /**
+     * Pre-allocate table and slab
+     * @param count expected device count
+     */
+    void reserve(size_t count);
+    /**
+     * Return DevEUI index memory usage
+     * @param retVal index statistics
+     */
+    void indexStats(IDENTITY_INDEX_STATS &retVal) const;
+};
+
+EXPORT_SHARED_C_FUNC IdentityService* makeIdentityService6();
+
+#endif
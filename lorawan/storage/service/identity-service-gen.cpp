@@ -1,11 +1,13 @@
+#include <algorithm>
+#include <cstring>
 #include <regex>
 
 #include "lorawan/storage/service/identity-service-gen.h"
 #include "lorawan/lorawan-error.h"
 #include "lorawan/lorawan-string.h"
 #include "lorawan/helper/key128gen.h"
+#include "lorawan/helper/key-schedule.h"
 #include "lorawan/storage/serialization/identity-binary-serialization.h"
-#include "lorawan/lorawan-key.h"
 
 #ifdef ESP_PLATFORM
 #include <iostream>
@@ -17,17 +19,35 @@
 #endif
 
 #define DEFAULT_NETID   0
+// get() results kept by default
+#define DEFAULT_CACHE_SIZE  4096
+// addresses generated by one thread at a time
+#define GEN_PAGE_CHUNK      32
 
-GenIdentityService::GenIdentityService()
-    : maxDevNwkAddr(0), errCode(0)
+static size_t defaultThreadCount()
 {
+#ifdef ESP_PLATFORM
+    return 1;
+#else
+    size_t r = std::thread::hardware_concurrency();
+    return r ? r : 1;
+#endif
+}
 
+GenIdentityService::GenIdentityService()
+    : keySchedule(new KEY_SCHEDULE), cacheSize(DEFAULT_CACHE_SIZE), threadCount(defaultThreadCount()),
+      page(nullptr), pageFirst(0), pageSize(0), pageNext(0), pageDone(0), pageSequence(0), stopping(false),
+      errCode(0)
+{
+    setMasterKey("");
 }
 
 GenIdentityService::GenIdentityService(
     const std::string &masterKey
 )
-    : maxDevNwkAddr(0), errCode(0)
+    : keySchedule(new KEY_SCHEDULE), cacheSize(DEFAULT_CACHE_SIZE), threadCount(defaultThreadCount()),
+      page(nullptr), pageFirst(0), pageSize(0), pageNext(0), pageDone(0), pageSequence(0), stopping(false),
+      errCode(0)
 {
     setMasterKey(masterKey);
 }
@@ -37,13 +57,47 @@ void GenIdentityService::setMasterKey(
 )
 {
     phrase2key((uint8_t *) &key.c, masterKey.c_str(), masterKey.size());
+    keyScheduleInit(*keySchedule, key.c);
+    clearCache();
 }
 
-GenIdentityService::~GenIdentityService() = default;
+GenIdentityService::~GenIdentityService()
+{
+    stopWorkers();
+    delete keySchedule;
+}
 
 void GenIdentityService::clear()
 {
-    maxDevNwkAddr = 0;
+    addresses.clear();
+    clearCache();
+}
+
+void GenIdentityService::clearCache()
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache.clear();
+    cacheIndex.clear();
+}
+
+/**
+ * FNwkSIntKey with zero join and device nonces, same as deriveOptNegFNwkSIntKey()
+ * @param retVal session key
+ * @param schedule expanded key
+ * @param joinEUI join EUI
+ */
+static void deriveSessionKey(
+    KEY128 &retVal,
+    const KEY_SCHEDULE &schedule,
+    const DEVEUI &joinEUI
+)
+{
+    // 0x01 | JoinNonce | JoinEUI | DevNonce | pad 16
+    uint8_t block[16];
+    memset(block, '\0', sizeof(block));
+    block[0] = 1;
+    memmove(&block[1 + sizeof(JOINNONCE)], &joinEUI, sizeof(DEVEUI));
+    keyScheduleCMAC(retVal.c, schedule, block);
 }
 
 /**
@@ -57,19 +111,30 @@ int GenIdentityService::get(
     const DEVADDR &devaddr
 )
 {
+    if (cacheSize) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto f = cacheIndex.find(devaddr.u);
+        if (f != cacheIndex.end()) {
+            cache.splice(cache.begin(), cache, f->second);
+            retval = f->second->second;
+            return 0;
+        }
+    }
     retval.id.activation = ABP;	///< activation type: ABP or OTAA
     retval.id.deviceclass = CLASS_A;
-    euiGen((uint8_t *) &retval.id.devEUI.c, KEY_NUMBER_EUI, (uint8_t *) &key.c, devaddr.u);
-    keyGen((uint8_t *) &retval.id.appEUI.c, KEY_NUMBER_EUI, (uint8_t *) &key.c, devaddr.u);
+    euiGen((uint8_t *) &retval.id.devEUI.c, KEY_NUMBER_EUI, *keySchedule, devaddr.u);
+    // application EUI is generated with the same key number
+    retval.id.appEUI = retval.id.devEUI;
 
-    keyGen((uint8_t *) &retval.id.nwkKey.c, KEY_NUMBER_NWK, (uint8_t *) &key.c, devaddr.u);
-    keyGen((uint8_t *) &retval.id.appKey.c, KEY_NUMBER_APP, (uint8_t *) &key.c, devaddr.u);
+    keyGen((uint8_t *) &retval.id.nwkKey.c, KEY_NUMBER_NWK, *keySchedule, devaddr.u);
+    keyGen((uint8_t *) &retval.id.appKey.c, KEY_NUMBER_APP, *keySchedule, devaddr.u);
 
     retval.id.joinNonce = {};
     retval.id.devNonce = {};
 
-    deriveOptNegFNwkSIntKey(retval.id.nwkSKey, key, retval.id.appEUI, retval.id.joinNonce, retval.id.devNonce);
-    deriveOptNegFNwkSIntKey(retval.id.appSKey, key, retval.id.appEUI, retval.id.joinNonce, retval.id.devNonce);
+    // both session keys are derived from the master key
+    deriveSessionKey(retval.id.nwkSKey, *keySchedule, retval.id.appEUI);
+    retval.id.appSKey = retval.id.nwkSKey;
 
     retval.id.version = { 1, 0, 0 };
     string2DEVICENAME(retval.id.name, DEVADDR2string(devaddr).c_str());
@@ -77,6 +142,18 @@ int GenIdentityService::get(
         std::cerr << "get " << DEVADDR2string(devaddr)
             << std::endl;
 #endif
+    if (cacheSize) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        // other thread may add it
+        if (cacheIndex.find(devaddr.u) == cacheIndex.end()) {
+            cache.emplace_front(devaddr.u, retval);
+            cacheIndex[devaddr.u] = cache.begin();
+            while (cache.size() > cacheSize) {
+                cacheIndex.erase(cache.back().first);
+                cache.pop_back();
+            }
+        }
+    }
     return 0;
 }
 
@@ -87,51 +164,165 @@ int GenIdentityService::get(
 * @return LORA_OK- success
 */
 int GenIdentityService::getNetworkIdentity(
-    NETWORKIDENTITY &retval,
-    const DEVEUI &eui
+    NETWORKIDENTITY &,
+    const DEVEUI &
 ) {
     return ERR_CODE_DEVICE_EUI_NOT_FOUND;
 }
 
 void GenIdentityService::gen(
     NETWORKIDENTITY &retVal,
-    uint32_t nwkAddr
+    const DEVADDR &addr
 )
 {
-    retVal.value.devaddr = DEVADDR(netid, nwkAddr);
+    retVal.value.devaddr = addr;
 
-    euiGen((uint8_t *) &retVal.value.devid.id.devEUI.c, KEY_NUMBER_EUI, (uint8_t *) &key.c, retVal.value.devaddr.u);
-    keyGen((uint8_t *) &retVal.value.devid.id.appEUI.c, KEY_NUMBER_EUI, (uint8_t *) &key.c, retVal.value.devaddr.u);
+    euiGen((uint8_t *) &retVal.value.devid.id.devEUI.c, KEY_NUMBER_EUI, *keySchedule, retVal.value.devaddr.u);
+    // application EUI is generated with the same key number
+    retVal.value.devid.id.appEUI = retVal.value.devid.id.devEUI;
 
-    keyGen((uint8_t *) &retVal.value.devid.id.nwkKey.c, KEY_NUMBER_NWK, (uint8_t *) &key.c, retVal.value.devaddr.u);
-    keyGen((uint8_t *) &retVal.value.devid.id.appKey.c, KEY_NUMBER_APP, (uint8_t *) &key.c, retVal.value.devaddr.u);
+    keyGen((uint8_t *) &retVal.value.devid.id.nwkKey.c, KEY_NUMBER_NWK, *keySchedule, retVal.value.devaddr.u);
+    keyGen((uint8_t *) &retVal.value.devid.id.appKey.c, KEY_NUMBER_APP, *keySchedule, retVal.value.devaddr.u);
 
     retVal.value.devid.id.joinNonce = {};
     retVal.value.devid.id.devNonce = {};
 
-    deriveOptNegFNwkSIntKey(retVal.value.devid.id.nwkSKey, retVal.value.devid.id.nwkKey, retVal.value.devid.id.appEUI, retVal.value.devid.id.joinNonce, retVal.value.devid.id.devNonce);
-    deriveOptNegFNwkSIntKey(retVal.value.devid.id.appSKey, retVal.value.devid.id.appKey, retVal.value.devid.id.appEUI, retVal.value.devid.id.joinNonce, retVal.value.devid.id.devNonce);
+    // session keys are derived from the device keys
+    KEY_SCHEDULE deviceKey;
+    keyScheduleInit(deviceKey, retVal.value.devid.id.nwkKey.c);
+    deriveSessionKey(retVal.value.devid.id.nwkSKey, deviceKey, retVal.value.devid.id.appEUI);
+    keyScheduleInit(deviceKey, retVal.value.devid.id.appKey.c);
+    deriveSessionKey(retVal.value.devid.id.appSKey, deviceKey, retVal.value.devid.id.appEUI);
 
     retVal.value.devid.id.version = {1, 0, 0 };
     string2DEVICENAME(retVal.value.devid.id.name, DEVADDR2string(retVal.value.devaddr).c_str());
 }
 
+/**
+ * Append generated identities of the contiguous network addresses.
+ * Large page is split into chunks, worker threads and caller take chunks until all are generated.
+ * @param retVal appended identities
+ * @param first first network address
+ * @param count addresses count
+ */
+void GenIdentityService::genPage(
+    std::vector<NETWORKIDENTITY> &retVal,
+    uint32_t first,
+    size_t count
+)
+{
+    size_t start = retVal.size();
+    retVal.resize(start + count);
+    if (threadCount <= 1 || count <= GEN_PAGE_CHUNK) {
+        for (size_t i = 0; i < count; i++)
+            gen(retVal[start + i], DEVADDR(netid, (uint32_t) (first + i)));
+        return;
+    }
+    std::lock_guard<std::mutex> pageLock(pageMutex);
+    {
+        std::lock_guard<std::mutex> lock(workMutex);
+        if (workers.empty())
+            startWorkers();
+        page = &retVal[start];
+        pageFirst = first;
+        pageSize = count;
+        pageNext = 0;
+        pageDone = 0;
+        pageSequence++;
+    }
+    workCondition.notify_all();
+    genChunks();
+    std::unique_lock<std::mutex> lock(workMutex);
+    workDoneCondition.wait(lock, [this] {
+        return pageDone == pageSize;
+    });
+    page = nullptr;
+}
+
+void GenIdentityService::genChunks()
+{
+    std::unique_lock<std::mutex> lock(workMutex);
+    while (page && pageNext < pageSize) {
+        size_t i = pageNext;
+        size_t n = std::min<size_t>(GEN_PAGE_CHUNK, pageSize - i);
+        pageNext += n;
+        NETWORKIDENTITY *p = page + i;
+        uint32_t a = (uint32_t) (pageFirst + i);
+        lock.unlock();
+        for (size_t k = 0; k < n; k++)
+            gen(p[k], DEVADDR(netid, (uint32_t) (a + k)));
+        lock.lock();
+        pageDone += n;
+        if (pageDone == pageSize)
+            workDoneCondition.notify_all();
+    }
+}
+
+void GenIdentityService::work()
+{
+    uint64_t sequence = 0;
+    std::unique_lock<std::mutex> lock(workMutex);
+    while (true) {
+        workCondition.wait(lock, [this, &sequence] {
+            return stopping || pageSequence != sequence;
+        });
+        if (stopping)
+            break;
+        sequence = pageSequence;
+        lock.unlock();
+        genChunks();
+        lock.lock();
+    }
+}
+
+// workMutex is locked by caller
+void GenIdentityService::startWorkers()
+{
+    stopping = false;
+    for (size_t i = 1; i < threadCount; i++)
+        workers.emplace_back(&GenIdentityService::work, this);
+}
+
+void GenIdentityService::stopWorkers()
+{
+    std::lock_guard<std::mutex> pageLock(pageMutex);
+    {
+        std::lock_guard<std::mutex> lock(workMutex);
+        stopping = true;
+    }
+    workCondition.notify_all();
+    for (auto &w : workers) {
+        w.join();
+    }
+    workers.clear();
+}
+
 // List entries
 int GenIdentityService::list(
     std::vector<NETWORKIDENTITY> &retVal,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 ) {
-    uint32_t a = offset;
+    // addresses 0..size()-1, same as listAfter()
     size_t sz = netid.size();
-    for (int i = 0; i < size; i++) {
-        if (a > sz)
-            break;
-        NETWORKIDENTITY v;
-        gen(v, a);
-        retVal.push_back(v);
-        a++;
-    }
+    if (offset < sz)
+        genPage(retVal, offset, std::min<size_t>(size, sz - offset));
+    return CODE_OK;
+}
+
+// List entries following the address, network addresses are contiguous
+int GenIdentityService::listAfter(
+    std::vector<NETWORKIDENTITY> &retVal,
+    const DEVADDR *after,
+    uint32_t size
+) {
+    uint32_t base = DEVADDR(netid, false).u;
+    size_t sz = netid.size();
+    size_t a = 0;
+    if (after && after->u >= base)
+        a = (size_t) (after->u - base) + 1;
+    if (a < sz)
+        genPage(retVal, (uint32_t) a, std::min<size_t>(size, sz - a));
     return CODE_OK;
 }
 
@@ -141,11 +332,18 @@ size_t GenIdentityService::size()
     return netid.size();
 }
 
+/**
+ * Identifiers are generated, so put() only marks address as assigned
+ */
 int GenIdentityService::put(
     const DEVADDR &devaddr,
-    const DEVICEID &id
+    const DEVICEID &
 )
 {
+    // nothing to rebuild the bitmap from later
+    if (!addresses.ready(netid))
+        addresses.reset(netid);
+    addresses.put(devaddr);
     return CODE_OK;
 }
 
@@ -153,6 +351,7 @@ int GenIdentityService::rm(
     const DEVADDR &addr
 )
 {
+    addresses.rm(addr);
     return CODE_OK;
 }
 
@@ -175,7 +374,8 @@ void GenIdentityService::flush()
 
 void GenIdentityService::done()
 {
-
+    stopWorkers();
+    clear();
 }
 
 /**
@@ -183,21 +383,17 @@ void GenIdentityService::done()
   * @return 0- success, ERR_ADDR_SPACE_FULL- no address available
   */
 int GenIdentityService::next(
-    NETWORKIDENTITY &retval
-)
-{
-    return ERR_CODE_ADDR_SPACE_FULL;
-}
-
-/**
-  * Return next available network address
-  * @return 0- success, ERR_ADDR_SPACE_FULL- no address available
-  */
-int GenIdentityService::nextBruteForce(
     NETWORKIDENTITY &retVal
 )
 {
-    return ERR_CODE_ADDR_SPACE_FULL;
+    if (!addresses.ready(netid))
+        addresses.reset(netid);
+    DEVADDR a;
+    int r = addresses.next(a);
+    if (r)
+        return r;
+    gen(retVal, a);
+    return CODE_OK;
 }
 
 void GenIdentityService::setOption(
@@ -208,8 +404,27 @@ void GenIdentityService::setOption(
 {
     if (!value)
         return;
-    if (option == 0)
-        setMasterKey(*(std::string *) value);
+    switch (option) {
+        case GEN_IDENTITY_OPTION_MASTER_KEY:
+            setMasterKey(*(std::string *) value);
+            break;
+        case GEN_IDENTITY_OPTION_CACHE_SIZE:
+            {
+                std::lock_guard<std::mutex> lock(cacheMutex);
+                cacheSize = *(size_t *) value;
+                while (cache.size() > cacheSize) {
+                    cacheIndex.erase(cache.back().first);
+                    cache.pop_back();
+                }
+            }
+            break;
+        case GEN_IDENTITY_OPTION_THREADS:
+            stopWorkers();
+            threadCount = *(size_t *) value ? *(size_t *) value : 1;
+            break;
+        default:
+            break;
+    }
 }
 
 // ------------------- asynchronous imitations -------------------
@@ -251,11 +466,11 @@ int GenIdentityService::cRm(const DEVADDR &devAddr)
     return CODE_OK;
 }
 
-int GenIdentityService::cList(uint32_t offset, uint8_t size)
+int GenIdentityService::cList(uint32_t offset, uint32_t size)
 {
     IdentityListResponse r;
     r.response = list(r.identities, offset, size);
-    r.size = (uint8_t) r.identities.size();
+    r.size = (uint32_t) r.identities.size();
     if (responseClient)
         responseClient->onIdentityList(nullptr, &r);
     return CODE_OK;
@@ -264,7 +479,7 @@ int GenIdentityService::cList(uint32_t offset, uint8_t size)
 int GenIdentityService::cSize()
 {
     IdentityOperationResponse r;
-    r.size = (uint8_t) size();
+    r.size = (uint32_t) size();
     if (responseClient)
         responseClient->onIdentityOperation(nullptr, &r);
     return CODE_OK;
@@ -283,7 +498,7 @@ int GenIdentityService::filter(
     std::vector<NETWORKIDENTITY> &retVal,
     const std::vector<NETWORK_IDENTITY_FILTER> &filters,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 )
 {
     // logically incorrect to avoid infinite loop
@@ -293,7 +508,7 @@ int GenIdentityService::filter(
         if (a > sz)
             break;
         NETWORKIDENTITY v;
-        gen(v, a);
+        gen(v, DEVADDR(netid, a));
         if (!isIdentityFilteredV(v, filters))
             continue;
         retVal.push_back(v);
@@ -303,9 +518,9 @@ int GenIdentityService::filter(
 }
 
 int GenIdentityService::cFilter(
-    const std::vector<NETWORK_IDENTITY_FILTER> &filters,
+    const std::vector<NETWORK_IDENTITY_FILTER> &,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 )
 {
     return cList(offset, size);
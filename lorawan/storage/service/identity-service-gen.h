@@ -1,29 +1,73 @@
 #ifndef IDENTITY_SERVICE_GEN_H_
 #define IDENTITY_SERVICE_GEN_H_ 1
 
+#include <condition_variable>
+#include <list>
 #include <vector>
 #include <mutex>
 #include <map>
+#include <thread>
+#include <unordered_map>
 #include "lorawan/storage/service/identity-service.h"
+#include "lorawan/storage/service/identity-address-allocator.h"
+#include "lorawan/helper/key128gen.h"
 
 #include "lorawan/helper/plugin-helper.h"
 
+// setOption() options
+#define GEN_IDENTITY_OPTION_MASTER_KEY  0   ///< std::string *, master key passphrase
+#define GEN_IDENTITY_OPTION_CACHE_SIZE  1   ///< size_t *, get() results kept in the LRU cache, 0- no cache
+#define GEN_IDENTITY_OPTION_THREADS     2   ///< size_t *, threads generating list() pages including caller, 1- caller only
+
+/**
+ * Identifiers are generated from the master key and address, nothing is stored.
+ * Master key is expanded once, each key costs one AES block encryption.
+ * get() results of the recently used addresses are kept in the LRU cache.
+ * Large list() pages are split between worker threads.
+ */
 class GenIdentityService: public IdentityService {
 private:
     NETID netid;
     KEY128 key;
-    // helper data
-    // helps to find out free address in the space
-    uint32_t maxDevNwkAddr;
+    // expanded key
+    KEY_SCHEDULE *keySchedule;
+    // addresses assigned by next() or put()
+    IdentityAddressAllocator addresses;
+
+    // LRU cache of get(), most recently used first
+    typedef std::list<std::pair<uint32_t, DEVICEID> > CacheList;
+    size_t cacheSize;
+    CacheList cache;
+    std::unordered_map<uint32_t, CacheList::iterator> cacheIndex;
+    std::mutex cacheMutex;
+
+    // list() page generation
+    size_t threadCount;
+    std::vector<std::thread> workers;
+    // one page at a time
+    std::mutex pageMutex;
+    std::mutex workMutex;
+    std::condition_variable workCondition;
+    std::condition_variable workDoneCondition;
+    NETWORKIDENTITY *page;
+    uint32_t pageFirst;
+    size_t pageSize;
+    size_t pageNext;
+    size_t pageDone;
+    uint64_t pageSequence;
+    bool stopping;
+
+    void genPage(std::vector<NETWORKIDENTITY> &retVal, uint32_t first, size_t count);
+    // generate chunks of the current page until all are taken
+    void genChunks();
+    void work();
+    void startWorkers();
+    void stopWorkers();
+    void clearCache();
 protected:
     std::string masterKey;
     void clear();
-    /**
-      * Return next network address if available
-      * @return 0- success, ERR_ADDR_SPACE_FULL- no address available
-      */
-    int nextBruteForce(NETWORKIDENTITY &retVal);
-    void gen(NETWORKIDENTITY &retVal, uint32_t nwkAddr);
+    void gen(NETWORKIDENTITY &retVal, const DEVADDR &addr);
 public:
     int errCode;
     std::string errMessage;
@@ -38,7 +82,8 @@ public:
     int getNetworkIdentity(NETWORKIDENTITY &retval, const DEVEUI &eui) override;
     int put(const DEVADDR &devaddr, const DEVICEID &id) override;
     int rm(const DEVADDR &addr) override;
-    int list(std::vector<NETWORKIDENTITY> &retVal, uint32_t offset, uint8_t size) override;
+    int list(std::vector<NETWORKIDENTITY> &retVal, uint32_t offset, uint32_t size) override;
+    int listAfter(std::vector<NETWORKIDENTITY> &retVal, const DEVADDR *after, uint32_t size) override;
     size_t size() override;
     int next(NETWORKIDENTITY &retVal) override;
 
@@ -47,7 +92,7 @@ public:
     int cGetNetworkIdentity(const DEVEUI &eui) override;
     int cPut(const DEVADDR &devAddr, const DEVICEID &id) override;
     int cRm(const DEVADDR &devAddr) override;
-    int cList(uint32_t, uint8_t size) override;
+    int cList(uint32_t, uint32_t size) override;
     int cSize() override;
     int cNext() override;
 
@@ -55,12 +100,12 @@ public:
         std::vector<NETWORKIDENTITY> &retVal,
         const std::vector<NETWORK_IDENTITY_FILTER> &filters,
         uint32_t offset,
-        uint8_t size
+        uint32_t size
     ) override;
     int cFilter(
         const std::vector<NETWORK_IDENTITY_FILTER> &filters,
         uint32_t offset,
-        uint8_t size
+        uint32_t size
     ) override;
 
     int init(const std::string &option, void *data) override;
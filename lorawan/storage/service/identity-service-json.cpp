@@ -1,19 +1,36 @@
+#include <cstring>
 #include <sstream>
 #include <iostream>
 #include <fstream>
 #include "lorawan/storage/service/identity-service-json.h"
+#include "lorawan/lorawan-conv.h"
 #include "lorawan/lorawan-error.h"
 #include "lorawan/lorawan-string.h"
 #include "lorawan/helper/file-helper.h"
+#include "lorawan/storage/serialization/json-stream.h"
+#include "lorawan/storage/service/identity-snapshot.h"
 
 #ifdef ESP_PLATFORM
 #include <iostream>
 #include "platform-defs.h"
 #endif
 
-JsonIdentityService::JsonIdentityService() = default;
+#define JOURNAL_SUFFIX      ".log"
+#define OLD_JOURNAL_SUFFIX  ".log.old"
+#define SNAPSHOT_SUFFIX     ".tmp"
 
-JsonIdentityService::~JsonIdentityService() = default;
+// default seconds between background snapshots
+#define DEF_SNAPSHOT_PERIOD 60
+
+JsonIdentityService::JsonIdentityService()
+    : journalMode(JSON_JOURNAL_NONE), snapshotPeriod(DEF_SNAPSHOT_PERIOD), stopping(false)
+{
+}
+
+JsonIdentityService::~JsonIdentityService()
+{
+    stopSnapshots();
+}
 
 /**
  * request device identifier by network address. Return 0 if success, retval = EUI and keys
@@ -26,40 +43,22 @@ int JsonIdentityService::get(
     const DEVADDR &request
 )
 {
-    auto r = storage.find(request);
-    if (r != storage.end())
-        retVal = r->second;
-    else
-        return ERR_CODE_GATEWAY_NOT_FOUND;
-    return CODE_OK;
+    return MemoryIdentityService::get(retVal, request);
 }
 
 // List entries
 int JsonIdentityService::list(
     std::vector<NETWORKIDENTITY> &retVal,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 ) {
-    size_t o = 0;
-    size_t sz = 0;
-    for (auto & it : storage) {
-        if (o < offset) {
-            // skip first
-            o++;
-            continue;
-        }
-        sz++;
-        if (sz > size)
-            break;
-        retVal.emplace_back(it.first, it.second);
-    }
-    return CODE_OK;
+    return MemoryIdentityService::list(retVal, offset, size);
 }
 
 // Entries count
 size_t JsonIdentityService::size()
 {
-    return storage.size();
+    return MemoryIdentityService::size();
 }
 
 /**
@@ -73,14 +72,7 @@ int JsonIdentityService::getNetworkIdentity(
     const DEVEUI &eui
 )
 {
-    for(auto & it : storage) {
-        if (it.second.id.devEUI.u == eui.u) {
-            retVal.value.devaddr = it.first;
-            retVal.value.devid = it.second;
-            return CODE_OK;
-        }
-    }
-    return ERR_CODE_DEVICE_EUI_NOT_FOUND;
+    return MemoryIdentityService::getNetworkIdentity(retVal, eui);
 }
 
 /**
@@ -93,107 +85,363 @@ int JsonIdentityService::put(
     const DEVICEID &id
 )
 {
-    storage[devAddr] = id;
-    return CODE_OK;
+    if (journalMode == JSON_JOURNAL_NONE)
+        return MemoryIdentityService::put(devAddr, id);
+    std::lock_guard<std::mutex> lock(journalMutex);
+    // write ahead: update not written to the journal is not applied
+    int r = journal.append(IJO_PUT, devAddr, &id.id);
+    if (r)
+        return r;
+    return MemoryIdentityService::put(devAddr, id);
 }
 
 int JsonIdentityService::rm(
     const DEVADDR &addr
 )
 {
-    // find out by gateway identifier
-    auto r = storage.find(addr);
-    if (r != storage.end()) {
-        storage.erase(r);
-        return CODE_OK;
-    }
-    return ERR_CODE_DEVICE_ADDRESS_NOTFOUND;
+    if (journalMode == JSON_JOURNAL_NONE)
+        return MemoryIdentityService::rm(addr);
+    std::lock_guard<std::mutex> lock(journalMutex);
+    // rejected rm() must not be replayed
+    DEVICEID id;
+    if (MemoryIdentityService::get(id, addr))
+        return ERR_CODE_DEVICE_ADDRESS_NOTFOUND;
+    int r = journal.append(IJO_RM, addr, nullptr);
+    if (r)
+        return r;
+    return MemoryIdentityService::rm(addr);
 }
 
+// JSON object fields
+enum IDENTITY_JSON_FIELD {
+    IJF_ADDR = 0,
+    IJF_ACTIVATION,
+    IJF_CLASS,
+    IJF_DEVEUI,
+    IJF_NWKSKEY,
+    IJF_APPSKEY,
+    IJF_VERSION,
+    IJF_APPEUI,
+    IJF_APPKEY,
+    IJF_NWKKEY,
+    IJF_DEVNONCE,
+    IJF_JOINNONCE,
+    IJF_NAME
+};
+
+static const std::vector<std::string> IDENTITY_JSON_FIELDS {
+    "addr", "activation", "class", "deveui", "nwkSKey", "appSKey", "version",
+    "appeui", "appKey", "nwkKey", "devNonce", "joinNonce", "name"
+};
+
+#define HAS_FIELD(present, field) (((present) & (1u << (field))) != 0)
+
+/**
+ * Read identities one by one, document is not built
+ * @return true- success
+ */
 bool JsonIdentityService::load()
 {
     std::ifstream f(fileName);
-    nlohmann::json js;
-    try {
-        js = nlohmann::json::parse(f);
-    } catch (nlohmann::json::exception &exception) {
-        std::cerr << exception.what() << std::endl;
-        return false;
-    }
-    if (!js.is_array())
-        return false;
-    for (auto& e : js) {
+    JsonRecordReader reader(IDENTITY_JSON_FIELDS, [this] (const std::vector<std::string> &v, uint32_t present) {
+        if (!HAS_FIELD(present, IJF_ADDR))
+            return;
         DEVADDR a;
-        if (!e.contains("addr"))
-            continue;
-        string2DEVADDR(a, e["addr"]);
+        string2DEVADDR(a, v[IJF_ADDR]);
         DEVICEID id;
-        if (e.contains("activation"))
-            id.id.activation = string2activation(e["activation"]);
-        if (e.contains("class"))
-            id.setClass(string2deviceclass(e["class"]));
-        if (e.contains("deveui"))
-            string2DEVEUI(id.id.devEUI, e["deveui"]);
-        if (e.contains("nwkSKey"))
-            string2KEY(id.id.nwkSKey, e["nwkSKey"]);
-        if (e.contains("appSKey"))
-            string2KEY(id.id.appSKey, e["appSKey"]);
-        if (e.contains("version"))
-            id.id.version = string2LORAWAN_VERSION(e["version"]);
-        if (e.contains("appeui"))
-            string2DEVEUI(id.id.appEUI, e["appeui"]);
-        if (e.contains("appKey"))
-            string2KEY(id.id.appKey, e["appKey"]);
-        if (e.contains("nwkKey"))
-            string2KEY(id.id.nwkKey, e["nwkKey"]);
-        if (e.contains("devNonce"))
-            id.id.devNonce = string2DEVNONCE(e["devNonce"]);
-        if (e.contains("joinNonce"))
-            string2JOINNONCE(id.id.joinNonce, e["joinNonce"]);
-        if (e.contains("name")) {
-            std::string s = e["name"];
-            string2DEVICENAME(id.id.name, s.c_str());
-        }
-        storage[a] = id;
+        if (HAS_FIELD(present, IJF_ACTIVATION))
+            id.id.activation = string2activation(v[IJF_ACTIVATION]);
+        if (HAS_FIELD(present, IJF_CLASS))
+            id.setClass(string2deviceclass(v[IJF_CLASS]));
+        if (HAS_FIELD(present, IJF_DEVEUI))
+            string2DEVEUI(id.id.devEUI, v[IJF_DEVEUI]);
+        if (HAS_FIELD(present, IJF_NWKSKEY))
+            string2KEY(id.id.nwkSKey, v[IJF_NWKSKEY]);
+        if (HAS_FIELD(present, IJF_APPSKEY))
+            string2KEY(id.id.appSKey, v[IJF_APPSKEY]);
+        if (HAS_FIELD(present, IJF_VERSION))
+            id.id.version = string2LORAWAN_VERSION(v[IJF_VERSION]);
+        if (HAS_FIELD(present, IJF_APPEUI))
+            string2DEVEUI(id.id.appEUI, v[IJF_APPEUI]);
+        if (HAS_FIELD(present, IJF_APPKEY))
+            string2KEY(id.id.appKey, v[IJF_APPKEY]);
+        if (HAS_FIELD(present, IJF_NWKKEY))
+            string2KEY(id.id.nwkKey, v[IJF_NWKKEY]);
+        if (HAS_FIELD(present, IJF_DEVNONCE))
+            id.id.devNonce = string2DEVNONCE(v[IJF_DEVNONCE]);
+        if (HAS_FIELD(present, IJF_JOINNONCE))
+            string2JOINNONCE(id.id.joinNonce, v[IJF_JOINNONCE]);
+        if (HAS_FIELD(present, IJF_NAME))
+            string2DEVICENAME(id.id.name, v[IJF_NAME].c_str());
+        MemoryIdentityService::put(a, id);
+    });
+    if (!reader.parse(f)) {
+        std::cerr << reader.error() << std::endl;
+        return false;
     }
-    f.close();
     return true;
 }
 
-bool JsonIdentityService::store()
+/**
+ * Write identity in the DEVICEID::toJsonString() format
+ */
+static void writeIdentity(
+    JsonStreamWriter &w,
+    const DEVADDR &addr,
+    const DEVICEID &id
+)
+{
+    w.put('{');
+    if (!addr.empty()) {
+        uint32_t a = SWAP_BYTES_4(addr.u);
+        w.put(R"("addr":")").hex(&a, sizeof(a)).put("\",");
+    }
+    uint64_t devEUI = SWAP_BYTES_8(id.id.devEUI.u);
+    uint64_t appEUI = SWAP_BYTES_8(id.id.appEUI.u);
+    w.put(R"("activation":")").put(activation2string(id.id.activation))
+        .put(R"(","class":")").put(deviceclass2string(id.id.deviceclass))
+        .put(R"(","deveui":")").hex(&devEUI, sizeof(devEUI))
+        .put(R"(","nwkSKey":")").hex(&id.id.nwkSKey, sizeof(KEY128))
+        .put(R"(","appSKey":")").hex(&id.id.appSKey, sizeof(KEY128))
+        .put(R"(","version":")").dec(id.id.version.major).put('.').dec(id.id.version.minor).put('.').dec(id.id.version.release)
+        .put(R"(","appeui":")").hex(&appEUI, sizeof(appEUI))
+        .put(R"(","appKey":")").hex(&id.id.appKey, sizeof(KEY128))
+        .put(R"(","nwkKey":")").hex(&id.id.nwkKey, sizeof(KEY128))
+        .put(R"(","devNonce":")").hex(&id.id.devNonce, sizeof(DEVNONCE))
+        .put(R"(","joinNonce":")").hex(&id.id.joinNonce, sizeof(JOINNONCE))
+        .put(R"(","name":")").put(id.id.name.c, strnlen(id.id.name.c, sizeof(DEVICENAME::c)))
+        .put("\"}");
+}
+
+/**
+ * Write identities to the temporary file and replace the file, std::rename() does not replace file on Windows
+ * @param fileName JSON file name
+ * @param identities identities
+ * @return true- success
+ */
+static bool storeFile(
+    const std::string &fileName,
+    const std::map<DEVADDR, DEVICEID> &identities
+)
 {
-    std::ofstream f(fileName);
+    std::string tempName = fileName + SNAPSHOT_SUFFIX;
+    JsonStreamWriter w;
+    if (!w.open(tempName))
+        return false;
     bool isFirst = true;
-    f << "[\n";
-    for (auto& e : this->storage) {
+    w.put("[\n");
+    for (auto& e : identities) {
         if (isFirst)
             isFirst = false;
         else
-            f << ",\n";
-        f << e.second.toJsonString(e.first);
+            w.put(",\n");
+        writeIdentity(w, e.first, e.second);
     }
-    f << "]\n";
-    f.close();
-    return true;
+    w.put("]\n");
+    if (!w.close())
+        return false;
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    std::remove(fileName.c_str());
+#endif
+    return std::rename(tempName.c_str(), fileName.c_str()) == 0;
+}
+
+/**
+ * Write binary snapshot
+ * @param fileName binary snapshot file name
+ * @param identities identities
+ * @return true- success
+ */
+static bool storeBinaryFile(
+    const std::string &fileName,
+    const std::map<DEVADDR, DEVICEID> &identities
+)
+{
+    IdentitySnapshotWriter w;
+    if (w.open(fileName, true))
+        return false;
+    for (auto& e : identities) {
+        if (w.put(e.first, e.second.id))
+            break;
+    }
+    return w.close() == CODE_OK;
+}
+
+bool JsonIdentityService::store()
+{
+    const std::map<DEVADDR, DEVICEID> *identities = &storage;
+    std::map<DEVADDR, DEVICEID> merged;
+    if (mapped.isOpen()) {
+        copy(merged);
+        identities = &merged;
+    }
+    if (!storeFile(fileName, *identities))
+        return false;
+    return binaryFileName.empty() || storeBinaryFile(binaryFileName, *identities);
+}
+
+/**
+ * Append records of the current journal to the old one left by the failed snapshot, start the empty journal.
+ * Called with journalMutex locked.
+ * @return CODE_OK- success
+ */
+int JsonIdentityService::mergeJournals(
+    const std::string &journalName,
+    const std::string &oldJournalName
+)
+{
+    journal.close();
+    IdentityJournal old;
+    int r = old.open(oldJournalName, journalMode == JSON_JOURNAL_SYNC);
+    if (r == CODE_OK) {
+        IdentityJournal::replay(journalName, [&old, &r](
+            enum IDENTITY_JOURNAL_OPERATION op,
+            const DEVADDR &addr,
+            const DEVICE_ID *id
+        ) {
+            if (r == CODE_OK)
+                r = old.append(op, addr, id);
+        });
+        old.close();
+    }
+    // on error keep appending to the current journal, init() replays both
+    if (r == CODE_OK)
+        std::remove(journalName.c_str());
+    int ro = journal.open(journalName, journalMode == JSON_JOURNAL_SYNC);
+    return r ? r : ro;
+}
+
+/**
+ * Write JSON file from the copy of the storage, then remove the journal written before the copy was taken.
+ * Replay of the journal over the JSON file which already has its records gives the same state,
+ * so crash at any step does not lose updates.
+ * If the previous snapshot failed, the journal is merged into the old one, which is removed after the JSON file is written.
+ * @return CODE_OK- success
+ */
+int JsonIdentityService::snapshot()
+{
+    std::lock_guard<std::mutex> snapshotLock(snapshotMutex);
+    std::string journalName = fileName + JOURNAL_SUFFIX;
+    std::string oldJournalName = fileName + OLD_JOURNAL_SUFFIX;
+    std::map<DEVADDR, DEVICEID> identities;
+    {
+        std::lock_guard<std::mutex> lock(journalMutex);
+        copy(identities);
+        if (file::fileExists(oldJournalName)) {
+            // previous snapshot failed, the copy has records of both journals
+            if (mergeJournals(journalName, oldJournalName))
+                return ERR_CODE_JOURNAL_WRITE;
+        } else {
+            journal.close();
+            bool moved = std::rename(journalName.c_str(), oldJournalName.c_str()) == 0;
+            int r = journal.open(journalName, journalMode == JSON_JOURNAL_SYNC);
+            if (!moved || r)
+                return ERR_CODE_JOURNAL_WRITE;
+        }
+    }
+    if (!storeFile(fileName, identities))
+        return ERR_CODE_JOURNAL_WRITE;
+    if (!binaryFileName.empty() && !storeBinaryFile(binaryFileName, identities))
+        return ERR_CODE_JOURNAL_WRITE;
+    std::remove(oldJournalName.c_str());
+    return CODE_OK;
+}
+
+void JsonIdentityService::startSnapshots()
+{
+    if (snapshotPeriod == 0 || snapshotThread.joinable())
+        return;
+    stopping = false;
+    snapshotThread = std::thread([this] {
+        std::unique_lock<std::mutex> lock(snapshotThreadMutex);
+        while (!snapshotCondition.wait_for(lock, std::chrono::seconds(snapshotPeriod), [this] { return stopping; })) {
+            bool modified;
+            {
+                std::lock_guard<std::mutex> journalLock(journalMutex);
+                modified = journal.size() > 0;
+            }
+            if (modified)
+                snapshot();
+        }
+    });
+}
+
+void JsonIdentityService::stopSnapshots()
+{
+    if (!snapshotThread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(snapshotThreadMutex);
+        stopping = true;
+    }
+    snapshotCondition.notify_all();
+    snapshotThread.join();
+}
+
+/**
+ * Map binary snapshot if it is written after the JSON file
+ * @return true- snapshot is mapped
+ */
+bool JsonIdentityService::loadBinary()
+{
+    if (binaryFileName.empty() || !file::fileExists(binaryFileName))
+        return false;
+    if (file::fileExists(fileName) && fileModificationTime(binaryFileName) < fileModificationTime(fileName))
+        return false;
+    return openSnapshot(binaryFileName) == CODE_OK;
 }
 
 int JsonIdentityService::init(
     const std::string &databaseName,
-    void *database
+    void *
 )
 {
     fileName = databaseName;
-    return load() ? CODE_OK : ERR_CODE_INVALID_JSON;
+    bool mappedBinary = loadBinary();
+    if (journalMode == JSON_JOURNAL_NONE)
+        return (mappedBinary || load()) ? CODE_OK : ERR_CODE_INVALID_JSON;
+    // JSON file is created by the first snapshot
+    if (!mappedBinary && file::fileExists(fileName) && !load())
+        return ERR_CODE_INVALID_JSON;
+    auto apply = [this] (enum IDENTITY_JOURNAL_OPERATION, const DEVADDR &addr, const DEVICE_ID *id) {
+        if (id) {
+            DEVICEID v;
+            v.id = *id;
+            MemoryIdentityService::put(addr, v);
+        } else
+            MemoryIdentityService::rm(addr);
+    };
+    std::string journalName = fileName + JOURNAL_SUFFIX;
+    std::string oldJournalName = fileName + OLD_JOURNAL_SUFFIX;
+    size_t replayed = IdentityJournal::replay(oldJournalName, apply);
+    replayed += IdentityJournal::replay(journalName, apply);
+    // start from the empty journal, appended records must not follow the broken one.
+    // Without replayed records files are up to date
+    if (replayed && !store())
+        return ERR_CODE_JOURNAL_WRITE;
+    std::remove(oldJournalName.c_str());
+    std::remove(journalName.c_str());
+    int r = journal.open(journalName, journalMode == JSON_JOURNAL_SYNC);
+    if (r)
+        return r;
+    startSnapshots();
+    return CODE_OK;
 }
 
 void JsonIdentityService::flush()
 {
-    store();
+    if (journalMode == JSON_JOURNAL_NONE)
+        store();
+    else
+        snapshot();
 }
 
 void JsonIdentityService::done()
 {
-    storage.clear();
+    stopSnapshots();
+    std::lock_guard<std::mutex> lock(journalMutex);
+    journal.close();
+    MemoryIdentityService::done();
 }
 
 /**
@@ -201,10 +449,10 @@ void JsonIdentityService::done()
  * @return 0- success, ERR_CODE_ADDR_SPACE_FULL- no address available
  */
 int JsonIdentityService::next(
-    NETWORKIDENTITY &retval
+    NETWORKIDENTITY &retVal
 )
 {
-    return ERR_CODE_ADDR_SPACE_FULL;
+    return MemoryIdentityService::next(retVal);
 }
 
 void JsonIdentityService::setOption(
@@ -213,7 +461,21 @@ void JsonIdentityService::setOption(
 )
 
 {
-    // nothing to do
+    if (!value)
+        return;
+    switch (option) {
+        case JSON_IDENTITY_OPTION_JOURNAL:
+            journalMode = *(int *) value;
+            break;
+        case JSON_IDENTITY_OPTION_SNAPSHOT_PERIOD:
+            snapshotPeriod = *(uint32_t *) value;
+            break;
+        case JSON_IDENTITY_OPTION_BINARY_SNAPSHOT:
+            binaryFileName = (const char *) value;
+            break;
+        default:
+            break;
+    }
 }
 
 EXPORT_SHARED_C_FUNC IdentityService* makeIdentityService1()
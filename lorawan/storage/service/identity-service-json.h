@@ -1,22 +1,64 @@
 #ifndef IDENTITY_SERVICE_JSON_H_
 #define IDENTITY_SERVICE_JSON_H_ 1
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include "third-party/nlohmann/json.hpp"
 #include "lorawan/storage/service/identity-service-mem.h"
+#include "lorawan/storage/service/identity-journal.h"
 #include "lorawan/helper/plugin-helper.h"
 
+// setOption() options, set before init()
+#define JSON_IDENTITY_OPTION_JOURNAL            1   ///< int *, one of JSON_JOURNAL_NONE, JSON_JOURNAL_FLUSH, JSON_JOURNAL_SYNC
+#define JSON_IDENTITY_OPTION_SNAPSHOT_PERIOD    2   ///< uint32_t *, seconds between background snapshots, 0- by flush() only
+#define JSON_IDENTITY_OPTION_BINARY_SNAPSHOT    3   ///< const char *, binary snapshot file name, written with the JSON file
+
+#define JSON_JOURNAL_NONE   0   ///< flush() rewrites the file
+#define JSON_JOURNAL_FLUSH  1   ///< put() and rm() are written to the journal, survive process crash
+#define JSON_JOURNAL_SYNC   2   ///< put() and rm() are synced to the disk, survive power loss
+
+/**
+ * In-memory storage loaded from the JSON file.
+ * Without journal flush() rewrites the file, updates made after the last flush() are lost on crash.
+ * With journal each put() and rm() is appended to the "<file>.log" before it is applied, failed append leaves
+ * the storage unchanged.
+ * Snapshot moves the journal to "<file>.log.old", starts a new one, writes the JSON file and removes the old journal,
+ * so writers wait for the in-memory copy only. If the snapshot fails, the next one appends the journal to the old one.
+ * init() replays both journals over the JSON file and takes a snapshot.
+ * With binary snapshot the JSON file is followed by the binary one, init() maps binary snapshot instead of parsing
+ * JSON file if it is not older than JSON file.
+ */
 class JsonIdentityService: public MemoryIdentityService {
 private:
     bool load();
+    bool loadBinary();
     bool store();
+    int mergeJournals(const std::string &journalName, const std::string &oldJournalName);
+    int snapshot();
+    void startSnapshots();
+    void stopSnapshots();
 protected:
     std::string fileName;
+    std::string binaryFileName;
+    int journalMode;
+    uint32_t snapshotPeriod;
+    IdentityJournal journal;
+    // serialize journal and storage updates with snapshot
+    std::mutex journalMutex;
+    // one snapshot at a time
+    std::mutex snapshotMutex;
+    std::thread snapshotThread;
+    std::mutex snapshotThreadMutex;
+    std::condition_variable snapshotCondition;
+    bool stopping;
 public:
     JsonIdentityService();
     ~JsonIdentityService() override;
     int get(DEVICEID &retVal, const DEVADDR &request) override;
     // List entries
-    int list(std::vector<NETWORKIDENTITY> &retVal, uint32_t offset, uint8_t size) override;
+    int list(std::vector<NETWORKIDENTITY> &retVal, uint32_t offset, uint32_t size) override;
     size_t size() override;
     int getNetworkIdentity(NETWORKIDENTITY &retVal, const DEVEUI &eui) override;
 
@@ -1,7 +1,9 @@
+#include <algorithm>
 #include <sstream>
 #include <iostream>
 #include <cstring>
 #include "lorawan/storage/service/identity-service-lmdb.h"
+#include "lorawan/storage/service/identity-filter.h"
 #include "lorawan/lorawan-error.h"
 #include "lorawan/lorawan-string.h"
 #include "lorawan/helper/file-helper.h"
@@ -12,10 +14,139 @@
 #include "platform-defs.h"
 #endif
 
-LMDBIdentityService::LMDBIdentityService() = default;
+// DevEUI -> address named database
+#define EUI_DB_NAME     "deveui"
+// addresses are sorted as unsigned integers, first duplicate is the lowest address
+#define EUI_DB_FLAGS    (MDB_DUPSORT | MDB_INTEGERDUP)
+
+/**
+ * Read transaction of the view returned by getView() or getNetworkIdentityView() in this thread
+ */
+typedef struct {
+    const LMDBIdentityService *svc;
+    MDB_txn *txn;
+} LMDB_VIEW;
+
+static thread_local LMDB_VIEW view { nullptr, nullptr };
+
+LMDBIdentityService::LMDBIdentityService()
+    : euiDbi(0)
+{
+    env.maxDbs = 1;
+    // read transaction is not bound to the thread, it is reset and renewed by any thread
+    env.flags |= MDB_NOTLS;
+}
 
 LMDBIdentityService::~LMDBIdentityService() = default;
 
+/**
+ * Take reset read transaction and renew it, or begin a new one if none is idle.
+ * Each call has own transaction, so concurrent reads do not share it.
+ * @param retVal read transaction
+ * @return MDB_SUCCESS or LMDB error code
+ */
+int LMDBIdentityService::beginRead(
+    MDB_txn *&retVal
+)
+{
+    retVal = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(readMutex);
+        if (!idleReads.empty()) {
+            retVal = idleReads.back();
+            idleReads.pop_back();
+        }
+    }
+    int r;
+    if (retVal) {
+        r = mdb_txn_renew(retVal);
+        if (r) {
+            mdb_txn_abort(retVal);
+            retVal = nullptr;
+        }
+    } else {
+        r = mdb_txn_begin(env.env, nullptr, MDB_RDONLY, &retVal);
+        if (r)
+            retVal = nullptr;
+    }
+    return r;
+}
+
+/**
+ * Release snapshot, keep transaction handle for the next read
+ * @param txn read transaction returned by beginRead()
+ */
+void LMDBIdentityService::endRead(
+    MDB_txn *txn
+)
+{
+    mdb_txn_reset(txn);
+    std::lock_guard<std::mutex> lock(readMutex);
+    idleReads.push_back(txn);
+}
+
+/**
+ * Free idle read transactions before environment is closed
+ */
+void LMDBIdentityService::closeRead()
+{
+    std::lock_guard<std::mutex> lock(readMutex);
+    for (auto txn : idleReads) {
+        mdb_txn_abort(txn);
+    }
+    idleReads.clear();
+}
+
+/**
+ * Find identity by address in the read transaction
+ * @param txn read transaction
+ * @param retVal identity in the memory map
+ * @param addr address
+ * @return MDB_SUCCESS, MDB_NOTFOUND
+ */
+int LMDBIdentityService::findAddr(
+    MDB_txn *txn,
+    const DEVICE_ID *&retVal,
+    const DEVADDR &addr
+)
+{
+    MDB_val dbKey {SIZE_DEVADDR, (void *) &addr.u };
+    MDB_val dbVal {};
+    int r = mdb_get(txn, env.dbi, &dbKey, &dbVal);
+    if (r == MDB_SUCCESS && dbVal.mv_size != sizeof(DEVICE_ID))
+        r = MDB_NOTFOUND;   // error, database corrupted
+    if (r == MDB_SUCCESS)
+        retVal = (const DEVICE_ID *) dbVal.mv_data;
+    return r;
+}
+
+/**
+ * Find lowest address with EUI and its identity in the read transaction
+ * @param txn read transaction
+ * @param retVal identity in the memory map
+ * @param retAddr address
+ * @param eui device EUI
+ * @return MDB_SUCCESS, MDB_NOTFOUND
+ */
+int LMDBIdentityService::findEUI(
+    MDB_txn *txn,
+    const DEVICE_ID *&retVal,
+    DEVADDR &retAddr,
+    const DEVEUI &eui
+)
+{
+    MDB_val euiKey {sizeof(eui.u), (void *) &eui.u };
+    MDB_val euiVal {};
+    // first duplicate is the lowest address
+    int r = mdb_get(txn, euiDbi, &euiKey, &euiVal);
+    if (r == MDB_SUCCESS && euiVal.mv_size != SIZE_DEVADDR)
+        r = MDB_NOTFOUND;   // error, database corrupted
+    if (r)
+        return r;
+    memmove(&retAddr.u, euiVal.mv_data, SIZE_DEVADDR);
+    return findAddr(txn, retVal, retAddr);
+}
+
 /**
  * request device identifier by network address. Return 0 if success, retval = EUI and keys
  * @param retval device identifier
@@ -27,31 +158,70 @@ int LMDBIdentityService::get(
     const DEVADDR &request
 )
 {
-    // start transaction
-    int r = mdb_txn_begin(env.env, nullptr, MDB_RDONLY, &env.txn);
+    MDB_txn *txn;
+    int r = beginRead(txn);
     if (r)
         return ERR_CODE_LMDB_TXN_BEGIN;
-    MDB_val dbKey {SIZE_DEVADDR, (void *) &request.u };
-    MDB_val dbVal {};
-    r = mdb_get(env.txn, env.dbi, &dbKey, &dbVal);
-    if (r != MDB_SUCCESS) {
-        // it's ok
-        mdb_txn_abort(env.txn);
-        return r;
-    }
-    memmove((void*) &retVal.id, dbVal.mv_data, dbVal.mv_size < sizeof(DEVICE_ID) ? dbVal.mv_size : sizeof(DEVICE_ID));
-    r = mdb_txn_commit(env.txn);
+    const DEVICE_ID *v;
+    r = findAddr(txn, v, request);
+    if (r == MDB_SUCCESS)
+        memmove((void*) &retVal.id, v, sizeof(DEVICE_ID));
+    endRead(txn);
     return r;
 }
 
+int LMDBIdentityService::getView(
+    const DEVICE_ID *&retVal,
+    const DEVADDR &devAddr
+)
+{
+    MDB_txn *txn;
+    int r = beginRead(txn);
+    if (r)
+        return ERR_CODE_LMDB_TXN_BEGIN;
+    r = findAddr(txn, retVal, devAddr);
+    // keep snapshot until releaseView()
+    if (r)
+        endRead(txn);
+    else
+        view = LMDB_VIEW { this, txn };
+    return r;
+}
+
+int LMDBIdentityService::getNetworkIdentityView(
+    const DEVICE_ID *&retVal,
+    DEVADDR &retAddr,
+    const DEVEUI &eui
+)
+{
+    MDB_txn *txn;
+    int r = beginRead(txn);
+    if (r)
+        return ERR_CODE_LMDB_TXN_BEGIN;
+    r = findEUI(txn, retVal, retAddr, eui);
+    if (r)
+        endRead(txn);
+    else
+        view = LMDB_VIEW { this, txn };
+    return r;
+}
+
+void LMDBIdentityService::releaseView()
+{
+    if (view.svc != this || !view.txn)
+        return;
+    endRead(view.txn);
+    view = LMDB_VIEW { nullptr, nullptr };
+}
+
 // List entries
 int LMDBIdentityService::list(
     std::vector<NETWORKIDENTITY> &retVal,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 ) {
-    // start transaction
-    int r = mdb_txn_begin(env.env, nullptr, MDB_RDONLY, &env.txn);
+    MDB_txn *txn;
+    int r = beginRead(txn);
     if (r)
         return ERR_CODE_LMDB_TXN_BEGIN;
 
@@ -59,9 +229,9 @@ int LMDBIdentityService::list(
     size_t sz = 0;
 
     MDB_cursor *cursor;
-    r = mdb_cursor_open(env.txn, env.dbi, &cursor);
+    r = mdb_cursor_open(txn, env.dbi, &cursor);
     if (r != MDB_SUCCESS) {
-        mdb_txn_commit(env.txn);
+        endRead(txn);
         return r;
     }
 
@@ -69,6 +239,8 @@ int LMDBIdentityService::list(
     MDB_val dbVal {};
 
     while ((r = mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_NEXT)) == 0) {
+        if (dbKey.mv_size != SIZE_DEVADDR || dbVal.mv_size != sizeof(DEVICE_ID))
+            continue;  // named database record
         if (o < offset) {
             // skip first
             o++;
@@ -77,30 +249,77 @@ int LMDBIdentityService::list(
         sz++;
         if (sz > size)
             break;
+        // copy from the map to the list item
+        retVal.emplace_back();
+        NETWORKIDENTITY &nid = retVal.back();
+        memmove((void*) &nid.value.devaddr.u, dbKey.mv_data, SIZE_DEVADDR);
+        memmove((void*) &nid.value.devid.id, dbVal.mv_data, sizeof(DEVICE_ID));
+    }
+    mdb_cursor_close(cursor);
+    endRead(txn);
+    return CODE_OK;
+}
 
-        if (dbKey.mv_size != SIZE_DEVADDR)
-            break;  // error, database corrupted
-        NETWORKIDENTITY nid;
-        memmove((void*) &nid.value.devaddr, dbKey.mv_data, dbKey.mv_size < SIZE_DEVADDR ? dbKey.mv_size : SIZE_DEVADDR);
-        memmove((void*) &nid.value.devid, dbVal.mv_data, dbVal.mv_size < sizeof(DEVICE_ID) ? dbVal.mv_size : sizeof(DEVICE_ID));
-        retVal.emplace_back(nid.value.devaddr, nid.value.devid);
-    } while (mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_NEXT) == MDB_SUCCESS);
+/**
+ * List entries in the key order. Cursor is positioned by MDB_SET_RANGE to the key or the next one.
+ */
+int LMDBIdentityService::listAfter(
+    std::vector<NETWORKIDENTITY> &retVal,
+    const DEVADDR *after,
+    uint32_t size
+) {
+    if (size == 0)
+        return CODE_OK;
+    MDB_txn *txn;
+    int r = beginRead(txn);
+    if (r)
+        return ERR_CODE_LMDB_TXN_BEGIN;
 
-    r = mdb_txn_commit(env.txn);
-    return r;
+    MDB_cursor *cursor;
+    r = mdb_cursor_open(txn, env.dbi, &cursor);
+    if (r != MDB_SUCCESS) {
+        endRead(txn);
+        return r;
+    }
+
+    uint32_t key = after ? after->u : 0;
+    MDB_val dbKey { SIZE_DEVADDR, &key };
+    MDB_val dbVal {};
+    if (after) {
+        r = mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_SET_RANGE);
+        // skip the cursor entry itself
+        if (r == MDB_SUCCESS && dbKey.mv_size == SIZE_DEVADDR && memcmp(dbKey.mv_data, &key, SIZE_DEVADDR) == 0)
+            r = mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_NEXT);
+    } else
+        r = mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_FIRST);
+
+    for (; r == MDB_SUCCESS; r = mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_NEXT)) {
+        if (dbKey.mv_size != SIZE_DEVADDR || dbVal.mv_size != sizeof(DEVICE_ID))
+            continue;  // named database record
+        retVal.emplace_back();
+        NETWORKIDENTITY &nid = retVal.back();
+        memmove((void*) &nid.value.devaddr.u, dbKey.mv_data, SIZE_DEVADDR);
+        memmove((void*) &nid.value.devid.id, dbVal.mv_data, sizeof(DEVICE_ID));
+        if (--size == 0)
+            break;
+    }
+    mdb_cursor_close(cursor);
+    endRead(txn);
+    return CODE_OK;
 }
 
 // Entries count
 size_t LMDBIdentityService::size()
 {
-    // start transaction
-    int r = mdb_txn_begin(env.env, nullptr, MDB_RDONLY, &env.txn);
+    MDB_txn *txn;
+    int r = beginRead(txn);
     if (r)
-        return ERR_CODE_LMDB_TXN_BEGIN;
+        return 0;
+    // unnamed database has named database records too, EUI index has one entry per address
     MDB_stat stat;
-    mdb_stat(env.txn, env.dbi, &stat);
-    mdb_txn_commit(env.txn);
-    return stat.ms_entries;
+    r = mdb_stat(txn, euiDbi, &stat);
+    endRead(txn);
+    return r ? 0 : stat.ms_entries;
 }
 
 /**
@@ -114,113 +333,185 @@ int LMDBIdentityService::getNetworkIdentity(
     const DEVEUI &eui
 )
 {
-    // start transaction
-    int r = mdb_txn_begin(env.env, nullptr, MDB_RDONLY, &env.txn);
+    MDB_txn *txn;
+    int r = beginRead(txn);
     if (r)
         return ERR_CODE_LMDB_TXN_BEGIN;
+    const DEVICE_ID *v;
+    r = findEUI(txn, v, retVal.value.devaddr, eui);
+    if (r == MDB_SUCCESS)
+        memmove((void*) &retVal.value.devid.id, v, sizeof(DEVICE_ID));
+    endRead(txn);
+    return r;
+}
 
-    MDB_cursor *cursor;
-    r = mdb_cursor_open(env.txn, env.dbi, &cursor);
-    if (r != MDB_SUCCESS) {
-        mdb_txn_commit(env.txn);
-        return r;
-    }
-
-    MDB_val dbKey {};
+/**
+ * Put or remove identity and update EUI index in the current write transaction
+ * @param addr address
+ * @param id identity to put, nullptr- remove
+ * @return MDB_SUCCESS, MDB_NOTFOUND if address to remove does not exist or LMDB error code
+ */
+int LMDBIdentityService::writeTxn(
+    const DEVADDR &addr,
+    const DEVICE_ID *id
+)
+{
+    MDB_val dbKey {SIZE_DEVADDR, (void *) &addr.u };
     MDB_val dbVal {};
-
-    while ((r = mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_NEXT)) == MDB_SUCCESS) {
-        if (dbKey.mv_size != SIZE_DEVADDR || dbVal.mv_size != sizeof(DEVICE_ID))
-            break;  // error, database corrupted
-
-        if (((DEVICE_ID *)dbVal.mv_data)->devEUI == eui) {
-            memmove((void*) &retVal.value.devaddr.u, dbKey.mv_data, dbKey.mv_size < SIZE_DEVADDR ? dbKey.mv_size : SIZE_DEVADDR);
-            memmove((void*) &retVal.value.devid, dbVal.mv_data, dbVal.mv_size < sizeof(DEVICE_ID) ? dbVal.mv_size : sizeof(DEVICE_ID));
-            break;
+    int r = mdb_get(env.txn, env.dbi, &dbKey, &dbVal);
+    if (r == MDB_SUCCESS) {
+        if (dbVal.mv_size == sizeof(DEVICE_ID)) {
+            // remove old EUI -> address pair
+            uint64_t oldEUI;
+            memmove(&oldEUI, &((DEVICE_ID *) dbVal.mv_data)->devEUI.u, sizeof(oldEUI));
+            MDB_val euiKey {sizeof(oldEUI), &oldEUI };
+            MDB_val euiVal {SIZE_DEVADDR, (void *) &addr.u };
+            r = mdb_del(env.txn, euiDbi, &euiKey, &euiVal);
+            if (r != MDB_SUCCESS && r != MDB_NOTFOUND)
+                return r;
         }
-    };
-
-    r = mdb_txn_commit(env.txn);
-    return r;
+    } else {
+        if (r != MDB_NOTFOUND || !id)
+            return r;
+    }
+    if (!id)
+        return mdb_del(env.txn, env.dbi, &dbKey, nullptr);
+    MDB_val dbData {sizeof(DEVICE_ID), (void *) id };
+    r = mdb_put(env.txn, env.dbi, &dbKey, &dbData, 0);
+    if (r)
+        return r;
+    MDB_val euiKey {sizeof(id->devEUI.u), (void *) &id->devEUI.u };
+    MDB_val euiVal {SIZE_DEVADDR, (void *) &addr.u };
+    return mdb_put(env.txn, euiDbi, &euiKey, &euiVal, 0);
 }
 
 /**
- * UPSERT SQLite >= 3.24.0
- * @param request gateway identifier or address
+ * Put or remove identity in one write transaction, grow map and retry once if map is full
+ * @param addr address
+ * @param id identity to put, nullptr- remove
  * @return 0- success
  */
-int LMDBIdentityService::put(
-    const DEVADDR &devAddr,
-    const DEVICEID &id
+int LMDBIdentityService::write(
+    const DEVADDR &addr,
+    const DEVICE_ID *id
 )
 {
     // start transaction
     int r = mdb_txn_begin(env.env, nullptr, 0, &env.txn);
     if (r)
         return ERR_CODE_LMDB_TXN_BEGIN;
-    MDB_val dbKey {SIZE_DEVADDR, (void*) &devAddr.u };
-    MDB_val dbData {sizeof(DEVICE_ID), (void *) &id.id };
-    r = mdb_put(env.txn, env.dbi, &dbKey, &dbData, 0);
-    if (r) {
-        if (r == MDB_MAP_FULL) {
-            r = processMapFull(&env);
-            if (r == 0)
-                r = mdb_put(env.txn, env.dbi, &dbKey, &dbData, 0);
+    bool committing = false;
+    for (int attempt = 0; ; attempt++) {
+        committing = false;
+        r = writeTxn(addr, id);
+        if (r == MDB_SUCCESS) {
+            committing = true;
+            r = mdb_txn_commit(env.txn);
+            // transaction is released even if commit failed
+            env.txn = nullptr;
         }
+        if (r != MDB_MAP_FULL || attempt > 0)
+            break;
+        // abort transaction, re-open environment with bigger map and begin a new transaction
+        closeRead();
+        r = processMapFull(&env);
         if (r) {
-            mdb_txn_abort(env.txn);
-            return ERR_CODE_LMDB_PUT;
-        }
-    }
-    r = mdb_txn_commit(env.txn);
-    if (r) {
-        if (r == MDB_MAP_FULL) {
-            r = processMapFull(&env);
-            if (r == 0) {
-                r = mdb_txn_commit(env.txn);
-            }
+            env.txn = nullptr;
+            break;
         }
+        r = mdb_dbi_open(env.txn, EUI_DB_NAME, EUI_DB_FLAGS, &euiDbi);
         if (r)
-            return ERR_CODE_LMDB_TXN_COMMIT;
+            break;
     }
-    return r;
+    if (r == MDB_SUCCESS)
+        return CODE_OK;
+    if (env.txn) {
+        mdb_txn_abort(env.txn);
+        env.txn = nullptr;
+    }
+    if (r == MDB_NOTFOUND)
+        return r;
+    return committing ? ERR_CODE_LMDB_TXN_COMMIT : ERR_CODE_LMDB_PUT;
+}
+
+int LMDBIdentityService::put(
+    const DEVADDR &devAddr,
+    const DEVICEID &id
+)
+{
+    return write(devAddr, &id.id);
 }
 
 int LMDBIdentityService::rm(
     const DEVADDR &addr
 )
 {
-    // start transaction
-    int r = mdb_txn_begin(env.env, nullptr, 0, &env.txn);
-    if (r)
-        return ERR_CODE_LMDB_TXN_BEGIN;
+    return write(addr, nullptr);
+}
 
+/**
+ * Fill EUI index from the identities in the current write transaction
+ * @return MDB_SUCCESS or LMDB error code
+ */
+int LMDBIdentityService::rebuildEUIIndex()
+{
     MDB_cursor *cursor;
-    r = mdb_cursor_open(env.txn, env.dbi, &cursor);
-    if (r != MDB_SUCCESS) {
-        mdb_txn_commit(env.txn);
-        return r;
-    }
-    MDB_val dbKey {SIZE_DEVADDR, (void *) &addr.u};
-    DEVICE_ID did;
-    r = mdb_cursor_get(cursor, &dbKey, nullptr, MDB_SET_RANGE);
-    if (r != MDB_SUCCESS) {
-        mdb_txn_commit(env.txn);
+    int r = mdb_cursor_open(env.txn, env.dbi, &cursor);
+    if (r != MDB_SUCCESS)
         return r;
+    MDB_val dbKey {};
+    MDB_val dbVal {};
+    while ((r = mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_NEXT)) == MDB_SUCCESS) {
+        if (dbKey.mv_size != SIZE_DEVADDR || dbVal.mv_size != sizeof(DEVICE_ID))
+            continue;  // named database record
+        uint32_t a;
+        uint64_t eui;
+        memmove(&a, dbKey.mv_data, SIZE_DEVADDR);
+        memmove(&eui, &((DEVICE_ID *) dbVal.mv_data)->devEUI.u, sizeof(eui));
+        MDB_val euiKey {sizeof(eui), &eui };
+        MDB_val euiVal {SIZE_DEVADDR, &a };
+        r = mdb_put(env.txn, euiDbi, &euiKey, &euiVal, 0);
+        if (r)
+            break;
     }
+    mdb_cursor_close(cursor);
+    return r == MDB_NOTFOUND ? MDB_SUCCESS : r;
+}
 
-    do {
-        if (dbKey.mv_size != SIZE_DEVADDR)
-            break;  // error, database corrupted
-        if (*(uint32_t*)dbKey.mv_data != addr.u)
-            break;  // out of range
-        mdb_cursor_del(cursor, 0);
-    } while (mdb_cursor_get(cursor, &dbKey, nullptr, MDB_NEXT) == MDB_SUCCESS);
-
-    r = mdb_txn_commit(env.txn);
+/**
+ * Open EUI index. Create and fill it if database file is created by the previous version.
+ * @return 0- success
+ */
+int LMDBIdentityService::openEUIIndex()
+{
+    int r = mdb_txn_begin(env.env, nullptr, 0, &env.txn);
     if (r)
-        return ERR_CODE_LMDB_TXN_COMMIT;
-    return r;
+        return ERR_CODE_LMDB_TXN_BEGIN;
+    for (int attempt = 0; ; attempt++) {
+        r = mdb_dbi_open(env.txn, EUI_DB_NAME, EUI_DB_FLAGS, &euiDbi);
+        if (r == MDB_NOTFOUND) {
+            r = mdb_dbi_open(env.txn, EUI_DB_NAME, EUI_DB_FLAGS | MDB_CREATE, &euiDbi);
+            if (r == MDB_SUCCESS)
+                r = rebuildEUIIndex();
+        }
+        if (r == MDB_SUCCESS) {
+            r = mdb_txn_commit(env.txn);
+            env.txn = nullptr;
+        }
+        if (r != MDB_MAP_FULL || attempt > 0)
+            break;
+        closeRead();
+        r = processMapFull(&env);
+        if (r) {
+            env.txn = nullptr;
+            break;
+        }
+    }
+    if (env.txn) {
+        mdb_txn_abort(env.txn);
+        env.txn = nullptr;
+    }
+    return r ? ERR_CODE_LMDB_OPEN : CODE_OK;
 }
 
 int LMDBIdentityService::init(
@@ -231,7 +522,7 @@ int LMDBIdentityService::init(
     env.setDb(databaseName);
     if (!openDb(&env))
         return ERR_CODE_LMDB_OPEN;
-    return CODE_OK;
+    return openEUIIndex();
 }
 
 void LMDBIdentityService::flush()
@@ -239,6 +530,7 @@ void LMDBIdentityService::flush()
 }
 
 void LMDBIdentityService::done() {
+    closeRead();
     closeDb(&env);
 }
 
@@ -307,56 +599,188 @@ int LMDBIdentityService::cRm(const DEVADDR &devAddr)
 
 int LMDBIdentityService::cList(
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 )
 {
     IdentityListResponse r;
     r.response = list(r.identities, offset, size);
-    r.size = (uint8_t) r.identities.size();
+    r.size = (uint32_t) r.identities.size();
     if (responseClient)
         responseClient->onIdentityList(nullptr, &r);
    return CODE_OK;
 }
 
+/**
+ * Key range of the cursor scan narrowed by "and" filters
+ */
+typedef struct {
+    uint8_t lower[8];   ///< first key to look at, zeros- first key
+    std::vector<const NETWORK_IDENTITY_FILTER *> upper; ///< scan stops after the key prefix is greater than filter data
+} LMDB_FILTER_RANGE;
+
+/**
+ * Narrow key range by the filter
+ * @param retVal key range
+ * @param keySize key size, 4 for address and 8 for DevEUI
+ * @param filter "and" filter of the key property
+ * @return true if range is narrowed
+ */
+static bool filter2range(
+    LMDB_FILTER_RANGE &retVal,
+    size_t keySize,
+    const NETWORK_IDENTITY_FILTER &filter
+)
+{
+    size_t sz = IdentityFilter::comparedSize(filter);
+    if (sz == 0)
+        return false;
+    bool r = false;
+    switch (filter.comparisonOperator) {
+        case NICO_EQ:
+        case NICO_GT:
+        case NICO_GE:
+            // keys with the smaller prefix do not match
+            {
+                uint8_t lower[8] {};
+                memmove(lower, filter.filterData, sz);
+                if (memcmp(lower, retVal.lower, keySize) > 0)
+                    memmove(retVal.lower, lower, keySize);
+                r = true;
+            }
+            break;
+        default:
+            break;
+    }
+    switch (filter.comparisonOperator) {
+        case NICO_EQ:
+        case NICO_LT:
+        case NICO_LE:
+            retVal.upper.push_back(&filter);
+            r = true;
+            break;
+        default:
+            break;
+    }
+    return r;
+}
+
+/**
+ * Check is scan passed the upper bound
+ * @param range key range
+ * @param key key
+ * @return true- no more matched keys
+ */
+static bool isAfterRange(
+    const LMDB_FILTER_RANGE &range,
+    const void *key
+)
+{
+    for (auto f : range.upper) {
+        int c = memcmp(key, f->filterData, IdentityFilter::comparedSize(*f));
+        if (c > 0 || (c == 0 && f->comparisonOperator == NICO_LT))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Filter is checked over the key range. Unnamed database keys are addresses in memcmp() order, so address filters
+ * bound the cursor scan. Without address bounds, DevEUI equality is looked up in the "deveui" database range.
+ * Other properties are checked after the record is read.
+ */
 int LMDBIdentityService::filter(
     std::vector<NETWORKIDENTITY> &retVal,
     const std::vector<NETWORK_IDENTITY_FILTER> &filters,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 )
 {
-    // start transaction
-    int r = mdb_txn_begin(env.env, nullptr, MDB_RDONLY, &env.txn);
+    LMDB_FILTER_RANGE addrRange {};
+    LMDB_FILTER_RANGE euiRange {};
+    bool hasAddrRange = false;
+    bool hasEUIRange = false;
+    for (auto &f : filters) {
+        if (f.pre == NILPO_OR)
+            continue;   // does not change the result, see IdentityFilter
+        if (f.property == NIP_ADDRESS && filter2range(addrRange, SIZE_DEVADDR, f))
+            hasAddrRange = true;
+        if (f.property == NIP_DEVEUI && f.comparisonOperator == NICO_EQ && filter2range(euiRange, sizeof(DEVEUI::u), f))
+            hasEUIRange = true;
+    }
+
+    MDB_txn *txn;
+    int r = beginRead(txn);
     if (r)
         return ERR_CODE_LMDB_TXN_BEGIN;
 
+    IdentityFilter f(filters);
     size_t o = 0;
     size_t sz = 0;
 
     MDB_cursor *cursor;
-    r = mdb_cursor_open(env.txn, env.dbi, &cursor);
-    if (r != MDB_SUCCESS) {
-        mdb_txn_commit(env.txn);
-        return r;
-    }
-
     MDB_val dbKey {};
     MDB_val dbVal {};
 
-    while ((r = mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_NEXT)) == 0) {
-        if (o < offset) {
-            // skip first
-            o++;
-            continue;
+    if (hasEUIRange && !hasAddrRange) {
+        // addresses of matched EUIs in the primary key order
+        r = mdb_cursor_open(txn, euiDbi, &cursor);
+        if (r != MDB_SUCCESS) {
+            endRead(txn);
+            return r;
         }
-        sz++;
-        if (sz > size)
-            break;
+        std::vector<uint32_t> addrs;
+        dbKey = { sizeof(DEVEUI::u), euiRange.lower };
+        for (r = mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_SET_RANGE); r == MDB_SUCCESS;
+            r = mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_NEXT)) {
+            if (dbKey.mv_size != sizeof(DEVEUI::u) || dbVal.mv_size != SIZE_DEVADDR)
+                continue;
+            if (isAfterRange(euiRange, dbKey.mv_data))
+                break;
+            uint32_t a;
+            memmove(&a, dbVal.mv_data, SIZE_DEVADDR);
+            addrs.push_back(a);
+        }
+        mdb_cursor_close(cursor);
+        std::sort(addrs.begin(), addrs.end(), [] (uint32_t a, uint32_t b) {
+            return memcmp(&a, &b, SIZE_DEVADDR) < 0;
+        });
+        for (auto a : addrs) {
+            DEVADDR addr;
+            addr.u = a;
+            const DEVICE_ID *id;
+            if (findAddr(txn, id, addr) != MDB_SUCCESS || !f.match(addr, *id))
+                continue;
+            if (o < offset) {
+                // skip first
+                o++;
+                continue;
+            }
+            sz++;
+            if (sz > size)
+                break;
+            retVal.emplace_back();
+            NETWORKIDENTITY &nid = retVal.back();
+            nid.value.devaddr.u = a;
+            memmove((void*) &nid.value.devid.id, id, sizeof(DEVICE_ID));
+        }
+        endRead(txn);
+        return CODE_OK;
+    }
 
-        if (dbKey.mv_size != SIZE_DEVADDR || dbVal.mv_size != sizeof(DEVICE_ID))
-            break;  // error, database corrupted
+    r = mdb_cursor_open(txn, env.dbi, &cursor);
+    if (r != MDB_SUCCESS) {
+        endRead(txn);
+        return r;
+    }
 
-        if (!isIdentityFilteredV2(*(DEVADDR*) dbKey.mv_data, *(DEVICE_ID*) dbVal.mv_data, filters))
+    dbKey = { SIZE_DEVADDR, addrRange.lower };
+    for (r = mdb_cursor_get(cursor, &dbKey, &dbVal, hasAddrRange ? MDB_SET_RANGE : MDB_FIRST); r == MDB_SUCCESS;
+        r = mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_NEXT)) {
+        if (dbKey.mv_size != SIZE_DEVADDR || dbVal.mv_size != sizeof(DEVICE_ID))
+            continue;  // named database record
+        if (isAfterRange(addrRange, dbKey.mv_data))
+            break;
+        if (!f.match(*(DEVADDR*) dbKey.mv_data, *(DEVICE_ID*) dbVal.mv_data))
             continue;
         if (o < offset) {
             // skip first
@@ -366,25 +790,26 @@ int LMDBIdentityService::filter(
         sz++;
         if (sz > size)
             break;
-        NETWORKIDENTITY nid;
-        memmove((void*) &nid.value.devaddr.u, dbKey.mv_data, dbKey.mv_size < SIZE_DEVADDR ? dbKey.mv_size : SIZE_DEVADDR);
-        memmove((void*) &nid.value.devid, dbVal.mv_data, dbVal.mv_size < sizeof(DEVICE_ID) ? dbVal.mv_size : sizeof(DEVICE_ID));
-        retVal.emplace_back(nid.value.devaddr, nid.value.devid);
-    } while (mdb_cursor_get(cursor, &dbKey, &dbVal, MDB_NEXT) == MDB_SUCCESS);
-
-    r = mdb_txn_commit(env.txn);
-    return r;
+        // copy from the map to the list item
+        retVal.emplace_back();
+        NETWORKIDENTITY &nid = retVal.back();
+        memmove((void*) &nid.value.devaddr.u, dbKey.mv_data, SIZE_DEVADDR);
+        memmove((void*) &nid.value.devid.id, dbVal.mv_data, sizeof(DEVICE_ID));
+    }
+    mdb_cursor_close(cursor);
+    endRead(txn);
+    return CODE_OK;
 }
 
 int LMDBIdentityService::cFilter(
     const std::vector<NETWORK_IDENTITY_FILTER> &filters,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 )
 {
     IdentityListResponse r;
     r.response = filter(r.identities, filters, offset, size);
-    r.size = (uint8_t) r.identities.size();
+    r.size = (uint32_t) r.identities.size();
     if (responseClient)
         responseClient->onIdentityList(nullptr, &r);
     return CODE_OK;
@@ -393,7 +818,7 @@ int LMDBIdentityService::cFilter(
 int LMDBIdentityService::cSize()
 {
     IdentityOperationResponse r;
-    r.size = (uint8_t) size();
+    r.size = (uint32_t) size();
     if (responseClient)
         responseClient->onIdentityOperation(nullptr, &r);
     return CODE_OK;
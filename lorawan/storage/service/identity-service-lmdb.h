@@ -1,13 +1,39 @@
 #ifndef IDENTITY_SERVICE_LMDB_H_
 #define IDENTITY_SERVICE_LMDB_H_ 1
 
+#include <mutex>
+#include <vector>
+
 #include "lorawan/storage/service/identity-service.h"
 #include "lorawan/helper/plugin-helper.h"
 #include "lorawan/helper/lmdb-helper.h"
 
+/**
+ * LMDB storage.
+ * Identities are stored in the unnamed database keyed by address.
+ * Named database "deveui" maps DevEUI to addresses (sorted duplicates), it is updated in the same transaction.
+ * Each read takes own read-only transaction from the pool of reset ones and renews it, so reads from
+ * several threads do not share a transaction. getView() and getNetworkIdentityView() return pointers
+ * into the memory map, the view transaction is kept until releaseView() in the same thread.
+ */
 class LMDBIdentityService: public IdentityService {
 protected:
     dbenv env;
+    MDB_dbi euiDbi;
+    // reset read transactions ready to be renewed
+    std::mutex readMutex;
+    std::vector<MDB_txn *> idleReads;
+
+    int beginRead(MDB_txn *&retVal);
+    void endRead(MDB_txn *txn);
+    void closeRead();
+    int findAddr(MDB_txn *txn, const DEVICE_ID *&retVal, const DEVADDR &addr);
+    int findEUI(MDB_txn *txn, const DEVICE_ID *&retVal, DEVADDR &retAddr, const DEVEUI &eui);
+
+    int openEUIIndex();
+    int rebuildEUIIndex();
+    int write(const DEVADDR &addr, const DEVICE_ID *id);
+    int writeTxn(const DEVADDR &addr, const DEVICE_ID *id);
 public:
     LMDBIdentityService();
     ~LMDBIdentityService() override;
@@ -17,7 +43,8 @@ public:
     int getNetworkIdentity(NETWORKIDENTITY &retVal, const DEVEUI &eui) override;
     int put(const DEVADDR &devAddr, const DEVICEID &id) override;
     int rm(const DEVADDR &devAddr) override;
-    int list(std::vector<NETWORKIDENTITY> &retVal, uint32_t offset, uint8_t size) override;
+    int list(std::vector<NETWORKIDENTITY> &retVal, uint32_t offset, uint32_t size) override;
+    int listAfter(std::vector<NETWORKIDENTITY> &retVal, const DEVADDR *after, uint32_t size) override;
     size_t size() override;
     int next(NETWORKIDENTITY &retVal) override;
     // asynchronous imitation
@@ -25,7 +52,7 @@ public:
     int cGetNetworkIdentity(const DEVEUI &eui) override;
     int cPut(const DEVADDR &devAddr, const DEVICEID &id) override;
     int cRm(const DEVADDR &devAddr) override;
-    int cList(uint32_t offset, uint8_t size) override;
+    int cList(uint32_t offset, uint32_t size) override;
     int cSize() override;
     int cNext() override;
 
@@ -33,18 +60,22 @@ public:
         std::vector<NETWORKIDENTITY> &retVal,
         const std::vector<NETWORK_IDENTITY_FILTER> &filters,
         uint32_t offset,
-        uint8_t size
+        uint32_t size
     ) override;
     int cFilter(
         const std::vector<NETWORK_IDENTITY_FILTER> &filters,
         uint32_t offset,
-        uint8_t size
+        uint32_t size
     ) override;
 
     int init(const std::string &dbName, void *db) override;
     void flush() override;
     void done() override;
     void setOption(int option, void *value) override;
+
+    int getView(const DEVICE_ID *&retVal, const DEVADDR &devAddr) override;
+    int getNetworkIdentityView(const DEVICE_ID *&retVal, DEVADDR &retAddr, const DEVEUI &eui) override;
+    void releaseView() override;
 };
 
 EXPORT_SHARED_C_FUNC IdentityService* makeIdentityService5();
@@ -1,6 +1,7 @@
 #include <sstream>
 #include <iostream>
 #include "lorawan/storage/service/identity-service-mem.h"
+#include "lorawan/storage/service/identity-filter.h"
 #include "lorawan/lorawan-error.h"
 #include "lorawan/lorawan-string.h"
 #include "lorawan/helper/file-helper.h"
@@ -11,7 +12,10 @@
 #include "platform-defs.h"
 #endif
 
-MemoryIdentityService::MemoryIdentityService() = default;
+MemoryIdentityService::MemoryIdentityService()
+    : shadowedCount(0)
+{
+}
 
 MemoryIdentityService::~MemoryIdentityService() = default;
 
@@ -27,10 +31,14 @@ int MemoryIdentityService::get(
 )
 {
     auto r = storage.find(request);
-    if (r != storage.end())
+    if (r != storage.end()) {
         retVal = r->second;
-    else
+        return CODE_OK;
+    }
+    size_t i = findMapped(request);
+    if (i == mapped.size())
         return ERR_CODE_GATEWAY_NOT_FOUND;
+    retVal.id = mapped.id(i);
     return CODE_OK;
 }
 
@@ -38,28 +46,44 @@ int MemoryIdentityService::get(
 int MemoryIdentityService::list(
     std::vector<NETWORKIDENTITY> &retVal,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 ) {
     size_t o = 0;
     size_t sz = 0;
-    for (auto & it : storage) {
+    forEach(nullptr, [&] (const DEVADDR &addr, const DEVICEID &id) {
         if (o < offset) {
             // skip first
             o++;
-            continue;
+            return true;
         }
         sz++;
         if (sz > size)
-            break;
-        retVal.emplace_back(it.first, it.second);
-    }
+            return false;
+        retVal.emplace_back(addr, id);
+        return true;
+    });
+    return CODE_OK;
+}
+
+// List entries following the address
+int MemoryIdentityService::listAfter(
+    std::vector<NETWORKIDENTITY> &retVal,
+    const DEVADDR *after,
+    uint32_t size
+) {
+    if (size == 0)
+        return CODE_OK;
+    forEach(after, [&] (const DEVADDR &addr, const DEVICEID &id) {
+        retVal.emplace_back(addr, id);
+        return --size > 0;
+    });
     return CODE_OK;
 }
 
 // Entries count
 size_t MemoryIdentityService::size()
 {
-    return storage.size();
+    return storage.size() + mapped.size() - shadowedCount;
 }
 
 /**
@@ -73,14 +97,42 @@ int MemoryIdentityService::getNetworkIdentity(
     const DEVEUI &eui
 )
 {
-    for(auto & it : storage) {
-        if (it.second.id.devEUI.u == eui.u) {
-            retVal.value.devaddr = it.first;
-            retVal.value.devid = it.second;
+    DEVADDR a;
+    bool found = euiIndex.find(a, eui);
+    if (!mapped.hasEUIIndex()) {
+        // snapshot written without index
+        for (size_t i = 0; i < mapped.size(); i++) {
+            if (shadowed[i] || mapped.id(i).devEUI.u != eui.u)
+                continue;
+            if (!found || mapped.addr(i) < a.u) {
+                retVal.value.devaddr = DEVADDR(mapped.addr(i));
+                retVal.value.devid.id = mapped.id(i);
+                return CODE_OK;
+            }
+            break;
+        }
+    }
+    // lowest address of the mapped records which are not replaced or removed
+    const IDENTITY_SNAPSHOT_EUI *e;
+    size_t count = mapped.findEUI(e, eui);
+    for (size_t i = 0; i < count; i++) {
+        if (shadowed[e[i].index])
+            continue;
+        if (!found || e[i].addr < a.u) {
+            retVal.value.devaddr = DEVADDR(e[i].addr);
+            retVal.value.devid.id = mapped.id(e[i].index);
             return CODE_OK;
         }
+        break;
     }
-    return ERR_CODE_DEVICE_EUI_NOT_FOUND;
+    if (!found)
+        return ERR_CODE_DEVICE_EUI_NOT_FOUND;
+    auto r = storage.find(a);
+    if (r == storage.end())
+        return ERR_CODE_DEVICE_EUI_NOT_FOUND;
+    retVal.value.devaddr = r->first;
+    retVal.value.devid = r->second;
+    return CODE_OK;
 }
 
 /**
@@ -93,7 +145,21 @@ int MemoryIdentityService::put(
     const DEVICEID &id
 )
 {
-    storage[devAddr] = id;
+    auto r = storage.find(devAddr);
+    if (r != storage.end()) {
+        euiIndex.put(id.id.devEUI, devAddr, r->second.id.devEUI, true);
+        r->second = id;
+    } else {
+        // copy on write, mapped record is hidden by the stored one
+        size_t i = findMapped(devAddr);
+        if (i < mapped.size()) {
+            shadowed[i] = true;
+            shadowedCount++;
+        }
+        euiIndex.put(id.id.devEUI, devAddr, id.id.devEUI, false);
+        storage[devAddr] = id;
+        addresses.put(devAddr);
+    }
     return CODE_OK;
 }
 
@@ -104,9 +170,18 @@ int MemoryIdentityService::rm(
     // find out by gateway identifier
     auto r = storage.find(addr);
     if (r != storage.end()) {
+        euiIndex.rm(r->second.id.devEUI, r->first);
+        addresses.rm(addr);
         storage.erase(r);
         return CODE_OK;
     }
+    size_t i = findMapped(addr);
+    if (i < mapped.size()) {
+        shadowed[i] = true;
+        shadowedCount++;
+        addresses.rm(addr);
+        return CODE_OK;
+    }
     return ERR_CODE_DEVICE_ADDRESS_NOTFOUND;
 }
 
@@ -125,17 +200,31 @@ void MemoryIdentityService::flush()
 void MemoryIdentityService::done()
 {
     storage.clear();
+    euiIndex.clear();
+    addresses.clear();
+    mapped.close();
+    shadowed.clear();
+    shadowedCount = 0;
 }
 
 /**
- * Return next network address if available
+ * Return next network address if available.
+ * Address is reserved until rm() even if it is not stored by put().
  * @return 0- success, ERR_CODE_ADDR_SPACE_FULL- no address available
  */
 int MemoryIdentityService::next(
-    NETWORKIDENTITY &retval
+    NETWORKIDENTITY &retVal
 )
 {
-    return ERR_CODE_ADDR_SPACE_FULL;
+    if (!addresses.ready(netid)) {
+        // first call or network identifier changed, mark stored addresses in one pass
+        addresses.reset(netid);
+        forEach(nullptr, [this] (const DEVADDR &addr, const DEVICEID &) {
+            addresses.put(addr);
+            return true;
+        });
+    }
+    return addresses.next(retVal.value.devaddr);
 }
 
 void MemoryIdentityService::setOption(
@@ -147,6 +236,67 @@ void MemoryIdentityService::setOption(
     // nothing to do
 }
 
+size_t MemoryIdentityService::findMapped(
+    const DEVADDR &addr
+) const
+{
+    size_t i = mapped.find(addr);
+    if (i < mapped.size() && shadowed[i])
+        return mapped.size();
+    return i;
+}
+
+void MemoryIdentityService::copy(
+    std::map<DEVADDR, DEVICEID> &retVal
+) const
+{
+    if (!mapped.isOpen()) {
+        retVal = storage;
+        return;
+    }
+    retVal.clear();
+    forEach(nullptr, [&retVal] (const DEVADDR &addr, const DEVICEID &id) {
+        retVal.emplace_hint(retVal.end(), addr, id);
+        return true;
+    });
+}
+
+int MemoryIdentityService::openSnapshot(
+    const std::string &fileName
+)
+{
+    MemoryIdentityService::done();
+    int r = mapped.open(fileName);
+    if (r)
+        return r;
+    shadowed.assign(mapped.size(), false);
+    return CODE_OK;
+}
+
+int MemoryIdentityService::saveSnapshot(
+    const std::string &fileName
+) const
+{
+    IdentitySnapshotWriter w;
+    int r = w.open(fileName, true);
+    if (r)
+        return r;
+    forEach(nullptr, [&w, &r] (const DEVADDR &addr, const DEVICEID &id) {
+        r = w.put(addr, id.id);
+        return r == CODE_OK;
+    });
+    // close() removes temporary file if put() failed
+    int c = w.close();
+    return r ? r : c;
+}
+
+void MemoryIdentityService::indexStats(
+    IDENTITY_INDEX_STATS &retVal
+) const
+{
+    euiIndex.stats(retVal);
+}
+
 EXPORT_SHARED_C_FUNC IdentityService* makeMemoryIdentityService()
 {
     return new MemoryIdentityService;
@@ -192,12 +342,12 @@ int MemoryIdentityService::cRm(const DEVADDR &devAddr)
 
 int MemoryIdentityService::cList(
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 )
 {
     IdentityListResponse r;
     r.response = list(r.identities, offset, size);
-    r.size = (uint8_t) r.identities.size();
+    r.size = (uint32_t) r.identities.size();
     if (responseClient)
         responseClient->onIdentityList(nullptr, &r);
    return CODE_OK;
@@ -207,36 +357,38 @@ int MemoryIdentityService::filter(
     std::vector<NETWORKIDENTITY> &retVal,
     const std::vector<NETWORK_IDENTITY_FILTER> &filters,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 )
 {
+    IdentityFilter f(filters);
     size_t o = 0;
     size_t sz = 0;
-    for (auto & it : storage) {
-        if (!isIdentityFilteredV2(it.first, it.second.id, filters))
-            continue;
+    forEach(nullptr, [&] (const DEVADDR &addr, const DEVICEID &id) {
+        if (!f.match(addr, id.id))
+            return true;
         if (o < offset) {
             // skip first
             o++;
-            continue;
+            return true;
         }
         sz++;
         if (sz > size)
-            break;
-        retVal.emplace_back(it.first, it.second);
-    }
+            return false;
+        retVal.emplace_back(addr, id);
+        return true;
+    });
     return CODE_OK;
 }
 
 int MemoryIdentityService::cFilter(
     const std::vector<NETWORK_IDENTITY_FILTER> &filters,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 )
 {
     IdentityListResponse r;
     r.response = filter(r.identities, filters, offset, size);
-    r.size = (uint8_t) r.identities.size();
+    r.size = (uint32_t) r.identities.size();
     if (responseClient)
         responseClient->onIdentityList(nullptr, &r);
     return CODE_OK;
@@ -245,7 +397,7 @@ int MemoryIdentityService::cFilter(
 int MemoryIdentityService::cSize()
 {
     IdentityOperationResponse r;
-    r.size = (uint8_t) size();
+    r.size = (uint32_t) size();
     if (responseClient)
         responseClient->onIdentityOperation(nullptr, &r);
     return CODE_OK;
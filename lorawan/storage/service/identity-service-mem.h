@@ -2,11 +2,63 @@
 #define IDENTITY_SERVICE_MEM_H_ 1
 
 #include "lorawan/storage/service/identity-service.h"
+#include "lorawan/storage/service/identity-eui-index.h"
+#include "lorawan/storage/service/identity-address-allocator.h"
+#include "lorawan/storage/service/identity-snapshot.h"
 #include "lorawan/helper/plugin-helper.h"
 
 class MemoryIdentityService: public IdentityService {
 protected:
     std::map<DEVADDR, DEVICEID> storage;
+    // DevEUI -> address secondary index, kept in sync by put() and rm()
+    IdentityEUIIndex euiIndex;
+    // free addresses of the network, built by the first next() call
+    IdentityAddressAllocator addresses;
+    // read-only records mapped by openSnapshot(), storage holds records put after
+    IdentitySnapshot mapped;
+    // mapped records replaced by put() or removed by rm()
+    std::vector<bool> shadowed;
+    size_t shadowedCount;
+    /**
+     * Return mapped record number if record is not replaced or removed
+     * @return record number, mapped.size() if not found
+     */
+    size_t findMapped(const DEVADDR &addr) const;
+    /**
+     * Call onRecord(const DEVADDR &, const DEVICEID &) for stored and mapped records in the address order
+     * until it returns false. Template keeps list requests free of heap allocations.
+     * @param after start after the address, nullptr- from the first record
+     */
+    template<typename F>
+    void forEach(
+        const DEVADDR *after,
+        F onRecord
+    ) const
+    {
+        auto it = after ? storage.upper_bound(*after) : storage.begin();
+        size_t i = after ? mapped.upperBound(*after) : 0;
+        size_t count = mapped.size();
+        DEVICEID v;
+        while (true) {
+            while (i < count && shadowed[i])
+                i++;
+            if (it == storage.end() && i == count)
+                break;
+            // stored and mapped addresses never match, stored record shadows mapped one
+            if (i == count || (it != storage.end() && it->first.u < mapped.addr(i))) {
+                if (!onRecord(it->first, it->second))
+                    break;
+                it++;
+            } else {
+                v.id = mapped.id(i);
+                if (!onRecord(DEVADDR(mapped.addr(i)), v))
+                    break;
+                i++;
+            }
+        }
+    }
+    // copy stored and mapped records
+    void copy(std::map<DEVADDR, DEVICEID> &retVal) const;
 public:
     MemoryIdentityService();
     ~MemoryIdentityService() override;
@@ -16,7 +68,8 @@ public:
     int getNetworkIdentity(NETWORKIDENTITY &retVal, const DEVEUI &eui) override;
     int put(const DEVADDR &devAddr, const DEVICEID &id) override;
     int rm(const DEVADDR &devAddr) override;
-    int list(std::vector<NETWORKIDENTITY> &retVal, uint32_t offset, uint8_t size) override;
+    int list(std::vector<NETWORKIDENTITY> &retVal, uint32_t offset, uint32_t size) override;
+    int listAfter(std::vector<NETWORKIDENTITY> &retVal, const DEVADDR *after, uint32_t size) override;
     size_t size() override;
     int next(NETWORKIDENTITY &retVal) override;
     // asynchronous imitation
@@ -24,7 +77,7 @@ public:
     int cGetNetworkIdentity(const DEVEUI &eui) override;
     int cPut(const DEVADDR &devAddr, const DEVICEID &id) override;
     int cRm(const DEVADDR &devAddr) override;
-    int cList(uint32_t offset, uint8_t size) override;
+    int cList(uint32_t offset, uint32_t size) override;
     int cSize() override;
     int cNext() override;
 
@@ -32,18 +85,38 @@ public:
         std::vector<NETWORKIDENTITY> &retVal,
         const std::vector<NETWORK_IDENTITY_FILTER> &filters,
         uint32_t offset,
-        uint8_t size
+        uint32_t size
     ) override;
     int cFilter(
         const std::vector<NETWORK_IDENTITY_FILTER> &filters,
         uint32_t offset,
-        uint8_t size
+        uint32_t size
     ) override;
 
     int init(const std::string &dbName, void *db) override;
     void flush() override;
     void done() override;
     void setOption(int option, void *value) override;
+
+    /**
+     * Map binary snapshot file written by saveSnapshot(), records stored before are dropped.
+     * get() reads mapped records in place, put() and rm() copy on write.
+     * @param fileName snapshot file name
+     * @return CODE_OK- success, ERR_CODE_INVALID_SNAPSHOT- file does not exist or broken
+     */
+    int openSnapshot(const std::string &fileName);
+    /**
+     * Write all records to the binary snapshot file
+     * @param fileName snapshot file name
+     * @return CODE_OK- success
+     */
+    int saveSnapshot(const std::string &fileName) const;
+
+    /**
+     * Return DevEUI index memory usage
+     * @param retVal index statistics
+     */
+    void indexStats(IDENTITY_INDEX_STATS &retVal) const;
 };
 
 EXPORT_SHARED_C_FUNC IdentityService* makeIdentityService2();
@@ -1,9 +1,9 @@
-#include <sstream>
-#include <iostream>
+#include <cstddef>
+#include <cstring>
 #include "lorawan/storage/service/identity-service-sqlite.h"
+#include "lorawan/storage/service/identity-filter.h"
 #include "lorawan/lorawan-error.h"
 #include "lorawan/lorawan-string.h"
-#include "lorawan/helper/file-helper.h"
 #include "lorawan/helper/sqlite-helper.h"
 
 #ifdef ESP_PLATFORM
@@ -15,14 +15,137 @@
 
 #define FIELD_LIST "addr, activation, class, deveui, nwkskey, appskey, version, appeui, appkey, nwkkey, devnonce, joinnonce, name"
 
+// user_version of the database with BLOB columns. Version 0 has all columns in hex TEXT
+#define SCHEMA_VERSION  1
+// wait for the other connection (e.g. gateway service) releases the lock, ms
+#define BUSY_TIMEOUT    5000
+
+/**
+ * DEVICE_ID property stored in the column. Column 0 is address, columns 1..12 are properties in FIELD_LIST order
+ */
+typedef struct {
+    const char *name;
+    size_t offset;
+    size_t size;
+} SQLITE_IDENTITY_COLUMN;
+
+#define ID_COLUMN(n, f) { n, offsetof(DEVICE_ID, f), sizeof(DEVICE_ID::f) }
+
+// in NETWORK_IDENTITY_PROPERTY order starting from NIP_ACTIVATION
+static const SQLITE_IDENTITY_COLUMN ID_COLUMNS[] {
+    ID_COLUMN("activation", activation),
+    ID_COLUMN("class", deviceclass),
+    ID_COLUMN("deveui", devEUI),
+    ID_COLUMN("nwkskey", nwkSKey),
+    ID_COLUMN("appskey", appSKey),
+    ID_COLUMN("version", version),
+    ID_COLUMN("appeui", appEUI),
+    ID_COLUMN("appkey", appKey),
+    ID_COLUMN("nwkkey", nwkKey),
+    ID_COLUMN("devnonce", devNonce),
+    ID_COLUMN("joinnonce", joinNonce),
+    ID_COLUMN("name", name)
+};
+
+#define ID_COLUMN_COUNT ((int) (sizeof(ID_COLUMNS) / sizeof(SQLITE_IDENTITY_COLUMN)))
+
+static const char *STATEMENTS[SIS_COUNT_STATEMENTS] {
+    "SELECT " FIELD_LIST " FROM device WHERE addr = ?",
+    // lowest address with the EUI, device_key_deveui index has rowid (addr) in order
+    "SELECT " FIELD_LIST " FROM device WHERE deveui = ? ORDER BY addr LIMIT 1",
+    // UPSERT SQLite >= 3.24.0
+    "INSERT INTO device(" FIELD_LIST ") VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?) ON CONFLICT(addr) DO UPDATE SET "
+        "activation=excluded.activation, class=excluded.class, deveui=excluded.deveui, "
+        "nwkskey=excluded.nwkskey, appskey=excluded.appskey, version=excluded.version, "
+        "appeui=excluded.appeui, appkey=excluded.appkey, nwkkey=excluded.nwkkey, "
+        "devnonce=excluded.devnonce, joinnonce=excluded.joinnonce, name=excluded.name",
+    "DELETE FROM device WHERE addr = ?",
+    "SELECT " FIELD_LIST " FROM device ORDER BY addr LIMIT ? OFFSET ?",
+    // primary key range scan, -1 to start from the first entry
+    "SELECT " FIELD_LIST " FROM device WHERE addr > ? ORDER BY addr LIMIT ?",
+    "SELECT " FIELD_LIST " FROM device ORDER BY addr",
+    "SELECT count(addr) FROM device",
+    "BEGIN IMMEDIATE",
+    "COMMIT",
+    "ROLLBACK"
+};
+
+static const char *SCHEMA_STATEMENT[] {
+    R"(CREATE TABLE IF NOT EXISTS "device" ("addr" INTEGER NOT NULL PRIMARY KEY, "activation" BLOB, "class" BLOB, "deveui" BLOB, "nwkskey" BLOB, "appskey" BLOB, "version" BLOB, "appeui" BLOB, "appkey" BLOB, "nwkkey" BLOB, "devnonce" BLOB, "joinnonce" BLOB, "name" BLOB))",
+    R"(CREATE INDEX IF NOT EXISTS "device_key_deveui" ON "device" ("deveui"))",
+    // filter() selective properties
+    R"(CREATE INDEX IF NOT EXISTS "device_key_appeui" ON "device" ("appeui"))",
+    R"(CREATE INDEX IF NOT EXISTS "device_key_name" ON "device" ("name"))"
+};
+
+static const char *SQL_OPERATORS[] { "", " = ", " <> ", " > ", " < ", " >= ", " <= " };
+
+/**
+ * filter() parameter bound to the WHERE clause
+ */
+typedef struct {
+    const void *data;   ///< BLOB, nullptr- integer
+    int size;
+    int64_t value;
+} SQLITE_FILTER_PARAM;
+
+/**
+ * Translate filter to the condition. BLOB columns are compared as memcmp() does, compared prefix is taken by substr().
+ * @param retWhere condition appended
+ * @param retParams parameters appended
+ * @param filter "and" filter
+ * @return false if filter is not supported and must be checked after the row is read
+ */
+static bool filter2condition(
+    std::string &retWhere,
+    std::vector<SQLITE_FILTER_PARAM> &retParams,
+    const NETWORK_IDENTITY_FILTER &filter
+) {
+    if (filter.comparisonOperator < NICO_EQ || filter.comparisonOperator > NICO_LE)
+        return false;
+    size_t sz = IdentityFilter::comparedSize(filter);
+    if (sz == 0)
+        return false;
+    const char *op = SQL_OPERATORS[filter.comparisonOperator];
+    if (filter.property == NIP_ADDRESS) {
+        // integer column order is not the byte order, only whole address equality is supported
+        if (sz != sizeof(DEVADDR::u) || (filter.comparisonOperator != NICO_EQ && filter.comparisonOperator != NICO_NE))
+            return false;
+        uint32_t a;
+        memmove(&a, filter.filterData, sizeof(a));
+        retWhere += std::string(retWhere.empty() ? " WHERE " : " AND ") + "addr" + op + "?";
+        retParams.push_back({ nullptr, 0, a });
+        return true;
+    }
+    int c = (int) filter.property - (int) NIP_ACTIVATION;
+    if (c < 0 || c >= ID_COLUMN_COUNT)
+        return false;
+    const SQLITE_IDENTITY_COLUMN &col = ID_COLUMNS[c];
+    retWhere += retWhere.empty() ? " WHERE " : " AND ";
+    if (sz == col.size) {
+        retWhere += std::string(col.name) + op + "?";
+        retParams.push_back({ filter.filterData, (int) sz, 0 });
+        return true;
+    }
+    retWhere += std::string("substr(") + col.name + ", 1, " + std::to_string(sz) + ")" + op + "?";
+    retParams.push_back({ filter.filterData, (int) sz, 0 });
+    // longer value with the prefix not less than the filter data is greater than the filter data, use index range
+    if (filter.comparisonOperator == NICO_EQ || filter.comparisonOperator == NICO_GT || filter.comparisonOperator == NICO_GE) {
+        retWhere += std::string(" AND ") + col.name + " >= ?";
+        retParams.push_back({ filter.filterData, (int) sz, 0 });
+    }
+    return true;
+}
+
 SqliteIdentityService::SqliteIdentityService()
-    : db(nullptr)
+    : db(nullptr), ownDb(false), statements{}, committing(false)
 {
 
 }
 
 SqliteIdentityService::~SqliteIdentityService() = default;
 
+// parse version 0 row
 static void row2DEVICEID(
     DEVICEID &retVal,
     const std::vector<std::string> &row
@@ -42,6 +165,174 @@ static void row2DEVICEID(
     string2DEVICENAME(retVal.id.name, row[12].c_str());
 }
 
+static void column2DEVICEID(
+    DEVICEID &retVal,
+    sqlite3_stmt *stmt
+) {
+    char *p = (char *) &retVal.id;
+    for (int c = 0; c < ID_COLUMN_COUNT; c++) {
+        const SQLITE_IDENTITY_COLUMN &col = ID_COLUMNS[c];
+        const void *v = sqlite3_column_blob(stmt, c + 1);
+        size_t sz = (size_t) sqlite3_column_bytes(stmt, c + 1);
+        if (sz > col.size)
+            sz = col.size;
+        if (v)
+            memmove(p + col.offset, v, sz);
+        if (sz < col.size)
+            memset(p + col.offset + sz, 0, col.size - sz);
+    }
+}
+
+static void column2NETWORKIDENTITY(
+    NETWORKIDENTITY &retVal,
+    sqlite3_stmt *stmt
+) {
+    retVal.value.devaddr.u = (uint32_t) sqlite3_column_int64(stmt, 0);
+    column2DEVICEID(retVal.value.devid, stmt);
+}
+
+/**
+ * Bind address and properties. Values are not copied, they must live until sqlite3_step() returns
+ */
+static void bindIdentity(
+    sqlite3_stmt *stmt,
+    const DEVADDR &addr,
+    const DEVICE_ID &id
+) {
+    sqlite3_bind_int64(stmt, 1, addr.u);
+    const char *p = (const char *) &id;
+    for (int c = 0; c < ID_COLUMN_COUNT; c++) {
+        sqlite3_bind_blob(stmt, c + 2, p + ID_COLUMNS[c].offset, (int) ID_COLUMNS[c].size, SQLITE_STATIC);
+    }
+}
+
+// step statement once and make it ready for the next call
+static int stepReset(
+    sqlite3_stmt *stmt
+) {
+    int r = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return r;
+}
+
+static int execStatement(
+    sqlite3 *db,
+    const char *statement
+) {
+    char *zErrMsg = nullptr;
+    int r = sqlite3_exec(db, statement, nullptr, nullptr, &zErrMsg);
+    if (zErrMsg)
+        sqlite3_free(zErrMsg);
+    return r;
+}
+
+static int64_t selectInt(
+    sqlite3 *db,
+    const char *statement
+) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, statement, -1, &stmt, nullptr) != SQLITE_OK)
+        return -1;
+    int64_t r = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        r = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return r;
+}
+
+/**
+ * Convert version 0 table (hex TEXT columns) to BLOB columns in one transaction
+ * @param db database
+ * @return 0- success
+ */
+static int migrateTextSchema(
+    sqlite3 *db
+) {
+    if (execStatement(db, "BEGIN IMMEDIATE") != SQLITE_OK)
+        return ERR_CODE_DB_START_TRANSACTION;
+    int r = execStatement(db, R"(DROP INDEX IF EXISTS "device_key_deveui")");
+    if (r == SQLITE_OK)
+        r = execStatement(db, R"(ALTER TABLE "device" RENAME TO "device_text")");
+    for (auto s : SCHEMA_STATEMENT) {
+        if (r == SQLITE_OK)
+            r = execStatement(db, s);
+    }
+    std::vector<std::vector<std::string>> table;
+    if (r == SQLITE_OK) {
+        char *zErrMsg = nullptr;
+        r = sqlite3_exec(db, "SELECT " FIELD_LIST " FROM device_text", tableCallback, &table, &zErrMsg);
+        if (zErrMsg)
+            sqlite3_free(zErrMsg);
+    }
+    sqlite3_stmt *stmt = nullptr;
+    if (r == SQLITE_OK)
+        r = sqlite3_prepare_v2(db, STATEMENTS[SIS_PUT], -1, &stmt, nullptr);
+    if (r == SQLITE_OK) {
+        for (auto &row : table) {
+            if (row.size() < 13)
+                continue;
+            NETWORKIDENTITY ni;
+            ni.value.devaddr = row[0];
+            row2DEVICEID(ni.value.devid, row);
+            bindIdentity(stmt, ni.value.devaddr, ni.value.devid.id);
+            if (stepReset(stmt) != SQLITE_DONE) {
+                r = SQLITE_ERROR;
+                break;
+            }
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (r == SQLITE_OK)
+        r = execStatement(db, R"(DROP TABLE "device_text")");
+    if (r == SQLITE_OK)
+        r = execStatement(db, "PRAGMA user_version = 1");
+    if (r == SQLITE_OK)
+        r = execStatement(db, "COMMIT");
+    if (r != SQLITE_OK) {
+        execStatement(db, "ROLLBACK");
+        return ERR_CODE_DB_CREATE;
+    }
+    return CODE_OK;
+}
+
+/**
+ * Create tables or convert tables created by the previous version
+ * @return 0- success
+ */
+int SqliteIdentityService::openSchema()
+{
+    bool hasTable = selectInt(db, "SELECT count(name) FROM sqlite_master WHERE type = 'table' AND name = 'device'") > 0;
+    if (hasTable && selectInt(db, "PRAGMA user_version") < SCHEMA_VERSION)
+        return migrateTextSchema(db);
+    for (auto s : SCHEMA_STATEMENT) {
+        if (execStatement(db, s) != SQLITE_OK)
+            return ERR_CODE_DB_CREATE;
+    }
+    if (!hasTable && execStatement(db, "PRAGMA user_version = 1") != SQLITE_OK)
+        return ERR_CODE_DB_CREATE;
+    return CODE_OK;
+}
+
+int SqliteIdentityService::prepareStatements()
+{
+    for (int i = 0; i < SIS_COUNT_STATEMENTS; i++) {
+        if (sqlite3_prepare_v3(db, STATEMENTS[i], -1, SQLITE_PREPARE_PERSISTENT, &statements[i], nullptr) != SQLITE_OK) {
+            finalizeStatements();
+            return ERR_CODE_DB_EXEC;
+        }
+    }
+    return CODE_OK;
+}
+
+void SqliteIdentityService::finalizeStatements()
+{
+    for (auto &stmt : statements) {
+        // finalize NULL is no-op
+        sqlite3_finalize(stmt);
+        stmt = nullptr;
+    }
+}
+
 /**
  * request device identifier by network address. Return 0 if success, retval = EUI and keys
  * @param retval device identifier
@@ -53,79 +344,78 @@ int SqliteIdentityService::get(
     const DEVADDR &request
 )
 {
+    std::lock_guard<std::mutex> lock(dbMutex);
     if (!db)
         return ERR_CODE_DB_DATABASE_NOT_FOUND;
-    char *zErrMsg = nullptr;
-    std::stringstream statement;
-    statement << "SELECT " FIELD_LIST " FROM device WHERE addr = '"
-        << DEVADDR2string(request)
-        << "'";
-    std::vector<std::string> row;
-    int r = sqlite3_exec(db, statement.str().c_str(), rowCallback, &row, &zErrMsg);
-    if (r != SQLITE_OK) {
-        if (zErrMsg) {
-            sqlite3_free(zErrMsg);
-        }
-        return ERR_CODE_DB_SELECT;
-    } else {
-        if (row.size() < 2)
-            return ERR_CODE_BEST_GATEWAY_NOT_FOUND;
-    }
-    row2DEVICEID(retVal, row);
-    return CODE_OK;
+    sqlite3_stmt *stmt = statements[SIS_GET];
+    sqlite3_bind_int64(stmt, 1, request.u);
+    int r = sqlite3_step(stmt);
+    if (r == SQLITE_ROW)
+        column2DEVICEID(retVal, stmt);
+    sqlite3_reset(stmt);
+    if (r == SQLITE_ROW)
+        return CODE_OK;
+    if (r == SQLITE_DONE)
+        return ERR_CODE_DEVICE_ADDRESS_NOTFOUND;
+    return ERR_CODE_DB_SELECT;
 }
 
 // List entries
 int SqliteIdentityService::list(
     std::vector<NETWORKIDENTITY> &retVal,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 ) {
+    std::lock_guard<std::mutex> lock(dbMutex);
     if (!db)
         return ERR_CODE_DB_DATABASE_NOT_FOUND;
-    char *zErrMsg = nullptr;
-    std::stringstream statement;
-    statement << "SELECT " FIELD_LIST " FROM device LIMIT " << (int) size << " OFFSET " << offset;
-    std::vector<std::vector<std::string>> table;
-    // uncomment to check SQL expression
-    // std::cerr << statement.str() << std::endl;
-    int r = sqlite3_exec(db, statement.str().c_str(), tableCallback, &table, &zErrMsg);
-    if (r != SQLITE_OK) {
-        if (zErrMsg) {
-            sqlite3_free(zErrMsg);
-        }
-        return ERR_CODE_DB_SELECT;
+    sqlite3_stmt *stmt = statements[SIS_LIST];
+    sqlite3_bind_int64(stmt, 1, size);
+    sqlite3_bind_int64(stmt, 2, offset);
+    int r;
+    while ((r = sqlite3_step(stmt)) == SQLITE_ROW) {
+        NETWORKIDENTITY ni;
+        column2NETWORKIDENTITY(ni, stmt);
+        retVal.push_back(ni);
     }
-    for (auto row : table) {
-        if (row.size() < 2)
-            continue;
+    sqlite3_reset(stmt);
+    return r == SQLITE_DONE ? CODE_OK : ERR_CODE_DB_SELECT;
+}
+
+// List entries following the address
+int SqliteIdentityService::listAfter(
+    std::vector<NETWORKIDENTITY> &retVal,
+    const DEVADDR *after,
+    uint32_t size
+) {
+    std::lock_guard<std::mutex> lock(dbMutex);
+    if (!db)
+        return ERR_CODE_DB_DATABASE_NOT_FOUND;
+    sqlite3_stmt *stmt = statements[SIS_LIST_AFTER];
+    sqlite3_bind_int64(stmt, 1, after ? (sqlite3_int64) after->u : -1);
+    sqlite3_bind_int64(stmt, 2, size);
+    int r;
+    while ((r = sqlite3_step(stmt)) == SQLITE_ROW) {
         NETWORKIDENTITY ni;
-        row2DEVICEID(ni.value.devid, row);
-        ni.value.devaddr = row[0];
+        column2NETWORKIDENTITY(ni, stmt);
         retVal.push_back(ni);
     }
-    return CODE_OK;
+    sqlite3_reset(stmt);
+    return r == SQLITE_DONE ? CODE_OK : ERR_CODE_DB_SELECT;
 }
 
 // Entries count
 size_t SqliteIdentityService::size()
 {
+    std::lock_guard<std::mutex> lock(dbMutex);
     if (!db)
         return 0;
-    char *zErrMsg = nullptr;
-    std::string statement = "SELECT count(addr) FROM device";
-    std::vector<std::string> row;
-    int r = sqlite3_exec(db, statement.c_str(), rowCallback, &row, &zErrMsg);
-    if (r != SQLITE_OK) {
-        if (zErrMsg) {
-            sqlite3_free(zErrMsg);
-        }
-        return 0;
-    } else {
-        if (row.empty())
-            return 0;
-    }
-    return strtoull(row[0].c_str(), nullptr, 10);
+    sqlite3_stmt *stmt = statements[SIS_COUNT];
+    size_t r = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        r = (size_t) sqlite3_column_int64(stmt, 0);
+    sqlite3_reset(stmt);
+    return r;
 }
 
 /**
@@ -139,124 +429,119 @@ int SqliteIdentityService::getNetworkIdentity(
     const DEVEUI &eui
 )
 {
+    std::lock_guard<std::mutex> lock(dbMutex);
     if (!db)
         return ERR_CODE_DB_DATABASE_NOT_FOUND;
-    char *zErrMsg = nullptr;
-    std::stringstream statement;
-    statement << "SELECT " FIELD_LIST " FROM device WHERE deveui = " << DEVEUI2string(eui) << " LIMIT 1";
-
-    // uncomment to check SQL expression
-    // std::cerr << statement.str() << std::endl;
-
-    std::vector<std::vector<std::string>> table;
-    int r = sqlite3_exec(db, statement.str().c_str(), tableCallback, &table, &zErrMsg);
-    if (r != SQLITE_OK) {
-        if (zErrMsg) {
-            sqlite3_free(zErrMsg);
-        }
-        return ERR_CODE_DB_SELECT;
-    }
-    if (table.empty())
+    sqlite3_stmt *stmt = statements[SIS_GET_EUI];
+    sqlite3_bind_blob(stmt, 1, &eui.u, sizeof(eui.u), SQLITE_STATIC);
+    int r = sqlite3_step(stmt);
+    if (r == SQLITE_ROW)
+        column2NETWORKIDENTITY(retval, stmt);
+    sqlite3_reset(stmt);
+    if (r == SQLITE_ROW)
+        return CODE_OK;
+    if (r == SQLITE_DONE)
         return ERR_CODE_DEVICE_EUI_NOT_FOUND;
-    row2DEVICEID(retval.value.devid, table[0]);
-    retval.value.devaddr = table[0][0];
-    return CODE_OK;
+    return ERR_CODE_DB_SELECT;
 }
 
 /**
- * UPSERT SQLite >= 3.24.0
- * @param devAddr device address
- * @param id device identifier
- * @return 0- success
+ * Queue write and wait until it is committed.
+ * If no commit is running, caller becomes the leader and commits all queued writes including writes queued
+ * by other threads, otherwise it waits for the running commit and then takes the next batch.
+ * @param op put or rm
+ * @return operation result
  */
-int SqliteIdentityService::put(
-    const DEVADDR &devAddr,
-    const DEVICEID &id
+int SqliteIdentityService::write(
+    SQLITE_IDENTITY_WRITE &op
 )
 {
-    if (!db)
-        return ERR_CODE_DB_DATABASE_NOT_FOUND;
-    char *zErrMsg = nullptr;
-    std::stringstream statement;
-
-    statement << "INSERT INTO device(" FIELD_LIST ") VALUES ('"
-        << DEVADDR2string(devAddr) << "', "
-        << "'" << activation2string(id.id.activation) << "', "
-        << "'" << deviceclass2string(id.id.deviceclass) << "', "
-        << "'" << DEVEUI2string(id.id.devEUI) << "', "
-        << "'" << KEY2string(id.id.nwkSKey) << "', "
-        << "'" << KEY2string(id.id.appSKey) << "', "
-        << "'" << LORAWAN_VERSION2string(id.id.version) << "', "
-        << "'" << DEVEUI2string(id.id.appEUI) << "', "
-        << "'" << KEY2string(id.id.appKey) << "', "
-        << "'" << KEY2string(id.id.nwkKey) << "', "
-        << "'" << DEVNONCE2string(id.id.devNonce) << "', "
-        << "'" << JOINNONCE2string(id.id.joinNonce) << "', "
-        << "'" << DEVICENAME2string(id.id.name)
-        << "') ON CONFLICT(addr) DO UPDATE SET "
-        "activation=excluded.activation, class=excluded.class, deveui=excluded.deveui, "
-        "nwkskey=excluded.nwkskey, appskey=excluded.appskey, version=excluded.version, "
-        "appeui=excluded.appeui, appkey=excluded.appkey, nwkkey=excluded.nwkkey, "
-        "devnonce=excluded.devnonce, joinnonce=excluded.joinnonce, name=excluded.name";
-    int r = sqlite3_exec(db, statement.str().c_str(), nullptr, nullptr, &zErrMsg);
-    if (r != SQLITE_OK) {
-        if (zErrMsg) {
-            sqlite3_free(zErrMsg);
+    std::unique_lock<std::mutex> lock(queueMutex);
+    op.done = false;
+    pending.push_back(&op);
+    while (!op.done) {
+        if (committing) {
+            queueCondition.wait(lock);
+            continue;
+        }
+        committing = true;
+        std::vector<SQLITE_IDENTITY_WRITE *> batch;
+        batch.swap(pending);
+        lock.unlock();
+        commit(batch);
+        lock.lock();
+        for (auto w : batch) {
+            w->done = true;
         }
-        return ERR_CODE_DB_INSERT;
+        committing = false;
+        queueCondition.notify_all();
     }
-    return CODE_OK;
+    return op.result;
 }
 
-int SqliteIdentityService::rm(
-    const DEVADDR &addr
+/**
+ * Execute writes in one transaction
+ * @param batch queued writes
+ */
+void SqliteIdentityService::commit(
+    std::vector<SQLITE_IDENTITY_WRITE *> &batch
 )
 {
+    std::lock_guard<std::mutex> lock(dbMutex);
+    int r = CODE_OK;
     if (!db)
-        return ERR_CODE_DB_DATABASE_NOT_FOUND;
-    char *zErrMsg = nullptr;
-    std::stringstream statement;
-    statement << "DELETE FROM device WHERE addr = '" << DEVADDR2string(addr) << "'";
-    int r = sqlite3_exec(db, statement.str().c_str(), nullptr, nullptr, &zErrMsg);
-    // uncomment to check SQL expression
-    // std::cerr << statement.str() << std::endl;
-    if (r != SQLITE_OK) {
-        if (zErrMsg) {
-            sqlite3_free(zErrMsg);
+        r = ERR_CODE_DB_DATABASE_NOT_FOUND;
+    else
+        if (stepReset(statements[SIS_BEGIN]) != SQLITE_DONE)
+            r = ERR_CODE_DB_START_TRANSACTION;
+    if (r) {
+        for (auto w : batch) {
+            w->result = r;
+        }
+        return;
+    }
+    for (auto w : batch) {
+        sqlite3_stmt *stmt;
+        if (w->isPut) {
+            stmt = statements[SIS_PUT];
+            bindIdentity(stmt, w->addr, w->id);
+        } else {
+            stmt = statements[SIS_RM];
+            sqlite3_bind_int64(stmt, 1, w->addr.u);
+        }
+        if (stepReset(stmt) == SQLITE_DONE)
+            w->result = CODE_OK;
+        else
+            w->result = w->isPut ? ERR_CODE_DB_INSERT : ERR_CODE_DB_EXEC;
+    }
+    if (stepReset(statements[SIS_COMMIT]) != SQLITE_DONE) {
+        stepReset(statements[SIS_ROLLBACK]);
+        for (auto w : batch) {
+            w->result = ERR_CODE_DB_COMMIT_TRANSACTION;
         }
-        return ERR_CODE_DB_EXEC;
     }
-    return CODE_OK;
 }
 
-/**
- * "CREATE DATABASE IF NOT EXISTS \"device\" USE \"db_name\"",
- */
-static std::string SCHEMA_STATEMENT[] {
-    R"(CREATE TABLE "device" ("addr" TEXT NOT NULL PRIMARY KEY, "activation" TEXT, "class" TEXT, "deveui" TEXT, "nwkskey" TEXT, "appskey" TEXT, "version" TEXT, "appeui" TEXT, "appkey" TEXT, "nwkkey" TEXT, "devnonce" TEXT, "joinnonce" TEXT, "name" TEXT))",
-    R"(CREATE INDEX "device_key_deveui" ON "device" ("deveui"))"
-};
+int SqliteIdentityService::put(
+    const DEVADDR &devAddr,
+    const DEVICEID &id
+)
+{
+    SQLITE_IDENTITY_WRITE op;
+    op.isPut = true;
+    op.addr = devAddr;
+    op.id = id.id;
+    return write(op);
+}
 
-static int createDatabaseFile(
-    const std::string &fileName
+int SqliteIdentityService::rm(
+    const DEVADDR &addr
 )
 {
-    sqlite3 *db;
-    int r = sqlite3_open_v2(fileName.c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
-    if (r)
-        return r;
-    char *zErrMsg = nullptr;
-    for (auto &s : SCHEMA_STATEMENT) {
-        r = sqlite3_exec(db, s.c_str(), nullptr, nullptr, &zErrMsg);
-        if (r != SQLITE_OK) {
-            if (zErrMsg) {
-                sqlite3_free(zErrMsg);
-            }
-            break;
-        }
-    }
-    sqlite3_close(db);
-    return r;
+    SQLITE_IDENTITY_WRITE op;
+    op.isPut = false;
+    op.addr = addr;
+    return write(op);
 }
 
 int SqliteIdentityService::init(
@@ -264,45 +549,51 @@ int SqliteIdentityService::init(
     void *database
 )
 {
+    std::lock_guard<std::mutex> lock(dbMutex);
     dbName = databaseName;
     if (database) {
         // use external db
         db = (sqlite3 *) database;
-        return CODE_OK;
-    }
-    if (!file::fileExists(dbName)) {
-        int r = createDatabaseFile(dbName);
-        if (r)
-            return r;
+        ownDb = false;
+    } else {
+        // statements and connection are serialized by dbMutex
+        int r = sqlite3_open_v2(dbName.c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, nullptr);
+        if (r) {
+            sqlite3_close(db);
+            db = nullptr;
+            return ERR_CODE_DB_DATABASE_OPEN;
+        }
+        ownDb = true;
+        sqlite3_busy_timeout(db, BUSY_TIMEOUT);
+        // readers do not block writer, commit does not sync until checkpoint
+        execStatement(db, "PRAGMA journal_mode = WAL");
+        execStatement(db, "PRAGMA synchronous = NORMAL");
     }
-    int r = sqlite3_open(dbName.c_str(), &db);
+    int r = openSchema();
+    if (r == CODE_OK)
+        r = prepareStatements();
     if (r) {
+        if (ownDb)
+            sqlite3_close(db);
         db = nullptr;
-        return ERR_CODE_DB_DATABASE_OPEN;
-    }
-    // validate objects
-    r = sqlite3_exec(db, "SELECT " FIELD_LIST " FROM device WHERE addr = ''", nullptr, nullptr, nullptr);
-    if (r != SQLITE_OK) {
-        r = createDatabaseFile(dbName);
-        if (r)
-            return r;
     }
-    return CODE_OK;
+    return r;
 }
 
 void SqliteIdentityService::flush()
 {
-    // re-open database file
-    // external db closed
+    // copy WAL to the database file
+    std::lock_guard<std::mutex> lock(dbMutex);
     if (db)
-        sqlite3_close(db);
-    sqlite3_open(dbName.c_str(), &db);
+        sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_PASSIVE, nullptr, nullptr);
 }
 
 void SqliteIdentityService::done()
 {
-    // int r =
-    sqlite3_close(db);
+    std::lock_guard<std::mutex> lock(dbMutex);
+    finalizeStatements();
+    if (ownDb)
+        sqlite3_close(db);
     db = nullptr;
 }
 
@@ -311,21 +602,26 @@ void SqliteIdentityService::done()
  * @return 0- success, ERR_CODE_ADDR_SPACE_FULL- no address available
  */
 int SqliteIdentityService::next(
-    NETWORKIDENTITY &retval
+    NETWORKIDENTITY &
 )
 {
     return ERR_CODE_ADDR_SPACE_FULL;
 }
 
 void SqliteIdentityService::setOption(
-    int option,
-    void *value
+    int,
+    void *
 )
 
 {
     // nothing to do
 }
 
+bool SqliteIdentityService::isThreadSafe()
+{
+    return true;
+}
+
 // ------------------- asynchronous imitation -------------------
 int SqliteIdentityService::cGet(const DEVADDR &request)
 {
@@ -366,12 +662,12 @@ int SqliteIdentityService::cRm(const DEVADDR &devAddr)
 
 int SqliteIdentityService::cList(
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 )
 {
     IdentityListResponse r;
     r.response = list(r.identities, offset, size);
-    r.size = (uint8_t) r.identities.size();
+    r.size = (uint32_t) r.identities.size();
     if (responseClient)
         responseClient->onIdentityList(nullptr, &r);
     return CODE_OK;
@@ -380,7 +676,7 @@ int SqliteIdentityService::cList(
 int SqliteIdentityService::cSize()
 {
     IdentityOperationResponse r;
-    r.size = (uint8_t) size();
+    r.size = (uint32_t) size();
     if (responseClient)
         responseClient->onIdentityOperation(nullptr, &r);
     return CODE_OK;
@@ -395,53 +691,98 @@ int SqliteIdentityService::cNext()
     return CODE_OK;
 }
 
+/**
+ * Supported "and" filters are translated to the WHERE clause, rest are checked after the row is read.
+ * "Or" filters do not change the result, see IdentityFilter.
+ */
 int SqliteIdentityService::filter(
     std::vector<NETWORKIDENTITY> &retVal,
     const std::vector<NETWORK_IDENTITY_FILTER> &filters,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 )
 {
+    std::string where;
+    std::vector<SQLITE_FILTER_PARAM> params;
+    std::vector<NETWORK_IDENTITY_FILTER> rest;
+    for (auto &f : filters) {
+        if (f.pre == NILPO_OR)
+            continue;
+        if (!filter2condition(where, params, f))
+            rest.push_back(f);
+    }
+    IdentityFilter f(rest);
+
+    std::lock_guard<std::mutex> lock(dbMutex);
     if (!db)
         return ERR_CODE_DB_DATABASE_NOT_FOUND;
-    char *zErrMsg = nullptr;
-    std::stringstream statement;
-    statement << "SELECT " FIELD_LIST " FROM device ";
-    if (!filters.empty())
-        statement << "WHERE " << NETWORK_IDENTITY_FILTERS2string(filters);
-    statement << " LIMIT " << (int) size << " OFFSET " << offset;
-
-    // uncomment to check SQL expression
-    // std::cerr << statement.str() << std::endl;
-
-    std::vector<std::vector<std::string>> table;
-    int r = sqlite3_exec(db, statement.str().c_str(), tableCallback, &table, &zErrMsg);
-    if (r != SQLITE_OK) {
-        if (zErrMsg) {
-            sqlite3_free(zErrMsg);
+    sqlite3_stmt *stmt;
+    bool prepared = !where.empty();
+    if (prepared) {
+        std::string sql = "SELECT " FIELD_LIST " FROM device" + where + " ORDER BY addr";
+        if (rest.empty())
+            sql += " LIMIT ? OFFSET ?";
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+            return ERR_CODE_DB_SELECT;
+        int p = 1;
+        for (auto &param : params) {
+            if (param.data)
+                sqlite3_bind_blob(stmt, p, param.data, param.size, SQLITE_STATIC);
+            else
+                sqlite3_bind_int64(stmt, p, param.value);
+            p++;
         }
-        return ERR_CODE_DB_SELECT;
+        if (rest.empty()) {
+            sqlite3_bind_int64(stmt, p, size);
+            sqlite3_bind_int64(stmt, p + 1, offset);
+        }
+    } else {
+        if (rest.empty()) {
+            stmt = statements[SIS_LIST];
+            sqlite3_bind_int64(stmt, 1, size);
+            sqlite3_bind_int64(stmt, 2, offset);
+        } else
+            stmt = statements[SIS_SCAN];
     }
-    for (auto row : table) {
-        if (row.size() < 2)
-            continue;
+    // LIMIT and OFFSET are applied by SQLite if all filters are in the WHERE clause
+    if (rest.empty())
+        offset = 0;
+    size_t o = 0;
+    size_t sz = 0;
+    int r;
+    while ((r = sqlite3_step(stmt)) == SQLITE_ROW) {
         NETWORKIDENTITY ni;
-        row2DEVICEID(ni.value.devid, row);
-        ni.value.devaddr = row[0];
+        column2NETWORKIDENTITY(ni, stmt);
+        if (!f.match(ni.value.devaddr, ni.value.devid.id))
+            continue;
+        if (o < offset) {
+            // skip first
+            o++;
+            continue;
+        }
+        sz++;
+        if (sz > size) {
+            r = SQLITE_DONE;
+            break;
+        }
         retVal.push_back(ni);
     }
-    return CODE_OK;
+    if (prepared)
+        sqlite3_finalize(stmt);
+    else
+        sqlite3_reset(stmt);
+    return r == SQLITE_DONE ? CODE_OK : ERR_CODE_DB_SELECT;
 }
 
 int SqliteIdentityService::cFilter(
     const std::vector<NETWORK_IDENTITY_FILTER> &filters,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 )
 {
     IdentityListResponse r;
     r.response = filter(r.identities, filters, offset, size);
-    r.size = (uint8_t) r.identities.size();
+    r.size = (uint32_t) r.identities.size();
     if (responseClient)
         responseClient->onIdentityList(nullptr, &r);
     return CODE_OK;
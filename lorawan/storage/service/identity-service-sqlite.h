@@ -1,14 +1,64 @@
 #ifndef IDENTITY_SERVICE_SQLITE_H_
 #define IDENTITY_SERVICE_SQLITE_H_ 1
 
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
 #include <sqlite3.h>
 #include "lorawan/storage/service/identity-service.h"
 #include "lorawan/helper/plugin-helper.h"
 
+enum SQLITE_IDENTITY_STATEMENT {
+    SIS_GET = 0,
+    SIS_GET_EUI,
+    SIS_PUT,
+    SIS_RM,
+    SIS_LIST,
+    SIS_LIST_AFTER,
+    SIS_SCAN,
+    SIS_COUNT,
+    SIS_BEGIN,
+    SIS_COMMIT,
+    SIS_ROLLBACK,
+    SIS_COUNT_STATEMENTS
+};
+
+/**
+ * Pending put() or rm() waiting for the group commit
+ */
+typedef struct {
+    bool isPut;
+    DEVADDR addr;
+    DEVICE_ID id;
+    int result;
+    bool done;
+} SQLITE_IDENTITY_WRITE;
+
+/**
+ * SQLite storage.
+ * Address is integer primary key, other properties are stored as BLOBs in the same byte order as DEVICE_ID has.
+ * Statements are prepared once in init(), connection and statements are serialized by dbMutex.
+ * Concurrent put() and rm() calls are queued, the first caller commits all queued writes in one transaction.
+ */
 class SqliteIdentityService: public IdentityService {
 protected:
     std::string dbName;
     sqlite3 *db;
+    bool ownDb;
+    sqlite3_stmt *statements[SIS_COUNT_STATEMENTS];
+    std::mutex dbMutex;
+    // group commit
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::vector<SQLITE_IDENTITY_WRITE *> pending;
+    bool committing;
+
+    int openSchema();
+    int prepareStatements();
+    void finalizeStatements();
+    int write(SQLITE_IDENTITY_WRITE &op);
+    void commit(std::vector<SQLITE_IDENTITY_WRITE *> &batch);
 public:
     SqliteIdentityService();
     ~SqliteIdentityService() override;
@@ -18,7 +68,8 @@ public:
     int getNetworkIdentity(NETWORKIDENTITY &retVal, const DEVEUI &eui) override;
     int put(const DEVADDR &devAddr, const DEVICEID &id) override;
     int rm(const DEVADDR &addr) override;
-    int list(std::vector<NETWORKIDENTITY> &retVal, uint32_t offset, uint8_t size) override;
+    int list(std::vector<NETWORKIDENTITY> &retVal, uint32_t offset, uint32_t size) override;
+    int listAfter(std::vector<NETWORKIDENTITY> &retVal, const DEVADDR *after, uint32_t size) override;
     size_t size() override;
     int next(NETWORKIDENTITY &retVal) override;
 
@@ -27,7 +78,7 @@ public:
     int cGetNetworkIdentity(const DEVEUI &eui) override;
     int cPut(const DEVADDR &devAddr, const DEVICEID &id) override;
     int cRm(const DEVADDR &devAddr) override;
-    int cList(uint32_t offset, uint8_t size) override;
+    int cList(uint32_t offset, uint32_t size) override;
     int cSize() override;
     int cNext() override;
 
@@ -35,18 +86,19 @@ public:
         std::vector<NETWORKIDENTITY> &retVal,
         const std::vector<NETWORK_IDENTITY_FILTER> &filters,
         uint32_t offset,
-        uint8_t size
+        uint32_t size
     ) override;
     int cFilter(
         const std::vector<NETWORK_IDENTITY_FILTER> &filters,
         uint32_t offset,
-        uint8_t size
+        uint32_t size
     ) override;
 
     int init(const std::string &dbName, void *db) override;
     void flush() override;
     void done() override;
     void setOption(int option, void *value) override;
+    bool isThreadSafe() override;
 };
 
 EXPORT_SHARED_C_FUNC IdentityService* makeIdentityService3();
@@ -17,6 +17,7 @@ IdentityQueryTag
 QUERY_IDENTITY_ADDR = 'a',
 QUERY_IDENTITY_EUI = 'i',
 QUERY_IDENTITY_LIST = 'l',
+QUERY_IDENTITY_LIST_AFTER = 'k',
 QUERY_IDENTITY_COUNT = 'c',
 QUERY_IDENTITY_ASSIGN = 'p',
 QUERY_IDENTITY_RM = 'r',
@@ -158,7 +159,7 @@ public:
 };
 
 ClientUDPIdentityService::ClientUDPIdentityService()
-    :  port(0), code(0), accessCode(0), client(nullptr), retCode(CODE_OK), verbose(0)
+    :  batching(false), port(0), code(0), accessCode(0), client(nullptr), retCode(CODE_OK), verbose(0)
 {
 }
 
@@ -191,13 +192,24 @@ int ClientUDPIdentityService::get(
 int ClientUDPIdentityService::list(
     std::vector<NETWORKIDENTITY> &retVal,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 ) {
     IdentityOperationRequest req(QUERY_IDENTITY_LIST, offset, size, code, accessCode);
     syncClient.request(&req);
     return CODE_OK;
 }
 
+// List entries following the address, server seeks the cursor by 'k' request
+int ClientUDPIdentityService::listAfter(
+    std::vector<NETWORKIDENTITY> &retVal,
+    const DEVADDR *after,
+    uint32_t size
+) {
+    IdentityListAfterRequest req(after, size, code, accessCode);
+    syncClient.request(&req);
+    return CODE_OK;
+}
+
 // Entries count
 size_t ClientUDPIdentityService::size()
 {
@@ -308,39 +320,81 @@ void ClientUDPIdentityService::setOption(
     }
 }
 
+void ClientUDPIdentityService::beginBatch()
+{
+    batch = IdentityBatchRequest(code, accessCode);
+    batching = true;
+}
+
+int ClientUDPIdentityService::endBatch()
+{
+    batching = false;
+    if (!client)
+        return ERR_CODE_SOCKET_CREATE;
+    sendBatch();
+    return CODE_OK;
+}
+
+void ClientUDPIdentityService::sendBatch()
+{
+    if (batch.count)
+        client->request(&batch);
+    // header is converted to network byte order by the client
+    batch = IdentityBatchRequest(code, accessCode);
+}
+
+/**
+ * Send request or append it to the batch. Full batch is sent before the request is appended.
+ * @param request request
+ * @return CODE_OK- success
+ */
+int ClientUDPIdentityService::send(
+    ServiceMessage &request
+)
+{
+    if (!client)
+        return ERR_CODE_SOCKET_CREATE;
+    if (!batching) {
+        client->request(&request);
+        return CODE_OK;
+    }
+    if (!batch.add(request)) {
+        sendBatch();
+        if (!batch.add(request))
+            client->request(&request);  // can not be batched
+    }
+    return CODE_OK;
+}
+
 // ------------------- asynchronous calls -------------------
 
 int ClientUDPIdentityService::cGet(const DEVADDR &request)
 {
-    IdentityAddrRequest req(QUERY_IDENTITY_EUI, addr, code, accessCode);
-    client->request(&req);
-    return CODE_OK;
+    IdentityAddrRequest req(QUERY_IDENTITY_EUI, request, code, accessCode);
+    return send(req);
 }
 
 int ClientUDPIdentityService::cGetNetworkIdentity(const DEVEUI &devEUI)
 {
     IdentityEUIRequest req(QUERY_IDENTITY_ADDR, devEUI, code, accessCode);
-    client->request(&req);
-    return CODE_OK;
+    return send(req);
 }
 
 int ClientUDPIdentityService::cPut(const DEVADDR &devAddr, const DEVICEID &devId)
 {
     IdentityAssignRequest req(QUERY_IDENTITY_ASSIGN, NETWORKIDENTITY(devAddr, devId), code, accessCode);
-    client->request(&req);
-    return CODE_OK;
+    return send(req);
 }
 
 int ClientUDPIdentityService::cRm(const DEVADDR &devAddr)
 {
     IdentityAddrRequest req(QUERY_IDENTITY_RM, devAddr, code, accessCode);
-    client->request(&req);
-    return CODE_OK;
+    return send(req);
 }
 
 int ClientUDPIdentityService::cList(
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 )
 {
     IdentityOperationRequest req(QUERY_IDENTITY_LIST, offset, size, code, accessCode);
@@ -366,7 +420,7 @@ int ClientUDPIdentityService::filter(
     std::vector<NETWORKIDENTITY> &retVal,
     const std::vector<NETWORK_IDENTITY_FILTER> &filters,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 )
 {
     IdentityOperationRequest req(QUERY_IDENTITY_FILTER, offset, size, code, accessCode);
@@ -377,7 +431,7 @@ int ClientUDPIdentityService::filter(
 int ClientUDPIdentityService::cFilter(
     const std::vector<NETWORK_IDENTITY_FILTER> &filters,
     uint32_t offset,
-    uint8_t size
+    uint32_t size
 )
 {
     IdentityOperationRequest req(QUERY_IDENTITY_FILTER, offset, size, code, accessCode);
@@ -6,9 +6,16 @@
 #include "cli-helper.h"
 #include "lorawan/lorawan-msg.h"
 #include "lorawan/storage/client/sync-query-client.h"
+#include "lorawan/storage/serialization/identity-binary-serialization.h"
 #include "lorawan/helper/plugin-helper.h"
 
 class ClientUDPIdentityService: public IdentityService {
+private:
+    // requests queued by asynchronous calls between beginBatch() and endBatch()
+    IdentityBatchRequest batch;
+    bool batching;
+    int send(ServiceMessage &request);
+    void sendBatch();
 public:
     std::string addr;
     uint16_t port;
@@ -27,7 +34,8 @@ public:
     int getNetworkIdentity(NETWORKIDENTITY &retVal, const DEVEUI &eui) override;
     int put(const DEVADDR &devAddr, const DEVICEID &id) override;
     int rm(const DEVADDR &devAddr) override;
-    int list(std::vector<NETWORKIDENTITY> &retVal, uint32_t offset, uint8_t size) override;
+    int list(std::vector<NETWORKIDENTITY> &retVal, uint32_t offset, uint32_t size) override;
+    int listAfter(std::vector<NETWORKIDENTITY> &retVal, const DEVADDR *after, uint32_t size) override;
     size_t size() override;
     int next(NETWORKIDENTITY &retVal) override;
 
@@ -36,7 +44,7 @@ public:
     int cGetNetworkIdentity(const DEVEUI &eui) override;
     int cPut(const DEVADDR &devAddr, const DEVICEID &id) override;
     int cRm(const DEVADDR &devAddr) override;
-    int cList(uint32_t offset, uint8_t size) override;
+    int cList(uint32_t offset, uint32_t size) override;
     int cSize() override;
     int cNext() override;
 
@@ -44,14 +52,25 @@ public:
         std::vector<NETWORKIDENTITY> &retVal,
         const std::vector<NETWORK_IDENTITY_FILTER> &filters,
         uint32_t offset,
-        uint8_t size
+        uint32_t size
     ) override;
     int cFilter(
         const std::vector<NETWORK_IDENTITY_FILTER> &filters,
         uint32_t offset,
-        uint8_t size
+        uint32_t size
     ) override;
 
+    /**
+     * Queue next asynchronous get, put and remove calls to send them in one datagram
+     */
+    void beginBatch();
+    /**
+     * Send queued requests. Responses are passed to the same callbacks in order of calls,
+     * response code is the request status.
+     * @return CODE_OK- success
+     */
+    int endBatch();
+
     int init(const std::string &addrPort, void *db) override;
     void flush() override;
     void done() override;
@@ -1,6 +1,7 @@
 #include <cstring>
 #include "lorawan/storage/service/identity-service.h"
 #include "lorawan/lorawan-conv.h"
+#include "lorawan/lorawan-error.h"
 
 IdentityService::IdentityService()
     : responseClient(nullptr)
@@ -57,6 +58,28 @@ int IdentityService::joinAccept(
     return 0;
 }
 
+bool IdentityService::isThreadSafe() {
+    return false;
+}
+
+int IdentityService::getView(
+    const DEVICE_ID *&,
+    const DEVADDR &
+) {
+    return ERR_CODE_NOT_IMPLEMENTED;
+}
+
+int IdentityService::getNetworkIdentityView(
+    const DEVICE_ID *&,
+    DEVADDR &,
+    const DEVEUI &
+) {
+    return ERR_CODE_NOT_IMPLEMENTED;
+}
+
+void IdentityService::releaseView() {
+}
+
 NETID *IdentityService::getNetworkId() {
     return &netid;
 }
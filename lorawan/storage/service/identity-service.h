@@ -20,6 +20,7 @@
  * put(const DEVADDR &devaddr, const DEVICEID &id)                        cPut(const DEVADDR &devaddr, const DEVICEID &id)
  * rm(const DEVADDR &addr)                                                cRm(const DEVADDR &addr)
  * list(std::vector<NETWORKIDENTITY> &retVal, size_t offset, size_t size) cList(size_t offset, size_t size)
+ * listAfter(std::vector<NETWORKIDENTITY> &retVal, const DEVADDR *after, uint32_t size)
  * filter(std::vector<NETWORKIDENTITY> &retVal, const std::vector<NETWORK_IDENTITY_FILTER> &filters, size_t offset, size_t size)
  *  cFilter(const std::vector<NETWORK_IDENTITY_FILTER> &filters, size_t offset, size_t size)
  * size()                                                                 cSize()
@@ -115,7 +116,22 @@ public:
     virtual int list(
         std::vector<NETWORKIDENTITY> &retVal,
         uint32_t offset,
-        uint8_t size
+        uint32_t size
+    ) = 0;
+
+    /**
+     * synchronous list entries in the storage order following the entry with the address (key continuation).
+     * Pass address of the last returned entry to get the next page, storage does not skip previous entries.
+     * Each storage seeks the cursor itself, paging through list() from the first entry makes export O(n^2).
+     * @param retVal return values
+     * @param after address of the last entry of the previous page, nullptr- from the first entry
+     * @param size max entries count
+     * @return 0- success
+     */
+    virtual int listAfter(
+        std::vector<NETWORKIDENTITY> &retVal,
+        const DEVADDR *after,
+        uint32_t size
     ) = 0;
 
     /**
@@ -131,7 +147,7 @@ public:
         std::vector<NETWORKIDENTITY> &retVal,
         const std::vector<NETWORK_IDENTITY_FILTER> &filters,
         uint32_t offset,
-        uint8_t size
+        uint32_t size
     ) = 0;
 
     /**
@@ -141,7 +157,7 @@ public:
      */
     virtual int cList(
         uint32_t offset,
-        uint8_t size
+        uint32_t size
     ) = 0;
 
     /**
@@ -154,7 +170,7 @@ public:
     virtual int cFilter(
         const std::vector<NETWORK_IDENTITY_FILTER> &filters,
         uint32_t offset,
-        uint8_t size
+        uint32_t size
     ) = 0;
 
     /**
@@ -209,6 +225,36 @@ public:
      */
     virtual void setOption(int option, void *value) = 0;
 
+    /**
+     * Return true if get(), getNetworkIdentity(), put() and rm() can be called from different threads at once
+     * @return false by default
+     */
+    virtual bool isThreadSafe();
+
+    /**
+     * Zero-copy request device identifier by network address.
+     * retVal points to the device identifier kept by the storage. It is valid until releaseView() call,
+     * call releaseView() before any other call if CODE_OK is returned.
+     * @param retVal device identifier view
+     * @param devAddr network address
+     * @return CODE_OK- success, ERR_CODE_NOT_IMPLEMENTED- storage does not provide views, use get()
+     */
+    virtual int getView(const DEVICE_ID *&retVal, const DEVADDR &devAddr);
+
+    /**
+     * Zero-copy request device identifier and network address by EUI. See getView()
+     * @param retVal device identifier view
+     * @param retAddr network address
+     * @param eui device EUI
+     * @return CODE_OK- success, ERR_CODE_NOT_IMPLEMENTED- storage does not provide views, use getNetworkIdentity()
+     */
+    virtual int getNetworkIdentityView(const DEVICE_ID *&retVal, DEVADDR &retAddr, const DEVEUI &eui);
+
+    /**
+     * Release view returned by getView() or getNetworkIdentityView()
+     */
+    virtual void releaseView();
+
     virtual NETID *getNetworkId();
 
     virtual void setNetworkId(
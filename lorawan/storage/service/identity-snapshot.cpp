@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <cstring>
+
+#if defined(_MSC_VER) || defined(__MINGW32__)
+#include <windows.h>
+#elif defined(ESP_PLATFORM)
+#include <cstdlib>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "lorawan/storage/service/identity-snapshot.h"
+#include "lorawan/lorawan-error.h"
+
+#define SNAPSHOT_TEMP_SUFFIX    ".tmp"
+// device identifiers follow the header
+#define OFFSET_SNAPSHOT_IDS     64
+#define ALIGN8(v)               (((v) + 7) & ~((uint64_t) 7))
+
+IdentitySnapshot::IdentitySnapshot()
+    : data(nullptr), dataSize(0),
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    mapping(nullptr),
+#endif
+    header(nullptr), addrs(nullptr), ids(nullptr), euis(nullptr)
+{
+}
+
+IdentitySnapshot::~IdentitySnapshot()
+{
+    close();
+}
+
+/**
+ * Check does count elements starting at the offset fit the file. Offset and count are read from the file,
+ * so sum and product are not calculated, they can wrap.
+ */
+static bool sectionFits(
+    uint64_t offset,
+    uint64_t count,
+    size_t elemSize,
+    size_t dataSize
+)
+{
+    return offset <= dataSize && count <= (dataSize - offset) / elemSize;
+}
+
+int IdentitySnapshot::open(
+    const std::string &fileName
+)
+{
+    close();
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    HANDLE f = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE)
+        return ERR_CODE_INVALID_SNAPSHOT;
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(f, &sz) || sz.QuadPart < (LONGLONG) sizeof(IDENTITY_SNAPSHOT_HEADER)) {
+        CloseHandle(f);
+        return ERR_CODE_INVALID_SNAPSHOT;
+    }
+    mapping = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(f);
+    if (!mapping)
+        return ERR_CODE_INVALID_SNAPSHOT;
+    data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(mapping);
+        mapping = nullptr;
+        return ERR_CODE_INVALID_SNAPSHOT;
+    }
+    dataSize = (size_t) sz.QuadPart;
+#elif defined(ESP_PLATFORM)
+    // no mmap(), read file to the heap
+    FILE *f = fopen(fileName.c_str(), "rb");
+    if (!f)
+        return ERR_CODE_INVALID_SNAPSHOT;
+    long sz = -1;
+    if (!fseek(f, 0, SEEK_END))
+        sz = ftell(f);
+    if (sz < (long) sizeof(IDENTITY_SNAPSHOT_HEADER) || fseek(f, 0, SEEK_SET)) {
+        fclose(f);
+        return ERR_CODE_INVALID_SNAPSHOT;
+    }
+    data = malloc((size_t) sz);
+    if (!data || fread(data, (size_t) sz, 1, f) != 1) {
+        fclose(f);
+        free(data);
+        data = nullptr;
+        return ERR_CODE_INVALID_SNAPSHOT;
+    }
+    fclose(f);
+    dataSize = (size_t) sz;
+#else
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return ERR_CODE_INVALID_SNAPSHOT;
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size < (off_t) sizeof(IDENTITY_SNAPSHOT_HEADER)) {
+        ::close(fd);
+        return ERR_CODE_INVALID_SNAPSHOT;
+    }
+    void *p = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        return ERR_CODE_INVALID_SNAPSHOT;
+    data = p;
+    dataSize = (size_t) st.st_size;
+#endif
+    auto h = (const IDENTITY_SNAPSHOT_HEADER *) data;
+    bool valid = h->magic == IDENTITY_SNAPSHOT_MAGIC
+        && h->version == IDENTITY_SNAPSHOT_VERSION
+        && h->recordSize == sizeof(DEVICE_ID)
+        && h->fileSize == dataSize
+        && sectionFits(h->idOffset, h->count, sizeof(DEVICE_ID), dataSize)
+        && h->addrOffset % sizeof(uint32_t) == 0
+        && sectionFits(h->addrOffset, h->count, sizeof(uint32_t), dataSize);
+    if (valid && (h->flags & IDENTITY_SNAPSHOT_FLAG_EUI_INDEX))
+        valid = h->euiOffset % sizeof(uint64_t) == 0
+            && sectionFits(h->euiOffset, h->count, sizeof(IDENTITY_SNAPSHOT_EUI), dataSize);
+    if (!valid) {
+        close();
+        return ERR_CODE_INVALID_SNAPSHOT;
+    }
+    header = h;
+    addrs = (const uint32_t *) ((const char *) data + h->addrOffset);
+    ids = (const DEVICE_ID *) ((const char *) data + h->idOffset);
+    if (h->flags & IDENTITY_SNAPSHOT_FLAG_EUI_INDEX)
+        euis = (const IDENTITY_SNAPSHOT_EUI *) ((const char *) data + h->euiOffset);
+    return CODE_OK;
+}
+
+void IdentitySnapshot::close()
+{
+    if (data) {
+#if defined(_MSC_VER) || defined(__MINGW32__)
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+        mapping = nullptr;
+#elif defined(ESP_PLATFORM)
+        free(data);
+#else
+        munmap(data, dataSize);
+#endif
+    }
+    data = nullptr;
+    dataSize = 0;
+    header = nullptr;
+    addrs = nullptr;
+    ids = nullptr;
+    euis = nullptr;
+}
+
+bool IdentitySnapshot::isOpen() const
+{
+    return header != nullptr;
+}
+
+size_t IdentitySnapshot::size() const
+{
+    return header ? (size_t) header->count : 0;
+}
+
+size_t IdentitySnapshot::find(
+    const DEVADDR &addr
+) const
+{
+    size_t count = size();
+    auto p = std::lower_bound(addrs, addrs + count, addr.u);
+    if (p == addrs + count || *p != addr.u)
+        return count;
+    return p - addrs;
+}
+
+size_t IdentitySnapshot::upperBound(
+    const DEVADDR &addr
+) const
+{
+    return std::upper_bound(addrs, addrs + size(), addr.u) - addrs;
+}
+
+size_t IdentitySnapshot::findEUI(
+    const IDENTITY_SNAPSHOT_EUI *&retVal,
+    const DEVEUI &eui
+) const
+{
+    if (!euis)
+        return 0;
+    IDENTITY_SNAPSHOT_EUI key;
+    key.eui = eui.u;
+    auto range = std::equal_range(euis, euis + size(), key,
+        [] (const IDENTITY_SNAPSHOT_EUI &l, const IDENTITY_SNAPSHOT_EUI &r) {
+            return l.eui < r.eui;
+        });
+    retVal = range.first;
+    return range.second - range.first;
+}
+
+bool IdentitySnapshot::hasEUIIndex() const
+{
+    return euis != nullptr;
+}
+
+uint32_t IdentitySnapshot::addr(
+    size_t index
+) const
+{
+    return addrs[index];
+}
+
+const DEVICE_ID &IdentitySnapshot::id(
+    size_t index
+) const
+{
+    return ids[index];
+}
+
+IdentitySnapshotWriter::IdentitySnapshotWriter()
+    : file(nullptr), euiIndex(false), status(CODE_OK)
+{
+}
+
+IdentitySnapshotWriter::~IdentitySnapshotWriter()
+{
+    if (file) {
+        fclose(file);
+        std::remove((fileName + SNAPSHOT_TEMP_SUFFIX).c_str());
+    }
+}
+
+int IdentitySnapshotWriter::open(
+    const std::string &aFileName,
+    bool withEUIIndex
+)
+{
+    fileName = aFileName;
+    euiIndex = withEUIIndex;
+    addrs.clear();
+    euis.clear();
+    file = fopen((fileName + SNAPSHOT_TEMP_SUFFIX).c_str(), "wb");
+    if (!file)
+        return ERR_CODE_INVALID_SNAPSHOT;
+    // header is written by close()
+    status = fseek(file, OFFSET_SNAPSHOT_IDS, SEEK_SET) ? ERR_CODE_INVALID_SNAPSHOT : CODE_OK;
+    return status;
+}
+
+int IdentitySnapshotWriter::put(
+    const DEVADDR &addr,
+    const DEVICE_ID &id
+)
+{
+    if (status)
+        return status;
+    if (!addrs.empty() && addrs.back() >= addr.u)
+        return status = ERR_CODE_INVALID_SNAPSHOT;
+    if (fwrite(&id, sizeof(DEVICE_ID), 1, file) != 1)
+        return status = ERR_CODE_INVALID_SNAPSHOT;
+    addrs.push_back(addr.u);
+    if (euiIndex)
+        euis.push_back(id.devEUI.u);
+    return CODE_OK;
+}
+
+static bool writeBuffer(
+    FILE *file,
+    const void *buffer,
+    size_t size
+)
+{
+    return size == 0 || fwrite(buffer, size, 1, file) == 1;
+}
+
+int IdentitySnapshotWriter::close()
+{
+    if (!file)
+        return ERR_CODE_INVALID_SNAPSHOT;
+    std::string tempName = fileName + SNAPSHOT_TEMP_SUFFIX;
+    IDENTITY_SNAPSHOT_HEADER h;
+    memset(&h, 0, sizeof(h));
+    h.magic = IDENTITY_SNAPSHOT_MAGIC;
+    h.version = IDENTITY_SNAPSHOT_VERSION;
+    h.recordSize = sizeof(DEVICE_ID);
+    h.count = addrs.size();
+    h.idOffset = OFFSET_SNAPSHOT_IDS;
+    h.addrOffset = ALIGN8(h.idOffset + h.count * sizeof(DEVICE_ID));
+    h.fileSize = h.addrOffset + h.count * sizeof(uint32_t);
+    std::vector<IDENTITY_SNAPSHOT_EUI> index;
+    if (euiIndex) {
+        h.flags |= IDENTITY_SNAPSHOT_FLAG_EUI_INDEX;
+        h.euiOffset = ALIGN8(h.fileSize);
+        h.fileSize = h.euiOffset + h.count * sizeof(IDENTITY_SNAPSHOT_EUI);
+        index.resize(addrs.size());
+        for (size_t i = 0; i < addrs.size(); i++) {
+            index[i].eui = euis[i];
+            index[i].addr = addrs[i];
+            index[i].index = (uint32_t) i;
+        }
+        // records are in the address order already
+        std::stable_sort(index.begin(), index.end(), [] (const IDENTITY_SNAPSHOT_EUI &l, const IDENTITY_SNAPSHOT_EUI &r) {
+            return l.eui < r.eui;
+        });
+    }
+    if (!status) {
+        // sections follow the records, file is written sequentially, only header is written by seek,
+        // fseek() long offset can not address files above 2GB
+        static const char zeros[8] = { 0 };
+        uint64_t idEnd = h.idOffset + h.count * sizeof(DEVICE_ID);
+        uint64_t addrEnd = h.addrOffset + h.count * sizeof(uint32_t);
+        if (!writeBuffer(file, zeros, (size_t) (h.addrOffset - idEnd))
+            || !writeBuffer(file, addrs.data(), addrs.size() * sizeof(uint32_t))
+            || (euiIndex && (!writeBuffer(file, zeros, (size_t) (h.euiOffset - addrEnd))
+                || !writeBuffer(file, index.data(), index.size() * sizeof(IDENTITY_SNAPSHOT_EUI))))
+            || fseek(file, 0, SEEK_SET)
+            || !writeBuffer(file, &h, sizeof(h)))
+            status = ERR_CODE_INVALID_SNAPSHOT;
+    }
+    if (fclose(file))
+        status = ERR_CODE_INVALID_SNAPSHOT;
+    file = nullptr;
+    if (!status) {
+#if defined(_MSC_VER) || defined(__MINGW32__)
+        std::remove(fileName.c_str());
+#endif
+        if (std::rename(tempName.c_str(), fileName.c_str()))
+            status = ERR_CODE_INVALID_SNAPSHOT;
+    }
+    if (status)
+        std::remove(tempName.c_str());
+    addrs.clear();
+    euis.clear();
+    return status;
+}
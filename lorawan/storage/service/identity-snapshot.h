@@ -0,0 +1,123 @@
+#ifndef IDENTITY_SNAPSHOT_H_
+#define IDENTITY_SNAPSHOT_H_ 1
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "lorawan/lorawan-types.h"
+
+#define IDENTITY_SNAPSHOT_MAGIC     0x5349574c  ///< "LWIS"
+#define IDENTITY_SNAPSHOT_VERSION   1
+
+#define IDENTITY_SNAPSHOT_FLAG_EUI_INDEX    1   ///< EUI index follows the device identifiers
+
+/**
+ * Snapshot file header, host byte order
+ */
+typedef struct {
+    uint32_t magic;         ///< IDENTITY_SNAPSHOT_MAGIC
+    uint32_t version;       ///< IDENTITY_SNAPSHOT_VERSION
+    uint32_t recordSize;    ///< sizeof(DEVICE_ID)
+    uint32_t flags;         ///< IDENTITY_SNAPSHOT_FLAG_EUI_INDEX
+    uint64_t count;         ///< records count
+    uint64_t addrOffset;    ///< sorted uint32_t addresses
+    uint64_t idOffset;      ///< DEVICE_ID records in the address order
+    uint64_t euiOffset;     ///< IDENTITY_SNAPSHOT_EUI entries sorted by EUI, then address, 0- no index
+    uint64_t fileSize;      ///< whole file size
+} IDENTITY_SNAPSHOT_HEADER;
+
+/**
+ * EUI index entry
+ */
+typedef struct {
+    uint64_t eui;
+    uint32_t addr;
+    uint32_t index;         ///< record number
+} IDENTITY_SNAPSHOT_EUI;
+
+/**
+ * Read-only memory mapped identity snapshot.
+ * Records are fixed size, address is found by binary search over the address array,
+ * EUI by binary search over the EUI index. Nothing is parsed or copied on open().
+ */
+class IdentitySnapshot {
+protected:
+    void *data;
+    size_t dataSize;
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    void *mapping;
+#endif
+    const IDENTITY_SNAPSHOT_HEADER *header;
+    const uint32_t *addrs;
+    const DEVICE_ID *ids;
+    const IDENTITY_SNAPSHOT_EUI *euis;
+public:
+    IdentitySnapshot();
+    virtual ~IdentitySnapshot();
+    /**
+     * Map snapshot file
+     * @param fileName snapshot file name
+     * @return CODE_OK- success, ERR_CODE_INVALID_SNAPSHOT- file does not exist or broken
+     */
+    int open(const std::string &fileName);
+    void close();
+    bool isOpen() const;
+    // records count
+    size_t size() const;
+    /**
+     * Find record by address
+     * @return record number, size() if not found
+     */
+    size_t find(const DEVADDR &addr) const;
+    /**
+     * First record which address is greater than the address
+     * @return record number, size() if none
+     */
+    size_t upperBound(const DEVADDR &addr) const;
+    /**
+     * EUI index entries of the EUI in ascending address order
+     * @param retVal first entry
+     * @return entries count, 0 if not found or snapshot has no index
+     */
+    size_t findEUI(const IDENTITY_SNAPSHOT_EUI *&retVal, const DEVEUI &eui) const;
+    bool hasEUIIndex() const;
+    uint32_t addr(size_t index) const;
+    const DEVICE_ID &id(size_t index) const;
+};
+
+/**
+ * Write snapshot file. Records are written as they are put, addresses and EUI index at close().
+ * File is written to the "<file>.tmp" and renamed at close(), so mapped snapshot is not modified.
+ */
+class IdentitySnapshotWriter {
+protected:
+    FILE *file;
+    std::string fileName;
+    bool euiIndex;
+    std::vector<uint32_t> addrs;
+    std::vector<uint64_t> euis;
+    int status;
+public:
+    IdentitySnapshotWriter();
+    virtual ~IdentitySnapshotWriter();
+    /**
+     * Create temporary file
+     * @param fileName snapshot file name
+     * @param withEUIIndex true- add EUI index
+     * @return CODE_OK- success
+     */
+    int open(const std::string &fileName, bool withEUIIndex);
+    /**
+     * Append record, addresses must be in ascending order
+     * @return CODE_OK- success, ERR_CODE_INVALID_SNAPSHOT- address is not greater than previous one
+     */
+    int put(const DEVADDR &addr, const DEVICE_ID &id);
+    /**
+     * Write addresses, index, header and replace the file
+     * @return CODE_OK- success
+     */
+    int close();
+};
+
+#endif
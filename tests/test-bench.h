@@ -0,0 +1,32 @@
+#ifndef TEST_BENCH_H_
+#define TEST_BENCH_H_ 1
+
+#include <cstdlib>
+#include <cstring>
+
+#define BENCH_FLAG  "--bench"
+
+/**
+ * Benchmarks do not run by ctest, run "<test> --bench [count]" to measure
+ * @param retVal count passed after the flag or defaultCount
+ * @param argc main() argc
+ * @param argv main() argv
+ * @param defaultCount count if not passed
+ * @return true- benchmark requested
+ */
+inline bool isBenchRequested(
+    size_t &retVal,
+    int argc,
+    char **argv,
+    size_t defaultCount
+)
+{
+    if (argc < 2 || strcmp(argv[1], BENCH_FLAG) != 0)
+        return false;
+    retVal = argc > 2 ? (size_t) strtoull(argv[2], nullptr, 10) : defaultCount;
+    if (!retVal)
+        retVal = defaultCount;
+    return true;
+}
+
+#endif
@@ -0,0 +1,210 @@
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "lorawan/lorawan-error.h"
+#include "lorawan/storage/service/identity-service-concurrent.h"
+#include "test-identity-helper.h"
+
+#define KEYS            4096
+#define WRITERS         2
+#define READERS         4
+#define OPS_PER_WRITER  40000
+
+/*
+ * Each key has its own writer. Writer operation n (1, 2, ..) puts version n if n is odd and removes the key if n is even.
+ * started[key] is set before and committed[key] after the operation, so reader which read committed before
+ * and started after the lookup must observe one of the states in [committed, started] interval.
+ */
+static std::atomic<uint32_t> started[KEYS];
+static std::atomic<uint32_t> committed[KEYS];
+static std::atomic<bool> writing;
+static std::atomic<size_t> errors;
+static std::atomic<size_t> lookups;
+
+static uint32_t key2addr(uint32_t key)
+{
+    return key * 7919 + 1;
+}
+
+static uint64_t key2eui(uint32_t key)
+{
+    return 0x100000000ull | key;
+}
+
+static bool isValid(uint32_t key, bool found, const DEVICE_ID &id, uint32_t lo, uint32_t hi)
+{
+    if (!found)
+        // some "removed" state (even, 0 is initial) must be in the interval
+        return ((lo & 1) == 0) || lo < hi;
+    uint32_t v = (uint32_t) id.appEUI.u;
+    if ((v & 1) == 0 || v < lo || v > hi)
+        return false;
+    DEVICEID expected;
+    makeId(expected, key, v);
+    return memcmp(&expected.id, &id, sizeof(DEVICE_ID)) == 0;
+}
+
+static void writer(IdentityService *svc, int n)
+{
+    uint32_t rnd = n + 1;
+    for (int i = 0; i < OPS_PER_WRITER; i++) {
+        rnd = rnd * 1103515245 + 12345;
+        uint32_t key = ((rnd >> 8) % (KEYS / WRITERS)) * WRITERS + n;
+        uint32_t op = started[key].load() + 1;
+        started[key].store(op);
+        DEVADDR a;
+        a.u = key2addr(key);
+        if (op & 1) {
+            DEVICEID id;
+            makeId(id, key, op);
+            svc->put(a, id);
+        } else
+            svc->rm(a);
+        committed[key].store(op);
+    }
+}
+
+static void reader(IdentityService *svc, int n)
+{
+    uint32_t rnd = 1000 + n;
+    size_t c = 0;
+    while (writing.load()) {
+        rnd = rnd * 1103515245 + 12345;
+        uint32_t key = (rnd >> 8) % KEYS;
+        uint32_t lo = committed[key].load();
+        bool found;
+        NETWORKIDENTITY ni;
+        if (rnd & 0x80000000) {
+            DEVADDR a;
+            a.u = key2addr(key);
+            found = svc->get(ni.value.devid, a) == CODE_OK;
+            ni.value.devaddr = a;
+        } else {
+            DEVEUI eui(key2eui(key));
+            found = svc->getNetworkIdentity(ni, eui) == CODE_OK;
+        }
+        uint32_t hi = started[key].load();
+        if (!isValid(key, found, ni.value.devid.id, lo, hi) || (found && ni.value.devaddr.u != key2addr(key)))
+            errors++;
+        c++;
+    }
+    lookups += c;
+}
+
+static void testConcurrent()
+{
+    ConcurrentMemoryIdentityService svc;
+    svc.init("", nullptr);
+    assert(svc.isThreadSafe());
+    for (int i = 0; i < KEYS; i++) {
+        started[i] = 0;
+        committed[i] = 0;
+    }
+    errors = 0;
+    lookups = 0;
+    writing = true;
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < READERS; i++)
+        readers.emplace_back(reader, &svc, i);
+    std::vector<std::thread> writers;
+    for (int i = 0; i < WRITERS; i++)
+        writers.emplace_back(writer, &svc, i);
+    for (auto &t : writers)
+        t.join();
+    writing = false;
+    for (auto &t : readers)
+        t.join();
+    std::cout << "lookups: " << lookups << " errors: " << errors << std::endl;
+    assert(errors == 0);
+
+    // quiescent state must match last committed operation
+    size_t present = 0;
+    for (uint32_t key = 0; key < KEYS; key++) {
+        uint32_t op = committed[key];
+        DEVICEID id;
+        DEVADDR a;
+        a.u = key2addr(key);
+        bool found = svc.get(id, a) == CODE_OK;
+        assert(found == ((op & 1) == 1));
+        assert(isValid(key, found, id.id, op, op));
+        if (found)
+            present++;
+    }
+    assert(svc.size() == present);
+    std::vector<NETWORKIDENTITY> l;
+    svc.list(l, 0, 255);
+    for (size_t i = 1; i < l.size(); i++) {
+        assert(l[i - 1].value.devaddr.u < l[i].value.devaddr.u);
+    }
+    svc.done();
+    assert(svc.size() == 0);
+}
+
+// replaced tables are released while readers keep reading
+static void testReclaim()
+{
+    SeqlockHashMap<uint32_t, uint64_t> m;
+    std::atomic<bool> reading(true);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < READERS; i++) {
+        readers.emplace_back([&m, &reading] {
+            uint64_t v;
+            uint32_t k = 0;
+            while (reading.load())
+                m.find(v, k++ % KEYS);
+        });
+    }
+    size_t maxRetired = 0;
+    for (uint32_t round = 0; round < 64; round++) {
+        // clear() replaces table, put() rebuilds it while growing
+        m.clear();
+        for (uint32_t k = 0; k < KEYS; k++) {
+            m.put(k, k);
+        }
+        if (m.retiredSize() > maxRetired)
+            maxRetired = m.retiredSize();
+    }
+    reading = false;
+    for (auto &t : readers)
+        t.join();
+    std::cout << "retired tables max: " << maxRetired << std::endl;
+    // each round replaces 10 tables (clear and growth from 16 to 8192 slots), released during reads
+    assert(maxRetired < 320);
+    // first write releases draining tables and switches epoch, second one releases the rest
+    m.put(0, 0);
+    m.put(0, 0);
+    assert(m.retiredSize() == 0);
+}
+
+static void testNext()
+{
+    ConcurrentMemoryIdentityService svc;
+    svc.init("", nullptr);
+    NETID netid(0, 1);
+    svc.setNetworkId(netid);
+    DEVICEID id;
+    makeId(id, 0, 1);
+    svc.put(DEVADDR(netid, (uint32_t) 0), id);
+    svc.put(DEVADDR(netid, (uint32_t) 1), id);
+    NETWORKIDENTITY ni;
+    int r = svc.next(ni);
+    assert(r == CODE_OK);
+    assert(ni.value.devaddr.u == DEVADDR(netid, (uint32_t) 2).u);
+    svc.rm(DEVADDR(netid, (uint32_t) 0));
+    r = svc.next(ni);
+    assert(r == CODE_OK);
+    assert(ni.value.devaddr.u == DEVADDR(netid, (uint32_t) 0).u);
+    svc.done();
+}
+
+int main() {
+    testConcurrent();
+    testReclaim();
+    testNext();
+    return 0;
+}
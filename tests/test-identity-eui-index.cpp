@@ -0,0 +1,190 @@
+#include <cassert>
+#include <iostream>
+
+#include "lorawan/lorawan-error.h"
+#include "lorawan/storage/service/identity-eui-index.h"
+#include "lorawan/storage/service/identity-service-mem.h"
+#include "lorawan/storage/service/identity-service-flat.h"
+#include "lorawan/storage/service/identity-service-concurrent.h"
+#ifdef ENABLE_LMDB
+#include "lorawan/helper/file-helper.h"
+#include "lorawan/storage/service/identity-service-lmdb.h"
+#endif
+
+#define EUI_SHARED  0x1122334455667788ull
+#define EUI_OTHER   0x99aabbccddeeff00ull
+
+static void testIndex()
+{
+    IdentityEUIIndex idx;
+    DEVEUI shared(EUI_SHARED);
+    DEVEUI other(EUI_OTHER);
+    DEVADDR a;
+    assert(!idx.find(a, shared));
+    // duplicate EUI, lowest address wins whatever the insertion order
+    idx.put(shared, DEVADDR(30), shared, false);
+    idx.put(shared, DEVADDR(10), shared, false);
+    idx.put(shared, DEVADDR(20), shared, false);
+    assert(idx.find(a, shared) && a.u == 10);
+    // same EUI again is not indexed twice
+    idx.put(shared, DEVADDR(10), shared, true);
+    IDENTITY_INDEX_STATS stats;
+    idx.stats(stats);
+    assert(stats.entries == 3);
+    // EUI of the lowest address changed
+    idx.put(other, DEVADDR(10), shared, true);
+    assert(idx.find(a, shared) && a.u == 20);
+    assert(idx.find(a, other) && a.u == 10);
+    // lowest address removed
+    idx.rm(shared, DEVADDR(20));
+    assert(idx.find(a, shared) && a.u == 30);
+    // address indexed with other EUI is not removed
+    idx.rm(shared, DEVADDR(10));
+    assert(idx.find(a, other) && a.u == 10);
+    idx.rm(shared, DEVADDR(30));
+    assert(!idx.find(a, shared));
+    idx.clear();
+    assert(!idx.find(a, other));
+}
+
+static void putId(
+    IdentityService &svc,
+    uint32_t addr,
+    uint64_t eui
+)
+{
+    DEVICEID id;
+    id.id.devEUI.u = eui;
+    int r = svc.put(DEVADDR(addr), id);
+    assert(r == CODE_OK);
+}
+
+static uint32_t findAddr(
+    IdentityService &svc,
+    uint64_t eui
+)
+{
+    NETWORKIDENTITY ni;
+    if (svc.getNetworkIdentity(ni, DEVEUI(eui)) != CODE_OK)
+        return 0;
+    assert(ni.value.devid.id.devEUI.u == eui);
+    return ni.value.devaddr.u;
+}
+
+/**
+ * Index is kept in sync by put() and rm() of the service
+ */
+static void testService(
+    IdentityService &svc,
+    const char *name,
+    const std::string &dbName = ""
+)
+{
+    int r = svc.init(dbName, nullptr);
+    assert(r == CODE_OK);
+    // clear entries left by the failed run
+    std::vector<NETWORKIDENTITY> old;
+    svc.listAfter(old, nullptr, UINT32_MAX);
+    for (auto &ni : old)
+        svc.rm(ni.value.devaddr);
+    putId(svc, 300, EUI_SHARED);
+    putId(svc, 100, EUI_SHARED);
+    putId(svc, 200, EUI_SHARED);
+    assert(findAddr(svc, EUI_SHARED) == 100);
+    // re-put of the lowest address with changed EUI
+    putId(svc, 100, EUI_OTHER);
+    assert(findAddr(svc, EUI_SHARED) == 200);
+    assert(findAddr(svc, EUI_OTHER) == 100);
+    // back to the shared EUI
+    putId(svc, 100, EUI_SHARED);
+    assert(findAddr(svc, EUI_SHARED) == 100);
+    assert(findAddr(svc, EUI_OTHER) == 0);
+    // rm of the lowest address
+    assert(svc.rm(DEVADDR(100)) == CODE_OK);
+    assert(findAddr(svc, EUI_SHARED) == 200);
+    assert(svc.rm(DEVADDR(200)) == CODE_OK);
+    assert(svc.rm(DEVADDR(300)) == CODE_OK);
+    assert(findAddr(svc, EUI_SHARED) == 0);
+    svc.done();
+    std::cout << name << " EUI index OK" << std::endl;
+}
+
+#ifdef ENABLE_LMDB
+#define LMDB_REBUILD_DB "test-identity-eui-rebuild.lmdb"
+
+/**
+ * Database written without "deveui" named database gets the index on the first open
+ */
+static void testLMDBRebuild()
+{
+    file::rmDir(LMDB_REBUILD_DB);
+    dbenv env;
+    env.setDb(LMDB_REBUILD_DB);
+    bool opened = openDb(&env);
+    assert(opened);
+    int r = mdb_txn_begin(env.env, nullptr, 0, &env.txn);
+    assert(r == MDB_SUCCESS);
+    uint32_t addrs[] { 300, 100, 200, 400 };
+    for (auto a : addrs) {
+        DEVICEID id;
+        id.id.devEUI.u = a == 400 ? EUI_OTHER : EUI_SHARED;
+        MDB_val dbKey { sizeof(a), &a };
+        MDB_val dbVal { sizeof(DEVICE_ID), &id.id };
+        r = mdb_put(env.txn, env.dbi, &dbKey, &dbVal, 0);
+        assert(r == MDB_SUCCESS);
+    }
+    r = mdb_txn_commit(env.txn);
+    assert(r == MDB_SUCCESS);
+    closeDb(&env);
+
+    LMDBIdentityService svc;
+    r = svc.init(LMDB_REBUILD_DB, nullptr);
+    assert(r == CODE_OK);
+    assert(svc.size() == 4);
+    assert(findAddr(svc, EUI_SHARED) == 100);
+    assert(findAddr(svc, EUI_OTHER) == 400);
+    // zero-copy lookup reads the same index
+    const DEVICE_ID *v;
+    DEVADDR a;
+    r = svc.getNetworkIdentityView(v, a, DEVEUI(EUI_SHARED));
+    assert(r == CODE_OK);
+    assert(a.u == 100 && v->devEUI.u == EUI_SHARED);
+    svc.releaseView();
+    r = svc.getView(v, DEVADDR(400));
+    assert(r == CODE_OK);
+    assert(v->devEUI.u == EUI_OTHER);
+    svc.releaseView();
+    svc.done();
+
+    // index is not rebuilt again, updates are kept
+    r = svc.init(LMDB_REBUILD_DB, nullptr);
+    assert(r == CODE_OK);
+    r = svc.rm(DEVADDR(100));
+    assert(r == CODE_OK);
+    assert(findAddr(svc, EUI_SHARED) == 200);
+    svc.done();
+    r = svc.init(LMDB_REBUILD_DB, nullptr);
+    assert(r == CODE_OK);
+    assert(svc.size() == 3);
+    assert(findAddr(svc, EUI_SHARED) == 200);
+    svc.done();
+    file::rmDir(LMDB_REBUILD_DB);
+    std::cout << "lmdb EUI index rebuild OK" << std::endl;
+}
+#endif
+
+int main(int argc, char **argv) {
+    testIndex();
+    MemoryIdentityService mem;
+    testService(mem, "memory");
+    FlatMemoryIdentityService flat;
+    testService(flat, "flat");
+    ConcurrentMemoryIdentityService concurrent;
+    testService(concurrent, "concurrent");
+#ifdef ENABLE_LMDB
+    LMDBIdentityService lmdb;
+    testService(lmdb, "lmdb", "test-identity-eui-index.lmdb");
+    testLMDBRebuild();
+#endif
+    return 0;
+}
@@ -0,0 +1,222 @@
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "lorawan/lorawan-error.h"
+#ifdef ENABLE_SQLITE
+#include "lorawan/storage/service/identity-service-sqlite.h"
+#endif
+#ifdef ENABLE_LMDB
+#include "lorawan/storage/service/identity-service-lmdb.h"
+#endif
+#include "test-bench.h"
+#include "test-identity-helper.h"
+
+#define IDENTITIES      20000
+#define APPLICATIONS    100
+#define BENCH_ROUNDS    20
+#define READ_THREADS    4
+#define READ_ROUNDS     200
+
+/**
+ * Identity of one of APPLICATIONS applications, name holds the index
+ */
+static void makeAppId(NETWORKIDENTITY &retVal, uint32_t i)
+{
+    makeId(retVal, i * 7919 + 1);
+    retVal.value.devid.id.devEUI.u = 0x100000000ull | (i * 31);
+    retVal.value.devid.id.appEUI.u = 0x7000000000000000ull | (i % APPLICATIONS);
+    memmove(retVal.value.devid.id.name.c, &i, sizeof(i));
+}
+
+static NETWORK_IDENTITY_FILTER makeFilter(
+    NETWORK_IDENTITY_LOGICAL_PRE_OPERATOR pre,
+    NETWORK_IDENTITY_PROPERTY property,
+    NETWORK_IDENTITY_COMPARISON_OPERATOR op,
+    const void *data,
+    uint8_t length
+)
+{
+    NETWORK_IDENTITY_FILTER r;
+    r.pre = pre;
+    r.property = property;
+    r.comparisonOperator = op;
+    r.length = length;
+    memset(r.filterData, 0, sizeof(r.filterData));
+    memmove(r.filterData, data, length);
+    return r;
+}
+
+/**
+ * Old filter(): full scan, each identity is checked after it is read
+ */
+static size_t scanFilter(
+    IdentityService &svc,
+    const std::vector<NETWORK_IDENTITY_FILTER> &filters
+)
+{
+    std::vector<NETWORKIDENTITY> all;
+    svc.listAfter(all, nullptr, UINT32_MAX);
+    size_t r = 0;
+    for (auto &ni : all) {
+        if (isIdentityFilteredV2(ni.value.devaddr, ni.value.devid.id, filters))
+            r++;
+    }
+    return r;
+}
+
+/**
+ * filter() and listAfter() called from several threads at once, each call must see whole result
+ */
+static void testConcurrentReads(
+    IdentityService &svc,
+    const std::vector<NETWORK_IDENTITY_FILTER> &filters,
+    size_t expected
+)
+{
+    std::atomic<size_t> errors(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < READ_THREADS; t++) {
+        readers.emplace_back([&svc, &filters, &errors, expected, t] {
+            for (int i = 0; i < READ_ROUNDS; i++) {
+                std::vector<NETWORKIDENTITY> r;
+                if ((i + t) & 1) {
+                    if (svc.filter(r, filters, 0, 255) != CODE_OK || r.size() != expected)
+                        errors++;
+                } else {
+                    if (svc.listAfter(r, nullptr, 100) != CODE_OK || r.size() != 100)
+                        errors++;
+                }
+            }
+        });
+    }
+    for (auto &t : readers)
+        t.join();
+    assert(errors == 0);
+}
+
+/**
+ * Filters are checked by the storage, result must be the same as isIdentityFilteredV2() returns
+ * @param concurrentReads true- storage allows reads from several threads
+ * @param benchRounds 0- no benchmark, otherwise compare scan and filter() time
+ */
+static void testPushdown(
+    IdentityService &svc,
+    const char *name,
+    bool concurrentReads,
+    size_t benchRounds
+)
+{
+    // clear entries left by the previous run
+    std::vector<NETWORKIDENTITY> old;
+    svc.listAfter(old, nullptr, UINT32_MAX);
+    for (auto &ni : old)
+        svc.rm(ni.value.devaddr);
+    std::vector<NETWORKIDENTITY> ids(IDENTITIES);
+    for (uint32_t i = 0; i < IDENTITIES; i++) {
+        makeAppId(ids[i], i);
+        svc.put(ids[i].value.devaddr, ids[i].value.devid);
+    }
+
+    NETWORKIDENTITY sample;
+    makeAppId(sample, 4242);
+    const DEVICE_ID &d = sample.value.devid.id;
+    const uint32_t &a = sample.value.devaddr.u;
+    std::vector<std::vector<NETWORK_IDENTITY_FILTER> > cases {
+        // one application
+        { makeFilter(NILPO_NONE, NIP_APPEUI, NICO_EQ, &d.appEUI.u, 8) },
+        { makeFilter(NILPO_NONE, NIP_DEVEUI, NICO_EQ, &d.devEUI.u, 8) },
+        { makeFilter(NILPO_NONE, NIP_ADDRESS, NICO_EQ, &a, 4) },
+        { makeFilter(NILPO_NONE, NIP_ADDRESS, NICO_NE, &a, 4),
+            makeFilter(NILPO_AND, NIP_APPEUI, NICO_EQ, &d.appEUI.u, 8) },
+        // prefixes and ranges
+        { makeFilter(NILPO_NONE, NIP_ADDRESS, NICO_EQ, &a, 2) },
+        { makeFilter(NILPO_NONE, NIP_ADDRESS, NICO_GT, &a, 3),
+            makeFilter(NILPO_AND, NIP_ADDRESS, NICO_LE, &a, 4) },
+        { makeFilter(NILPO_NONE, NIP_DEVEUI, NICO_EQ, &d.devEUI.u, 3) },
+        { makeFilter(NILPO_NONE, NIP_DEVICENAME, NICO_EQ, &d.name.c, 2) },
+        { makeFilter(NILPO_NONE, NIP_DEVICENAME, NICO_GE, &d.name.c, 8),
+            makeFilter(NILPO_AND, NIP_APPEUI, NICO_LT, &d.appEUI.u, 8) },
+        { makeFilter(NILPO_NONE, NIP_APPEUI, NICO_EQ, &d.appEUI.u, 8),
+            makeFilter(NILPO_AND, NIP_NWKSKEY, NICO_GT, &d.nwkSKey, 16),
+            makeFilter(NILPO_AND, NIP_ACTIVATION, NICO_EQ, &d.activation, 1) },
+        // "or" does not change the result, empty comparison is constant
+        { makeFilter(NILPO_NONE, NIP_DEVEUI, NICO_EQ, &d.devEUI.u, 8),
+            makeFilter(NILPO_OR, NIP_APPEUI, NICO_EQ, &d.appEUI.u, 8) },
+        { makeFilter(NILPO_NONE, NIP_APPEUI, NICO_EQ, &d.appEUI.u, 0),
+            makeFilter(NILPO_AND, NIP_DEVEUI, NICO_EQ, &d.devEUI.u, 8) },
+        { makeFilter(NILPO_NONE, NIP_APPEUI, NICO_NE, &d.appEUI.u, 0) }
+    };
+    for (auto &filters : cases) {
+        std::vector<NETWORKIDENTITY> expected;
+        for (auto &ni : ids) {
+            if (isIdentityFilteredV2(ni.value.devaddr, ni.value.devid.id, filters))
+                expected.push_back(ni);
+        }
+        std::vector<NETWORKIDENTITY> r;
+        assert(svc.filter(r, filters, 0, 255) == CODE_OK);
+        assert(r.size() == std::min<size_t>(expected.size(), 255));
+        for (auto &ni : r) {
+            assert(isIdentityFilteredV2(ni.value.devaddr, ni.value.devid.id, filters));
+        }
+        if (expected.size() > 1) {
+            // pages follow each other
+            std::vector<NETWORKIDENTITY> p;
+            assert(svc.filter(p, filters, 1, 255) == CODE_OK);
+            assert(p.size() == std::min<size_t>(expected.size() - 1, 255));
+            assert(p[0].value.devaddr.u == r[1].value.devaddr.u);
+        }
+    }
+
+    std::vector<NETWORK_IDENTITY_FILTER> app { makeFilter(NILPO_NONE, NIP_APPEUI, NICO_EQ, &d.appEUI.u, 8) };
+    if (concurrentReads)
+        testConcurrentReads(svc, app, IDENTITIES / APPLICATIONS);
+    if (benchRounds) {
+        size_t found = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < benchRounds; i++)
+            found += scanFilter(svc, app);
+        auto t1 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < benchRounds; i++) {
+            std::vector<NETWORKIDENTITY> r;
+            svc.filter(r, app, 0, 255);
+            found -= r.size();
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        assert(found == 0);
+        std::cout << name << " single AppEUI of " << IDENTITIES
+            << " scan: " << std::chrono::duration<double, std::micro>(t1 - t0).count() / benchRounds << "us"
+            << " filter: " << std::chrono::duration<double, std::micro>(t2 - t1).count() / benchRounds << "us"
+            << std::endl;
+    }
+    for (auto &ni : ids)
+        svc.rm(ni.value.devaddr);
+    assert(svc.size() == 0);
+}
+
+int main(int argc, char **argv) {
+    size_t benchRounds = 0;
+    isBenchRequested(benchRounds, argc, argv, BENCH_ROUNDS);
+#ifdef ENABLE_SQLITE
+    {
+        SqliteIdentityService svc;
+        assert(svc.init(":memory:", nullptr) == CODE_OK);
+        testPushdown(svc, "sqlite", false, benchRounds);
+        svc.done();
+    }
+#endif
+#ifdef ENABLE_LMDB
+    {
+        LMDBIdentityService svc;
+        assert(svc.init("test-identity-filter.lmdb", nullptr) == CODE_OK);
+        testPushdown(svc, "lmdb", true, benchRounds);
+        svc.done();
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,250 @@
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "lorawan/lorawan-error.h"
+#include "lorawan/lorawan-key.h"
+#include "lorawan/lorawan-string.h"
+#include "lorawan/helper/key128gen.h"
+#include "lorawan/storage/service/identity-service-gen.h"
+#include "test-bench.h"
+
+#define MASTER_KEY          "masterkey"
+// pass page size after --bench
+#define BENCH_PAGE          100000
+
+/**
+ * get() as it was before the master key schedule
+ */
+static void referenceGet(
+    DEVICEID &retVal,
+    const std::string &masterKey,
+    const DEVADDR &addr
+)
+{
+    KEY128 key;
+    phrase2key((uint8_t *) &key.c, masterKey.c_str(), masterKey.size());
+    memset(&retVal.id, 0, sizeof(DEVICE_ID));
+    retVal.id.activation = ABP;
+    retVal.id.deviceclass = CLASS_A;
+    euiGen((uint8_t *) &retVal.id.devEUI.c, KEY_NUMBER_EUI, (uint8_t *) &key.c, addr.u);
+    KEY128 eui;
+    keyGen((uint8_t *) &eui.c, KEY_NUMBER_EUI, (uint8_t *) &key.c, addr.u);
+    memmove(&retVal.id.appEUI, &eui, sizeof(DEVEUI));
+    keyGen((uint8_t *) &retVal.id.nwkKey.c, KEY_NUMBER_NWK, (uint8_t *) &key.c, addr.u);
+    keyGen((uint8_t *) &retVal.id.appKey.c, KEY_NUMBER_APP, (uint8_t *) &key.c, addr.u);
+    deriveOptNegFNwkSIntKey(retVal.id.nwkSKey, key, retVal.id.appEUI, retVal.id.joinNonce, retVal.id.devNonce);
+    deriveOptNegFNwkSIntKey(retVal.id.appSKey, key, retVal.id.appEUI, retVal.id.joinNonce, retVal.id.devNonce);
+    retVal.id.version = { 1, 0, 0 };
+    string2DEVICENAME(retVal.id.name, DEVADDR2string(addr).c_str());
+}
+
+/**
+ * list() entry as it was before the master key schedule
+ */
+static void referenceGen(
+    NETWORKIDENTITY &retVal,
+    const std::string &masterKey,
+    const DEVADDR &addr
+)
+{
+    referenceGet(retVal.value.devid, masterKey, addr);
+    retVal.value.devaddr = addr;
+    DEVICE_ID &id = retVal.value.devid.id;
+    deriveOptNegFNwkSIntKey(id.nwkSKey, id.nwkKey, id.appEUI, id.joinNonce, id.devNonce);
+    deriveOptNegFNwkSIntKey(id.appSKey, id.appKey, id.appEUI, id.joinNonce, id.devNonce);
+}
+
+static bool sameId(
+    const DEVICEID &l,
+    const DEVICEID &r
+)
+{
+    return memcmp(&l.id, &r.id, sizeof(DEVICE_ID)) == 0;
+}
+
+/**
+ * Precomputed schedule gives the same keys, cached and generated values are the same
+ */
+static void testGet()
+{
+    for (size_t cacheSize : { (size_t) 0, (size_t) 3, (size_t) 4096 }) {
+        GenIdentityService svc;
+        svc.setOption(GEN_IDENTITY_OPTION_CACHE_SIZE, &cacheSize);
+        NETID netid(0);
+        int r = svc.init(MASTER_KEY, &netid);
+        assert(r == CODE_OK);
+        for (int round = 0; round < 3; round++) {
+            for (uint32_t a = 0; a < 1000; a += 7) {
+                DEVICEID id;
+                DEVICEID expected;
+                DEVADDR addr(netid, a);
+                r = svc.get(id, addr);
+                assert(r == CODE_OK);
+                referenceGet(expected, MASTER_KEY, addr);
+                assert(sameId(id, expected));
+            }
+        }
+        // other master key drops cached values
+        DEVICEID id;
+        DEVICEID expected;
+        DEVADDR addr(netid, (uint32_t) 7);
+        std::string otherKey("other");
+        svc.setOption(GEN_IDENTITY_OPTION_MASTER_KEY, &otherKey);
+        svc.get(id, addr);
+        referenceGet(expected, otherKey, addr);
+        assert(sameId(id, expected));
+    }
+}
+
+/**
+ * Pages generated by the workers are the same as generated by the caller
+ */
+static void testList()
+{
+    NETID netid(0);
+    std::vector<NETWORKIDENTITY> expected;
+    for (uint32_t a = 0; a < 5000; a++) {
+        NETWORKIDENTITY ni;
+        referenceGen(ni, MASTER_KEY, DEVADDR(netid, a));
+        expected.push_back(ni);
+    }
+    for (size_t threads : { (size_t) 1, (size_t) 3, (size_t) 8 }) {
+        GenIdentityService svc;
+        svc.setOption(GEN_IDENTITY_OPTION_THREADS, &threads);
+        svc.init(MASTER_KEY, &netid);
+        std::vector<NETWORKIDENTITY> l;
+        svc.listAfter(l, nullptr, (uint32_t) expected.size());
+        assert(l.size() == expected.size());
+        for (size_t i = 0; i < l.size(); i++) {
+            assert(l[i].value.devaddr.u == expected[i].value.devaddr.u);
+            assert(sameId(l[i].value.devid, expected[i].value.devid));
+        }
+        // appended to the existing entries
+        svc.listAfter(l, &expected[999].value.devaddr, 100);
+        assert(l.size() == expected.size() + 100);
+        assert(sameId(l.back().value.devid, expected[1099].value.devid));
+        l.clear();
+        svc.list(l, 300, 255);
+        assert(l.size() == 255);
+        for (size_t i = 0; i < l.size(); i++) {
+            assert(sameId(l[i].value.devid, expected[300 + i].value.devid));
+        }
+        // last addresses
+        l.clear();
+        DEVADDR nearEnd(netid, (uint32_t) svc.size() - 100);
+        svc.listAfter(l, &nearEnd, UINT32_MAX);
+        assert(l.size() == 99);
+        l.clear();
+        svc.list(l, (uint32_t) svc.size() - 10, 255);
+        assert(l.size() == 10);
+    }
+}
+
+/**
+ * Full list() walk and full listAfter() walk enumerate the same size() addresses
+ */
+static void testWalk()
+{
+    // type 7: 10 bits long network address
+    NETID netid(7, 1);
+    GenIdentityService svc;
+    svc.init(MASTER_KEY, &netid);
+    std::vector<NETWORKIDENTITY> byOffset;
+    for (uint32_t ofs = 0; ; ) {
+        size_t before = byOffset.size();
+        svc.list(byOffset, ofs, 255);
+        if (byOffset.size() == before)
+            break;
+        ofs += (uint32_t) (byOffset.size() - before);
+    }
+    std::vector<NETWORKIDENTITY> byCursor;
+    for (;;) {
+        size_t before = byCursor.size();
+        DEVADDR last;
+        if (before)
+            last = byCursor.back().value.devaddr;
+        svc.listAfter(byCursor, before ? &last : nullptr, 100);
+        if (byCursor.size() == before)
+            break;
+    }
+    assert(byOffset.size() == svc.size());
+    assert(byCursor.size() == byOffset.size());
+    for (size_t i = 0; i < byOffset.size(); i++) {
+        assert(byCursor[i].value.devaddr.u == byOffset[i].value.devaddr.u);
+        assert(sameId(byCursor[i].value.devid, byOffset[i].value.devid));
+    }
+}
+
+static double nsPerCall(
+    std::chrono::steady_clock::time_point t0,
+    size_t count
+)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / count;
+}
+
+static void benchmark(size_t pageSize)
+{
+    NETID netid(0);
+    const uint32_t hot = 1000;
+    const int rounds = 100;
+    DEVICEID id;
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t a = 0; a < hot * 10; a++) {
+        referenceGet(id, MASTER_KEY, DEVADDR(netid, a));
+    }
+    double reference = nsPerCall(t0, hot * 10);
+
+    size_t noCache = 0;
+    GenIdentityService uncached;
+    uncached.setOption(GEN_IDENTITY_OPTION_CACHE_SIZE, &noCache);
+    uncached.init(MASTER_KEY, &netid);
+    t0 = std::chrono::steady_clock::now();
+    for (uint32_t a = 0; a < hot * 10; a++) {
+        uncached.get(id, DEVADDR(netid, a));
+    }
+    double schedule = nsPerCall(t0, hot * 10);
+
+    GenIdentityService cached;
+    cached.init(MASTER_KEY, &netid);
+    std::vector<DEVADDR> addrs;
+    for (uint32_t a = 0; a < hot; a++) {
+        addrs.push_back(DEVADDR(netid, a * 7919));
+    }
+    t0 = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        for (auto &a : addrs) {
+            cached.get(id, a);
+        }
+    }
+    double lru = nsPerCall(t0, hot * rounds);
+    std::cout << "get(): reference " << reference << "ns, key schedule " << schedule
+        << "ns, LRU hit " << lru << "ns" << std::endl;
+
+    for (size_t threads : { (size_t) 1, (size_t) std::max(2u, std::thread::hardware_concurrency()) }) {
+        GenIdentityService svc;
+        svc.setOption(GEN_IDENTITY_OPTION_THREADS, &threads);
+        svc.init(MASTER_KEY, &netid);
+        std::vector<NETWORKIDENTITY> l;
+        l.reserve(pageSize);
+        t0 = std::chrono::steady_clock::now();
+        svc.listAfter(l, nullptr, (uint32_t) pageSize);
+        std::cout << pageSize << " identities page, " << threads << " threads: "
+            << nsPerCall(t0, 1) / 1000000 << "ms" << std::endl;
+        assert(l.size() == pageSize);
+    }
+}
+
+int main(int argc, char **argv) {
+    testGet();
+    testList();
+    testWalk();
+    size_t pageSize;
+    if (isBenchRequested(pageSize, argc, argv, BENCH_PAGE))
+        benchmark(pageSize);
+    return 0;
+}
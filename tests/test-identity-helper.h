@@ -0,0 +1,56 @@
+#ifndef TEST_IDENTITY_HELPER_H_
+#define TEST_IDENTITY_HELPER_H_ 1
+
+#include <cstdio>
+
+#include "lorawan/lorawan-types.h"
+
+/**
+ * Device identifier depending on the key and version. DevEUI is 0x100000000 | key, AppEUI is version,
+ * keys and nonces are filled with the pattern of both to catch torn reads, name is "d<key>".
+ * Activation and class are valid values, so identifier is the same after text round trip.
+ * @param retVal device identifier
+ * @param key device key, usually address
+ * @param version entry version
+ */
+inline void makeId(
+    DEVICEID &retVal,
+    uint32_t key,
+    uint32_t version = 0
+)
+{
+    retVal = DEVICEID();
+    uint64_t pattern = ((uint64_t) key << 32 | version) * 0x9E3779B97F4A7C15ull;
+    retVal.id.activation = (key & 1) ? OTAA : ABP;
+    retVal.id.deviceclass = (DEVICECLASS) (key % 3);
+    retVal.id.devEUI.u = 0x100000000ull | key;
+    retVal.id.appEUI.u = version;
+    unsigned char *keys[] = { retVal.id.nwkSKey.c, retVal.id.appSKey.c, retVal.id.appKey.c, retVal.id.nwkKey.c };
+    for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]); k++) {
+        for (size_t i = 0; i < sizeof(KEY128::c); i++)
+            keys[k][i] = (unsigned char) ((pattern >> (8 * (i % 8))) + k);
+    }
+    retVal.id.version.c = (uint8_t) pattern;
+    retVal.id.devNonce.u = (uint16_t) (pattern >> 8);
+    for (size_t i = 0; i < sizeof(JOINNONCE::c); i++)
+        retVal.id.joinNonce.c[i] = (unsigned char) (pattern >> (8 * (i + 3)));
+    snprintf(retVal.id.name.c, sizeof(DEVICENAME::c), "d%u", key % 1000000);
+}
+
+/**
+ * Network identity with the address and device identifier depending on the address and version
+ * @param retVal network identity
+ * @param addr network address
+ * @param version entry version
+ */
+inline void makeId(
+    NETWORKIDENTITY &retVal,
+    uint32_t addr,
+    uint32_t version = 0
+)
+{
+    retVal.value.devaddr.u = addr;
+    makeId(retVal.value.devid, addr, version);
+}
+
+#endif
@@ -0,0 +1,255 @@
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lorawan/lorawan-error.h"
+#include "lorawan/storage/service/identity-service-json.h"
+#include "test-identity-helper.h"
+
+#define FILE_NAME   "test-identity-journal.json"
+
+static void removeFiles()
+{
+    std::remove(FILE_NAME);
+    std::remove(FILE_NAME ".log");
+    std::remove(FILE_NAME ".log.old");
+    std::remove(FILE_NAME ".tmp");
+}
+
+static void assertSame(
+    IdentityService &svc,
+    IdentityService &expected
+)
+{
+    std::vector<NETWORKIDENTITY> l;
+    std::vector<NETWORKIDENTITY> e;
+    svc.listAfter(l, nullptr, UINT32_MAX);
+    expected.listAfter(e, nullptr, UINT32_MAX);
+    assert(l.size() == e.size());
+    for (size_t i = 0; i < l.size(); i++) {
+        assert(l[i].value.devaddr.u == e[i].value.devaddr.u);
+        assert(memcmp(&l[i].value.devid.id, &e[i].value.devid.id, sizeof(DEVICE_ID)) == 0);
+    }
+}
+
+static void update(
+    IdentityService &svc,
+    IdentityService &expected,
+    uint32_t from,
+    uint32_t to,
+    uint32_t version
+)
+{
+    for (uint32_t a = from; a < to; a++) {
+        NETWORKIDENTITY ni;
+        makeId(ni, a, version);
+        assert(svc.put(ni.value.devaddr, ni.value.devid) == CODE_OK);
+        expected.put(ni.value.devaddr, ni.value.devid);
+        if (a % 7 == 0) {
+            assert(svc.rm(ni.value.devaddr) == CODE_OK);
+            expected.rm(ni.value.devaddr);
+        }
+    }
+}
+
+/**
+ * Updates are replayed after the service is destroyed without flush(), broken record at the end is ignored
+ */
+static void testReplay()
+{
+    removeFiles();
+    int mode = JSON_JOURNAL_FLUSH;
+    uint32_t period = 0;
+    MemoryIdentityService expected;
+    {
+        JsonIdentityService svc;
+        svc.setOption(JSON_IDENTITY_OPTION_JOURNAL, &mode);
+        svc.setOption(JSON_IDENTITY_OPTION_SNAPSHOT_PERIOD, &period);
+        assert(svc.init(FILE_NAME, nullptr) == CODE_OK);
+        update(svc, expected, 1, 100, 1);
+        update(svc, expected, 50, 60, 2);
+        assert(svc.rm(DEVADDR(7)) == ERR_CODE_DEVICE_ADDRESS_NOTFOUND);
+    }
+    // crash in the middle of the record
+    FILE *f = fopen(FILE_NAME ".log", "ab");
+    fwrite("torn record", 11, 1, f);
+    fclose(f);
+    {
+        JsonIdentityService svc;
+        svc.setOption(JSON_IDENTITY_OPTION_JOURNAL, &mode);
+        svc.setOption(JSON_IDENTITY_OPTION_SNAPSHOT_PERIOD, &period);
+        assert(svc.init(FILE_NAME, nullptr) == CODE_OK);
+        assertSame(svc, expected);
+        update(svc, expected, 90, 120, 3);
+        // crash after the journal is moved, before JSON file is written
+        std::rename(FILE_NAME ".log", FILE_NAME ".log.old");
+    }
+    {
+        JsonIdentityService svc;
+        svc.setOption(JSON_IDENTITY_OPTION_JOURNAL, &mode);
+        svc.setOption(JSON_IDENTITY_OPTION_SNAPSHOT_PERIOD, &period);
+        assert(svc.init(FILE_NAME, nullptr) == CODE_OK);
+        assertSame(svc, expected);
+        update(svc, expected, 1, 10, 4);
+        svc.flush();
+        svc.done();
+    }
+    // snapshot is the plain JSON file
+    JsonIdentityService plain;
+    assert(plain.init(FILE_NAME, nullptr) == CODE_OK);
+    assertSame(plain, expected);
+    removeFiles();
+}
+
+/**
+ * Background snapshot writes JSON file and empties the journal
+ */
+static void testSnapshot()
+{
+    removeFiles();
+    int mode = JSON_JOURNAL_SYNC;
+    uint32_t period = 1;
+    MemoryIdentityService expected;
+    JsonIdentityService svc;
+    svc.setOption(JSON_IDENTITY_OPTION_JOURNAL, &mode);
+    svc.setOption(JSON_IDENTITY_OPTION_SNAPSHOT_PERIOD, &period);
+    assert(svc.init(FILE_NAME, nullptr) == CODE_OK);
+    auto t0 = std::chrono::steady_clock::now();
+    update(svc, expected, 1, 200, 1);
+    auto t1 = std::chrono::steady_clock::now();
+    std::cout << "synced put/rm: " << std::chrono::duration<double, std::micro>(t1 - t0).count() / 227 << "us" << std::endl;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    FILE *f = fopen(FILE_NAME ".log", "rb");
+    assert(f);
+    fseek(f, 0, SEEK_END);
+    assert(ftell(f) == 0);
+    fclose(f);
+    JsonIdentityService plain;
+    assert(plain.init(FILE_NAME, nullptr) == CODE_OK);
+    assertSame(plain, expected);
+    svc.done();
+    removeFiles();
+}
+
+static long fileSize(
+    const char *fileName
+)
+{
+    FILE *f = fopen(fileName, "rb");
+    if (!f)
+        return -1;
+    fseek(f, 0, SEEK_END);
+    long r = ftell(f);
+    fclose(f);
+    return r;
+}
+
+/**
+ * Snapshot failed to write JSON file, the next one merges journals and removes them
+ */
+static void testFailedSnapshot()
+{
+    removeFiles();
+    rmdir(FILE_NAME ".tmp");
+    int mode = JSON_JOURNAL_FLUSH;
+    uint32_t period = 0;
+    MemoryIdentityService expected;
+    {
+        JsonIdentityService svc;
+        svc.setOption(JSON_IDENTITY_OPTION_JOURNAL, &mode);
+        svc.setOption(JSON_IDENTITY_OPTION_SNAPSHOT_PERIOD, &period);
+        assert(svc.init(FILE_NAME, nullptr) == CODE_OK);
+        update(svc, expected, 1, 50, 1);
+        // temporary JSON file can not be created
+        assert(mkdir(FILE_NAME ".tmp", 0700) == 0);
+        svc.flush();
+        assert(fileSize(FILE_NAME ".log.old") > 0);
+        update(svc, expected, 30, 80, 2);
+        svc.flush();
+        assert(fileSize(FILE_NAME ".log.old") > 0);
+        assert(fileSize(FILE_NAME ".log") == 0);
+        update(svc, expected, 70, 90, 3);
+        // not found, not journaled
+        assert(svc.rm(DEVADDR(7)) == ERR_CODE_DEVICE_ADDRESS_NOTFOUND);
+        rmdir(FILE_NAME ".tmp");
+        svc.flush();
+        assert(fileSize(FILE_NAME ".log.old") < 0);
+        assert(fileSize(FILE_NAME ".log") == 0);
+        update(svc, expected, 85, 95, 4);
+    }
+    JsonIdentityService svc;
+    svc.setOption(JSON_IDENTITY_OPTION_JOURNAL, &mode);
+    svc.setOption(JSON_IDENTITY_OPTION_SNAPSHOT_PERIOD, &period);
+    assert(svc.init(FILE_NAME, nullptr) == CODE_OK);
+    assertSame(svc, expected);
+    svc.done();
+    removeFiles();
+}
+
+/**
+ * Journal of the service can be replaced by the device which write always fails
+ */
+class FailingJournalService: public JsonIdentityService {
+public:
+    void failJournal(bool fail)
+    {
+        journal.close();
+        assert(journal.open(fail ? "/dev/full" : FILE_NAME ".log", false) == CODE_OK);
+    }
+};
+
+/**
+ * put() and rm() which are not written to the journal do not change the storage
+ */
+static void testFailedAppend()
+{
+    removeFiles();
+    int mode = JSON_JOURNAL_FLUSH;
+    uint32_t period = 0;
+    MemoryIdentityService expected;
+    {
+        FailingJournalService svc;
+        svc.setOption(JSON_IDENTITY_OPTION_JOURNAL, &mode);
+        svc.setOption(JSON_IDENTITY_OPTION_SNAPSHOT_PERIOD, &period);
+        assert(svc.init(FILE_NAME, nullptr) == CODE_OK);
+        update(svc, expected, 1, 20, 1);
+        svc.failJournal(true);
+        NETWORKIDENTITY ni;
+        // new entry
+        makeId(ni, 100, 2);
+        assert(svc.put(ni.value.devaddr, ni.value.devid) == ERR_CODE_JOURNAL_WRITE);
+        DEVICEID id;
+        assert(svc.get(id, ni.value.devaddr) != CODE_OK);
+        // replaced entry
+        makeId(ni, 3, 2);
+        assert(svc.put(ni.value.devaddr, ni.value.devid) == ERR_CODE_JOURNAL_WRITE);
+        assert(svc.rm(DEVADDR(4)) == ERR_CODE_JOURNAL_WRITE);
+        // not found is reported before the journal is written
+        assert(svc.rm(DEVADDR(7)) == ERR_CODE_DEVICE_ADDRESS_NOTFOUND);
+        assertSame(svc, expected);
+        svc.failJournal(false);
+        update(svc, expected, 15, 25, 3);
+    }
+    JsonIdentityService svc;
+    svc.setOption(JSON_IDENTITY_OPTION_JOURNAL, &mode);
+    svc.setOption(JSON_IDENTITY_OPTION_SNAPSHOT_PERIOD, &period);
+    assert(svc.init(FILE_NAME, nullptr) == CODE_OK);
+    assertSame(svc, expected);
+    svc.done();
+    removeFiles();
+}
+
+int main() {
+    testReplay();
+    testSnapshot();
+    testFailedSnapshot();
+    testFailedAppend();
+    return 0;
+}
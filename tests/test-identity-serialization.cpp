@@ -0,0 +1,684 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include "lorawan/lorawan-error.h"
+#include "lorawan/storage/service/identity-service-mem.h"
+#include "lorawan/storage/service/identity-service-flat.h"
+#include "lorawan/storage/service/identity-service-concurrent.h"
+#include "lorawan/storage/service/identity-filter.h"
+#include "lorawan/storage/serialization/identity-binary-serialization.h"
+#include "lorawan/storage/service/gateway-service-mem.h"
+#include "lorawan/storage/serialization/gateway-binary-serialization.h"
+#include "lorawan/storage/client/sync-response-client.h"
+#include "test-bench.h"
+#include "test-identity-helper.h"
+#ifdef ENABLE_LMDB
+#include "lorawan/helper/file-helper.h"
+#include "lorawan/storage/service/identity-service-lmdb.h"
+#endif
+
+#define CODE        42
+#define ACCESS_CODE 0x2a2a
+#define BENCH_ROUNDS 20000
+#define BENCH_CHECK_ROUNDS 500
+
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t sz)
+{
+    allocations++;
+    void *p = malloc(sz ? sz : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+/**
+ * Put, get by address and EUI, remove in one batch, compare with single requests
+ */
+static void testBatch()
+{
+    MemoryIdentityService svc;
+    svc.init("", nullptr);
+    IdentityBinarySerialization ser(&svc, CODE, ACCESS_CODE);
+
+    IdentityBatchRequest batch(CODE, ACCESS_CODE);
+    for (uint32_t a = 1; a <= 5; a++) {
+        NETWORKIDENTITY ni;
+        makeId(ni, a);
+        IdentityAssignRequest req(QUERY_IDENTITY_ASSIGN, ni, CODE, ACCESS_CODE);
+        assert(batch.add(req));
+    }
+    IdentityAddrRequest getAddr(QUERY_IDENTITY_EUI, DEVADDR(3), CODE, ACCESS_CODE);
+    assert(batch.add(getAddr));
+    IdentityEUIRequest getEUI(QUERY_IDENTITY_ADDR, DEVEUI(0x100000004ull), CODE, ACCESS_CODE);
+    assert(batch.add(getEUI));
+    IdentityAddrRequest rm(QUERY_IDENTITY_RM, DEVADDR(2), CODE, ACCESS_CODE);
+    assert(batch.add(rm));
+    IdentityAddrRequest rmMissing(QUERY_IDENTITY_RM, DEVADDR(200), CODE, ACCESS_CODE);
+    assert(batch.add(rmMissing));
+    // request objects are kept serialized in host byte order
+    assert(getAddr.addr.u == 3);
+    assert(batch.count == 9);
+
+    unsigned char req[SIZE_BATCH_REQUEST_MAX];
+    batch.ntoh();
+    size_t sz = batch.serialize(req);
+    assert(validateIdentityQuery(req, sz) == QUERY_IDENTITY_BATCH);
+    size_t expectedSize = responseSizeForIdentityRequest(req, sz);
+
+    // responses do not fill unused bytes
+    unsigned char resp[SIZE_BATCH_RESPONSE_MAX];
+    memset(resp, 0, sizeof(resp));
+    size_t rsz = ser.query(resp, sizeof(resp), req, sz);
+    assert(rsz == expectedSize);
+    assert(svc.size() == 4);
+
+    IdentityBatchResponse br(resp, rsz);
+    br.ntoh();
+    assert(br.tag == QUERY_IDENTITY_BATCH);
+    assert(br.count == 9 && br.items.size() == 9);
+    for (int i = 0; i < 8; i++) {
+        assert(br.items[i].status == CODE_OK);
+    }
+    assert(br.items[8].status == ERR_CODE_DEVICE_ADDRESS_NOTFOUND);
+
+    // batch item is the same as the response to the single request
+    IdentityGetResponse gr(br.items[5].response, br.items[5].size);
+    gr.ntoh();
+    NETWORKIDENTITY expected;
+    makeId(expected, 3);
+    assert(gr.response.value.devaddr.u == 3);
+    assert(memcmp(&gr.response.value.devid.id.nwkSKey, &expected.value.devid.id.nwkSKey, sizeof(KEY128)) == 0);
+    unsigned char single[SIZE_GET_RESPONSE];
+    memset(single, 0, sizeof(single));
+    getAddr.ntoh();
+    size_t ssz = getAddr.serialize(req);
+    assert(ser.query(single, sizeof(single), req, ssz) == br.items[5].size);
+    assert(memcmp(single, br.items[5].response, br.items[5].size) == 0);
+
+    IdentityGetResponse er(br.items[6].response, br.items[6].size);
+    er.ntoh();
+    assert(er.response.value.devaddr.u == 4);
+
+    // requests which responses do not fit are not executed
+    batch = IdentityBatchRequest(CODE, ACCESS_CODE);
+    for (uint32_t a = 10; a < 13; a++) {
+        NETWORKIDENTITY ni;
+        makeId(ni, a);
+        IdentityAssignRequest r(QUERY_IDENTITY_ASSIGN, ni, CODE, ACCESS_CODE);
+        batch.add(r);
+    }
+    batch.ntoh();
+    sz = batch.serialize(req);
+    rsz = ser.query(resp, SIZE_BATCH_HEADER + 2 * (SIZE_BATCH_ITEM_HEADER + SIZE_OPERATION_RESPONSE), req, sz);
+    IdentityBatchResponse partial(resp, rsz);
+    assert(partial.count == 2);
+    assert(svc.size() == 6);
+
+    // wrong access code
+    IdentityBatchRequest denied(CODE, ACCESS_CODE + 1);
+    denied.add(rm);
+    denied.ntoh();
+    sz = denied.serialize(req);
+    rsz = ser.query(resp, sizeof(resp), req, sz);
+    IdentityOperationResponse dr(resp, rsz);
+    dr.ntoh();
+    assert(dr.code == ERR_CODE_ACCESS_DENIED);
+    assert(svc.size() == 6);
+    svc.done();
+}
+
+/**
+ * Serve requests of each kind, count heap allocations, measure latency if requested
+ * @param rounds requests to serve
+ * @param measure true- print latency percentiles
+ */
+static void benchQuery(
+    size_t rounds,
+    bool measure
+)
+{
+    MemoryIdentityService svc;
+    svc.init("", nullptr);
+    IdentityBinarySerialization ser(&svc, CODE, ACCESS_CODE);
+
+    std::vector<std::vector<unsigned char> > requests;
+    for (uint32_t a = 1; a <= 16; a++) {
+        NETWORKIDENTITY ni;
+        makeId(ni, a);
+        IdentityAssignRequest put(QUERY_IDENTITY_ASSIGN, ni, CODE, ACCESS_CODE);
+        IdentityAddrRequest getAddr(QUERY_IDENTITY_EUI, DEVADDR(a), CODE, ACCESS_CODE);
+        IdentityEUIRequest getEUI(QUERY_IDENTITY_ADDR, DEVEUI(0x100000000ull | a), CODE, ACCESS_CODE);
+        IdentityAddrRequest rmMissing(QUERY_IDENTITY_RM, DEVADDR(a + 1000), CODE, ACCESS_CODE);
+        IdentityOperationRequest count(QUERY_IDENTITY_COUNT, 0, 0, CODE, ACCESS_CODE);
+        IdentityOperationRequest list(QUERY_IDENTITY_LIST, 0, 8, CODE, ACCESS_CODE);
+        IdentityAddrRequest denied(QUERY_IDENTITY_EUI, DEVADDR(a), CODE, ACCESS_CODE + 1);
+        ServiceMessage *msgs[] = { &put, &getAddr, &getEUI, &rmMissing, &count, &list, &denied };
+        for (auto m : msgs) {
+            unsigned char b[SIZE_ASSIGN_REQUEST];
+            m->ntoh();
+            size_t sz = m->serialize(b);
+            requests.emplace_back(b, b + sz);
+        }
+    }
+    std::vector<double> latencies(rounds);
+    unsigned char resp[SIZE_BATCH_RESPONSE_MAX];
+    // first round puts entries and reserves list buffer
+    for (auto &r : requests)
+        assert(ser.query(resp, sizeof(resp), r.data(), r.size()) > 0);
+
+    size_t before = allocations;
+    for (size_t i = 0; i < rounds; i++) {
+        auto &r = requests[i % requests.size()];
+        auto t0 = std::chrono::steady_clock::now();
+        size_t sz = ser.query(resp, sizeof(resp), r.data(), r.size());
+        auto t1 = std::chrono::steady_clock::now();
+        assert(sz > 0);
+        latencies[i] = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    }
+    size_t allocated = allocations - before;
+    if (measure) {
+        std::sort(latencies.begin(), latencies.end());
+        std::cout << "requests: " << rounds
+            << " allocations per request: " << (double) allocated / rounds
+            << " p50: " << latencies[rounds / 2] << "ns"
+            << " p99: " << latencies[rounds * 99 / 100] << "ns" << std::endl;
+    }
+    assert(allocated == 0);
+    svc.done();
+}
+
+/**
+ * Count is not truncated, list after request frames cover all entries once
+ */
+static void testListAfter()
+{
+    MemoryIdentityService svc;
+    svc.init("", nullptr);
+    IdentityBinarySerialization ser(&svc, CODE, ACCESS_CODE);
+    for (uint32_t a = 1; a <= 600; a++) {
+        NETWORKIDENTITY ni;
+        makeId(ni, a * 7);
+        svc.put(ni.value.devaddr, ni.value.devid);
+    }
+    unsigned char req[SIZE_LIST_AFTER_REQUEST];
+    unsigned char resp[SIZE_BATCH_RESPONSE_MAX];
+
+    IdentityOperationRequest count(QUERY_IDENTITY_COUNT, 0, 0, CODE, ACCESS_CODE);
+    count.ntoh();
+    size_t sz = count.serialize(req);
+    IdentityOperationResponse cr(resp, ser.query(resp, sizeof(resp), req, sz));
+    cr.ntoh();
+    assert(cr.response == 600);
+
+    IdentityListAfterRequest list(nullptr, 1000, CODE, ACCESS_CODE);
+    list.ntoh();
+    sz = list.serialize(req);
+    assert(responseSizeForIdentityRequest(req, sz) <= SIZE_BATCH_RESPONSE_MAX);
+    std::vector<uint32_t> addrs;
+    int frames = 0;
+    while (true) {
+        size_t rsz = ser.query(resp, sizeof(resp), req, sz);
+        IdentityListAfterResponse lr(resp, rsz);
+        lr.ntoh();
+        assert(lr.status == CODE_OK);
+        assert(lr.count == lr.identities.size());
+        for (auto &it : lr.identities) {
+            addrs.push_back(it.value.devaddr.u);
+        }
+        frames++;
+        if (!nextListAfterRequest(req, sz, resp, rsz)) {
+            assert(lr.flags & LIST_AFTER_FLAG_END);
+            break;
+        }
+    }
+    assert(frames == 6);
+    assert(addrs.size() == 600);
+    for (size_t i = 0; i < addrs.size(); i++) {
+        assert(addrs[i] == (i + 1) * 7);
+    }
+
+    // requested count is reached before the end
+    IdentityListAfterRequest page(nullptr, 150, CODE, ACCESS_CODE);
+    page.ntoh();
+    sz = page.serialize(req);
+    size_t rsz = ser.query(resp, sizeof(resp), req, sz);
+    assert(nextListAfterRequest(req, sz, resp, rsz));
+    rsz = ser.query(resp, sizeof(resp), req, sz);
+    IdentityListAfterResponse lr(resp, rsz);
+    lr.ntoh();
+    assert(lr.count == 150 - 116 && !(lr.flags & LIST_AFTER_FLAG_END));
+    assert(lr.identities[0].value.devaddr.u == 117 * 7);
+    assert(!nextListAfterRequest(req, sz, resp, rsz));
+    svc.done();
+}
+
+/**
+ * Keep count and list size of the last asynchronous response
+ */
+class CountResponseClient : public SyncResponseClient {
+public:
+    uint32_t count = 0;
+    size_t listed = 0;
+    void onIdentityOperation(
+        QueryClient* client,
+        const IdentityOperationResponse *response
+    ) override {
+        count = response->size;
+    }
+    void onIdentityList(
+        QueryClient* client,
+        const IdentityListResponse *response
+    ) override {
+        listed = response->identities.size();
+        count = response->size;
+    }
+};
+
+/**
+ * Asynchronous service calls responseClient
+ */
+class AsyncMemoryIdentityService : public MemoryIdentityService {
+public:
+    explicit AsyncMemoryIdentityService(ResponseClient *client)
+    {
+        responseClient = client;
+    }
+};
+
+/**
+ * Page size and count above 255 are not truncated
+ */
+static void testWideSizes()
+{
+    CountResponseClient client;
+    AsyncMemoryIdentityService svc(&client);
+    svc.init("", nullptr);
+    for (uint32_t a = 1; a <= 600; a++) {
+        NETWORKIDENTITY ni;
+        makeId(ni, a);
+        svc.put(ni.value.devaddr, ni.value.devid);
+    }
+    std::vector<NETWORKIDENTITY> l;
+    svc.list(l, 0, 300);
+    assert(l.size() == 300);
+    std::vector<NETWORK_IDENTITY_FILTER> none;
+    l.clear();
+    svc.filter(l, none, 100, 400);
+    assert(l.size() == 400 && l[0].value.devaddr.u == 101);
+    svc.cSize();
+    assert(client.count == 600);
+    svc.cList(0, 300);
+    assert(client.listed == 300 && client.count == 300);
+    svc.cFilter(none, 500, 300);
+    assert(client.listed == 100 && client.count == 100);
+
+    // frame keeps one byte, page size is saturated
+    IdentityOperationRequest list(QUERY_IDENTITY_LIST, 0, 300, CODE, ACCESS_CODE);
+    unsigned char req[SIZE_OPERATION_REQUEST];
+    list.ntoh();
+    list.serialize(req);
+    IdentityOperationRequest parsed(req, sizeof(req));
+    assert(parsed.size == 255);
+    svc.done();
+}
+
+/**
+ * Gateway requests are served without allocations too
+ */
+static void testGateway()
+{
+    MemoryGatewayService svc;
+    svc.init("", nullptr);
+    GatewayBinarySerialization ser(&svc, CODE, ACCESS_CODE);
+    unsigned char req[64];
+    unsigned char resp[SIZE_BATCH_RESPONSE_MAX];
+
+    for (uint64_t id = 1; id <= 3; id++) {
+        GatewayIdentity gi(id, "10.2.0." + std::to_string(id) + ":4242");
+        GatewayIdAddrRequest put(QUERY_GATEWAY_ASSIGN, gi, CODE, ACCESS_CODE);
+        put.ntoh();
+        size_t sz = put.serialize(req);
+        size_t rsz = ser.query(resp, sizeof(resp), req, sz);
+        GatewayOperationResponse r(resp, rsz);
+        r.ntoh();
+        assert(r.response == CODE_OK && r.size == 1);
+    }
+
+    GatewayIdRequest get(QUERY_GATEWAY_ADDR, 2, CODE, ACCESS_CODE);
+    get.ntoh();
+    size_t getSize = get.serialize(req);
+    size_t before = allocations;
+    size_t rsz = ser.query(resp, sizeof(resp), req, getSize);
+    assert(allocations == before);
+    GatewayGetResponse gr(resp, rsz);
+    gr.ntoh();
+    assert(gr.response.gatewayId == 2);
+    assert(gr.response.toString() == GatewayIdentity(2, "10.2.0.2:4242").toString());
+
+    GatewayOperationRequest list(QUERY_GATEWAY_LIST, 0, 10, CODE, ACCESS_CODE);
+    list.ntoh();
+    size_t sz = list.serialize(req);
+    rsz = ser.query(resp, sizeof(resp), req, sz);
+    GatewayListResponse lr(resp, rsz);
+    lr.ntoh();
+    assert(lr.identities.size() == 3);
+    assert(lr.identities[2].toString() == GatewayIdentity(3, "10.2.0.3:4242").toString());
+    // list is shortened to fit
+    rsz = ser.query(resp, SIZE_OPERATION_RESPONSE + 2 * 15, req, sz);
+    assert(rsz == SIZE_OPERATION_RESPONSE + 2 * 15);
+
+    GatewayOperationRequest count(QUERY_GATEWAY_COUNT, 0, 0, CODE, ACCESS_CODE + 1);
+    count.ntoh();
+    sz = count.serialize(req);
+    rsz = ser.query(resp, sizeof(resp), req, sz);
+    assert(rsz == SIZE_OPERATION_RESPONSE);
+    GatewayOperationResponse dr(resp, rsz);
+    dr.ntoh();
+    assert(dr.code == ERR_CODE_ACCESS_DENIED);
+
+    // identity serialization does not take gateway requests
+    MemoryIdentityService identityService;
+    identityService.init("", nullptr);
+    IdentityBinarySerialization identitySer(&identityService, CODE, ACCESS_CODE);
+    get.serialize(req);
+    assert(!isIdentityTag(req, getSize) && isGatewayTag(req, getSize));
+    assert(identitySer.query(resp, sizeof(resp), req, getSize) == 0);
+
+    // two gateways per frame
+    GatewayListAfterRequest listAfter(nullptr, 10, CODE, ACCESS_CODE);
+    listAfter.ntoh();
+    sz = listAfter.serialize(req);
+    std::vector<uint64_t> ids;
+    int frames = 0;
+    while (true) {
+        rsz = ser.query(resp, SIZE_GATEWAY_LIST_AFTER_RESPONSE + 2 * 15, req, sz);
+        GatewayListAfterResponse r(resp, rsz);
+        r.ntoh();
+        assert(r.status == CODE_OK && r.count == r.identities.size());
+        for (auto &it : r.identities) {
+            ids.push_back(it.gatewayId);
+        }
+        frames++;
+        if (!nextGatewayListAfterRequest(req, sz, resp, rsz)) {
+            assert(r.flags & GATEWAY_LIST_AFTER_FLAG_END);
+            break;
+        }
+    }
+    assert(frames == 2);
+    assert(ids == std::vector<uint64_t>({1, 2, 3}));
+    svc.done();
+}
+
+/**
+ * Pages by listAfter() must give the same entries as list() does
+ */
+static void testKeyset(
+    IdentityService &svc,
+    const std::string &dbName = ""
+)
+{
+    svc.init(dbName, nullptr);
+    // database may keep entries of the previous run
+    std::vector<NETWORKIDENTITY> stale;
+    svc.list(stale, 0, 255);
+    while (!stale.empty()) {
+        for (auto &it : stale) {
+            svc.rm(it.value.devaddr);
+        }
+        stale.clear();
+        svc.list(stale, 0, 255);
+    }
+    // not in address order
+    for (uint32_t a = 1; a <= 600; a++) {
+        NETWORKIDENTITY ni;
+        makeId(ni, (a * 7919) % 100003);
+        svc.put(ni.value.devaddr, ni.value.devid);
+    }
+    svc.rm(DEVADDR((100 * 7919) % 100003));
+    std::vector<NETWORKIDENTITY> all;
+    for (uint32_t o = 0; ; o += 255) {
+        size_t c = all.size();
+        svc.list(all, o, 255);
+        if (all.size() - c < 255)
+            break;
+    }
+    assert(all.size() == 599);
+
+    std::vector<NETWORKIDENTITY> paged;
+    std::vector<NETWORKIDENTITY> page;
+    DEVADDR last;
+    const DEVADDR *after = nullptr;
+    while (true) {
+        page.clear();
+        assert(svc.listAfter(page, after, 37) == CODE_OK);
+        if (page.empty())
+            break;
+        paged.insert(paged.end(), page.begin(), page.end());
+        last = page.back().value.devaddr;
+        after = &last;
+    }
+    assert(paged.size() == all.size());
+    for (size_t i = 0; i < all.size(); i++) {
+        assert(paged[i].value.devaddr.u == all[i].value.devaddr.u);
+        assert(paged[i].value.devid.id.devEUI.u == all[i].value.devid.id.devEUI.u);
+    }
+    svc.done();
+}
+
+/**
+ * Compiled filters, in-memory storages and packed column scan must give the same result as isIdentityFilteredV2()
+ */
+static void testFilter()
+{
+    // few distinct byte values, so equal prefixes are frequent
+    static const uint8_t bytes[] = { 0, 1, 0x7f, 0x80, 0xff };
+    uint32_t rnd = 42;
+    std::vector<NETWORKIDENTITY> ids(200);
+    MemoryIdentityService mem;
+    FlatMemoryIdentityService flat;
+    mem.init("", nullptr);
+    flat.init("", nullptr);
+    for (size_t i = 0; i < ids.size(); i++) {
+        uint8_t *p = (uint8_t *) &ids[i].value;
+        for (size_t j = 0; j < sizeof(ids[i].value); j++) {
+            rnd = rnd * 1103515245 + 12345;
+            p[j] = bytes[(rnd >> 16) % sizeof(bytes)];
+        }
+        ids[i].value.devaddr.u = (ids[i].value.devaddr.u & 0xffff00ff) | (uint32_t) i << 8;   // unique
+        mem.put(ids[i].value.devaddr, ids[i].value.devid);
+        flat.put(ids[i].value.devaddr, ids[i].value.devid);
+    }
+    // replaced and removed rows must be reflected in the DevEUI column
+    ids[3].value.devid.id.devEUI.u = 0;
+    mem.put(ids[3].value.devaddr, ids[3].value.devid);
+    flat.put(ids[3].value.devaddr, ids[3].value.devid);
+    mem.rm(ids[5].value.devaddr);
+    flat.rm(ids[5].value.devaddr);
+    ids.erase(ids.begin() + 5);
+
+    for (int n = 0; n < 2000; n++) {
+        std::vector<NETWORK_IDENTITY_FILTER> filters;
+        rnd = rnd * 1103515245 + 12345;
+        size_t c = (rnd >> 16) % 4;
+        for (size_t i = 0; i < c; i++) {
+            NETWORK_IDENTITY_FILTER f;
+            rnd = rnd * 1103515245 + 12345;
+            f.pre = (NETWORK_IDENTITY_LOGICAL_PRE_OPERATOR) ((rnd >> 8) % 3);
+            f.property = (NETWORK_IDENTITY_PROPERTY) ((rnd >> 12) % 15);
+            f.comparisonOperator = (NETWORK_IDENTITY_COMPARISON_OPERATOR) ((rnd >> 16) % 7);
+            f.length = (uint8_t) ((rnd >> 20) % 17);
+            // take filter data from some identity
+            const uint8_t *src = (const uint8_t *) &ids[(rnd >> 4) % ids.size()].value;
+            size_t o = (rnd >> 24) % (sizeof(ids[0].value) - sizeof(f.filterData));
+            memmove(f.filterData, src + o, sizeof(f.filterData));
+            if ((rnd >> 28) & 1)
+                f.filterData[(rnd >> 29) % sizeof(f.filterData)] = (char) bytes[(rnd >> 8) % sizeof(bytes)];
+            filters.push_back(f);
+        }
+        IdentityFilter compiled(filters);
+        std::vector<uint32_t> expected;
+        for (auto &id : ids) {
+            bool r = isIdentityFilteredV2(id.value.devaddr, id.value.devid.id, filters);
+            assert(compiled.match(id.value.devaddr, id.value.devid.id) == r);
+            if (r)
+                expected.push_back(id.value.devaddr.u);
+        }
+        std::sort(expected.begin(), expected.end());
+        std::vector<NETWORKIDENTITY> rm;
+        std::vector<NETWORKIDENTITY> rf;
+        mem.filter(rm, filters, 0, 255);
+        flat.filter(rf, filters, 0, 255);
+        assert(rm.size() == expected.size());
+        assert(rf.size() == expected.size());
+        for (size_t i = 0; i < expected.size(); i++) {
+            assert(rm[i].value.devaddr.u == expected[i]);
+            assert(rf[i].value.devaddr.u == expected[i]);
+        }
+    }
+    // column scan buffer is kept between calls
+    std::vector<NETWORK_IDENTITY_FILTER> none;
+    std::vector<NETWORKIDENTITY> all;
+    all.reserve(ids.size());
+    flat.filter(all, none, 0, 255);
+    assert(all.size() == ids.size());
+    all.clear();
+    size_t before = allocations;
+    flat.filter(all, none, 0, 255);
+    assert(allocations == before);
+    mem.done();
+    flat.done();
+}
+
+#ifdef ENABLE_LMDB
+#define LMDB_READ_DB "test-identity-serialization.lmdb"
+
+/**
+ * Get by address and by EUI served from LMDB memory map views must give the same responses as the memory storage does
+ */
+static void testLMDBRead()
+{
+    file::rmDir(LMDB_READ_DB);
+    MemoryIdentityService mem;
+    LMDBIdentityService lmdb;
+    mem.init("", nullptr);
+    assert(lmdb.init(LMDB_READ_DB, nullptr) == CODE_OK);
+    IdentityBinarySerialization memSer(&mem, CODE, ACCESS_CODE);
+    IdentityBinarySerialization lmdbSer(&lmdb, CODE, ACCESS_CODE);
+
+    std::vector<std::vector<unsigned char> > requests;
+    for (uint32_t a = 1; a <= 64; a++) {
+        NETWORKIDENTITY ni;
+        makeId(ni, a * 3);
+        IdentityAssignRequest put(QUERY_IDENTITY_ASSIGN, ni, CODE, ACCESS_CODE);
+        unsigned char b[SIZE_ASSIGN_REQUEST];
+        put.ntoh();
+        size_t sz = put.serialize(b);
+        requests.emplace_back(b, b + sz);
+    }
+    // existing and missing entries
+    for (uint32_t a = 1; a <= 200; a++) {
+        IdentityAddrRequest getAddr(QUERY_IDENTITY_EUI, DEVADDR(a), CODE, ACCESS_CODE);
+        IdentityEUIRequest getEUI(QUERY_IDENTITY_ADDR, DEVEUI(0x100000000ull | a), CODE, ACCESS_CODE);
+        ServiceMessage *msgs[] = { &getAddr, &getEUI };
+        for (auto m : msgs) {
+            unsigned char b[SIZE_ASSIGN_REQUEST];
+            m->ntoh();
+            size_t sz = m->serialize(b);
+            requests.emplace_back(b, b + sz);
+        }
+    }
+    IdentityAddrRequest rm(QUERY_IDENTITY_RM, DEVADDR(9), CODE, ACCESS_CODE);
+    IdentityAddrRequest getRemoved(QUERY_IDENTITY_EUI, DEVADDR(9), CODE, ACCESS_CODE);
+    IdentityEUIRequest getRemovedEUI(QUERY_IDENTITY_ADDR, DEVEUI(0x100000009ull), CODE, ACCESS_CODE);
+    IdentityOperationRequest count(QUERY_IDENTITY_COUNT, 0, 0, CODE, ACCESS_CODE);
+    IdentityOperationRequest list(QUERY_IDENTITY_LIST, 0, 20, CODE, ACCESS_CODE);
+    ServiceMessage *msgs[] = { &rm, &getRemoved, &getRemovedEUI, &count, &list };
+    for (auto m : msgs) {
+        unsigned char b[SIZE_ASSIGN_REQUEST];
+        m->ntoh();
+        size_t sz = m->serialize(b);
+        requests.emplace_back(b, b + sz);
+    }
+
+    unsigned char memResp[SIZE_BATCH_RESPONSE_MAX];
+    unsigned char lmdbResp[SIZE_BATCH_RESPONSE_MAX];
+    int found = 0;
+    for (auto &r : requests) {
+        memset(memResp, 0, sizeof(memResp));
+        memset(lmdbResp, 0, sizeof(lmdbResp));
+        size_t msz = memSer.query(memResp, sizeof(memResp), r.data(), r.size());
+        size_t lsz = lmdbSer.query(lmdbResp, sizeof(lmdbResp), r.data(), r.size());
+        assert(msz > 0);
+        assert(msz == lsz);
+        assert(memcmp(memResp, lmdbResp, msz) == 0);
+        if (r[0] == QUERY_IDENTITY_EUI && msz == SIZE_GET_RESPONSE) {
+            IdentityGetResponse gr(lmdbResp, lsz);
+            gr.ntoh();
+            // nothing found is indicated by zero EUI
+            if (gr.response.value.devid.id.devEUI.u)
+                found++;
+        }
+    }
+    // 64 addresses are requested before the removal
+    assert(found == 64);
+
+    // responses above are served from views, not from copies
+    const DEVICE_ID *view;
+    DEVADDR a;
+    assert(lmdb.getView(view, DEVADDR(6)) == CODE_OK);
+    assert(view->devEUI.u == 0x100000006ull);
+    lmdb.releaseView();
+    assert(lmdb.getNetworkIdentityView(view, a, DEVEUI(0x100000006ull)) == CODE_OK);
+    assert(a.u == 6 && view->devEUI.u == 0x100000006ull);
+    lmdb.releaseView();
+    assert(lmdb.getView(view, DEVADDR(9)) != CODE_OK);
+    mem.done();
+    lmdb.done();
+    file::rmDir(LMDB_READ_DB);
+    std::cout << "lmdb read path OK" << std::endl;
+}
+#endif
+
+int main(int argc, char **argv) {
+    testBatch();
+    testFilter();
+    testGateway();
+    testListAfter();
+    testWideSizes();
+    {
+        MemoryIdentityService mem;
+        testKeyset(mem);
+        FlatMemoryIdentityService flat;
+        testKeyset(flat);
+        ConcurrentMemoryIdentityService concurrent;
+        testKeyset(concurrent);
+#ifdef ENABLE_LMDB
+        LMDBIdentityService lmdb;
+        testKeyset(lmdb, "test-identity-keyset.lmdb");
+        file::rmDir("test-identity-keyset.lmdb");
+#endif
+    }
+#ifdef ENABLE_LMDB
+    testLMDBRead();
+#endif
+    size_t rounds;
+    if (isBenchRequested(rounds, argc, argv, BENCH_ROUNDS))
+        benchQuery(rounds, true);
+    else
+        benchQuery(BENCH_CHECK_ROUNDS, false);   // each request served a few times
+    return 0;
+}
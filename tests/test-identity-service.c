@@ -112,6 +112,94 @@ static void testLmdb()
     destroyIdentityServiceC(o);
 }
 
+/**
+ * Insert, remove and list addresses in the flat table, check order and EUI lookup
+ * @return 0- success
+ */
+static int testFlat()
+{
+    void *o = makeIdentityServiceC(CISI_FLAT);
+    c_init(o, "", NULL);
+    C_DEVICEID d;
+    memmove(&d, &devId, sizeof(d));
+    // put addresses in random order
+    for (uint32_t i = 0; i < 1000; i++) {
+        C_DEVADDR a = (i * 2654435761u) % 100000;
+        d.devEUI = a + 1;
+        c_put(o, &a, &d);
+    }
+    for (uint32_t i = 0; i < 1000; i += 3) {
+        C_DEVADDR a = (i * 2654435761u) % 100000;
+        if (c_rm(o, &a))
+            return 1;
+    }
+    if (c_size(o) != 1000 - 334)
+        return 2;
+    for (uint32_t i = 0; i < 1000; i++) {
+        C_DEVADDR a = (i * 2654435761u) % 100000;
+        int r = c_get(o, &d, &a);
+        if ((i % 3 == 0) != (r != 0))
+            return 3;
+        if (r == 0 && d.devEUI != a + 1)
+            return 4;
+        C_DEVEUI eui = a + 1;
+        C_NETWORKIDENTITY ni;
+        r = c_getNetworkIdentity(o, &ni, &eui);
+        if ((i % 3 == 0) != (r != 0))
+            return 5;
+        if (r == 0 && ni.devaddr != a)
+            return 6;
+    }
+    // list in ascending address order
+    C_NETWORKIDENTITY nis[100];
+    C_DEVADDR prev = 0;
+    for (uint32_t ofs = 0; ofs < 1000; ofs += 100) {
+        int c = c_list(o, nis, ofs, 100);
+        for (int i = 0; i < c; i++) {
+            if (ofs + i > 0 && nis[i].devaddr <= prev)
+                return 7;
+            prev = nis[i].devaddr;
+        }
+    }
+    c_done(o);
+    destroyIdentityServiceC(o);
+    return 0;
+}
+
+/**
+ * Allocate addresses in the default network, reuse removed one
+ * @return 0- success
+ */
+static int testNext()
+{
+    void *o = makeIdentityServiceC(CISI_MEM);
+    c_init(o, "", NULL);
+    C_DEVICEID d;
+    memmove(&d, &devId, sizeof(d));
+    for (C_DEVADDR a = 1; a <= 100; a++)
+        c_put(o, &a, &d);
+    C_DEVADDR a = 50;
+    c_rm(o, &a);
+    C_NETWORKIDENTITY ni;
+    // zero address is never assigned, 50 is the lowest free one
+    if (c_next(o, &ni) || ni.devaddr != 50)
+        return 1;
+    if (c_next(o, &ni) || ni.devaddr != 101)
+        return 2;
+    // bitmap follows put() and rm() after the first next()
+    a = 102;
+    c_put(o, &a, &d);
+    a = 7;
+    c_rm(o, &a);
+    if (c_next(o, &ni) || ni.devaddr != 7)
+        return 3;
+    if (c_next(o, &ni) || ni.devaddr != 103)
+        return 4;
+    c_done(o);
+    destroyIdentityServiceC(o);
+    return 0;
+}
+
 static void testString()
 {
     char buffer[256];
@@ -157,6 +245,16 @@ static void testString()
 
 int main() {
     testString();
+    int r = testFlat();
+    if (r) {
+        printf("flat identity service test failed: %d\n", r);
+        return r;
+    }
+    r = testNext();
+    if (r) {
+        printf("identity service next address test failed: %d\n", r);
+        return r;
+    }
     // testSqlite();
     // testJson();
     // testLmdb();
@@ -0,0 +1,298 @@
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "lorawan/lorawan-error.h"
+#include "lorawan/storage/service/identity-service-json.h"
+#include "test-bench.h"
+#include "test-identity-helper.h"
+
+#define SNAPSHOT_FILE_NAME  "test-identity-snapshot.bin"
+#define JSON_FILE_NAME      "test-identity-snapshot.json"
+#define IDENTITIES          5000
+// pass 1000000 after --bench for the 1M identities cold start
+#define BENCH_IDENTITIES    200000
+
+static void makeRandomId(NETWORKIDENTITY &retVal, std::mt19937 &rnd)
+{
+    uint32_t addr = rnd();
+    uint32_t version = rnd();
+    makeId(retVal, addr, version);
+    // shared EUIs, ABP devices may have the same one
+    retVal.value.devid.id.devEUI.u = rnd() % (IDENTITIES / 2);
+}
+
+static void assertSame(
+    IdentityService &svc,
+    IdentityService &expected
+)
+{
+    assert(svc.size() == expected.size());
+    std::vector<NETWORKIDENTITY> l;
+    std::vector<NETWORKIDENTITY> e;
+    svc.listAfter(l, nullptr, UINT32_MAX);
+    expected.listAfter(e, nullptr, UINT32_MAX);
+    assert(l.size() == e.size());
+    for (size_t i = 0; i < l.size(); i++) {
+        assert(l[i].value.devaddr.u == e[i].value.devaddr.u);
+        assert(memcmp(&l[i].value.devid.id, &e[i].value.devid.id, sizeof(DEVICE_ID)) == 0);
+        DEVICEID id;
+        assert(svc.get(id, l[i].value.devaddr) == CODE_OK);
+        assert(memcmp(&id.id, &e[i].value.devid.id, sizeof(DEVICE_ID)) == 0);
+        NETWORKIDENTITY ni;
+        NETWORKIDENTITY eni;
+        assert(svc.getNetworkIdentity(ni, e[i].value.devid.id.devEUI) == CODE_OK);
+        assert(expected.getNetworkIdentity(eni, e[i].value.devid.id.devEUI) == CODE_OK);
+        assert(ni.value.devaddr.u == eni.value.devaddr.u);
+    }
+    // pages
+    for (size_t start = 0; start < e.size(); start += 97) {
+        l.clear();
+        svc.listAfter(l, start ? &e[start - 1].value.devaddr : nullptr, 97);
+        assert(l.size() == std::min<size_t>(97, e.size() - start));
+        assert(l[0].value.devaddr.u == e[start].value.devaddr.u);
+    }
+    l.clear();
+    e.clear();
+    svc.list(l, 100, 50);
+    expected.list(e, 100, 50);
+    assert(l.size() == e.size());
+    assert(l.empty() || l.back().value.devaddr.u == e.back().value.devaddr.u);
+    // filter
+    std::vector<NETWORK_IDENTITY_FILTER> filters;
+    NETWORK_IDENTITY_FILTER f;
+    f.pre = NILPO_AND;
+    f.property = NIP_DEVEUI;
+    f.comparisonOperator = NICO_LT;
+    f.length = sizeof(DEVEUI);
+    memset(f.filterData, 0, sizeof(f.filterData));
+    DEVEUI bound(IDENTITIES / 8);
+    memmove(f.filterData, &bound, sizeof(DEVEUI));
+    filters.push_back(f);
+    l.clear();
+    e.clear();
+    svc.filter(l, filters, 3, 200);
+    expected.filter(e, filters, 3, 200);
+    assert(l.size() == e.size());
+    for (size_t i = 0; i < l.size(); i++) {
+        assert(l[i].value.devaddr.u == e[i].value.devaddr.u);
+    }
+}
+
+/**
+ * Mapped records are read in place, put() and rm() are copied on write
+ */
+static void testCopyOnWrite()
+{
+    int r;
+    std::mt19937 rnd(42);
+    MemoryIdentityService expected;
+    {
+        MemoryIdentityService svc;
+        for (int i = 0; i < IDENTITIES; i++) {
+            NETWORKIDENTITY ni;
+            makeRandomId(ni, rnd);
+            svc.put(ni.value.devaddr, ni.value.devid);
+            expected.put(ni.value.devaddr, ni.value.devid);
+        }
+        r = svc.saveSnapshot(SNAPSHOT_FILE_NAME);
+        assert(r == CODE_OK);
+    }
+    MemoryIdentityService svc;
+    r = svc.openSnapshot(SNAPSHOT_FILE_NAME);
+    assert(r == CODE_OK);
+    assertSame(svc, expected);
+
+    std::vector<NETWORKIDENTITY> all;
+    expected.listAfter(all, nullptr, UINT32_MAX);
+    for (size_t i = 0; i < all.size(); i += 3) {
+        if (i % 2) {
+            r = svc.rm(all[i].value.devaddr);
+            assert(r == CODE_OK);
+            expected.rm(all[i].value.devaddr);
+        } else {
+            all[i].value.devid.id.devEUI.u++;
+            svc.put(all[i].value.devaddr, all[i].value.devid);
+            expected.put(all[i].value.devaddr, all[i].value.devid);
+        }
+    }
+    for (int i = 0; i < 500; i++) {
+        NETWORKIDENTITY ni;
+        makeRandomId(ni, rnd);
+        svc.put(ni.value.devaddr, ni.value.devid);
+        expected.put(ni.value.devaddr, ni.value.devid);
+    }
+    // removed mapped record
+    assert(svc.rm(all[3].value.devaddr) == ERR_CODE_DEVICE_ADDRESS_NOTFOUND);
+    assertSame(svc, expected);
+
+    // snapshot of the mapped and copied records replaces mapped file
+    r = svc.saveSnapshot(SNAPSHOT_FILE_NAME);
+    assert(r == CODE_OK);
+    MemoryIdentityService reopened;
+    r = reopened.openSnapshot(SNAPSHOT_FILE_NAME);
+    assert(r == CODE_OK);
+    assertSame(reopened, expected);
+    reopened.done();
+    assert(reopened.size() == 0);
+
+    // broken file
+    FILE *f = fopen(SNAPSHOT_FILE_NAME, "r+b");
+    fseek(f, 0, SEEK_END);
+    fwrite("x", 1, 1, f);
+    fclose(f);
+    assert(reopened.openSnapshot(SNAPSHOT_FILE_NAME) == ERR_CODE_INVALID_SNAPSHOT);
+    std::remove(SNAPSHOT_FILE_NAME);
+}
+
+/**
+ * Section offsets and count which sum or product wraps must not pass the header check
+ */
+static void testWrappedOffsets()
+{
+    MemoryIdentityService svc;
+    std::mt19937 rnd(7);
+    for (int i = 0; i < 10; i++) {
+        NETWORKIDENTITY ni;
+        makeRandomId(ni, rnd);
+        svc.put(ni.value.devaddr, ni.value.devid);
+    }
+    assert(svc.saveSnapshot(SNAPSHOT_FILE_NAME) == CODE_OK);
+    IDENTITY_SNAPSHOT_HEADER saved;
+    FILE *f = fopen(SNAPSHOT_FILE_NAME, "rb");
+    assert(f);
+    assert(fread(&saved, sizeof(saved), 1, f) == 1);
+    fclose(f);
+    for (int c = 0; c < 4; c++) {
+        IDENTITY_SNAPSHOT_HEADER h = saved;
+        switch (c) {
+            case 0:
+                // offset + count * 4 wraps to 0
+                h.addrOffset = UINT64_MAX - 3;
+                h.count = 1;
+                break;
+            case 1:
+                // count * sizeof(DEVICE_ID) wraps
+                h.count = (UINT64_MAX / sizeof(DEVICE_ID)) + 2;
+                break;
+            case 2:
+                h.euiOffset = UINT64_MAX - 15;
+                break;
+            default:
+                h.idOffset = h.fileSize + 1;
+                h.count = 0;
+                break;
+        }
+        f = fopen(SNAPSHOT_FILE_NAME, "r+b");
+        assert(f);
+        assert(fwrite(&h, sizeof(h), 1, f) == 1);
+        fclose(f);
+        MemoryIdentityService reopened;
+        assert(reopened.openSnapshot(SNAPSHOT_FILE_NAME) == ERR_CODE_INVALID_SNAPSHOT);
+    }
+    std::remove(SNAPSHOT_FILE_NAME);
+}
+
+/**
+ * JSON storage writes binary snapshot and maps it at start
+ */
+static void testJson()
+{
+    int r;
+    std::remove(JSON_FILE_NAME);
+    std::remove(SNAPSHOT_FILE_NAME);
+    std::mt19937 rnd(7);
+    MemoryIdentityService expected;
+    {
+        JsonIdentityService svc;
+        svc.setOption(JSON_IDENTITY_OPTION_BINARY_SNAPSHOT, (void *) SNAPSHOT_FILE_NAME);
+        svc.init(JSON_FILE_NAME, nullptr);
+        for (int i = 0; i < 1000; i++) {
+            NETWORKIDENTITY ni;
+            makeRandomId(ni, rnd);
+            svc.put(ni.value.devaddr, ni.value.devid);
+            expected.put(ni.value.devaddr, ni.value.devid);
+        }
+        svc.flush();
+    }
+    {
+        JsonIdentityService svc;
+        svc.setOption(JSON_IDENTITY_OPTION_BINARY_SNAPSHOT, (void *) SNAPSHOT_FILE_NAME);
+        r = svc.init(JSON_FILE_NAME, nullptr);
+        assert(r == CODE_OK);
+        assertSame(svc, expected);
+        NETWORKIDENTITY ni;
+        makeRandomId(ni, rnd);
+        svc.put(ni.value.devaddr, ni.value.devid);
+        expected.put(ni.value.devaddr, ni.value.devid);
+        svc.flush();
+    }
+    // JSON file has the same records
+    JsonIdentityService plain;
+    r = plain.init(JSON_FILE_NAME, nullptr);
+    assert(r == CODE_OK);
+    assertSame(plain, expected);
+    std::remove(JSON_FILE_NAME);
+    std::remove(SNAPSHOT_FILE_NAME);
+}
+
+/**
+ * Cold start: JSON file parsing vs mapping snapshot
+ */
+static void benchmark(int identities)
+{
+    std::mt19937 rnd(1);
+    std::vector<DEVADDR> addrs;
+    {
+        JsonIdentityService svc;
+        svc.setOption(JSON_IDENTITY_OPTION_BINARY_SNAPSHOT, (void *) SNAPSHOT_FILE_NAME);
+        svc.init(JSON_FILE_NAME, nullptr);
+        for (int i = 0; i < identities; i++) {
+            NETWORKIDENTITY ni;
+            makeRandomId(ni, rnd);
+            svc.put(ni.value.devaddr, ni.value.devid);
+            if (i % 1000 == 0)
+                addrs.push_back(ni.value.devaddr);
+        }
+        svc.flush();
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    JsonIdentityService json;
+    int r = json.init(JSON_FILE_NAME, nullptr);
+    auto t1 = std::chrono::steady_clock::now();
+    assert(r == CODE_OK);
+    MemoryIdentityService mapped;
+    r = mapped.openSnapshot(SNAPSHOT_FILE_NAME);
+    auto t2 = std::chrono::steady_clock::now();
+    assert(r == CODE_OK);
+    assert(mapped.size() == json.size());
+    DEVICEID id;
+    for (int round = 0; round < 100; round++) {
+        for (auto &a : addrs) {
+            r = mapped.get(id, a);
+            assert(r == CODE_OK);
+        }
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    std::cout << json.size() << " identities, JSON load: "
+        << std::chrono::duration<double, std::milli>(t1 - t0).count() << "ms, snapshot map: "
+        << std::chrono::duration<double, std::milli>(t2 - t1).count() << "ms, mapped get(): "
+        << std::chrono::duration<double, std::nano>(t3 - t2).count() / (100 * addrs.size()) << "ns" << std::endl;
+    std::remove(JSON_FILE_NAME);
+    std::remove(SNAPSHOT_FILE_NAME);
+}
+
+int main(int argc, char **argv) {
+    testCopyOnWrite();
+    testWrappedOffsets();
+    testJson();
+    size_t identities;
+    if (isBenchRequested(identities, argc, argv, BENCH_IDENTITIES))
+        benchmark((int) identities);
+    return 0;
+}
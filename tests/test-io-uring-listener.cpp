@@ -0,0 +1,151 @@
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "lorawan/lorawan-error.h"
+#include "lorawan/storage/listener/io-uring-listener.h"
+#include "lorawan/storage/service/identity-service-mem.h"
+#include "lorawan/storage/service/gateway-service-mem.h"
+#include "lorawan/storage/serialization/identity-binary-serialization.h"
+#include "lorawan/storage/serialization/gateway-binary-serialization.h"
+#include "test-bench.h"
+
+#define CODE        42
+#define ACCESS_CODE 0x2a2a
+#define PORT        14344
+#define DEVICES     1000
+// requests sent before responses are read
+#define BURST       32
+// bursts sent by ctest run
+#define CHECK_BURSTS    500
+// pass bursts count after --bench
+#define BURSTS      5000
+// stop() wakes up the ring wait
+#define STOP_MAX_MS 100
+
+/**
+ * Send bursts of get requests, check each response
+ * @return responses received
+ */
+static size_t client(
+    uint16_t port,
+    int bursts
+)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(sock >= 0);
+    struct timeval timeout { 1, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char *) &timeout, sizeof(timeout));
+    struct sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    size_t r = 0;
+    unsigned char request[256];
+    unsigned char response[SIZE_BATCH_RESPONSE_MAX];
+    bool expected[DEVICES + 1];
+    for (int b = 0; b < bursts; b++) {
+        memset(expected, 0, sizeof(expected));
+        for (int i = 0; i < BURST; i++) {
+            uint32_t a = 1 + (b * BURST + i) % DEVICES;
+            expected[a] = true;
+            IdentityAddrRequest get(QUERY_IDENTITY_EUI, DEVADDR(a), CODE, ACCESS_CODE);
+            get.ntoh();
+            size_t sz = get.serialize(request);
+            sendto(sock, request, sz, 0, (const struct sockaddr *) &addr, sizeof(addr));
+        }
+        // invalid request is not answered
+        if (b == 0)
+            sendto(sock, "?", 1, 0, (const struct sockaddr *) &addr, sizeof(addr));
+        for (int i = 0; i < BURST; i++) {
+            ssize_t rsz = recv(sock, response, sizeof(response), 0);
+            if (rsz <= 0)
+                break;
+            IdentityGetResponse gr(response, (size_t) rsz);
+            gr.ntoh();
+            uint64_t eui = gr.response.value.devid.id.devEUI.u;
+            assert(eui >= 1 && eui <= DEVICES && expected[eui]);
+            r++;
+        }
+    }
+    close(sock);
+    return r;
+}
+
+/**
+ * Serve bursts by the listener, print requests per second
+ * @return responses received
+ */
+static size_t measure(
+    UDPListener &listener,
+    const char *name,
+    uint16_t port,
+    int bursts
+)
+{
+    listener.setAddress("127.0.0.1", port);
+    int r = CODE_OK;
+    std::thread server([&listener, &r] {
+        r = listener.run();
+    });
+    // wait for the socket
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    auto t0 = std::chrono::steady_clock::now();
+    size_t received = client(port, bursts);
+    auto t1 = std::chrono::steady_clock::now();
+    listener.stop();
+    server.join();
+    auto stopMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t1).count();
+    assert(r == CODE_OK);
+    std::cout << name << ": " << received << " responses, "
+        << (uint64_t) (received / std::chrono::duration<double>(t1 - t0).count()) << " requests/s, stopped in "
+        << stopMs << "ms" << std::endl;
+    assert(stopMs < STOP_MAX_MS);
+    return received;
+}
+
+int main(int argc, char **argv) {
+    size_t benchBursts;
+    int bursts = isBenchRequested(benchBursts, argc, argv, BURSTS) ? (int) benchBursts : CHECK_BURSTS;
+    MemoryIdentityService svc;
+    svc.init("", nullptr);
+    for (uint32_t a = 1; a <= DEVICES; a++) {
+        DEVICEID id;
+        id.id.devEUI.u = a;
+        svc.put(DEVADDR(a), id);
+    }
+    MemoryGatewayService gwSvc;
+    gwSvc.init("", nullptr);
+    IdentityBinarySerialization ser(&svc, CODE, ACCESS_CODE);
+    GatewayBinarySerialization gwSer(&gwSvc, CODE, ACCESS_CODE);
+
+    bool supported = IoUringListener::isSupported();
+    std::cout << "io_uring " << (supported ? "is" : "is not") << " supported" << std::endl;
+    // not supported: listener falls back to sockets and answers too
+    IoUringListener ring(&ser, &gwSer);
+    size_t received = measure(ring, "io_uring", PORT, bursts);
+    // loopback does not drop datagrams of the short bursts
+    assert(received == (size_t) bursts * BURST);
+    uint64_t requests;
+    uint64_t enters;
+    ring.ringStats(requests, enters);
+    if (supported) {
+        std::cout << "io_uring_enter() calls per request: " << (double) enters / requests << std::endl;
+        // invalid one too
+        assert(requests == received + 1);
+        assert(enters < requests);
+    } else
+        assert(requests == 0);
+
+    UDPListener sockets(&ser, &gwSer);
+    measure(sockets, "sockets", PORT + 1, bursts);
+    return 0;
+}
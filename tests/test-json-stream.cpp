@@ -0,0 +1,215 @@
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "lorawan/lorawan-error.h"
+#include "lorawan/lorawan-string.h"
+#include "lorawan/helper/ip-address.h"
+#include "lorawan/storage/service/identity-service-json.h"
+#include "lorawan/storage/service/gateway-service-json.h"
+#include "test-bench.h"
+#include "test-identity-helper.h"
+
+#define IDENTITY_FILE_NAME  "test-json-stream-identity.json"
+#define GATEWAY_FILE_NAME   "test-json-stream-gateway.json"
+// generated devices, pass 1000000 after --bench to load the 1M device file
+#define DEVICES             100000
+
+/**
+ * Addresses are spread over the address space, AppEUI is shared by 1% of devices
+ */
+static void makeDevice(NETWORKIDENTITY &retVal, uint32_t i)
+{
+    makeId(retVal, i * 2654435761u, i % 100);
+}
+
+static std::string readFile(const std::string &fileName)
+{
+    std::ifstream f(fileName, std::ios::binary);
+    std::stringstream ss;
+    ss << f.rdbuf();
+    return ss.str();
+}
+
+// peak resident set size, kB
+static long maxRss()
+{
+    struct rusage u;
+    getrusage(RUSAGE_SELF, &u);
+    return u.ru_maxrss;
+}
+
+/**
+ * Streaming writer output is the same as written by toJsonString(), loader reads it back
+ */
+static void testIdentityFormat()
+{
+    std::remove(IDENTITY_FILE_NAME);
+    MemoryIdentityService expected;
+    std::stringstream ss;
+    {
+        JsonIdentityService svc;
+        svc.init(IDENTITY_FILE_NAME, nullptr);
+        for (uint32_t i = 1; i <= 1000; i++) {
+            NETWORKIDENTITY ni;
+            makeDevice(ni, i);
+            svc.put(ni.value.devaddr, ni.value.devid);
+            expected.put(ni.value.devaddr, ni.value.devid);
+        }
+        svc.flush();
+    }
+    std::vector<NETWORKIDENTITY> e;
+    expected.listAfter(e, nullptr, UINT32_MAX);
+    ss << "[\n";
+    for (size_t i = 0; i < e.size(); i++) {
+        if (i)
+            ss << ",\n";
+        ss << e[i].value.devid.toJsonString(e[i].value.devaddr);
+    }
+    ss << "]\n";
+    assert(readFile(IDENTITY_FILE_NAME) == ss.str());
+
+    JsonIdentityService svc;
+    assert(svc.init(IDENTITY_FILE_NAME, nullptr) == CODE_OK);
+    std::vector<NETWORKIDENTITY> l;
+    svc.listAfter(l, nullptr, UINT32_MAX);
+    assert(l.size() == e.size());
+    for (size_t i = 0; i < l.size(); i++) {
+        assert(l[i].value.devaddr.u == e[i].value.devaddr.u);
+        assert(memcmp(&l[i].value.devid.id, &e[i].value.devid.id, sizeof(DEVICE_ID)) == 0);
+    }
+    std::remove(IDENTITY_FILE_NAME);
+}
+
+/**
+ * Unknown fields and nested values are skipped, syntax error and non-array are rejected
+ */
+static void testIdentityParse()
+{
+    std::ofstream f(IDENTITY_FILE_NAME);
+    f << R"([{"x": {"addr": "00000001"}, "addr": "00000002", "y": [1, "a", {"name": "n"}], "name": "dev2", "z": null},)"
+      << R"({"deveui": "0000000000000003"}, {"addr": "00000004", "class": "C"}])";
+    f.close();
+    JsonIdentityService svc;
+    assert(svc.init(IDENTITY_FILE_NAME, nullptr) == CODE_OK);
+    assert(svc.size() == 2);
+    DEVICEID id;
+    assert(svc.get(id, DEVADDR(2)) == CODE_OK);
+    assert(id.id.name.toString() == "dev2");
+    assert(svc.get(id, DEVADDR(4)) == CODE_OK);
+    assert(id.id.deviceclass == CLASS_C);
+
+    f.open(IDENTITY_FILE_NAME);
+    f << R"([{"addr": "00000002"}, {"addr": )";
+    f.close();
+    JsonIdentityService broken;
+    assert(broken.init(IDENTITY_FILE_NAME, nullptr) == ERR_CODE_INVALID_JSON);
+
+    f.open(IDENTITY_FILE_NAME);
+    f << R"({"addr": "00000002"})";
+    f.close();
+    JsonIdentityService notArray;
+    assert(notArray.init(IDENTITY_FILE_NAME, nullptr) == ERR_CODE_INVALID_JSON);
+    std::remove(IDENTITY_FILE_NAME);
+}
+
+static void testGateway()
+{
+    std::remove(GATEWAY_FILE_NAME);
+    std::stringstream ss;
+    {
+        JsonGatewayService svc;
+        svc.init(GATEWAY_FILE_NAME, nullptr);
+        ss << "[\n";
+        for (uint64_t i = 1; i <= 100; i++) {
+            GatewayIdentity gi(i * 0x1000100010001ull, "10.0.0." + std::to_string(i) + ":" + std::to_string(1600 + i));
+            svc.put(gi);
+            if (i > 1)
+                ss << ",\n";
+            ss << gi.toJsonString();
+        }
+        ss << "]\n";
+        svc.flush();
+    }
+    assert(readFile(GATEWAY_FILE_NAME) == ss.str());
+    JsonGatewayService svc;
+    svc.init(GATEWAY_FILE_NAME, nullptr);
+    assert(svc.size() == 100);
+    GatewayIdentity gi;
+    assert(svc.get(gi, GatewayIdentity(0x1000100010001ull * 7)) == CODE_OK);
+    assert(sockaddr2string(&gi.sockaddr) == "10.0.0.7:1607");
+    std::remove(GATEWAY_FILE_NAME);
+}
+
+/**
+ * Load generated file with the document parser and with the streaming loader, streaming one goes first
+ * because peak RSS does not go down.
+ */
+static void benchmark(uint32_t devices)
+{
+    {
+        JsonIdentityService svc;
+        svc.init(IDENTITY_FILE_NAME, nullptr);
+        for (uint32_t i = 1; i <= devices; i++) {
+            NETWORKIDENTITY ni;
+            makeDevice(ni, i);
+            svc.put(ni.value.devaddr, ni.value.devid);
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        svc.flush();
+        auto t1 = std::chrono::steady_clock::now();
+        std::cout << devices << " devices, streaming write: "
+            << std::chrono::duration<double, std::milli>(t1 - t0).count() << "ms" << std::endl;
+    }
+    long rss0 = maxRss();
+    size_t loaded;
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        JsonIdentityService svc;
+        int r = svc.init(IDENTITY_FILE_NAME, nullptr);
+        auto t1 = std::chrono::steady_clock::now();
+        assert(r == CODE_OK);
+        loaded = svc.size();
+        std::cout << "streaming load: " << std::chrono::duration<double, std::milli>(t1 - t0).count() << "ms, peak RSS +"
+            << (maxRss() - rss0) / 1024 << "MB" << std::endl;
+    }
+    long rss1 = maxRss();
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        std::ifstream f(IDENTITY_FILE_NAME);
+        nlohmann::json js = nlohmann::json::parse(f);
+        MemoryIdentityService svc;
+        for (auto &e : js) {
+            DEVADDR a;
+            string2DEVADDR(a, e["addr"]);
+            DEVICEID id;
+            string2DEVEUI(id.id.devEUI, e["deveui"]);
+            string2KEY(id.id.nwkSKey, e["nwkSKey"]);
+            string2KEY(id.id.appSKey, e["appSKey"]);
+            svc.put(a, id);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        assert(svc.size() == loaded);
+        std::cout << "document load: " << std::chrono::duration<double, std::milli>(t1 - t0).count() << "ms, peak RSS +"
+            << (maxRss() - rss1) / 1024 << "MB over the streaming peak" << std::endl;
+    }
+    std::remove(IDENTITY_FILE_NAME);
+}
+
+int main(int argc, char **argv) {
+    testIdentityFormat();
+    testIdentityParse();
+    testGateway();
+    size_t devices;
+    if (isBenchRequested(devices, argc, argv, DEVICES))
+        benchmark((uint32_t) devices);
+    return 0;
+}
@@ -0,0 +1,352 @@
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "lorawan/lorawan-error.h"
+#include "lorawan/storage/listener/storage-listener.h"
+#include "lorawan/storage/service/identity-service-mem.h"
+#include "lorawan/storage/service/gateway-service-mem.h"
+#include "lorawan/storage/serialization/identity-binary-serialization.h"
+#include "lorawan/storage/serialization/gateway-binary-serialization.h"
+#include "test-bench.h"
+
+#define CODE        42
+#define ACCESS_CODE 0x2a2a
+// pipelined requests, pass count after --bench
+#define BENCH_REQUESTS  200000
+// bytes returned by one read
+#define READ_SIZE       65536
+
+/**
+ * Listener without transport
+ */
+class FrameListener : public StorageListener {
+public:
+    FrameListener(
+        IdentitySerialization *identitySerialization,
+        GatewaySerialization *gatewaySerialization
+    ) : StorageListener(identitySerialization, gatewaySerialization)
+    {
+    }
+    void setAddress(const std::string &host, uint16_t port) override {}
+    void setAddress(uint32_t &ipv4, uint16_t port) override {}
+    int run() override { return CODE_OK; }
+    void stop() override {}
+    void setLog(int verbose, Log *log) override {}
+};
+
+static void appendFrame(
+    std::vector<unsigned char> &retVal,
+    const unsigned char *buf,
+    size_t sz
+)
+{
+    retVal.push_back((unsigned char) (sz >> 24));
+    retVal.push_back((unsigned char) (sz >> 16));
+    retVal.push_back((unsigned char) (sz >> 8));
+    retVal.push_back((unsigned char) sz);
+    retVal.insert(retVal.end(), buf, buf + sz);
+}
+
+static void appendRequest(
+    std::vector<unsigned char> &retVal,
+    ServiceMessage &request
+)
+{
+    unsigned char buf[256];
+    request.ntoh();
+    size_t sz = request.serialize(buf);
+    request.ntoh();
+    appendFrame(retVal, buf, sz);
+}
+
+static std::vector<std::vector<unsigned char> > splitFrames(
+    const unsigned char *buf,
+    size_t sz
+)
+{
+    std::vector<std::vector<unsigned char> > r;
+    for (size_t ofs = 0; ofs + SIZE_FRAME_HEADER <= sz; ) {
+        size_t len = ((size_t) buf[ofs] << 24) | ((size_t) buf[ofs + 1] << 16) | ((size_t) buf[ofs + 2] << 8) | buf[ofs + 3];
+        r.emplace_back(buf + ofs + SIZE_FRAME_HEADER, buf + ofs + SIZE_FRAME_HEADER + len);
+        ofs += SIZE_FRAME_HEADER + len;
+    }
+    return r;
+}
+
+/**
+ * Identity records have unused bytes, compare decoded entries
+ */
+static bool sameResponse(
+    const std::vector<unsigned char> &l,
+    const std::vector<unsigned char> &r
+)
+{
+    if (l.size() != r.size())
+        return false;
+    if (l.empty())
+        return true;
+    switch (l[0]) {
+        case QUERY_IDENTITY_LIST_AFTER:
+        {
+            IdentityListAfterResponse lr(l.data(), l.size());
+            IdentityListAfterResponse rr(r.data(), r.size());
+            if (lr.count != rr.count || lr.flags != rr.flags || lr.identities.size() != rr.identities.size())
+                return false;
+            for (size_t i = 0; i < lr.identities.size(); i++) {
+                if (lr.identities[i].value.devaddr.u != rr.identities[i].value.devaddr.u
+                    || lr.identities[i].value.devid.id.devEUI.u != rr.identities[i].value.devid.id.devEUI.u)
+                    return false;
+            }
+            return true;
+        }
+        case QUERY_IDENTITY_ADDR:
+        case QUERY_IDENTITY_EUI:
+        {
+            IdentityGetResponse lr(l.data(), l.size());
+            IdentityGetResponse rr(r.data(), r.size());
+            return lr.response.value.devaddr.u == rr.response.value.devaddr.u
+                && lr.response.value.devid.id.devEUI.u == rr.response.value.devid.id.devEUI.u;
+        }
+        default:
+            return l == r;
+    }
+}
+
+/**
+ * Coalesced and split requests are answered in order, whatever the reads are
+ */
+static void testFrames()
+{
+    MemoryIdentityService svc;
+    svc.init("", nullptr);
+    MemoryGatewayService gwSvc;
+    gwSvc.init("", nullptr);
+    IdentityBinarySerialization ser(&svc, CODE, ACCESS_CODE);
+    GatewayBinarySerialization gwSer(&gwSvc, CODE, ACCESS_CODE);
+    FrameListener listener(&ser, &gwSer);
+    for (uint32_t a = 1; a <= 600; a++) {
+        DEVICEID id;
+        id.id.devEUI.u = a;
+        svc.put(DEVADDR(a), id);
+    }
+    gwSvc.put(GatewayIdentity(7, "10.0.0.7:4242"));
+
+    std::vector<unsigned char> stream;
+    IdentityAddrRequest get(QUERY_IDENTITY_EUI, DEVADDR(5), CODE, ACCESS_CODE);
+    appendRequest(stream, get);
+    GatewayIdRequest gwGet(QUERY_GATEWAY_ADDR, 7, CODE, ACCESS_CODE);
+    appendRequest(stream, gwGet);
+    // invalid request is answered by the empty frame
+    appendFrame(stream, (const unsigned char *) "?", 1);
+    // 600 entries in 6 frames
+    IdentityListAfterRequest list(nullptr, 1000, CODE, ACCESS_CODE);
+    appendRequest(stream, list);
+    IdentityOperationRequest count(QUERY_IDENTITY_COUNT, 0, 0, CODE, ACCESS_CODE);
+    appendRequest(stream, count);
+
+    std::vector<unsigned char> expected;
+    std::vector<unsigned char> none;
+    int r = listener.queryFrames(expected, none, stream.data(), stream.size());
+    assert(r == CODE_OK);
+    assert(none.empty());
+    auto responses = splitFrames(expected.data(), expected.size());
+    assert(responses.size() == 1 + 1 + 1 + 6 + 1);
+    IdentityGetResponse gr(responses[0].data(), responses[0].size());
+    gr.ntoh();
+    assert(gr.response.value.devid.id.devEUI.u == 5);
+    GatewayGetResponse gwr(responses[1].data(), responses[1].size());
+    gwr.ntoh();
+    assert(gwr.response.gatewayId == 7);
+    assert(responses[2].empty());
+    size_t listed = 0;
+    for (int i = 3; i < 9; i++) {
+        IdentityListAfterResponse lr(responses[i].data(), responses[i].size());
+        lr.ntoh();
+        listed += lr.identities.size();
+        assert(((lr.flags & LIST_AFTER_FLAG_END) != 0) == (i == 8));
+    }
+    assert(listed == 600);
+    IdentityOperationResponse cr(responses[9].data(), responses[9].size());
+    cr.ntoh();
+    assert(cr.response == 600);
+
+    // byte by byte, random reads, several streams in one read
+    std::mt19937 rnd(1);
+    for (size_t maxRead : { (size_t) 1, (size_t) 3, (size_t) 50, (size_t) 1000, stream.size() * 3 }) {
+        std::vector<unsigned char> three(stream);
+        three.insert(three.end(), stream.begin(), stream.end());
+        three.insert(three.end(), stream.begin(), stream.end());
+        std::vector<unsigned char> pending;
+        std::vector<unsigned char> out;
+        for (size_t ofs = 0; ofs < three.size(); ) {
+            size_t sz = std::min<size_t>(three.size() - ofs, 1 + rnd() % maxRead);
+            r = listener.queryFrames(out, pending, three.data() + ofs, sz);
+            assert(r == CODE_OK);
+            ofs += sz;
+        }
+        assert(pending.empty());
+        assert(out.size() == expected.size() * 3);
+        for (int i = 0; i < 3; i++) {
+            auto frames = splitFrames(out.data() + i * expected.size(), expected.size());
+            assert(frames.size() == responses.size());
+            for (size_t f = 0; f < frames.size(); f++) {
+                assert(sameResponse(frames[f], responses[f]));
+            }
+        }
+    }
+
+    // too long frame closes connection
+    std::vector<unsigned char> pending;
+    std::vector<unsigned char> out;
+    unsigned char tooLong[SIZE_FRAME_HEADER] = { 0, 0x10, 0, 1 };
+    assert(listener.queryFrames(out, pending, tooLong, sizeof(tooLong)) == ERR_CODE_INVALID_PACKET);
+
+    // without framing, one request per read, list after frames are concatenated
+    out.clear();
+    unsigned char req[SIZE_LIST_AFTER_REQUEST];
+    list.ntoh();
+    size_t sz = list.serialize(req);
+    size_t n = listener.queryResponses(out, req, sz, false);
+    assert(n == 6);
+    assert(out.size() == expected.size() - (4 * 10) - responses[0].size() - responses[1].size() - responses[9].size());
+    assert(listener.queryResponses(out, (const unsigned char *) "?", 1, false) == 0);
+    svc.done();
+}
+
+/**
+ * With cursor list after frames are answered one at a time, requests read after the list after request wait for them.
+ * Reads stop while the cursor is active, as the UV listener does.
+ */
+static void testCursor()
+{
+    MemoryIdentityService svc;
+    svc.init("", nullptr);
+    IdentityBinarySerialization ser(&svc, CODE, ACCESS_CODE);
+    FrameListener listener(&ser, nullptr);
+    for (uint32_t a = 1; a <= 600; a++) {
+        DEVICEID id;
+        id.id.devEUI.u = a;
+        svc.put(DEVADDR(a), id);
+    }
+    std::vector<unsigned char> stream;
+    IdentityAddrRequest get(QUERY_IDENTITY_EUI, DEVADDR(5), CODE, ACCESS_CODE);
+    appendRequest(stream, get);
+    // 600 entries in 6 frames
+    IdentityListAfterRequest list(nullptr, 1000, CODE, ACCESS_CODE);
+    appendRequest(stream, list);
+    IdentityOperationRequest count(QUERY_IDENTITY_COUNT, 0, 0, CODE, ACCESS_CODE);
+    appendRequest(stream, count);
+    std::vector<unsigned char> expected;
+    std::vector<unsigned char> none;
+    listener.queryFrames(expected, none, stream.data(), stream.size());
+    auto responses = splitFrames(expected.data(), expected.size());
+    assert(responses.size() == 1 + 6 + 1);
+
+    std::mt19937 rnd(2);
+    for (size_t maxRead : { (size_t) 1, (size_t) 50, stream.size() * 3 }) {
+        std::vector<unsigned char> three(stream);
+        three.insert(three.end(), stream.begin(), stream.end());
+        three.insert(three.end(), stream.begin(), stream.end());
+        std::vector<unsigned char> pending;
+        std::vector<unsigned char> out;
+        ListAfterCursor cursor;
+        size_t ofs = 0;
+        while (ofs < three.size() || cursor.active) {
+            // one write
+            std::vector<unsigned char> step;
+            int r = CODE_OK;
+            if (cursor.active) {
+                size_t c = listener.queryNext(step, cursor, true);
+                assert(c == 1);
+                if (!cursor.active)
+                    r = listener.queryFrames(step, pending, nullptr, 0, &cursor);
+            } else {
+                size_t sz = std::min<size_t>(three.size() - ofs, 1 + rnd() % maxRead);
+                r = listener.queryFrames(step, pending, three.data() + ofs, sz, &cursor);
+                ofs += sz;
+            }
+            assert(r == CODE_OK);
+            // never the whole list at once
+            size_t listFrames = 0;
+            for (auto &f : splitFrames(step.data(), step.size())) {
+                if (!f.empty() && f[0] == QUERY_IDENTITY_LIST_AFTER)
+                    listFrames++;
+            }
+            assert(listFrames <= 2);
+            out.insert(out.end(), step.begin(), step.end());
+        }
+        assert(pending.empty());
+        auto frames = splitFrames(out.data(), out.size());
+        assert(frames.size() == responses.size() * 3);
+        for (size_t f = 0; f < frames.size(); f++) {
+            assert(sameResponse(frames[f], responses[f % responses.size()]));
+        }
+    }
+
+    // without framing list after frames follow each other
+    std::vector<unsigned char> all;
+    std::vector<unsigned char> streamed;
+    unsigned char req[SIZE_LIST_AFTER_REQUEST];
+    list.ntoh();
+    size_t sz = list.serialize(req);
+    list.ntoh();
+    size_t n = listener.queryResponses(all, req, sz, false);
+    ListAfterCursor cursor;
+    size_t m = listener.queryResponses(streamed, req, sz, false, &cursor);
+    while (cursor.active)
+        m += listener.queryNext(streamed, cursor, false);
+    assert(n == 6 && m == n);
+    assert(streamed.size() == all.size());
+    svc.done();
+}
+
+/**
+ * Pipelined get requests read in 64K chunks
+ */
+static void benchmark(size_t requests)
+{
+    MemoryIdentityService svc;
+    svc.init("", nullptr);
+    IdentityBinarySerialization ser(&svc, CODE, ACCESS_CODE);
+    FrameListener listener(&ser, nullptr);
+    for (uint32_t a = 1; a <= 10000; a++) {
+        DEVICEID id;
+        id.id.devEUI.u = a;
+        svc.put(DEVADDR(a), id);
+    }
+    std::vector<unsigned char> stream;
+    for (size_t i = 0; i < requests; i++) {
+        IdentityAddrRequest get(QUERY_IDENTITY_EUI, DEVADDR((uint32_t) (1 + i % 10000)), CODE, ACCESS_CODE);
+        appendRequest(stream, get);
+    }
+    std::vector<unsigned char> pending;
+    std::vector<unsigned char> out;
+    size_t written = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t ofs = 0; ofs < stream.size(); ofs += READ_SIZE) {
+        out.clear();
+        listener.queryFrames(out, pending, stream.data() + ofs, std::min<size_t>(READ_SIZE, stream.size() - ofs));
+        written += out.size();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    assert(pending.empty());
+    assert(written == requests * (SIZE_FRAME_HEADER + SIZE_GET_RESPONSE));
+    double s = std::chrono::duration<double>(t1 - t0).count();
+    std::cout << requests << " pipelined requests: " << s * 1000 << "ms, "
+        << (size_t) (requests / s) << " requests/s" << std::endl;
+    svc.done();
+}
+
+int main(int argc, char **argv) {
+    testFrames();
+    testCursor();
+    size_t requests;
+    if (isBenchRequested(requests, argc, argv, BENCH_REQUESTS))
+        benchmark(requests);
+    return 0;
+}
@@ -0,0 +1,232 @@
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include "lorawan/lorawan-error.h"
+#include "lorawan/helper/buffer-pool.h"
+#include "lorawan/storage/listener/storage-listener.h"
+#include "lorawan/storage/service/identity-service-mem.h"
+#include "lorawan/storage/service/gateway-service-mem.h"
+#include "lorawan/storage/serialization/identity-binary-serialization.h"
+#include "lorawan/storage/serialization/gateway-binary-serialization.h"
+
+#define CODE        42
+#define ACCESS_CODE 0x2a2a
+#define READ_BUFFER_SIZE    (64 * 1024)
+// sends waiting for the callback
+#define IN_FLIGHT   8
+#define WARM_UP     1000
+#define ROUNDS      100000
+
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t sz)
+{
+    allocations++;
+    void *p = malloc(sz ? sz : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+/**
+ * Listener without transport
+ */
+class PoolListener : public StorageListener {
+public:
+    PoolListener(
+        IdentitySerialization *identitySerialization,
+        GatewaySerialization *gatewaySerialization
+    ) : StorageListener(identitySerialization, gatewaySerialization)
+    {
+    }
+    void setAddress(const std::string &host, uint16_t port) override {}
+    void setAddress(uint32_t &ipv4, uint16_t port) override {}
+    int run() override { return CODE_OK; }
+    void stop() override {}
+    void setLog(int verbose, Log *log) override {}
+};
+
+/**
+ * Same layout as the UV listener send request
+ */
+typedef struct {
+    void *req;
+    unsigned char buffer[SIZE_BATCH_RESPONSE_MAX];
+} UDP_SEND;
+
+static void testBlockPool()
+{
+    BlockPool pool(13);
+    assert(pool.blockSize() % sizeof(void *) == 0);
+    assert(pool.blockSize() >= 13);
+    std::vector<void *> blocks;
+    for (int i = 0; i < BUFFER_POOL_SLAB_BLOCKS + 1; i++) {
+        void *b = pool.alloc();
+        assert(((uintptr_t) b) % sizeof(void *) == 0);
+        for (auto p : blocks) {
+            assert(p != b);
+        }
+        blocks.push_back(b);
+    }
+    assert(pool.inUse() == BUFFER_POOL_SLAB_BLOCKS + 1);
+    assert(pool.capacity() == 2 * BUFFER_POOL_SLAB_BLOCKS);
+    for (auto b : blocks) {
+        pool.release(b);
+    }
+    pool.release(nullptr);
+    assert(pool.inUse() == 0);
+    // released blocks are reused, pool does not grow
+    for (int i = 0; i < 10 * BUFFER_POOL_SLAB_BLOCKS; i++) {
+        void *b = pool.alloc();
+        pool.release(b);
+    }
+    assert(pool.capacity() == 2 * BUFFER_POOL_SLAB_BLOCKS);
+}
+
+static void testObjectPool()
+{
+    ObjectPool<std::vector<unsigned char> > pool;
+    auto v = pool.alloc();
+    v->resize(1000);
+    pool.release(v);
+    auto w = pool.alloc();
+    // same object, capacity is kept
+    assert(w == v);
+    assert(w->capacity() >= 1000);
+    pool.release(w);
+    assert(pool.capacity() == 1);
+}
+
+static void appendFrame(
+    std::vector<unsigned char> &retVal,
+    ServiceMessage &request
+)
+{
+    unsigned char buf[256];
+    request.ntoh();
+    size_t sz = request.serialize(buf);
+    request.ntoh();
+    retVal.push_back((unsigned char) (sz >> 24));
+    retVal.push_back((unsigned char) (sz >> 16));
+    retVal.push_back((unsigned char) (sz >> 8));
+    retVal.push_back((unsigned char) sz);
+    retVal.insert(retVal.end(), buf, buf + sz);
+}
+
+/**
+ * Read, query and send the way the UV listener callbacks do, send callbacks come IN_FLIGHT reads later.
+ * After the warm-up no heap allocation is made.
+ */
+static void testSteadyState()
+{
+    MemoryIdentityService svc;
+    svc.init("", nullptr);
+    MemoryGatewayService gwSvc;
+    gwSvc.init("", nullptr);
+    IdentityBinarySerialization ser(&svc, CODE, ACCESS_CODE);
+    GatewayBinarySerialization gwSer(&gwSvc, CODE, ACCESS_CODE);
+    PoolListener listener(&ser, &gwSer);
+    for (uint32_t a = 1; a <= 1000; a++) {
+        DEVICEID id;
+        id.id.devEUI.u = a;
+        svc.put(DEVADDR(a), id);
+    }
+    gwSvc.put(GatewayIdentity(7, "10.0.0.7:4242"));
+
+    // UDP datagram
+    unsigned char datagram[256];
+    IdentityAddrRequest get(QUERY_IDENTITY_EUI, DEVADDR(5), CODE, ACCESS_CODE);
+    get.ntoh();
+    size_t datagramSize = get.serialize(datagram);
+    // TCP read of pipelined frames, split in two reads
+    std::vector<unsigned char> stream;
+    for (uint32_t a = 1; a <= 20; a++) {
+        IdentityAddrRequest r(QUERY_IDENTITY_EUI, DEVADDR(a * 7), CODE, ACCESS_CODE);
+        appendFrame(stream, r);
+    }
+    GatewayIdRequest gwGet(QUERY_GATEWAY_ADDR, 7, CODE, ACCESS_CODE);
+    appendFrame(stream, gwGet);
+    IdentityOperationRequest count(QUERY_IDENTITY_COUNT, 0, 0, CODE, ACCESS_CODE);
+    appendFrame(stream, count);
+    size_t split = stream.size() / 2 + 3;
+
+    BlockPool readBuffers(READ_BUFFER_SIZE);
+    BlockPool udpSends(sizeof(UDP_SEND));
+    ObjectPool<std::vector<unsigned char> > tcpWrites;
+    std::vector<unsigned char> pending;
+    // ring of sends waiting for the callback
+    UDP_SEND *udpInFlight[IN_FLIGHT] = {};
+    std::vector<unsigned char> *tcpInFlight[IN_FLIGHT] = {};
+
+    size_t before = 0;
+    size_t responded = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int round = 0; round < WARM_UP + ROUNDS; round++) {
+        if (round == WARM_UP) {
+            before = allocations;
+            t0 = std::chrono::steady_clock::now();
+        }
+        int slot = round % IN_FLIGHT;
+        // send callbacks
+        udpSends.release(udpInFlight[slot]);
+        if (tcpInFlight[slot])
+            tcpWrites.release(tcpInFlight[slot]);
+
+        // UDP read
+        auto buf = (unsigned char *) readBuffers.alloc();
+        memmove(buf, datagram, datagramSize);
+        auto send = (UDP_SEND *) udpSends.alloc();
+        size_t sz = listener.query(send->buffer, sizeof(send->buffer), buf, datagramSize);
+        assert(sz > 0);
+        udpInFlight[slot] = send;
+        readBuffers.release(buf);
+
+        // TCP read
+        buf = (unsigned char *) readBuffers.alloc();
+        size_t ofs = round % 2 ? split : 0;
+        size_t len = round % 2 ? stream.size() - split : split;
+        memmove(buf, stream.data() + ofs, len);
+        auto w = tcpWrites.alloc();
+        w->clear();
+        int r = listener.queryFrames(*w, pending, buf, len);
+        assert(r == CODE_OK);
+        responded += w->size();
+        tcpInFlight[slot] = w;
+        readBuffers.release(buf);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    size_t allocated = allocations - before;
+    assert(pending.empty());
+    assert(responded > 0);
+    std::cout << ROUNDS << " UDP and TCP reads, allocations after warm-up: " << allocated
+        << ", read buffers: " << readBuffers.capacity()
+        << ", UDP sends: " << udpSends.capacity()
+        << ", TCP writes: " << tcpWrites.capacity()
+        << ", " << std::chrono::duration<double, std::nano>(t1 - t0).count() / ROUNDS << "ns per round" << std::endl;
+    assert(allocated == 0);
+    for (int i = 0; i < IN_FLIGHT; i++) {
+        udpSends.release(udpInFlight[i]);
+        tcpWrites.release(tcpInFlight[i]);
+    }
+    assert(udpSends.inUse() == 0);
+    assert(readBuffers.inUse() == 0);
+}
+
+int main(int argc, char **argv) {
+    testBlockPool();
+    testObjectPool();
+    testSteadyState();
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "lorawan/lorawan-error.h"
+#include "lorawan/storage/listener/udp-listener.h"
+#include "lorawan/storage/service/identity-service-mem.h"
+#include "lorawan/storage/service/gateway-service-mem.h"
+#include "lorawan/storage/serialization/identity-binary-serialization.h"
+#include "lorawan/storage/serialization/gateway-binary-serialization.h"
+
+#define CODE        42
+#define ACCESS_CODE 0x2a2a
+#define PORT        14444
+#define DEVICES     100
+// requests queued before the listener takes them
+#define BURST       100
+#define IDLE_MS     1500
+// receive timeout of the listener was 1s
+#define STOP_MAX_MS 100
+
+static long contextSwitches()
+{
+    struct rusage u;
+    getrusage(RUSAGE_SELF, &u);
+    return u.ru_nvcsw + u.ru_nivcsw;
+}
+
+/**
+ * Send the burst at once, then read responses
+ * @return responses received
+ */
+static int burst(
+    uint16_t port
+)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(sock >= 0);
+    int sz = 1024 * 1024;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char *) &sz, sizeof(sz));
+    struct timeval timeout { 1, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char *) &timeout, sizeof(timeout));
+    struct sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    unsigned char request[256];
+    unsigned char response[SIZE_BATCH_RESPONSE_MAX];
+    for (int i = 0; i < BURST; i++) {
+        uint32_t a = 1 + i % DEVICES;
+        IdentityAddrRequest get(QUERY_IDENTITY_EUI, DEVADDR(a), CODE, ACCESS_CODE);
+        get.ntoh();
+        size_t rsz = get.serialize(request);
+        sendto(sock, request, rsz, 0, (const struct sockaddr *) &addr, sizeof(addr));
+    }
+    int r = 0;
+    for (int i = 0; i < BURST; i++) {
+        if (recv(sock, response, sizeof(response), 0) <= 0)
+            break;
+        r++;
+    }
+    close(sock);
+    return r;
+}
+
+/**
+ * Serve a burst, stay idle, then stop
+ */
+static void testStop(
+    int threads,
+    uint16_t port
+)
+{
+    MemoryIdentityService svc;
+    svc.init("", nullptr);
+    for (uint32_t a = 1; a <= DEVICES; a++) {
+        DEVICEID id;
+        id.id.devEUI.u = a;
+        svc.put(DEVADDR(a), id);
+    }
+    MemoryGatewayService gwSvc;
+    gwSvc.init("", nullptr);
+    IdentityBinarySerialization ser(&svc, CODE, ACCESS_CODE);
+    GatewayBinarySerialization gwSer(&gwSvc, CODE, ACCESS_CODE);
+    UDPListener listener(&ser, &gwSer);
+    listener.setAddress("127.0.0.1", port);
+    listener.setThreadCount(threads);
+    int r = CODE_OK;
+    std::thread server([&listener, &r] {
+        r = listener.run();
+    });
+    // wait for sockets
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    int responses = burst(port);
+    assert(responses == BURST);
+
+    // idle workers sleep in poll(), nothing wakes them up
+    long switches = contextSwitches();
+    std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_MS));
+    long idleSwitches = contextSwitches() - switches;
+
+    auto t0 = std::chrono::steady_clock::now();
+    listener.stop();
+    server.join();
+    auto stopMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    assert(r == CODE_OK);
+    std::cout << threads << " workers: " << responses << " responses, context switches while idle: "
+        << idleSwitches << ", stopped in " << stopMs << "ms" << std::endl;
+#ifdef UDP_LISTENER_POLL
+    // sleep of this thread only
+    assert(idleSwitches <= 2);
+    assert(stopMs < STOP_MAX_MS);
+#endif
+}
+
+int main(int argc, char **argv) {
+    testStop(1, PORT);
+    testStop(4, PORT + 1);
+    return 0;
+}
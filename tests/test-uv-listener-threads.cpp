@@ -0,0 +1,148 @@
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "lorawan/lorawan-error.h"
+#include "lorawan/storage/listener/uv-listener.h"
+#include "lorawan/storage/service/identity-service-concurrent.h"
+#include "lorawan/storage/service/gateway-service-mem.h"
+#include "lorawan/storage/serialization/identity-binary-serialization.h"
+#include "lorawan/storage/serialization/gateway-binary-serialization.h"
+#include "test-bench.h"
+
+#define CODE        42
+#define ACCESS_CODE 0x2a2a
+#define PORT        14244
+#define DEVICES     10000
+// milliseconds per loops count of the ctest run
+#define CHECK_DURATION  200
+// seconds per loops count, pass duration after --bench
+#define DURATION    1
+
+/**
+ * Send get requests and wait for the response until the deadline
+ * @return responses received
+ */
+static uint64_t client(
+    uint16_t port,
+    uint32_t seed,
+    std::chrono::steady_clock::time_point deadline
+)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(sock >= 0);
+    struct timeval timeout { 0, 200000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char *) &timeout, sizeof(timeout));
+    struct sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    uint64_t r = 0;
+    unsigned char request[256];
+    unsigned char response[SIZE_BATCH_RESPONSE_MAX];
+    for (uint32_t i = seed; std::chrono::steady_clock::now() < deadline; i++) {
+        uint32_t a = 1 + i % DEVICES;
+        IdentityAddrRequest get(QUERY_IDENTITY_EUI, DEVADDR(a), CODE, ACCESS_CODE);
+        get.ntoh();
+        size_t sz = get.serialize(request);
+        if (sendto(sock, request, sz, 0, (const struct sockaddr *) &addr, sizeof(addr)) != (ssize_t) sz)
+            continue;
+        ssize_t rsz = recv(sock, response, sizeof(response), 0);
+        if (rsz <= 0)
+            continue;
+        IdentityGetResponse gr(response, (size_t) rsz);
+        gr.ntoh();
+        if (gr.response.value.devid.id.devEUI.u == a)
+            r++;
+    }
+    close(sock);
+    return r;
+}
+
+/**
+ * Run listener with the loops count, clients on all cores
+ * @param duration milliseconds
+ * @return requests per second
+ */
+static double measure(
+    int loops,
+    int clients,
+    uint16_t port,
+    size_t duration
+)
+{
+    ConcurrentMemoryIdentityService svc;
+    svc.init("", nullptr);
+    for (uint32_t a = 1; a <= DEVICES; a++) {
+        DEVICEID id;
+        id.id.devEUI.u = a;
+        svc.put(DEVADDR(a), id);
+    }
+    MemoryGatewayService gwSvc;
+    gwSvc.init("", nullptr);
+    IdentityBinarySerialization ser(&svc, CODE, ACCESS_CODE);
+    GatewayBinarySerialization gwSer(&gwSvc, CODE, ACCESS_CODE);
+    UVListener listener(&ser, &gwSer);
+    listener.setAddress("127.0.0.1", port);
+    listener.setThreadCount(loops);
+    int r = CODE_OK;
+    std::thread server([&listener, &r] {
+        r = listener.run();
+    });
+    // wait for sockets
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    auto t0 = std::chrono::steady_clock::now();
+    auto deadline = t0 + std::chrono::milliseconds(duration);
+    std::vector<uint64_t> counts(clients, 0);
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; c++) {
+        threads.emplace_back([&counts, c, port, deadline] {
+            counts[c] = client(port, c * 7919, deadline);
+        });
+    }
+    for (auto &t : threads)
+        t.join();
+    auto t1 = std::chrono::steady_clock::now();
+    listener.stop();
+    server.join();
+    assert(r == CODE_OK);
+    uint64_t total = 0;
+    for (auto c : counts)
+        total += c;
+    assert(total > 0);
+    return total / std::chrono::duration<double>(t1 - t0).count();
+}
+
+int main(int argc, char **argv) {
+    size_t seconds;
+    bool bench = isBenchRequested(seconds, argc, argv, DURATION);
+    size_t duration = bench ? seconds * 1000 : CHECK_DURATION;
+    int cores = (int) std::thread::hardware_concurrency();
+    if (cores < 1)
+        cores = 1;
+    std::vector<int> loopCounts;
+    for (int n = 1; n < cores; n *= 2)
+        loopCounts.push_back(n);
+    loopCounts.push_back(cores);
+    double single = 0.0;
+    uint16_t port = PORT;
+    for (auto n : loopCounts) {
+        double rps = measure(n, 2 * cores, port++, duration);
+        if (n == 1)
+            single = rps;
+        if (bench)
+            std::cout << n << " loops: " << (uint64_t) rps << " requests/s, x" << rps / single << std::endl;
+    }
+    return 0;
+}